@@ -0,0 +1,69 @@
+/* allocation_hook.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Object file to install the allocation sampling hooks.  Linking it in
+   replaces operator new and operator delete with versions that call the
+   hooks in sampling_profiler.h when they are set, so that allocations
+   can be profiled.  When no profile is running, the only cost is a test
+   of the hook pointer.
+*/
+
+#include "sampling_profiler.h"
+#include "mldb/compiler/compiler.h"
+#include <new>
+#include <stdlib.h>
+
+
+namespace MLDB {
+
+namespace {
+
+struct Init {
+    Init()
+    {
+        allocation_hook_installed = true;
+    }
+} init;
+
+} // file scope
+
+} // namespace MLDB
+
+void * operator new (size_t size)
+{
+    using namespace MLDB;
+
+    if (size == 0)
+        size = 1;
+
+    void * result;
+    while ((result = malloc(size)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+
+    auto sampler = allocation_sampler.load(std::memory_order_relaxed);
+    if (MLDB_UNLIKELY(sampler != nullptr))
+        sampler(result, size);
+
+    return result;
+}
+
+void operator delete (void * ptr) noexcept
+{
+    using namespace MLDB;
+
+    auto sampler = deallocation_sampler.load(std::memory_order_relaxed);
+    if (MLDB_UNLIKELY(sampler != nullptr) && ptr)
+        sampler(ptr);
+
+    free(ptr);
+}
+
+void operator delete (void * ptr, size_t size) noexcept
+{
+    operator delete (ptr);
+}
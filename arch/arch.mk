@@ -20,6 +20,7 @@ LIBARCH_SOURCES := \
 	rt.cc \
 	abort.cc \
 	spinlock.cc \
+	sampling_profiler.cc \
 
 ifeq ($(ARCH),x86_64)
 LIBARCH_SOURCES += simd_vector_avx.cc
@@ -45,6 +46,8 @@ $(eval $(call set_single_compile_option,simd_vector_avx.cc,-mavx))
 
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
+$(eval $(call library,allocation_hook,allocation_hook.cc,arch))
+
 $(eval $(call library,node_exception_tracing,node_exception_tracing.cc,exception_hook arch dl))
 
 
@@ -0,0 +1,590 @@
+/* sampling_profiler.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Sampling profiler for CPU time and allocations.
+*/
+
+#include "sampling_profiler.h"
+#include "backtrace.h"
+#include "exception.h"
+#include "format.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+std::atomic<void (*) (void * ptr, size_t size)> allocation_sampler(nullptr);
+std::atomic<void (*) (void * ptr)> deallocation_sampler(nullptr);
+bool allocation_hook_installed = false;
+
+namespace {
+
+constexpr int MAX_DEPTH = 48;
+constexpr size_t MAX_SAMPLES = 65536;
+
+struct Sample {
+    uint64_t weight;
+    int depth;
+    void * frames[MAX_DEPTH];
+};
+
+/** Fixed size buffer of samples, which are written from signal handlers
+    and from within operator new, and so can't allocate or take locks.
+*/
+struct SampleBuffer {
+    SampleBuffer(size_t capacity)
+        : samples(new Sample[capacity]()), capacity(capacity),
+          next(0), dropped(0)
+    {
+    }
+
+    /** Reserve a sample, or return null if the buffer is full. */
+    Sample * reserve()
+    {
+        size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i < capacity)
+            return &samples[i];
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    size_t size() const
+    {
+        return std::min<size_t>(next, capacity);
+    }
+
+    std::unique_ptr<Sample[]> samples;
+    size_t capacity;
+    std::atomic<size_t> next;
+    std::atomic<uint64_t> dropped;
+};
+
+/// Only one profile runs at once
+std::atomic<bool> running(false);
+
+/// Buffer of the profile that's running
+std::atomic<SampleBuffer *> currentBuffer(nullptr);
+
+/// Number of samples being written, so that we know when all are done
+std::atomic<int> writers(0);
+
+struct RunningGuard {
+    RunningGuard()
+    {
+        bool expected = false;
+        if (!running.compare_exchange_strong(expected, true))
+            throw MLDB::Exception("A profile is already running");
+    }
+
+    ~RunningGuard()
+    {
+        running = false;
+    }
+};
+
+struct WriterGuard {
+    WriterGuard()
+    {
+        ++writers;
+    }
+
+    ~WriterGuard()
+    {
+        --writers;
+    }
+};
+
+/** Stop taking samples, and wait until those being taken are written. */
+void stopSampling()
+{
+    currentBuffer = nullptr;
+    while (writers.load())
+        std::this_thread::yield();
+}
+
+/** Sleep for the given number of seconds, or until keepGoing returns
+    false, and return the number of seconds slept.
+*/
+double sleepFor(double seconds, const ProfileKeepGoing & keepGoing)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto started = Clock::now();
+    auto until = started
+        + std::chrono::duration_cast<Clock::duration>
+            (std::chrono::duration<double>(seconds));
+
+    for (;;) {
+        auto now = Clock::now();
+        if (now >= until || (keepGoing && !keepGoing()))
+            return std::chrono::duration<double>(now - started).count();
+        auto wakeup = until;
+        if (keepGoing)
+            wakeup = std::min(wakeup, now + std::chrono::milliseconds(100));
+        std::this_thread::sleep_until(wakeup);
+    }
+}
+
+/** Turn the samples into a profile, skipping the given number of frames
+    at the top of each stack (the profiler's own).  Only samples for which
+    include returns true are counted.
+*/
+Profile aggregate(const SampleBuffer & buffer, int numToSkip, double seconds,
+                  const std::vector<bool> * include = nullptr)
+{
+    Profile result;
+    result.seconds = seconds;
+    result.dropped = buffer.dropped;
+
+    std::unordered_map<const void *, std::string> names;
+
+    auto getName = [&] (const void * address) -> const std::string &
+        {
+            auto it = names.find(address);
+            if (it != names.end())
+                return it->second;
+            std::string name = BacktraceFrame(0, address).print_for_trace();
+            // Semicolons separate the frames in the folded format
+            std::replace(name.begin(), name.end(), ';', ':');
+            return names.emplace(address, std::move(name)).first->second;
+        };
+
+    for (size_t i = 0;  i < buffer.size();  ++i) {
+        const Sample & sample = buffer.samples[i];
+        if (sample.depth <= numToSkip)
+            continue;
+        if (include && !(*include)[i])
+            continue;
+
+        ++result.samples;
+
+        std::string stack;
+        for (int j = sample.depth - 1;  j >= numToSkip;  --j) {
+            // Except for the innermost one, the frames are return
+            // addresses which may belong to the next function
+            const char * address = (const char *)sample.frames[j];
+            if (j > numToSkip)
+                address -= 1;
+            if (!stack.empty())
+                stack += ';';
+            stack += getName(address);
+        }
+
+        result.stacks[stack] += sample.weight;
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* CPU PROFILING                                                             */
+/*****************************************************************************/
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+/// The stacks start with the interrupted instruction
+constexpr int CPU_FRAMES_TO_SKIP = 0;
+
+/// Largest distance between two frames that is believed
+constexpr uintptr_t MAX_FRAME_BYTES = 1024 * 1024;
+
+/** The writable mappings of the process, sorted by address, one of which
+    holds the stack of each thread.  They are read from /proc/self/maps
+    when the profile starts, as that can't be done from within the signal
+    handler, and bound the walk of the frame pointers to the stack of the
+    interrupted thread.
+*/
+struct StackRegions {
+    void load()
+    {
+        std::ifstream stream("/proc/self/maps");
+        std::string line;
+        while (std::getline(stream, line)) {
+            unsigned long start, end;
+            char perms[5];
+            if (sscanf(line.c_str(), "%lx-%lx %4s", &start, &end, perms) != 3)
+                continue;
+            if (perms[0] != 'r' || perms[1] != 'w')
+                continue;
+            // Adjacent mappings are all readable, so they can be merged
+            if (!regions.empty() && regions.back().second == start)
+                regions.back().second = end;
+            else regions.emplace_back(start, end);
+        }
+    }
+
+    /** Return the end of the region holding the given address, or zero
+        if it's not in any of them.  Safe to call from a signal handler.
+    */
+    uintptr_t endOf(uintptr_t address) const
+    {
+        auto it = std::upper_bound
+            (regions.begin(), regions.end(), address,
+             [] (uintptr_t address, const std::pair<uintptr_t, uintptr_t> & r)
+             {
+                 return address < r.first;
+             });
+        if (it == regions.begin())
+            return 0;
+        --it;
+        return address < it->second ? it->second : 0;
+    }
+
+    std::vector<std::pair<uintptr_t, uintptr_t> > regions;
+};
+
+/// Stack regions of the profile that's running
+std::atomic<const StackRegions *> currentRegions(nullptr);
+
+/** Return the stack of the code that the signal interrupted, by following
+    the chain of frame pointers from the registers saved in the signal's
+    context.  MLDB is compiled with -fno-omit-frame-pointer so that this
+    works.  Unlike ::backtrace(), it is async-signal-safe, as it only reads
+    the stack.  It stops as soon as a frame doesn't look right, which is
+    what happens in code compiled without frame pointers (libc, BLAS), and
+    never reads outside of the stack that holds the stack pointer, so that
+    a garbage frame pointer can't make it fault.
+*/
+int frameBacktrace(void * context, void ** frames, int maxFrames)
+{
+    const ucontext_t * uc = (const ucontext_t *)context;
+#if defined(__x86_64__)
+    uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+    uintptr_t fp = uc->uc_mcontext.gregs[REG_RBP];
+    uintptr_t sp = uc->uc_mcontext.gregs[REG_RSP];
+#else
+    uintptr_t pc = uc->uc_mcontext.pc;
+    uintptr_t fp = uc->uc_mcontext.regs[29];
+    uintptr_t sp = uc->uc_mcontext.sp;
+#endif
+
+    int depth = 0;
+    frames[depth++] = (void *)pc;
+
+    // Top of the interrupted thread's stack.  It's unknown for a thread
+    // started since the profile began, in which case we only have the pc.
+    const StackRegions * regions = currentRegions.load();
+    uintptr_t top = regions ? regions->endOf(sp) : 0;
+    if (top < sp + 2 * sizeof(uintptr_t))
+        return depth;
+
+    // Each frame holds the caller's frame pointer followed by the return
+    // address.  The stack grows down, so each caller's frame is above the
+    // previous one, and all of them are above the stack pointer.
+    uintptr_t lowest = sp;
+    while (depth < maxFrames) {
+        if (fp < lowest || fp - lowest > MAX_FRAME_BYTES
+            || fp > top - 2 * sizeof(uintptr_t)
+            || fp % sizeof(uintptr_t) != 0)
+            break;
+        const uintptr_t * frame = (const uintptr_t *)fp;
+        uintptr_t ret = frame[1];
+        if (ret < 4096)
+            break;
+        frames[depth++] = (void *)ret;
+        lowest = fp + 2 * sizeof(uintptr_t);
+        fp = frame[0];
+    }
+
+    return depth;
+}
+
+#else
+
+/// Skip the signal handler and the signal trampoline
+constexpr int CPU_FRAMES_TO_SKIP = 2;
+
+/** On other architectures, we fall back to ::backtrace().  It is not
+    guaranteed to be async-signal-safe; it is with glibc once the unwinder
+    has been loaded (see installSignalHandler()), as long as the signal
+    doesn't interrupt the unwinder itself.
+*/
+int frameBacktrace(void * context, void ** frames, int maxFrames)
+{
+    return ::backtrace(frames, maxFrames);
+}
+
+#endif
+
+void onProfilingSignal(int signal, siginfo_t * info, void * context)
+{
+    int savedErrno = errno;
+    {
+        WriterGuard guard;
+        if (SampleBuffer * buffer = currentBuffer.load()) {
+            if (Sample * sample = buffer->reserve()) {
+                sample->weight = 1;
+                sample->depth = frameBacktrace(context, sample->frames,
+                                               MAX_DEPTH);
+            }
+        }
+    }
+    errno = savedErrno;
+}
+
+/** Install the SIGPROF handler.  It stays installed once the profile is
+    done, as there may still be signals on their way.
+*/
+void installSignalHandler()
+{
+    static std::once_flag installed;
+    std::call_once(installed, [] ()
+        {
+            // The first call to backtrace() loads the unwinder, which
+            // can't be done from within a signal handler in case it's used
+            // there
+            void * frames[2];
+            ::backtrace(frames, 2);
+
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_sigaction = onProfilingSignal;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            if (sigaction(SIGPROF, &action, nullptr) == -1)
+                throw MLDB::Exception(errno, "installing SIGPROF handler",
+                                      "sigaction");
+        });
+}
+
+void setProfilingTimer(int frequency)
+{
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    if (frequency > 0) {
+        timer.it_interval.tv_usec = 1000000 / frequency;
+        timer.it_value = timer.it_interval;
+    }
+    if (setitimer(ITIMER_PROF, &timer, nullptr) == -1)
+        throw MLDB::Exception(errno, "setting profiling timer", "setitimer");
+}
+
+
+/*****************************************************************************/
+/* ALLOCATION PROFILING                                                      */
+/*****************************************************************************/
+
+/** Set of the sampled allocations that haven't been freed.  It's a fixed
+    size open addressing hash table that can be updated without locks or
+    allocations, as it's used from within operator new and delete.  When
+    it's full, further samples are not tracked.
+*/
+struct LiveTable {
+    static constexpr size_t SIZE = 65536;
+    static constexpr int MAX_PROBES = 16;
+
+    /// Marks the slot of an allocation that was freed
+    static void * tombstone()
+    {
+        return (void *)1;
+    }
+
+    void clear()
+    {
+        for (auto & p: ptrs)
+            p.store(nullptr, std::memory_order_relaxed);
+    }
+
+    static size_t hash(const void * ptr)
+    {
+        return ((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL >> 48;
+    }
+
+    void insert(void * ptr, uint32_t sample)
+    {
+        size_t h = hash(ptr);
+        for (int i = 0;  i < MAX_PROBES;  ++i) {
+            size_t slot = (h + i) % SIZE;
+            void * expected = nullptr;
+            if (ptrs[slot].compare_exchange_strong(expected, ptr)) {
+                samples[slot] = sample;
+                return;
+            }
+        }
+    }
+
+    void erase(void * ptr)
+    {
+        size_t h = hash(ptr);
+        for (int i = 0;  i < MAX_PROBES;  ++i) {
+            size_t slot = (h + i) % SIZE;
+            void * current = ptrs[slot].load(std::memory_order_relaxed);
+            if (current == nullptr)
+                return;
+            if (current == ptr
+                && ptrs[slot].compare_exchange_strong(current, tombstone()))
+                return;
+        }
+    }
+
+    std::atomic<void *> ptrs[SIZE];
+    uint32_t samples[SIZE];
+} liveTable;
+
+/// Average number of bytes allocated by a thread between samples
+size_t sampleInterval = 512 * 1024;
+
+/// Bytes allocated by this thread since its last sample
+__thread size_t bytesSinceSample = 0;
+
+/// Stops the allocations made while sampling from being sampled
+__thread bool inSampler = false;
+
+void sampleAllocation(void * ptr, size_t size)
+{
+    if (inSampler)
+        return;
+    bytesSinceSample += size;
+    if (bytesSinceSample < sampleInterval)
+        return;
+
+    inSampler = true;
+    {
+        WriterGuard guard;
+        if (SampleBuffer * buffer = currentBuffer.load()) {
+            if (Sample * sample = buffer->reserve()) {
+                // The sample stands for all bytes allocated by the thread
+                // since the last one
+                sample->weight = bytesSinceSample;
+                sample->depth = ::backtrace(sample->frames, MAX_DEPTH);
+                liveTable.insert(ptr, sample - buffer->samples.get());
+            }
+        }
+    }
+    bytesSinceSample = 0;
+    inSampler = false;
+}
+
+void sampleDeallocation(void * ptr)
+{
+    liveTable.erase(ptr);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PROFILE                                                                   */
+/*****************************************************************************/
+
+std::string
+Profile::
+printFolded() const
+{
+    std::string result;
+    for (auto & s: stacks) {
+        result += s.first;
+        result += ' ';
+        result += std::to_string(s.second);
+        result += '\n';
+    }
+    return result;
+}
+
+Profile profileCpu(double seconds, int frequency,
+                   const ProfileKeepGoing & keepGoing)
+{
+    if (frequency <= 0 || frequency > 10000)
+        throw MLDB::Exception("Profiling frequency must be between 1 and "
+                              "10000 per second");
+
+    RunningGuard guard;
+    installSignalHandler();
+
+    // The timer counts the CPU time of all threads together
+    size_t capacity
+        = std::min<size_t>(MAX_SAMPLES,
+                           seconds * frequency
+                           * std::max(1u, std::thread::hardware_concurrency())
+                           + 1000);
+    SampleBuffer buffer(capacity);
+
+#if defined(__x86_64__) || defined(__aarch64__)
+    StackRegions regions;
+    regions.load();
+    currentRegions = &regions;
+#endif
+
+    currentBuffer = &buffer;
+
+    setProfilingTimer(frequency);
+    double slept = sleepFor(seconds, keepGoing);
+    setProfilingTimer(0);
+
+    // No sample uses the regions once they are all written
+    stopSampling();
+#if defined(__x86_64__) || defined(__aarch64__)
+    currentRegions = nullptr;
+#endif
+
+    return aggregate(buffer, CPU_FRAMES_TO_SKIP, slept);
+}
+
+Profile profileAllocations(double seconds, size_t sampleBytes, bool live,
+                           const ProfileKeepGoing & keepGoing)
+{
+    if (!allocation_hook_installed)
+        throw MLDB::Exception("Allocation profiling needs the "
+                              "allocation_hook library to be linked in");
+
+    RunningGuard guard;
+
+    // Make sure the unwinder is loaded before it's needed
+    void * frames[2];
+    ::backtrace(frames, 2);
+
+    SampleBuffer buffer(MAX_SAMPLES);
+    sampleInterval = std::max<size_t>(sampleBytes, 1);
+    liveTable.clear();
+    currentBuffer = &buffer;
+
+    deallocation_sampler.store(sampleDeallocation);
+    allocation_sampler.store(sampleAllocation);
+
+    double slept = sleepFor(seconds, keepGoing);
+
+    allocation_sampler.store(nullptr);
+    stopSampling();
+    deallocation_sampler.store(nullptr);
+
+    std::vector<bool> include;
+    if (live) {
+        include.resize(buffer.size());
+        for (size_t i = 0;  i < LiveTable::SIZE;  ++i) {
+            void * ptr = liveTable.ptrs[i].load();
+            if (ptr && ptr != LiveTable::tombstone()
+                && liveTable.samples[i] < include.size())
+                include[liveTable.samples[i]] = true;
+        }
+    }
+
+    // Skip the sampler and operator new
+    return aggregate(buffer, 2 /* numToSkip */, slept,
+                     live ? &include : nullptr);
+}
+
+bool profileRunning()
+{
+    return running;
+}
+
+} // namespace MLDB
@@ -0,0 +1,92 @@
+/* sampling_profiler.h                                             -*- C++ -*-
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Sampling profiler for CPU time and allocations in a running process.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace MLDB {
+
+/** Hooks called on each allocation and deallocation made through operator
+    new and operator delete, when the allocation_hook library is linked in
+    and the hooks are not null.  They are set by profileAllocations() for
+    the duration of the profile.  They are atomic as every thread reads
+    them while they are set; reading them with relaxed ordering is enough.
+*/
+extern std::atomic<void (*) (void * ptr, size_t size)> allocation_sampler;
+extern std::atomic<void (*) (void * ptr)> deallocation_sampler;
+
+/** Set by the allocation_hook library when it's linked in, to say that
+    the hooks above will be called.
+*/
+extern bool allocation_hook_installed;
+
+
+/*****************************************************************************/
+/* PROFILE                                                                   */
+/*****************************************************************************/
+
+/** The result of a profile: the weight of each distinct stack, where the
+    stack is given as the names of its functions from the outermost to the
+    innermost, separated by semicolons.
+*/
+struct Profile {
+    std::map<std::string, uint64_t> stacks;
+    uint64_t samples = 0;   ///< Number of samples taken
+    uint64_t dropped = 0;   ///< Samples that didn't fit in the buffer
+    double seconds = 0.0;   ///< Length of the profile
+
+    /** Print in the "folded" format, one stack per line followed by its
+        weight, which can be turned into a flame graph by the usual
+        tools (for example flamegraph.pl).
+    */
+    std::string printFolded() const;
+};
+
+/** Called regularly while a profile runs; the profile stops early, and
+    returns what it has so far, once it returns false.
+*/
+typedef std::function<bool ()> ProfileKeepGoing;
+
+/** Profile the CPU time used by all threads of the process for the given
+    number of seconds, by taking a backtrace of the thread that's running
+    at the given frequency (per second of CPU time), and return the number
+    of samples for each stack.  The stacks are found by following frame
+    pointers, so frames of code compiled without them may be missing.
+    The walk never leaves the stack of the interrupted thread, as it was
+    mapped when the profile started; threads started during the profile
+    only have their innermost frame recorded.
+
+    Only one profile (of either kind) can run at once; an exception is
+    thrown if another one is already running.
+*/
+Profile profileCpu(double seconds, int frequency = 100,
+                   const ProfileKeepGoing & keepGoing = nullptr);
+
+/** Profile the allocations made through operator new for the given number
+    of seconds, by taking a backtrace about every sampleBytes allocated by
+    each thread.  With live false, the weight of each stack is the number
+    of bytes allocated; with live true, it's the number of bytes allocated
+    during the profile that were still not freed at the end, which shows
+    where memory grows.
+
+    Throws an exception if the allocation_hook library isn't linked in.
+*/
+Profile profileAllocations(double seconds, size_t sampleBytes = 512 * 1024,
+                           bool live = false,
+                           const ProfileKeepGoing & keepGoing = nullptr);
+
+/** Is a profile running? */
+bool profileRunning();
+
+} // namespace MLDB
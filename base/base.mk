@@ -5,6 +5,8 @@ LIBBASE_SOURCES := \
         parse_context.cc \
 	thread_pool.cc \
 	parallel.cc \
+	cancellation.cc \
+	metrics.cc \
 	optimized_path.cc
 
 LIBBASE_LINK :=	arch gc
@@ -0,0 +1,118 @@
+/** cancellation.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "cancellation.h"
+#include "mldb/arch/exception.h"
+#include <algorithm>
+#include <chrono>
+
+
+namespace MLDB {
+
+namespace {
+
+__thread CancellationToken * currentToken = nullptr;
+
+int64_t steadyNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* CANCELLATION TOKEN                                                        */
+/*****************************************************************************/
+
+CancellationToken::
+CancellationToken()
+    : state(RUNNING), deadline(0)
+{
+}
+
+void
+CancellationToken::
+cancel(const std::string & reason)
+{
+    setState(CANCELLED, reason);
+}
+
+void
+CancellationToken::
+setTimeout(double seconds)
+{
+    if (seconds <= 0.0) {
+        deadline = 0;
+        return;
+    }
+    // Zero is reserved for no deadline
+    deadline = std::max<int64_t>(steadyNanos() + (int64_t)(seconds * 1e9), 1);
+}
+
+bool
+CancellationToken::
+checkDeadline(int64_t deadline) const
+{
+    if (steadyNanos() < deadline)
+        return false;
+    setState(TIMED_OUT, "deadline exceeded");
+    return true;
+}
+
+void
+CancellationToken::
+setState(State newState, const std::string & reason) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    int expected = RUNNING;
+    if (state.compare_exchange_strong(expected, newState))
+        reason_ = reason;
+}
+
+std::string
+CancellationToken::
+reason() const
+{
+    if (!isCancelled())
+        return std::string();
+    std::unique_lock<std::mutex> guard(mutex);
+    return reason_;
+}
+
+void
+CancellationToken::
+throwIfCancelled() const
+{
+    if (isCancelled())
+        throw MLDB::Exception("Work was cancelled: " + reason());
+}
+
+CancellationToken * currentCancellationToken()
+{
+    return currentToken;
+}
+
+
+/*****************************************************************************/
+/* CANCELLATION SCOPE                                                        */
+/*****************************************************************************/
+
+CancellationScope::
+CancellationScope(CancellationToken * token)
+    : previous(currentToken)
+{
+    currentToken = token;
+}
+
+CancellationScope::
+~CancellationScope()
+{
+    currentToken = previous;
+}
+
+} // namespace MLDB
@@ -0,0 +1,117 @@
+/** cancellation.h                                                 -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Cooperative cancellation of work, with deadlines.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* CANCELLATION TOKEN                                                        */
+/*****************************************************************************/
+
+/** A request for some work to stop, shared between whoever may make the
+    request and the work itself, which checks it when convenient.  The
+    token may also have a deadline, after which it is cancelled
+    automatically the next time it's checked.
+
+    The work done while a token is current for a thread (see
+    CancellationScope) can check it with currentWorkCancelled().  Like job
+    priorities, the current token is carried along with jobs submitted to
+    a ThreadPool, and so to the parallelMap() workers.  Tokens must be
+    owned by a std::shared_ptr for this to work.
+*/
+
+struct CancellationToken
+    : public std::enable_shared_from_this<CancellationToken> {
+
+    CancellationToken();
+
+    /** Ask the work to stop.  The first reason given is kept. */
+    void cancel(const std::string & reason = "cancelled");
+
+    /** Cancel the work automatically once the given number of seconds
+        has elapsed.  A value of zero or less removes the deadline.
+    */
+    void setTimeout(double seconds);
+
+    /** Has the work been asked to stop?  This is cheap enough to be
+        called for each row of a query.
+    */
+    bool isCancelled() const
+    {
+        if (state.load(std::memory_order_relaxed) != RUNNING)
+            return true;
+        int64_t dl = deadline.load(std::memory_order_relaxed);
+        return dl != 0 && checkDeadline(dl);
+    }
+
+    /** Was the work cancelled because its deadline passed? */
+    bool timedOut() const
+    {
+        return isCancelled() && state == TIMED_OUT;
+    }
+
+    /** Reason the work was cancelled, or an empty string if it wasn't. */
+    std::string reason() const;
+
+    /** Throws an MLDB::Exception with the reason if the work has been
+        cancelled.
+    */
+    void throwIfCancelled() const;
+
+private:
+    enum State {
+        RUNNING,
+        CANCELLED,
+        TIMED_OUT
+    };
+
+    bool checkDeadline(int64_t deadline) const;
+    void setState(State newState, const std::string & reason) const;
+
+    mutable std::atomic<int> state;
+
+    /// Deadline in nanoseconds of the steady clock, or zero for none
+    std::atomic<int64_t> deadline;
+
+    mutable std::mutex mutex;
+    mutable std::string reason_;
+};
+
+/** Return the token of the work being done by the calling thread, or null
+    if there is none.
+*/
+CancellationToken * currentCancellationToken();
+
+/** Returns true if the calling thread has a current token, and the work
+    it's doing was cancelled.
+*/
+inline bool currentWorkCancelled()
+{
+    CancellationToken * token = currentCancellationToken();
+    return token && token->isCancelled();
+}
+
+/** Makes the given token current for the calling thread for the lifetime
+    of the object.  A null token means that there is none.
+*/
+struct CancellationScope {
+    CancellationScope(CancellationToken * token);
+    ~CancellationScope();
+
+    CancellationToken * previous;
+};
+
+} // namespace MLDB
@@ -0,0 +1,434 @@
+/** metrics.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "metrics.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/format.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/compiler/compiler.h"
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* THREAD CELLS                                                              */
+/*****************************************************************************/
+
+/** The values of all metrics for one thread.  Each cell is written only by
+    its thread, so there is no need for atomic read-modify-write
+    operations; the atomics are there so that the values can be read
+    safely by other threads.
+*/
+
+struct MetricsRegistry::ThreadCells {
+    ThreadCells()
+    {
+        for (auto & c: cells)
+            c.store(0, std::memory_order_relaxed);
+    }
+
+    void add(int slot, uint64_t amount)
+    {
+        auto & cell = cells[slot];
+        cell.store(cell.load(std::memory_order_relaxed) + amount,
+                   std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> cells[MAX_SLOTS];
+};
+
+/** Registers the cells of a thread when it first records a metric, and
+    folds them into the retired totals when it exits.
+*/
+struct ThreadCellsHolder {
+    ThreadCellsHolder()
+        : cells(new MetricsRegistry::ThreadCells())
+    {
+        MetricsRegistry::instance().addThread(cells.get());
+    }
+
+    ~ThreadCellsHolder()
+    {
+        MetricsRegistry::instance().removeThread(cells.get());
+    }
+
+    std::unique_ptr<MetricsRegistry::ThreadCells> cells;
+};
+
+namespace {
+
+// Fast path to the cells; the holder is only there for the cleanup
+__thread MetricsRegistry::ThreadCells * currentCells = nullptr;
+
+thread_local std::unique_ptr<ThreadCellsHolder> holder;
+
+// Prometheus wants labels without braces to be merged with those it adds
+std::string withLabels(const std::string & labels,
+                       const std::string & extra = "")
+{
+    if (labels.empty() && extra.empty())
+        return std::string();
+    if (labels.empty())
+        return "{" + extra + "}";
+    if (extra.empty())
+        return "{" + labels + "}";
+    return "{" + labels + "," + extra + "}";
+}
+
+std::string printValue(double value)
+{
+    if (value == (int64_t)value)
+        return std::to_string((int64_t)value);
+    return MLDB::format("%.9g", value);
+}
+
+const char * typeName(MetricsRegistry::Type type)
+{
+    switch (type) {
+    case MetricsRegistry::COUNTER:   return "counter";
+    case MetricsRegistry::GAUGE:     return "gauge";
+    case MetricsRegistry::HISTOGRAM: return "histogram";
+    }
+    return "untyped";
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COUNTER                                                                   */
+/*****************************************************************************/
+
+void
+Counter::
+inc(uint64_t amount) const
+{
+    if (slot < 0)
+        return;
+    MetricsRegistry::threadCells().add(slot, amount);
+}
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+constexpr int LatencyHistogram::NUM_BUCKETS;
+constexpr int LatencyHistogram::NUM_SLOTS;
+
+int
+LatencyHistogram::
+bucketFor(uint64_t nanos)
+{
+    // Round up to a whole number of microseconds
+    uint64_t micros = (nanos + 999) / 1000;
+    if (micros <= 1)
+        return 0;
+    // Smallest i such that micros <= 2^i
+    int bucket = 64 - __builtin_clzll(micros - 1);
+    return std::min(bucket, (int)NUM_BUCKETS);
+}
+
+double
+LatencyHistogram::
+bucketLimit(int bucket)
+{
+    return std::ldexp(1e-6, bucket);
+}
+
+void
+LatencyHistogram::
+record(double seconds) const
+{
+    recordNanos(seconds <= 0 ? 0 : (uint64_t)(seconds * 1e9));
+}
+
+void
+LatencyHistogram::
+recordNanos(uint64_t nanos) const
+{
+    if (slot < 0)
+        return;
+    auto & cells = MetricsRegistry::threadCells();
+    cells.add(slot + bucketFor(nanos), 1);
+    cells.add(slot + NUM_BUCKETS + 1, nanos);
+}
+
+
+/*****************************************************************************/
+/* METRICS REGISTRY                                                          */
+/*****************************************************************************/
+
+constexpr int MetricsRegistry::MAX_SLOTS;
+
+MetricsRegistry::
+MetricsRegistry()
+    : nextSlot(0), nextCallbackId(1), retired(new ThreadCells())
+{
+}
+
+MetricsRegistry &
+MetricsRegistry::
+instance()
+{
+    static MetricsRegistry * result = new MetricsRegistry();
+    return *result;
+}
+
+MetricsRegistry::ThreadCells &
+MetricsRegistry::
+threadCells()
+{
+    if (MLDB_LIKELY(currentCells != nullptr))
+        return *currentCells;
+    holder.reset(new ThreadCellsHolder());
+    currentCells = holder->cells.get();
+    return *currentCells;
+}
+
+void
+MetricsRegistry::
+addThread(ThreadCells * cells)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    threads.push_back(cells);
+}
+
+void
+MetricsRegistry::
+removeThread(ThreadCells * cells)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = std::find(threads.begin(), threads.end(), cells);
+    ExcAssert(it != threads.end());
+    threads.erase(it);
+    for (int i = 0;  i < nextSlot;  ++i)
+        retired->add(i, cells->cells[i].load(std::memory_order_relaxed));
+    currentCells = nullptr;
+}
+
+int
+MetricsRegistry::
+addSeries(const std::string & name, const std::string & help,
+          Type type, const std::string & labels, int numSlots)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    Family & family = families[name];
+    if (family.series.empty()) {
+        family.help = help;
+        family.type = type;
+    }
+    else if (family.type != type || family.series[0].read) {
+        throw MLDB::Exception("Metric '" + name + "' was already registered "
+                              "as a different kind of " + typeName(family.type));
+    }
+
+    for (auto & s: family.series) {
+        if (s.labels == labels)
+            return s.slot;
+    }
+
+    if (nextSlot + numSlots > MAX_SLOTS)
+        throw MLDB::Exception("Too many metrics registered; can't add '"
+                              + name + "'");
+
+    Series series;
+    series.labels = labels;
+    series.slot = nextSlot;
+    nextSlot += numSlots;
+    family.series.emplace_back(std::move(series));
+    return family.series.back().slot;
+}
+
+Counter
+MetricsRegistry::
+counter(const std::string & name,
+        const std::string & help,
+        const std::string & labels)
+{
+    return Counter(addSeries(name, help, COUNTER, labels, 1));
+}
+
+LatencyHistogram
+MetricsRegistry::
+histogram(const std::string & name,
+          const std::string & help,
+          const std::string & labels)
+{
+    return LatencyHistogram(addSeries(name, help, HISTOGRAM, labels,
+                                      LatencyHistogram::NUM_SLOTS));
+}
+
+uint64_t
+MetricsRegistry::
+addCallback(const std::string & name,
+            const std::string & help,
+            Type type,
+            std::function<double ()> read,
+            const std::string & labels)
+{
+    ExcAssertNotEqual(type, HISTOGRAM);
+
+    std::unique_lock<std::mutex> guard(mutex);
+    Family & family = families[name];
+    if (family.series.empty()) {
+        family.help = help;
+        family.type = type;
+    }
+    else if (family.type != type || !family.series[0].read) {
+        throw MLDB::Exception("Metric '" + name + "' was already registered "
+                              "as a different kind of " + typeName(family.type));
+    }
+
+    Series series;
+    series.labels = labels;
+    series.callbackId = nextCallbackId++;
+    series.read = std::move(read);
+    family.series.emplace_back(std::move(series));
+    return family.series.back().callbackId;
+}
+
+void
+MetricsRegistry::
+removeCallback(uint64_t id)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    for (auto it = families.begin();  it != families.end();  ++it) {
+        auto & series = it->second.series;
+        for (auto jt = series.begin();  jt != series.end();  ++jt) {
+            if (jt->callbackId != id)
+                continue;
+            series.erase(jt);
+            if (series.empty())
+                families.erase(it);
+            return;
+        }
+    }
+}
+
+uint64_t
+MetricsRegistry::
+sumSlot(int slot) const
+{
+    uint64_t result = retired->cells[slot].load(std::memory_order_relaxed);
+    for (auto * t: threads)
+        result += t->cells[slot].load(std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t
+MetricsRegistry::
+value(const Counter & counter) const
+{
+    if (counter.slot < 0)
+        return 0;
+    std::unique_lock<std::mutex> guard(mutex);
+    return sumSlot(counter.slot);
+}
+
+uint64_t
+MetricsRegistry::
+count(const LatencyHistogram & histogram) const
+{
+    if (histogram.slot < 0)
+        return 0;
+    std::unique_lock<std::mutex> guard(mutex);
+    uint64_t result = 0;
+    for (int i = 0;  i <= LatencyHistogram::NUM_BUCKETS;  ++i)
+        result += sumSlot(histogram.slot + i);
+    return result;
+}
+
+std::string
+MetricsRegistry::
+printPrometheus() const
+{
+    // Callbacks are called without the lock held, as they may need to
+    // take locks of their own
+    std::vector<std::tuple<std::string, std::string,
+                           std::function<double ()> > > callbacks;
+
+    std::string result;
+
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+
+        for (auto & f: families) {
+            const std::string & name = f.first;
+            const Family & family = f.second;
+
+            if (family.series.empty())
+                continue;
+
+            if (family.series[0].read) {
+                for (auto & s: family.series)
+                    callbacks.emplace_back(name, s.labels, s.read);
+                continue;
+            }
+
+            result += "# HELP " + name + " " + family.help + "\n";
+            result += "# TYPE " + name + " " + typeName(family.type) + "\n";
+
+            for (auto & s: family.series) {
+                if (family.type != HISTOGRAM) {
+                    result += name + withLabels(s.labels) + " "
+                        + std::to_string(sumSlot(s.slot)) + "\n";
+                    continue;
+                }
+
+                // Prometheus buckets are cumulative
+                uint64_t count = 0;
+                for (int i = 0;  i < LatencyHistogram::NUM_BUCKETS;  ++i) {
+                    count += sumSlot(s.slot + i);
+                    result += name + "_bucket"
+                        + withLabels(s.labels,
+                                     MLDB::format("le=\"%.9g\"",
+                                                  LatencyHistogram::bucketLimit(i)))
+                        + " " + std::to_string(count) + "\n";
+                }
+                count += sumSlot(s.slot + LatencyHistogram::NUM_BUCKETS);
+                result += name + "_bucket" + withLabels(s.labels, "le=\"+Inf\"")
+                    + " " + std::to_string(count) + "\n";
+
+                uint64_t sumNanos
+                    = sumSlot(s.slot + LatencyHistogram::NUM_BUCKETS + 1);
+                result += name + "_sum" + withLabels(s.labels) + " "
+                    + printValue(sumNanos * 1e-9) + "\n";
+                result += name + "_count" + withLabels(s.labels) + " "
+                    + std::to_string(count) + "\n";
+            }
+        }
+    }
+
+    // Now the callbacks, grouped by metric name
+    std::string lastName;
+    for (auto & c: callbacks) {
+        const std::string & name = std::get<0>(c);
+        if (name != lastName) {
+            std::unique_lock<std::mutex> guard(mutex);
+            auto it = families.find(name);
+            if (it == families.end())
+                continue;
+            result += "# HELP " + name + " " + it->second.help + "\n";
+            result += "# TYPE " + name + " " + typeName(it->second.type) + "\n";
+            lastName = name;
+        }
+        result += name + withLabels(std::get<1>(c)) + " "
+            + printValue(std::get<2>(c)()) + "\n";
+    }
+
+    return result;
+}
+
+} // namespace MLDB
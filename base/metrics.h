@@ -0,0 +1,240 @@
+/** metrics.h                                                      -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Registry of operational metrics (counters and latency histograms),
+    cheap enough to be recorded on hot paths and exported in the
+    Prometheus text format.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COUNTER                                                                   */
+/*****************************************************************************/
+
+/** Handle to a counter in the MetricsRegistry.  Handles are cheap to copy,
+    and are normally obtained once and kept in a static variable.
+    Incrementing a counter is lock-free and doesn't contend with other
+    threads: each thread has its own cell, and the cells are only summed up
+    when the metrics are read.
+*/
+
+struct Counter {
+    Counter()
+        : slot(-1)
+    {
+    }
+
+    /** Add the given amount to the counter. */
+    void inc(uint64_t amount = 1) const;
+
+private:
+    friend struct MetricsRegistry;
+    Counter(int slot)
+        : slot(slot)
+    {
+    }
+
+    int slot;
+};
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+/** Handle to a histogram of durations in the MetricsRegistry.  The buckets
+    are powers of two of microseconds, from 1us up to about 36 minutes.
+    As for counters, recording is lock-free.
+*/
+
+struct LatencyHistogram {
+    static constexpr int NUM_BUCKETS = 32;
+
+    LatencyHistogram()
+        : slot(-1)
+    {
+    }
+
+    /** Record a duration in seconds. */
+    void record(double seconds) const;
+
+    /** Record a duration in nanoseconds. */
+    void recordNanos(uint64_t nanos) const;
+
+    /** Index of the bucket that a duration falls into; NUM_BUCKETS is
+        for durations longer than the last bucket.
+    */
+    static int bucketFor(uint64_t nanos);
+
+    /** Upper bound of the given bucket, in seconds. */
+    static double bucketLimit(int bucket);
+
+private:
+    friend struct MetricsRegistry;
+    LatencyHistogram(int slot)
+        : slot(slot)
+    {
+    }
+
+    /// Slots used: one per bucket, one for the overflow and one for
+    /// the sum in nanoseconds.  The count is the sum of the buckets.
+    static constexpr int NUM_SLOTS = NUM_BUCKETS + 2;
+
+    int slot;
+};
+
+
+/*****************************************************************************/
+/* LATENCY TIMER                                                             */
+/*****************************************************************************/
+
+/** Records the time between its construction and destruction into a
+    histogram.
+*/
+
+struct LatencyTimer {
+    LatencyTimer(const LatencyHistogram & histogram)
+        : histogram(histogram),
+          started(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~LatencyTimer()
+    {
+        histogram.recordNanos
+            (std::chrono::duration_cast<std::chrono::nanoseconds>
+             (std::chrono::steady_clock::now() - started).count());
+    }
+
+    const LatencyHistogram & histogram;
+    std::chrono::steady_clock::time_point started;
+};
+
+
+/*****************************************************************************/
+/* METRICS REGISTRY                                                          */
+/*****************************************************************************/
+
+/** Process-wide registry of metrics.  A metric is identified by its name
+    and its labels, which are given in the Prometheus syntax without the
+    braces (for example 'code="2xx"').  Registering the same metric twice
+    returns the same handle.
+
+    Values that are already maintained elsewhere, such as the statistics of
+    the thread pool, can be exported through callbacks that are read when
+    the metrics are printed.
+*/
+
+struct MetricsRegistry {
+
+    enum Type {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    /** Return the registry.  It is never destroyed, so that metrics may
+        be recorded until the very end of the process.
+    */
+    static MetricsRegistry & instance();
+
+    Counter counter(const std::string & name,
+                    const std::string & help,
+                    const std::string & labels = "");
+
+    LatencyHistogram histogram(const std::string & name,
+                               const std::string & help,
+                               const std::string & labels = "");
+
+    /** Add a counter or gauge whose value is obtained by calling the given
+        function.  Returns an identifier that can be passed to
+        removeCallback() when the value is no longer available.
+    */
+    uint64_t addCallback(const std::string & name,
+                         const std::string & help,
+                         Type type,
+                         std::function<double ()> read,
+                         const std::string & labels = "");
+
+    void removeCallback(uint64_t id);
+
+    /** Return the current value of the given counter, summed over all
+        threads.
+    */
+    uint64_t value(const Counter & counter) const;
+
+    /** Return the number of durations recorded in the given histogram. */
+    uint64_t count(const LatencyHistogram & histogram) const;
+
+    /** Print all metrics in the Prometheus text exposition format. */
+    std::string printPrometheus() const;
+
+    /// Total number of slots available; each counter takes one and each
+    /// histogram LatencyHistogram::NUM_SLOTS
+    static constexpr int MAX_SLOTS = 4096;
+
+    struct ThreadCells;
+
+private:
+    MetricsRegistry();
+
+    friend struct Counter;
+    friend struct LatencyHistogram;
+
+    struct Series {
+        std::string labels;
+        int slot = -1;                       ///< For counters and histograms
+        uint64_t callbackId = 0;             ///< For callbacks
+        std::function<double ()> read;
+    };
+
+    struct Family {
+        std::string help;
+        Type type;
+        std::vector<Series> series;
+    };
+
+    int addSeries(const std::string & name, const std::string & help,
+                  Type type, const std::string & labels, int numSlots);
+
+    /** Return the calling thread's cells, creating them if needed. */
+    static ThreadCells & threadCells();
+
+    friend struct ThreadCellsHolder;
+    void addThread(ThreadCells * cells);
+    void removeThread(ThreadCells * cells);
+
+    /** Sum the given slot over all threads.  Must be called with the
+        lock held.
+    */
+    uint64_t sumSlot(int slot) const;
+
+    mutable std::mutex mutex;
+    std::map<std::string, Family> families;
+    int nextSlot;
+    uint64_t nextCallbackId;
+
+    /// Cells of the threads that are running
+    std::vector<ThreadCells *> threads;
+
+    /// Totals of the threads that have exited
+    std::unique_ptr<ThreadCells> retired;
+};
+
+} // namespace MLDB
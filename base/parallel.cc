@@ -9,6 +9,7 @@
 #include "mldb/compiler/compiler.h"
 #include "mldb/base/exc_assert.h"
 #include "thread_pool.h"
+#include "cancellation.h"
 #include <atomic>
 #include <mutex>
 
@@ -35,9 +36,15 @@ void parallelMap(size_t first, size_t last,
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
-    auto worker = [&] ()
+    std::function<void ()> worker = [&] ()
         {
             while (!hasException.load(std::memory_order_relaxed)) {
+                // Give the thread to more urgent work if there is some,
+                // leaving a job behind to finish our work later
+                if (tp.shouldYield()) {
+                    tp.add(worker);
+                    return;
+                }
                 size_t myindex = index.fetch_add(1);
                 if (myindex >= last)
                     return;
@@ -87,10 +94,19 @@ bool parallelMapHaltable(size_t first, size_t last,
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
-    auto worker = [&] ()
+    std::function<void ()> worker = [&] ()
         {
             while (!stop.load(std::memory_order_relaxed)
                    && !hasException.load(std::memory_order_relaxed)) {
+                // Stop early if the work was cancelled
+                if (currentWorkCancelled()) {
+                    stop = true;
+                    return;
+                }
+                if (tp.shouldYield()) {
+                    tp.add(worker);
+                    return;
+                }
                 size_t myindex = index.fetch_add(1);
                 if (myindex >= last)
                     return;
@@ -147,9 +163,13 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
     if (occupancyLimit > (last - first + chunkSize - 1) / chunkSize)
         occupancyLimit = (last - first + chunkSize - 1) / chunkSize;
 
-    auto worker = [&] ()
+    std::function<void ()> worker = [&] ()
         {
             while (!hasException.load(std::memory_order_relaxed)) {
+                if (tp.shouldYield()) {
+                    tp.add(worker);
+                    return;
+                }
                 size_t myindex = index.fetch_add(chunkSize);
                 if (myindex >= last)
                     return;
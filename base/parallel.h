@@ -41,7 +41,8 @@ void parallelMap(size_t first, size_t last,
 
 /** Same as parallelMap(), but takes a lambda which will short-circuit the
     work if it returns false.  Returns false if and only if a doWork()
-    call returned false.
+    call returned false, or the work was cancelled via the calling thread's
+    CancellationToken.
 */
 bool parallelMapHaltable(size_t first, size_t last,
                          const std::function<bool (size_t)> & doWork,
@@ -1,3 +1,4 @@
 # This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
 $(eval $(call test,thread_pool_test,base,boost timed))
+$(eval $(call test,metrics_test,base,boost))
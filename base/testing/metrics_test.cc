@@ -0,0 +1,107 @@
+/** metrics_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the metrics registry.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/metrics.h"
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE(test_counter_threads)
+{
+    auto & registry = MetricsRegistry::instance();
+    Counter counter = registry.counter("test_threads_total", "Test");
+
+    // Values from threads that have exited are kept
+    std::vector<std::thread> threads;
+    for (unsigned i = 0;  i < 4;  ++i) {
+        threads.emplace_back([&] ()
+                             {
+                                 for (unsigned j = 0;  j < 10000;  ++j)
+                                     counter.inc();
+                             });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    counter.inc(5);
+    BOOST_CHECK_EQUAL(registry.value(counter), 40005);
+
+    // Registering again gives the same counter
+    Counter again = registry.counter("test_threads_total", "Test");
+    BOOST_CHECK_EQUAL(registry.value(again), 40005);
+
+    // But not with different labels
+    Counter labelled = registry.counter("test_threads_total", "Test",
+                                        "kind=\"other\"");
+    BOOST_CHECK_EQUAL(registry.value(labelled), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram_buckets)
+{
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketFor(0), 0);
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketFor(1000), 0);
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketFor(1001), 1);
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketFor(2000), 1);
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketFor(1000000), 10);
+    BOOST_CHECK_EQUAL(LatencyHistogram::bucketFor(1ULL << 62),
+                      LatencyHistogram::NUM_BUCKETS);
+
+    auto & registry = MetricsRegistry::instance();
+    LatencyHistogram histogram
+        = registry.histogram("test_latency_seconds", "Test");
+    histogram.record(0.0005);
+    histogram.record(0.5);
+    histogram.record(1e6);
+    BOOST_CHECK_EQUAL(registry.count(histogram), 3);
+}
+
+BOOST_AUTO_TEST_CASE(test_prometheus_format)
+{
+    auto & registry = MetricsRegistry::instance();
+    registry.counter("test_format_total", "Format test").inc(3);
+    registry.histogram("test_format_seconds", "Format test",
+                       "op=\"x\"").record(0.001);
+    uint64_t id = registry.addCallback("test_format_gauge", "Format test",
+                                       MetricsRegistry::GAUGE,
+                                       [] () { return 2.5; });
+
+    string text = registry.printPrometheus();
+    cerr << text;
+
+    BOOST_CHECK(text.find("# TYPE test_format_total counter\n"
+                          "test_format_total 3\n") != string::npos);
+    BOOST_CHECK(text.find("# TYPE test_format_seconds histogram\n")
+                != string::npos);
+    BOOST_CHECK(text.find("test_format_seconds_bucket{op=\"x\",le=\"0.000512\"} 0\n")
+                != string::npos);
+    BOOST_CHECK(text.find("test_format_seconds_bucket{op=\"x\",le=\"0.001024\"} 1\n")
+                != string::npos);
+    BOOST_CHECK(text.find("test_format_seconds_bucket{op=\"x\",le=\"+Inf\"} 1\n")
+                != string::npos);
+    BOOST_CHECK(text.find("test_format_seconds_sum{op=\"x\"} 0.001\n")
+                != string::npos);
+    BOOST_CHECK(text.find("test_format_seconds_count{op=\"x\"} 1\n")
+                != string::npos);
+    BOOST_CHECK(text.find("test_format_gauge 2.5\n") != string::npos);
+
+    registry.removeCallback(id);
+    text = registry.printPrometheus();
+    BOOST_CHECK(text.find("test_format_gauge") == string::npos);
+
+    // Can't reuse a name for a different type
+    BOOST_CHECK_THROW(registry.histogram("test_format_total", "Format test"),
+                      std::exception);
+}
@@ -15,12 +15,15 @@
 #include "mldb/arch/timers.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
 
 #include <boost/test/unit_test.hpp>
 #include <atomic>
 #include <thread>
 #include <cassert>
 #include <iostream>
+#include <mutex>
+#include <vector>
 
 using namespace std;
 using namespace MLDB;
@@ -165,6 +168,166 @@ BOOST_AUTO_TEST_CASE(thread_pool_test)
     BOOST_CHECK_EQUAL(jobsDone.load(), numJobs);
 }
 
+BOOST_AUTO_TEST_CASE(thread_pool_priority_order)
+{
+    ThreadPool threadPool(1);
+
+    // Keep the only thread busy while we queue up the jobs
+    std::atomic<bool> blocking(false), release(false);
+    threadPool.add([&] ()
+                   {
+                       blocking = true;
+                       while (!release)
+                           std::this_thread::yield();
+                   });
+    while (!blocking) ;
+
+    std::mutex mutex;
+    std::vector<JobPriority> order;
+    auto record = [&] ()
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            order.push_back(currentJobPriority());
+        };
+
+    threadPool.add(record, PRIORITY_BACKGROUND);
+    threadPool.add(record, PRIORITY_BATCH);
+    threadPool.add(record, PRIORITY_INTERACTIVE);
+
+    BOOST_CHECK_EQUAL(threadPool.priorityStats(PRIORITY_BATCH).queued, 1);
+
+    // Let the pool thread run them rather than doing it ourselves, so that
+    // the order is deterministic
+    release = true;
+    while (threadPool.jobsFinished() < 4)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::vector<JobPriority> expected
+        = { PRIORITY_INTERACTIVE, PRIORITY_BATCH, PRIORITY_BACKGROUND };
+    BOOST_CHECK(order == expected);
+
+    auto stats = threadPool.priorityStats(PRIORITY_BATCH);
+    BOOST_CHECK_EQUAL(stats.submitted, 1);
+    BOOST_CHECK_EQUAL(stats.started, 1);
+    BOOST_CHECK_EQUAL(stats.queued, 0);
+    BOOST_CHECK_EQUAL(stats.running, 0);
+    BOOST_CHECK_GE(stats.maxWaitSeconds, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_priority_inherited)
+{
+    ThreadPool threadPool(2);
+
+    std::atomic<int> innerPriority(-1);
+    {
+        JobPriorityScope scope(PRIORITY_BACKGROUND);
+        threadPool.add([&] ()
+                       {
+                           threadPool.add([&] ()
+                                          {
+                                              innerPriority = currentJobPriority();
+                                          });
+                       });
+    }
+    BOOST_CHECK_EQUAL(currentJobPriority(), PRIORITY_INTERACTIVE);
+
+    threadPool.waitForAll();
+    BOOST_CHECK_EQUAL(innerPriority, PRIORITY_BACKGROUND);
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_batch_yields_to_interactive)
+{
+    ThreadPool parent(1);
+    ThreadPool child(parent, 1);
+
+    // A long running batch job that gives up its thread as soon as it's
+    // asked to
+    std::atomic<bool> started(false), yielded(false);
+    {
+        JobPriorityScope scope(PRIORITY_BATCH);
+        child.add([&] ()
+                  {
+                      started = true;
+                      Timer timer;
+                      while (!child.shouldYield()) {
+                          if (timer.elapsed_wall() > 10.0)
+                              return;
+                          std::this_thread::yield();
+                      }
+                      yielded = true;
+                  });
+    }
+    while (!started)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // The parent's only thread is busy with the batch job, but the
+    // interactive job should get it
+    std::atomic<bool> interactiveRan(false);
+    parent.add([&] () { interactiveRan = true; }, PRIORITY_INTERACTIVE);
+
+    Timer timer;
+    while (!interactiveRan && timer.elapsed_wall() < 10.0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    BOOST_CHECK(yielded);
+    BOOST_CHECK(interactiveRan);
+
+    child.waitForAll();
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_cancellation_inherited)
+{
+    ThreadPool threadPool(2);
+
+    auto token = std::make_shared<CancellationToken>();
+    std::atomic<bool> sawCancelled(false);
+    {
+        CancellationScope scope(token.get());
+        token->cancel("test");
+        threadPool.add([&] ()
+                       {
+                           sawCancelled = currentWorkCancelled();
+                       });
+    }
+    BOOST_CHECK(!currentWorkCancelled());
+
+    threadPool.waitForAll();
+    BOOST_CHECK(sawCancelled);
+    BOOST_CHECK_EQUAL(token->reason(), "test");
+}
+
+BOOST_AUTO_TEST_CASE(parallel_map_haltable_cancelled)
+{
+    auto token = std::make_shared<CancellationToken>();
+    CancellationScope scope(token.get());
+
+    std::atomic<size_t> done(0);
+    auto doWork = [&] (size_t i)
+        {
+            if (++done == 100)
+                token->cancel("enough");
+            return true;
+        };
+
+    BOOST_CHECK(!parallelMapHaltable(0, 1000000, doWork));
+    BOOST_CHECK_LT(done, 1000000);
+    BOOST_CHECK(!token->timedOut());
+}
+
+BOOST_AUTO_TEST_CASE(cancellation_timeout)
+{
+    CancellationToken token;
+    token.setTimeout(0.01);
+    BOOST_CHECK(!token.isCancelled());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    BOOST_CHECK(token.isCancelled());
+    BOOST_CHECK(token.timedOut());
+
+    // Cancelling afterwards doesn't change the reason
+    token.cancel("too late");
+    BOOST_CHECK(token.timedOut());
+}
+
 // For the purposes of the tests, we make integers pass
 // for pointers to avoid having to actually run jobs.
 // The value zero is reserved for "no value was available".
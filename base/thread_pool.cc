@@ -9,14 +9,20 @@
 
 #include "thread_pool.h"
 #include "thread_pool_impl.h"
+#include "cancellation.h"
+#include "metrics.h"
 #include "mldb/arch/thread_specific.h"
 #include "mldb/arch/demangle.h"
 #include "mldb/jml/utils/environment.h"
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <vector>
 #include <thread>
 #include <iostream>
+#include <limits>
 
 
 using namespace std;
@@ -32,6 +38,69 @@ int numCpus()
     return NUM_CPUS;
 }
 
+/// Maximum number of threads of the shared pool running batch jobs.  The
+/// default (zero) keeps one thread free for interactive work.
+static EnvOption<int, true /* trace */>
+MLDB_BATCH_THREADS("MLDB_BATCH_THREADS", 0);
+
+/// Maximum number of threads of the shared pool running background jobs.
+/// The default (zero) is half of the threads.
+static EnvOption<int, true /* trace */>
+MLDB_BACKGROUND_THREADS("MLDB_BACKGROUND_THREADS", 0);
+
+
+/*****************************************************************************/
+/* JOB PRIORITY                                                              */
+/*****************************************************************************/
+
+namespace {
+
+__thread JobPriority currentPriority = PRIORITY_INTERACTIVE;
+__thread bool currentAdmitted = false;
+
+/// The pool whose jobs this thread is working through on behalf of its
+/// parent pool, if any (see ThreadPool::shouldYield())
+__thread const void * drainingPool = nullptr;
+
+} // file scope
+
+const char * jobPriorityName(JobPriority priority)
+{
+    switch (priority) {
+    case PRIORITY_INTERACTIVE:  return "interactive";
+    case PRIORITY_BATCH:        return "batch";
+    case PRIORITY_BACKGROUND:   return "background";
+    }
+    return "unknown";
+}
+
+JobPriority currentJobPriority()
+{
+    return currentPriority;
+}
+
+bool currentJobAdmitted()
+{
+    return currentAdmitted;
+}
+
+JobPriorityScope::
+JobPriorityScope(JobPriority priority, bool admitted)
+    : previousPriority(currentPriority),
+      previousAdmitted(currentAdmitted)
+{
+    currentPriority = priority;
+    currentAdmitted = admitted;
+}
+
+JobPriorityScope::
+~JobPriorityScope()
+{
+    currentPriority = previousPriority;
+    currentAdmitted = previousAdmitted;
+}
+
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -51,13 +120,39 @@ int numCpus()
     threads, but not being able to do much itself.  So the ability to
     handle lots of work being submitted by a given thread but not much being
     done by it is important.
+
+    Each thread has one queue per priority class.  When looking for work,
+    a thread considers the classes from the most to the least urgent, and
+    within a class takes from its own queue before stealing.
 */
 
 struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
-    
+
+    /// A job waiting in a queue, with the time it was queued and the
+    /// context of the work that submitted it
+    struct QueuedJob {
+        QueuedJob(ThreadJob job)
+            : job(std::move(job)),
+              queued(std::chrono::steady_clock::now()),
+              admitted(currentJobAdmitted())
+        {
+            if (CancellationToken * token = currentCancellationToken())
+                cancellation = token->shared_from_this();
+        }
+
+        ThreadJob job;
+        std::chrono::steady_clock::time_point queued;
+        bool admitted;   ///< Was the job submitted by admitted work?
+        std::shared_ptr<CancellationToken> cancellation;
+    };
+
+    /// A thread's queues, one per priority class
+    typedef std::array<std::shared_ptr<ThreadQueue<QueuedJob> >,
+                       NUM_JOB_PRIORITIES> JobQueues;
+
     /// A thread's local copy of the list of queues that may have work in
     /// them, including an epoch number.
-    struct Queues: public std::vector<std::shared_ptr<ThreadQueue<ThreadJob> > > {
+    struct Queues: public std::vector<JobQueues> {
         Queues(uint64_t epoch)
             : epoch(epoch)
         {
@@ -72,10 +167,11 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     struct ThreadEntry {
         ThreadEntry(Itl * owner = nullptr, int workerNum = -1)
             : owner(owner), workerNum(workerNum),
-              queue(new ThreadQueue<ThreadJob>()),
               queues(new Queues(0)),
               lastFound(-1)
         {
+            for (auto & q: queue)
+                q.reset(new ThreadQueue<QueuedJob>());
         }
 
         ~ThreadEntry()
@@ -100,11 +196,11 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         /// don't normally scavenge for work to do.
         int workerNum;
 
-        /// Our reference to our work queue.  It's a shared pointer
-        /// because others may continue to reference it even after
+        /// Our reference to our work queues.  They're shared pointers
+        /// because others may continue to reference them even after
         /// our thread has been destroyed, and allowing this avoids
         /// a lot of synchronization and locking.
-        std::shared_ptr<ThreadQueue<ThreadJob> > queue;
+        JobQueues queue;
 
         /// The list of queues that we know about over all threads.
         /// This is a cached copy that we occasionally check to see
@@ -130,6 +226,39 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     /// Statistics counters for debugging and information
     std::atomic<uint64_t> jobsStolen, jobsWithFullQueue, jobsRunLocally;
 
+    /// Counters and limits for one priority class
+    struct PriorityClass {
+        /// Jobs pushed onto a queue and not yet taken off.  This is
+        /// incremented before the push, so that it's never less than the
+        /// real number and a zero means there is no need to look.
+        std::atomic<uint64_t> queued{0};
+
+        /// Jobs being run
+        std::atomic<uint64_t> running{0};
+
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> started{0};
+
+        /// Total and maximum time that started jobs were queued
+        std::atomic<uint64_t> waitMicros{0};
+        std::atomic<uint64_t> maxWaitMicros{0};
+
+        /// Maximum number of pool threads running jobs of this class
+        std::atomic<int> maxThreads{std::numeric_limits<int>::max()};
+
+        /** Is there work of this class waiting that a pool thread would
+            be allowed to take?
+        */
+        bool hasRunnableWork() const
+        {
+            return queued.load(std::memory_order_relaxed) > 0
+                && running.load(std::memory_order_relaxed)
+                   < maxThreads.load(std::memory_order_relaxed);
+        }
+    };
+
+    PriorityClass classes[NUM_JOB_PRIORITIES];
+
     /// Non-zero when we're shutting down.
     std::atomic<int> shutdown;
     
@@ -263,10 +392,80 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         return *threadEntry;
     }
 
+    /** Are there jobs of a more urgent class than the given one which a
+        pool thread could run?
+    */
+    bool hasMoreUrgentWork(JobPriority priority) const
+    {
+        for (int p = 0;  p < priority;  ++p) {
+            if (classes[p].hasRunnableWork())
+                return true;
+        }
+        return false;
+    }
+
+    /** Work through our jobs on a thread of the parent pool, until they
+        run out or the parent has more urgent work for the thread.
+    */
     void runParentWorker()
     {
-        while (!shutdown && (this->work())) ;
+        JobPriority priority = currentJobPriority();
+
+        const void * previous = drainingPool;
+        drainingPool = this;
+
+        bool yielded = false;
+        while (!shutdown) {
+            if (parent->hasMoreUrgentWork(priority)) {
+                yielded = true;
+                break;
+            }
+            if (!this->work())
+                break;
+        }
+
+        drainingPool = previous;
         --this->parentJobs;
+
+        // Make sure that the rest of our work is picked up again by the
+        // parent once the more urgent work is done.
+        if (yielded && !shutdown)
+            addParentJob(priority);
+    }
+
+    /** Ask the parent pool to run a job that works through our jobs, if
+        there aren't enough of those already.
+    */
+    void addParentJob(JobPriority priority)
+    {
+        // If there aren't enough jobs alredy, we submit a new
+        // one.
+        size_t numWereActive = parentJobs.fetch_add(1);
+        if (numWereActive >= maxParentJobs) {
+            --parentJobs;
+            return;
+        }
+
+        // Get a weak pointer to ourself so that we can know
+        // if we're still alive or not.
+        auto weakThis = std::weak_ptr<Itl>(this->shared_from_this());
+
+        auto parentJob = [weakThis] ()
+            {
+                // GCC 4.8 uses a try/catch to implement lock()
+                // we avoid logging an exception message here
+                // by trying first, and then disabling exceptions.
+                if (weakThis.expired())
+                    return;
+                MLDB_TRACE_EXCEPTIONS(false);
+                auto strongThis = weakThis.lock();
+                if (strongThis)
+                    strongThis->runParentWorker();
+            };
+
+        if (!weakThis.expired())
+            parent->add(parentJob, priority);
+        else --parentJobs;
     }
 
     /** Add a new job to be run.  This is lock-free except for the very
@@ -277,42 +476,23 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         immediately to make forward progress and give time to the rest of
         the system to clear out some work from the queue.
     */
-    void add(ThreadJob job)
+    void add(ThreadJob job, JobPriority priority)
     {
+        ExcAssertGreaterEqual(priority, 0);
+        ExcAssertLess(priority, NUM_JOB_PRIORITIES);
+
+        PriorityClass & cls = classes[priority];
+
         submitted += 1;
+        cls.submitted += 1;
+        cls.queued += 1;
 
-        std::unique_ptr<ThreadJob> overflow
-            (getEntry().queue->push(new ThreadJob(std::move(job))));
+        std::unique_ptr<QueuedJob> overflow
+            (getEntry().queue[priority]->push(new QueuedJob(std::move(job))));
 
         if (!overflow) {
             if (parent) {
-                // If there aren't enough jobs alredy, we submit a new
-                // one.
-                size_t numWereActive = parentJobs.fetch_add(1);
-                if (numWereActive >= maxParentJobs) {
-                    --parentJobs;
-                }
-                else {
-                    // Get a weak pointer to ourself so that we can know
-                    // if we're still alive or not.
-                    auto weakThis = std::weak_ptr<Itl>(this->shared_from_this());
-
-                    auto parentJob = [weakThis] ()
-                        {
-                            // GCC 4.8 uses a try/catch to implement lock()
-                            // we avoid logging an exception message here
-                            // by trying first, and then disabling exceptions.
-                            if (weakThis.expired())
-                                return;
-                            MLDB_TRACE_EXCEPTIONS(false);
-                            auto strongThis = weakThis.lock();
-                            if (strongThis)
-                                strongThis->runParentWorker();
-                        };
-
-                    if (!weakThis.expired())
-                        parent->add(parentJob);
-                }
+                addParentJob(priority);
             }
             else {
                 // There is a possible race condition here: if we add this
@@ -328,37 +508,54 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         else {
             // The queue was full.  Do the work here, hopefully someone
             // will steal some work in the meantime.
+            cls.queued -= 1;
             ++jobsWithFullQueue;
-            runJob(*overflow);
+            runJob(*overflow, priority);
         }
     }
 
-    /** Runs as much work as possible in this thread's queue.  Returns
-        true if some work was obtained.
+    /** Runs as much work as possible in this thread's queues, the most
+        urgent first.  Returns true if some work was obtained.
     */
     bool runMine(ThreadEntry & entry)
     {
         bool result = false;
 
-        // First, do all of our work
-        ThreadJob * job;
-        while ((job = entry.queue->pop())) {
-            result = true;
-            ++jobsRunLocally;
-            runJob(*job);
-            delete job;
+        for (int p = 0;  p < NUM_JOB_PRIORITIES;  ++p) {
+            QueuedJob * job;
+            while ((job = entry.queue[p]->pop())) {
+                classes[p].queued -= 1;
+                result = true;
+                ++jobsRunLocally;
+                std::unique_ptr<QueuedJob> owned(job);
+                runJob(*job, (JobPriority)p);
+            }
         }
         
         return result;
     }
 
-    /** Steal one bit of work from another thread and run it.  Returns
-        true if some work was obtained.
+    /** Take a job of the given priority, from this thread's queue if
+        possible and otherwise by stealing it from another thread.  Returns
+        null if none was found.
     */
-    bool stealWork(ThreadEntry & entry)
+    QueuedJob * takeJob(ThreadEntry & entry, JobPriority priority)
+    {
+        QueuedJob * job = entry.queue[priority]->pop();
+        if (job)
+            ++jobsRunLocally;
+        else job = stealJob(entry, priority);
+
+        if (job)
+            classes[priority].queued -= 1;
+        return job;
+    }
+
+    /** Steal one job of the given priority from another thread.  Returns
+        null if none was found.
+    */
+    QueuedJob * stealJob(ThreadEntry & entry, JobPriority priority)
     {
-        bool foundWork = false;
-        
         // Check if we have the latest list of queues, by looking at
         // the epoch number.
         if (threadCreationEpoch.load() != entry.queues->epoch) {
@@ -378,49 +575,72 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
             }
         }
 
-        auto stealFrom = [&] (int n)
-            {
-                const std::shared_ptr<ThreadQueue<ThreadJob> > & q
-                    = entry.queues->at(n);
-                
-                ThreadJob * job;
-                while ((job = q->steal())) {
-                    entry.lastFound = n;
-
-                    ++jobsStolen;
-
-                    runJob(*job);
-                    foundWork = true;
-                    delete job;
-                    runMine(entry);
-                }
-            };
-
         size_t nq = entry.queues->size();
 
-        if (entry.lastFound > 0 && entry.lastFound < nq) {
-            stealFrom(entry.lastFound);
-        }
-
         for (unsigned i = 0;  i < nq && !shutdown;  ++i) {
             // Try to avoid all threads starting looking for work at the
-            // same place.
+            // same place, and start with where we last found some.
             int n = entry.lastFound + i;
             while (n < 0)
                 n += nq;
             while (n >= nq)
                 n -= nq;
-            stealFrom(n);
+
+            QueuedJob * job = entry.queues->at(n)[priority]->steal();
+            if (job) {
+                entry.lastFound = n;
+                ++jobsStolen;
+                return job;
+            }
         }
         
-        return foundWork;
+        return nullptr;
+    }
+
+    /** Find the most urgent job available to this thread and run it.  If
+        limited is true, classes which have reached their limit of threads
+        are skipped.  Returns true if a job was run.
+    */
+    bool runOne(ThreadEntry & entry, bool limited)
+    {
+        for (int p = 0;  p < NUM_JOB_PRIORITIES && !shutdown;  ++p) {
+            PriorityClass & cls = classes[p];
+            if (limited ? !cls.hasRunnableWork()
+                : cls.queued.load(std::memory_order_relaxed) == 0)
+                continue;
+
+            std::unique_ptr<QueuedJob> job(takeJob(entry, (JobPriority)p));
+            if (job) {
+                runJob(*job, (JobPriority)p);
+                return true;
+            }
+        }
+
+        return false;
     }
 
     /** Run a job we successfully dequeued from a queue somewhere. */
-    void runJob(const ThreadJob & job)
+    void runJob(const QueuedJob & queuedJob, JobPriority priority)
     {
+        PriorityClass & cls = classes[priority];
+
+        uint64_t waitMicros
+            = std::chrono::duration_cast<std::chrono::microseconds>
+            (std::chrono::steady_clock::now() - queuedJob.queued).count();
+        cls.started += 1;
+        cls.waitMicros += waitMicros;
+        uint64_t maxWait = cls.maxWaitMicros.load();
+        while (waitMicros > maxWait
+               && !cls.maxWaitMicros.compare_exchange_weak(maxWait, waitMicros)) ;
+
+        const ThreadJob & job = queuedJob.job;
+        JobPriorityScope scope(priority, queuedJob.admitted);
+        CancellationScope cancellationScope(queuedJob.cancellation.get());
+
+        cls.running += 1;
         try {
             job();
+            cls.running -= 1;
             finished += 1;
         } catch (const std::exception & exc) {
             finished += 1;
@@ -453,8 +673,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
         while (!shutdown && jobsRunning() > 0) {
             //cerr << "jobsRunning() = " << jobsRunning() << endl;
-            if (!runMine(entry))
-                stealWork(entry);
+            runOne(entry, false /* limited */);
             //std::this_thread::sleep_for(std::chrono::milliseconds(10));
         }
     }
@@ -465,11 +684,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     bool work()
     {
         ThreadEntry & entry = getEntry();
-
-        bool result;
-        if (!(result = runMine(entry)))
-            result = stealWork(entry);
-        return result;
+        return runOne(entry, false /* limited */);
     }
 
     /** Run a worker thread. */
@@ -480,58 +695,55 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         int itersWithNoWork = 0;
 
         while (!shutdown) {
-            if (!runMine(entry)) {
-                if (!stealWork(entry)) {
-                    // Nothing to do, for now.  Wait for something to
-                    // wake us up.  We try 10 times, and if there is
-                    // nothing to do then we go to sleep and wait for
-                    // some more work to come.
-                    ++itersWithNoWork;
-
-                    // Look for when we're idle, and if we are just sleep
-                    // MLDB-1538
-                    uint32_t s = submitted.load(std::memory_order_relaxed);
-                    uint32_t f = finished.load(std::memory_order_relaxed);
-
-                    if (s == f) {
-                        // We're idle.  No need to look for a job; we almost
-                        // certainly won't find one.
-                        ++threadsSleeping;
-                        std::unique_lock<std::mutex> guard(wakeupMutex);
-
-                        // We can't sleep forever, since we allow for
-                        // wakeups to be missed for efficiency reasons,
-                        // and so we need to poll every now and again.
-                        wakeupCv.wait_for(guard, std::chrono::milliseconds(250));
-
-                        --threadsSleeping;
-                        itersWithNoWork = 0;
-                    }
-
-                    if (itersWithNoWork == 10) {
-                        ++threadsSleeping;
-                        std::unique_lock<std::mutex> guard(wakeupMutex);
-
-                        // We can't sleep forever, since we allow for
-                        // wakeups to be missed for efficiency reasons,
-                        // and so we need to poll every now and again.
-                        wakeupCv.wait_for(guard, std::chrono::milliseconds(10));
-
-                        --threadsSleeping;
-                        itersWithNoWork = 0;
-                    }
-                    else {
-                        // We didn't find any work, but it's not yet time
-                        // to give up on it.  We wait a small amount of
-                        // time and try again.
-                        std::this_thread::yield();
-                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                    }
-                } else {
+            // Only take jobs of classes that haven't reached their limit
+            // of threads
+            if (!runOne(entry, true /* limited */)) {
+                // Nothing to do, for now.  Wait for something to
+                // wake us up.  We try 10 times, and if there is
+                // nothing to do then we go to sleep and wait for
+                // some more work to come.
+                ++itersWithNoWork;
+
+                // Look for when we're idle, and if we are just sleep
+                // MLDB-1538
+                uint32_t s = submitted.load(std::memory_order_relaxed);
+                uint32_t f = finished.load(std::memory_order_relaxed);
+
+                if (s == f) {
+                    // We're idle.  No need to look for a job; we almost
+                    // certainly won't find one.
+                    ++threadsSleeping;
+                    std::unique_lock<std::mutex> guard(wakeupMutex);
+
+                    // We can't sleep forever, since we allow for
+                    // wakeups to be missed for efficiency reasons,
+                    // and so we need to poll every now and again.
+                    wakeupCv.wait_for(guard, std::chrono::milliseconds(250));
+
+                    --threadsSleeping;
                     itersWithNoWork = 0;
                 }
-            }
-            else {
+
+                if (itersWithNoWork == 10) {
+                    ++threadsSleeping;
+                    std::unique_lock<std::mutex> guard(wakeupMutex);
+
+                    // We can't sleep forever, since we allow for
+                    // wakeups to be missed for efficiency reasons,
+                    // and so we need to poll every now and again.
+                    wakeupCv.wait_for(guard, std::chrono::milliseconds(10));
+
+                    --threadsSleeping;
+                    itersWithNoWork = 0;
+                }
+                else {
+                    // We didn't find any work, but it's not yet time
+                    // to give up on it.  We wait a small amount of
+                    // time and try again.
+                    std::this_thread::yield();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            } else {
                 itersWithNoWork = 0;
             }
         }
@@ -614,9 +826,13 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         cerr << "sleeping " << threadsSleeping << endl;
         cerr << "epoch " << threadCreationEpoch << endl;
         cerr << queues->size() << " queues" << endl;
-        for (auto & q: *queues) {
-            cerr << "  queue with " << q->num_queued_ << " bottom " << q->bottom_
-                 << " top " << q->top_ << endl;
+        for (auto & qs: *queues) {
+            for (int p = 0;  p < NUM_JOB_PRIORITIES;  ++p) {
+                auto & q = qs[p];
+                cerr << "  " << jobPriorityName((JobPriority)p)
+                     << " queue with " << q->num_queued_ << " bottom " << q->bottom_
+                     << " top " << q->top_ << endl;
+            }
         }
     }
 };
@@ -641,9 +857,9 @@ ThreadPool::
 
 void
 ThreadPool::
-add(ThreadJob job)
+add(ThreadJob job, JobPriority priority)
 {
-    itl->add(std::move(job));
+    itl->add(std::move(job), priority);
 }
 
 void
@@ -709,11 +925,147 @@ jobsRunLocally() const
     return itl->jobsRunLocally;
 }
 
+bool
+ThreadPool::
+shouldYield() const
+{
+    if (drainingPool != itl.get())
+        return false;
+    return itl->parent->hasMoreUrgentWork(currentJobPriority());
+}
+
+void
+ThreadPool::
+setMaxThreads(JobPriority priority, int maxThreads)
+{
+    ExcAssertGreaterEqual(priority, 0);
+    ExcAssertLess(priority, NUM_JOB_PRIORITIES);
+    ExcAssertGreater(maxThreads, 0);
+    itl->classes[priority].maxThreads = maxThreads;
+}
+
+ThreadPool::PriorityStats
+ThreadPool::
+priorityStats(JobPriority priority) const
+{
+    ExcAssertGreaterEqual(priority, 0);
+    ExcAssertLess(priority, NUM_JOB_PRIORITIES);
+    const auto & cls = itl->classes[priority];
+
+    PriorityStats result;
+    result.submitted = cls.submitted;
+    result.started = cls.started;
+    result.queued = cls.queued;
+    result.running = cls.running;
+    result.maxThreads = cls.maxThreads;
+    result.totalWaitSeconds = cls.waitMicros / 1000000.0;
+    result.maxWaitSeconds = cls.maxWaitMicros / 1000000.0;
+    return result;
+}
+
+namespace {
+
+/** Export the statistics of the shared thread pool through the metrics
+    registry.
+*/
+void registerThreadPoolMetrics(const ThreadPool & pool)
+{
+    auto & registry = MetricsRegistry::instance();
+
+    auto addCounter = [&] (const char * name, const char * help,
+                           uint64_t (ThreadPool::* read) () const)
+        {
+            registry.addCallback(name, help, MetricsRegistry::COUNTER,
+                                 [&pool,read] () { return (pool.*read)(); });
+        };
+
+    registry.addCallback("mldb_thread_pool_threads",
+                         "Threads in the shared thread pool",
+                         MetricsRegistry::GAUGE,
+                         [&pool] () { return pool.numThreads(); });
+    registry.addCallback("mldb_thread_pool_jobs_running",
+                         "Jobs running in the shared thread pool",
+                         MetricsRegistry::GAUGE,
+                         [&pool] () { return pool.jobsRunning(); });
+    addCounter("mldb_thread_pool_jobs_submitted_total",
+               "Jobs submitted to the shared thread pool",
+               &ThreadPool::jobsSubmitted);
+    addCounter("mldb_thread_pool_jobs_finished_total",
+               "Jobs finished by the shared thread pool",
+               &ThreadPool::jobsFinished);
+    addCounter("mldb_thread_pool_jobs_stolen_total",
+               "Jobs taken from the queue of another thread",
+               &ThreadPool::jobsStolen);
+    addCounter("mldb_thread_pool_jobs_with_full_queue_total",
+               "Jobs run immediately as their thread's queue was full",
+               &ThreadPool::jobsWithFullQueue);
+    addCounter("mldb_thread_pool_jobs_run_locally_total",
+               "Jobs run by the thread that submitted them",
+               &ThreadPool::jobsRunLocally);
+
+    for (int p = 0;  p < NUM_JOB_PRIORITIES;  ++p) {
+        JobPriority priority = (JobPriority)p;
+        std::string labels
+            = std::string("priority=\"") + jobPriorityName(priority) + "\"";
+        registry.addCallback("mldb_thread_pool_queued_jobs",
+                             "Jobs waiting in the queues of the shared "
+                             "thread pool, by priority class",
+                             MetricsRegistry::GAUGE,
+                             [&pool,priority] ()
+                             {
+                                 return pool.priorityStats(priority).queued;
+                             },
+                             labels);
+        registry.addCallback("mldb_thread_pool_running_jobs",
+                             "Jobs running in the shared thread pool, "
+                             "by priority class",
+                             MetricsRegistry::GAUGE,
+                             [&pool,priority] ()
+                             {
+                                 return pool.priorityStats(priority).running;
+                             },
+                             labels);
+        registry.addCallback("mldb_thread_pool_wait_seconds_total",
+                             "Time spent by jobs waiting in the queues of "
+                             "the shared thread pool, by priority class",
+                             MetricsRegistry::COUNTER,
+                             [&pool,priority] ()
+                             {
+                                 return pool.priorityStats(priority)
+                                     .totalWaitSeconds;
+                             },
+                             labels);
+    }
+}
+
+/** Limit the threads of the shared pool that batch and background work
+    may use, so that there are always some left for interactive work.
+    Private pools belong to a single task, and aren't limited.
+*/
+void setSharedPoolLimits(ThreadPool & pool)
+{
+    int numThreads = pool.numThreads();
+    int batchThreads = MLDB_BATCH_THREADS;
+    if (batchThreads <= 0)
+        batchThreads = std::max(numThreads - 1, 1);
+    int backgroundThreads = MLDB_BACKGROUND_THREADS;
+    if (backgroundThreads <= 0)
+        backgroundThreads = std::max(numThreads / 2, 1);
+    pool.setMaxThreads(PRIORITY_BATCH, batchThreads);
+    pool.setMaxThreads(PRIORITY_BACKGROUND, backgroundThreads);
+}
+
+} // file scope
+
 ThreadPool &
 ThreadPool::
 instance()
 {
     static ThreadPool result(numCpus());
+    static bool initialized
+        = (setSharedPoolLimits(result), registerThreadPoolMetrics(result),
+           true);
+    (void)initialized;
     return result;
 }
 
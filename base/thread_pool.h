@@ -21,6 +21,57 @@ typedef std::function<void () noexcept> ThreadJob;
 int numCpus();
 
 
+/*****************************************************************************/
+/* JOB PRIORITY                                                              */
+/*****************************************************************************/
+
+/** Priority class of a job.  Threads in a pool always take queued jobs of
+    a more urgent class before those of a less urgent one, and the number
+    of pool threads working on each class may be limited.
+
+    The priority is carried with each job: a job runs with the priority it
+    was submitted with, and any jobs that it submits in turn (for example
+    via parallelMap) inherit it.
+*/
+enum JobPriority {
+    PRIORITY_INTERACTIVE = 0,  ///< Latency sensitive, eg REST function calls
+    PRIORITY_BATCH = 1,        ///< Throughput oriented, eg queries
+    PRIORITY_BACKGROUND = 2    ///< Can wait, eg asynchronous procedures
+};
+
+constexpr int NUM_JOB_PRIORITIES = 3;
+
+/** Return the name of the priority class ("interactive", "batch" or
+    "background").
+*/
+const char * jobPriorityName(JobPriority priority);
+
+/** Return the priority of the work being done by the calling thread.
+    Threads which have never set one are interactive.
+*/
+JobPriority currentJobPriority();
+
+/** Return true if the calling thread is working on behalf of a task that
+    was already admitted to run (for example by the server's admission
+    control), so that the work it does or hands to other threads doesn't
+    need to be admitted again.  Like the priority, this is carried with
+    jobs.
+*/
+bool currentJobAdmitted();
+
+/** Sets the priority of the work done by the calling thread, and whether
+    it was admitted, for the lifetime of the object.
+*/
+struct JobPriorityScope {
+    JobPriorityScope(JobPriority priority,
+                     bool admitted = currentJobAdmitted());
+    ~JobPriorityScope();
+
+    JobPriority previousPriority;
+    bool previousAdmitted;
+};
+
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -50,8 +101,11 @@ struct ThreadPool {
 
         If this function returns, the job WILL be eventually run, or has
         already been run.
+
+        The job is queued with the given priority, which defaults to that
+        of the calling thread.
     */
-    void add(ThreadJob job);
+    void add(ThreadJob job, JobPriority priority = currentJobPriority());
 
     void waitForAll() const;
 
@@ -67,6 +121,36 @@ struct ThreadPool {
     uint64_t jobsWithFullQueue() const;
     uint64_t jobsRunLocally() const;
 
+    /** Returns true if the calling thread is one of the parent pool's
+        threads working through this pool's jobs, and jobs of a more urgent
+        class than the current one are waiting in the parent pool.
+
+        A long-running job of a pool created by parallelMap() can test this
+        between units of work; if it's true, it should add() a job to
+        finish its work and return so that the thread can be given to the
+        more urgent work.
+    */
+    bool shouldYield() const;
+
+    /** Limit the number of this pool's threads which may be running jobs
+        of the given priority at once.  Threads which are waiting for their
+        own jobs to finish are not limited.
+    */
+    void setMaxThreads(JobPriority priority, int maxThreads);
+
+    /// Statistics for the jobs of one priority class
+    struct PriorityStats {
+        uint64_t submitted = 0;    ///< Jobs added
+        uint64_t started = 0;      ///< Jobs taken from a queue to run
+        uint64_t queued = 0;       ///< Jobs currently waiting in a queue
+        uint64_t running = 0;      ///< Jobs currently running
+        int maxThreads = 0;        ///< Limit of pool threads for the class
+        double totalWaitSeconds = 0.0;  ///< Time started jobs were queued
+        double maxWaitSeconds = 0.0;    ///< Longest time a job was queued
+    };
+
+    PriorityStats priorityStats(JobPriority priority) const;
+
     static ThreadPool & instance();
     
 private:
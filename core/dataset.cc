@@ -24,6 +24,7 @@
 #include "mldb/jml/utils/environment.h"
 #include "mldb/ml/jml/buckets.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/rest/rest_request_router.h"
@@ -906,7 +907,8 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
                            const std::shared_ptr<SqlExpression> rowName,
                            ssize_t offset,
                            ssize_t limit,
-                           Utf8String alias) const
+                           Utf8String alias,
+                           const ProgressFunc & onProgress) const
 {
     if (!having->isConstantTrue() && groupBy.clauses.empty())
         throw HttpReturnException
@@ -931,12 +933,13 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
                 return onRow(path, row);
             };
 
-        iterateDatasetExpr(select, *this, alias, when, where,
+        // Rows are passed on in order from a single thread, so that
+        // the caller can stream them
+        return iterateDatasetExpr(select, *this, alias, when, where,
                                   { rowName->shallowCopy() },
-                                  { processor, true /*processInParallel*/ },
+                                  { processor, false /*processInParallel*/ },
                                   orderBy, offset, limit,
-                                  nullptr);
-        return true;
+                                  onProgress).first;
     }
     else {
 
@@ -955,13 +958,11 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
             };
 
          //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
-        iterateDatasetGrouped(select, *this, alias, when, where,
+        return iterateDatasetGrouped(select, *this, alias, when, where,
                                      groupBy, aggregators, *having, *rowName,
-                                     {processor, true/*processInParallel*/},
+                                     {processor, false/*processInParallel*/},
                                      orderBy, offset, limit,
-                                     nullptr);
-
-        return true;
+                                     onProgress).first;
     }
 }
 
@@ -1763,6 +1764,9 @@ generateRowsWhere(const SqlBindingScope & scope,
                                 
                                 ++rowCount;
                                 if (rowCount % PROGRESS_RATE == 0) {
+                                    if (currentWorkCancelled()) {
+                                        throw CancellationException("rows generation was cancelled");
+                                    }
                                     if (onProgress) {
                                         whereProgress = rowCount;
                                         if (!onProgress(whereProgress)) {
@@ -1920,6 +1924,8 @@ generateRowsWhere(const SqlBindingScope & scope,
                         ++rowCount;
 
                         if (rowCount % PROGRESS_RATE == 0) {
+                            if (currentWorkCancelled())
+                                return false;
                             if (onProgress) {
                                 whereProgress = rowCount;
                                 if (!onProgress(whereProgress)) {
@@ -2179,7 +2185,7 @@ queryBasic(const SqlBindingScope & scope,
             }
         };
 
-    return { exec };
+    return { exec, rowGenerator.explain.rawString() };
 }
 
 RestRequestMatchResult
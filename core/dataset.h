@@ -544,7 +544,12 @@ struct Dataset: public MldbEntity {
                         Utf8String alias = "",
                         const ProgressFunc & onProgress = nullptr) const;
 
-    /** Select from the database. */
+    /** Select from the database, passing each row to onRow as it is
+        produced instead of accumulating them.  The onRow calls are made
+        sequentially and in output order, so the caller can stream the
+        rows out directly.  Stops as soon as onRow returns false; the
+        return value is false in that case, and true otherwise.
+    */
     virtual bool
     queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
                                const SelectExpression & select,
@@ -556,7 +561,8 @@ struct Dataset: public MldbEntity {
                                const std::shared_ptr<SqlExpression> rowName,
                                ssize_t offset,
                                ssize_t limit,
-                               Utf8String alias = "") const;
+                               Utf8String alias = "",
+                               const ProgressFunc & onProgress = nullptr) const;
 
     /** Select from the database. */
     virtual std::vector<MatrixNamedRow>
@@ -101,6 +101,16 @@ apply(const ExpressionValue & input) const
     return function->apply(*this, input);
 }
 
+std::vector<ExpressionValue>
+FunctionApplier::
+applyBatch(const std::vector<ExpressionValue> & inputs) const
+{
+    ExcAssert(function);
+    std::vector<ExpressionValue> result = function->applyBatch(*this, inputs);
+    ExcAssertEqual(result.size(), inputs.size());
+    return result;
+}
+
 
 /*****************************************************************************/
 /* FUNCTION                                                                  */
@@ -132,6 +142,25 @@ getDetails() const
     return Any();
 }
 
+std::vector<ExpressionValue>
+Function::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+    for (auto & input: inputs)
+        result.emplace_back(apply(applier, input));
+    return result;
+}
+
+bool
+Function::
+supportsBatch() const
+{
+    return false;
+}
+
 std::unique_ptr<FunctionApplier>
 Function::
 bind(SqlBindingScope & outerContext,
@@ -116,6 +116,11 @@ struct FunctionApplier {
 
     /// Apply the function to the given context
     ExpressionValue apply(const ExpressionValue & input) const;
+
+    /// Apply the function to many inputs at once, returning one output
+    /// per input in the same order
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<ExpressionValue> & inputs) const;
 };
 
 
@@ -206,6 +211,25 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Used by the FunctionApplier to apply the function to a batch of
+        inputs, for example the rows of a block of a dataset being scanned
+        by a query.  Functions that can process many inputs more cheaply
+        than one at a time (eg, with a matrix multiplication) should
+        override.  The default calls apply() for each input.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
+    /** Does applyBatch() do better than applying the function to each
+        input in turn?  Queries only pass batches of rows to functions
+        that do, as the default implementation runs the batch on a single
+        thread and would lose the parallelism over rows.  Functions that
+        override applyBatch() should override this to return true.
+        Default returns false.
+    */
+    virtual bool supportsBatch() const;
+
     friend class FunctionApplier;
 };
 
@@ -13,12 +13,14 @@
 #include "mldb/types/basic_value_descriptions.h"
 #include <mutex>
 #include "mldb/server/mldb_server.h"
+#include "mldb/server/admission_control.h"
 #include "mldb/core/dataset.h"
 #include "mldb/core/plugin.h"
 #include "mldb/core/function.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/rest/cancellation_exception.h"
 #include "mldb/utils/progress.h"
+#include "mldb/base/metrics.h"
 
 
 using namespace std;
@@ -63,13 +65,46 @@ ProcedureRunStatusDescription()
              "Timestamp at which the run finished");
 }
 
+namespace {
+
+/** Record a procedure run in the metrics, labelled by procedure type.
+    Runs are coarse enough that looking up the metrics each time is
+    not a problem.
+*/
+void recordRun(const Procedure * owner, double seconds, bool succeeded)
+{
+    std::string type = owner->config_
+        ? owner->config_->type.rawString() : std::string("unknown");
+    std::string labels = "type=\"" + type + "\"";
+
+    auto & registry = MetricsRegistry::instance();
+    registry.counter("mldb_procedure_runs_total",
+                     "Procedure runs, by procedure type", labels).inc();
+    if (!succeeded) {
+        registry.counter("mldb_procedure_run_errors_total",
+                         "Procedure runs that failed, by procedure type",
+                         labels).inc();
+    }
+    registry.histogram("mldb_procedure_run_seconds",
+                       "Time taken by procedure runs, by procedure type",
+                       labels).record(seconds);
+}
+
+} // file scope
+
 ProcedureRun::
 ProcedureRun(Procedure * owner,
              ProcedureRunConfig config,
              const std::function<bool (const Json::Value & progress)> & onProgress)
 {
-    runStarted = Date::now();
     ExcAssert(owner);
+
+    // Procedures are at least batch work, and may need to wait their turn
+    JobPriority priority = std::max(currentJobPriority(), PRIORITY_BATCH);
+    auto ticket = owner->server->admission->admit(priority, "procedure run");
+    JobPriorityScope priorityScope(priority, true /* admitted */);
+
+    runStarted = Date::now();
     this->config.reset(new ProcedureRunConfig(std::move(config)));
     try {
         RunOutput output = owner->run(*this->config, onProgress);
@@ -77,9 +112,13 @@ ProcedureRun(Procedure * owner,
         this->details = std::move(output.details);
     } catch (...) {
         runFinished = Date::now();
+        recordRun(owner, runFinished.secondsSince(runStarted),
+                  false /* succeeded */);
         throw;
     }
     runFinished = Date::now();
+    recordRun(owner, runFinished.secondsSince(runStarted),
+              true /* succeeded */);
 }
 
 DEFINE_STRUCTURE_DESCRIPTION(ProcedureRun);
@@ -7,6 +7,7 @@
 #include "value_function.h"
 #include "mldb/types/value_description.h"
 #include "mldb/types/meta_value_description.h"
+#include <algorithm>
 #include <unordered_map>
 
 
@@ -36,6 +37,21 @@ ValueFunction(MldbServer * server,
         = toValueInfo(this->inputDescription);
     std::tie(outputInfo, std::ignore, toOutput)
         = toValueInfo(this->outputDescription);
+
+    if (this->inputDescription->kind == ValueKind::STRUCTURE) {
+        auto onField = [&] (const ValueDescription::FieldDescription & field)
+            {
+                InputSlot slot;
+                slot.name = PathElement(field.fieldName);
+                slot.offset = field.offset;
+                std::tie(std::ignore, slot.fromInput, std::ignore)
+                    = toValueInfo(field.description);
+                inputSlots.emplace_back(std::move(slot));
+            };
+
+        this->inputDescription->forEachField(nullptr /* no object */,
+                                             onField);
+    }
 }
     
 Any
@@ -45,6 +61,71 @@ getStatus() const
     return Any();
 }
 
+ValueFunction::InputBinding
+ValueFunction::
+bindInput(const std::vector<std::shared_ptr<ExpressionValueInfo> > & input)
+    const
+{
+    InputBinding result;
+    if (inputSlots.empty() || input.size() != 1 || !input[0]
+        || !input[0]->isRow())
+        return result;
+
+    for (auto & column: input[0]->getKnownColumns()) {
+        if (column.columnName.size() != 1)
+            return InputBinding();
+        PathElement name = column.columnName[0];
+
+        auto it = std::find_if(inputSlots.begin(), inputSlots.end(),
+                               [&] (const InputSlot & slot)
+                               {
+                                   return slot.name == name;
+                               });
+        if (it == inputSlots.end())
+            return InputBinding();
+
+        result.columns.emplace_back(std::move(name));
+        result.slots.push_back(it - inputSlots.begin());
+    }
+
+    return result;
+}
+
+bool
+ValueFunction::
+fromBoundInput(void * obj, const ExpressionValue & input,
+               const InputBinding & binding) const
+{
+    if (!input.isRow())
+        return false;
+
+    struct State {
+        const ValueFunction * function;
+        const InputBinding * binding;
+        char * obj;
+        size_t column;
+    } state { this, &binding, (char *)obj, 0 };
+
+    // Only a pointer is captured, so that wrapping the lambda in a
+    // std::function doesn't allocate
+    State * s = &state;
+
+    auto onColumn = [s] (const PathElement & columnName,
+                         const ExpressionValue & val)
+        {
+            if (s->column == s->binding->columns.size()
+                || columnName != s->binding->columns[s->column])
+                return false;
+            const InputSlot & slot
+                = s->function->inputSlots[s->binding->slots[s->column++]];
+            slot.fromInput(s->obj + slot.offset, val);
+            return true;
+        };
+
+    return input.forEachColumn(onColumn)
+        && state.column == binding.columns.size();
+}
+
 FunctionInfo
 ValueFunction::
 getFunctionInfo() const
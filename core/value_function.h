@@ -73,6 +73,44 @@ struct ValueFunction: public Function {
     /// Function that does the conversion from binary -> ExpressionValue for
     /// the function's return type.
     ToOutput toOutput;
+
+    /** One field of the input structure, laid out flat when the function
+        is constructed so that calls don't need to look it up by name.
+    */
+    struct InputSlot {
+        PathElement name;     ///< Name of the column that sets the field
+        int offset;           ///< Offset of the field within the structure
+        FromInput fromInput;  ///< Converts the column's value for the field
+    };
+
+    /// Fields of the input structure; empty if the input isn't a structure
+    std::vector<InputSlot> inputSlots;
+
+    /** Input columns of a bound function, resolved at bind time into the
+        slots that they set.  A call whose input has the same columns in
+        the same order, which is normal for calls made from a given SQL
+        expression, can then set the fields by position.
+    */
+    struct InputBinding {
+        std::vector<PathElement> columns;  ///< Bound columns, in order
+        std::vector<int> slots;            ///< Input slot of each column
+    };
+
+    /** Resolve the columns of the input that the function is bound with
+        into input slots.  The binding is empty, and calls go through
+        fromInput, unless all of the columns are known and have a slot.
+    */
+    InputBinding
+    bindInput(const std::vector<std::shared_ptr<ExpressionValueInfo> > & input)
+        const;
+
+    /** Convert the input into its binary representation by position,
+        using a binding returned by bindInput().  Returns false if the
+        input doesn't have the columns of the binding, in which case obj
+        may have been partly written and fromInput must be used instead.
+    */
+    bool fromBoundInput(void * obj, const ExpressionValue & input,
+                        const InputBinding & binding) const;
     
     /// Since we know the input and output types, we can provide a default
     /// implementation of this function.
@@ -98,6 +136,9 @@ struct FunctionApplierT: public FunctionApplier {
     virtual ~FunctionApplierT()
     {
     }
+
+    /// Input columns resolved at bind time; see ValueFunction::bindInput()
+    ValueFunction::InputBinding inputBinding;
 };
 
 
@@ -154,6 +195,20 @@ struct ValueFunctionT: public ValueFunction {
     {
         return call(std::move(input));
     }
+
+    /** Batch interface, for functions that can process many inputs more
+        efficiently together than one at a time.  Default calls applyT()
+        for each input.
+    */
+    virtual std::vector<Output> applyBatchT(const ApplierT & applier,
+                                            std::vector<Input> inputs) const
+    {
+        std::vector<Output> result;
+        result.reserve(inputs.size());
+        for (auto & input: inputs)
+            result.emplace_back(applyT(applier, std::move(input)));
+        return result;
+    }
     
     virtual std::unique_ptr<Applier>
     bindT(SqlBindingScope & outerContext,
@@ -164,6 +219,7 @@ struct ValueFunctionT: public ValueFunction {
         result->info = getFunctionInfo();
         result->info.checkInputCompatibility(input);
         result->info.deterministic = config_->deterministic;
+        result->inputBinding = bindInput(input);
         return result;
     }
 
@@ -188,7 +244,7 @@ private:
 
         // Convert the input from an ExpressionValue to its real type
         Input in;
-        fromInput(&in, context);
+        convertInput(in, context, downcast->inputBinding);
 
         // Apply the function with the proper types
         Output out = applyT(*downcast, std::move(in));
@@ -197,6 +253,47 @@ private:
         return toOutput(&out);
     }
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override
+    {
+        const auto * downcast
+            = dynamic_cast<const Applier *>(&applier);
+        if (!downcast) {
+            throw HttpReturnException(500, "Couldn't downcast applier");
+        }
+
+        std::vector<Input> in(inputs.size());
+        for (size_t i = 0;  i < inputs.size();  ++i)
+            convertInput(in[i], inputs[i], downcast->inputBinding);
+
+        std::vector<Output> out = applyBatchT(*downcast, std::move(in));
+        if (out.size() != inputs.size())
+            throw HttpReturnException(500, "Function batch returned the "
+                                      "wrong number of outputs");
+
+        std::vector<ExpressionValue> result;
+        result.reserve(out.size());
+        for (auto & o: out)
+            result.emplace_back(toOutput(&o));
+        return result;
+    }
+
+    /** Convert the input into a default constructed Input, by position
+        if it has the columns of the binding.
+    */
+    void convertInput(Input & in, const ExpressionValue & input,
+                      const InputBinding & binding) const
+    {
+        if (binding.slots.empty()) {
+            fromInput(&in, input);
+        }
+        else if (!fromBoundInput(&in, input, binding)) {
+            in = Input();
+            fromInput(&in, input);
+        }
+    }
+
     template<typename InputT, typename OutputT>
     friend class FunctionApplierT;
 };
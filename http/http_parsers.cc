@@ -8,6 +8,7 @@
 #include <string.h>
 #include <strings.h>
 #include <iostream>
+#include <vector>
 #include "base/exc_assert.h"
 #include "mldb/arch/exception.h"
 #include "mldb/base/parse_context.h"
@@ -128,8 +129,58 @@ prepareParsing(const char * bufferData, size_t bufferSize, string & buffer)
     return HttpParser::BufferState(data, dataSize, fromBuffer);
 }
 
+/* The buffers of the pool of the current thread. The pointer is only
+   there so that the vector is never destroyed, as buffers may be released
+   by other thread-local destructors. */
+__thread std::vector<std::string> * pooledBuffers = nullptr;
+
 } // local namespace
 
+
+/****************************************************************************/
+/* HTTP BUFFER POOL                                                         */
+/****************************************************************************/
+
+constexpr size_t HttpBufferPool::MAX_BUFFERS;
+constexpr size_t HttpBufferPool::MAX_CAPACITY;
+
+std::string
+HttpBufferPool::
+get()
+    noexcept
+{
+    std::string result;
+    if (pooledBuffers && !pooledBuffers->empty()) {
+        result.swap(pooledBuffers->back());
+        pooledBuffers->pop_back();
+    }
+    return result;
+}
+
+void
+HttpBufferPool::
+release(std::string && buffer)
+    noexcept
+{
+    if (buffer.capacity() > MAX_CAPACITY || buffer.capacity() == 0) {
+        return;
+    }
+    try {
+        if (!pooledBuffers) {
+            pooledBuffers = new std::vector<std::string>();
+            pooledBuffers->reserve(MAX_BUFFERS);
+        }
+    }
+    catch (const std::bad_alloc &) {
+        return;
+    }
+    if (pooledBuffers->size() < MAX_BUFFERS) {
+        buffer.clear();
+        pooledBuffers->emplace_back(std::move(buffer));
+    }
+}
+
+
 /****************************************************************************/
 /* HTTP PARSER                                                              */
 /****************************************************************************/
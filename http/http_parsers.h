@@ -19,6 +19,32 @@
 
 namespace MLDB {
 
+/****************************************************************************/
+/* HTTP BUFFER POOL                                                         */
+/****************************************************************************/
+
+/* A per-thread pool of the strings used as buffers by the parsers and the
+ * connection handlers. Buffers keep their capacity while they are in the
+ * pool, so that short connections don't each have to allocate and grow
+ * their own. */
+
+struct HttpBufferPool {
+    /* Return an empty buffer, which has some capacity if it was taken from
+       the pool. */
+    static std::string get() noexcept;
+
+    /* Return a buffer to the pool. Buffers that are too large are freed
+       instead. */
+    static void release(std::string && buffer) noexcept;
+
+    /* Maximum number of buffers kept by a thread */
+    static constexpr size_t MAX_BUFFERS = 256;
+
+    /* Maximum capacity of a buffer kept in the pool */
+    static constexpr size_t MAX_CAPACITY = 65536;
+};
+
+
 /****************************************************************************/
 /* HTTP PARSER                                                              */
 /****************************************************************************/
@@ -45,10 +71,16 @@ struct HttpParser {
 
     HttpParser()
         noexcept
+        : buffer_(HttpBufferPool::get())
     {
         clear();
     }
 
+    virtual ~HttpParser()
+    {
+        HttpBufferPool::release(std::move(buffer_));
+    }
+
     /* Feed the parsing with a 0-ended data chunk. Slightly slower than the
        explicitly sized version, but useful for testing. Avoid in production
        code. */
@@ -68,7 +68,8 @@ HttpResponse(int responseCode,
 
 HttpSocketHandler::
 HttpSocketHandler(TcpSocket socket)
-    : TcpSocketHandler(std::move(socket))
+    : TcpSocketHandler(std::move(socket)),
+      receivePaused_(false), receivePending_(false)
 {
     parser_.onRequestStart = [&] (const char * methodData, size_t methodSize,
                                   const char * urlData, size_t urlSize,
@@ -105,11 +106,43 @@ onReceivedData(const char * data, size_t size)
 {
     try {
         parser_.feed(data, size);
-        requestReceive();
     }
     catch (const MLDB::Exception & exc) {
         requestClose();
+        return;
     }
+
+    {
+        std::unique_lock<std::mutex> guard(receiveMutex_);
+        if (receivePaused_) {
+            receivePending_ = true;
+            return;
+        }
+    }
+    requestReceive();
+}
+
+void
+HttpSocketHandler::
+pauseReceiving()
+{
+    std::unique_lock<std::mutex> guard(receiveMutex_);
+    receivePaused_ = true;
+}
+
+void
+HttpSocketHandler::
+resumeReceiving()
+{
+    {
+        std::unique_lock<std::mutex> guard(receiveMutex_);
+        receivePaused_ = false;
+        if (!receivePending_) {
+            return;
+        }
+        receivePending_ = false;
+    }
+    requestReceive();
 }
 
 void
@@ -130,10 +163,23 @@ onReceiveError(const boost::system::error_code & ec, size_t bufferSize)
 /* HTTP CLASSIC HANDLER                                                     */
 /****************************************************************************/
 
+constexpr size_t HttpLegacySocketHandler::MAX_PIPELINED_REQUESTS;
+
 HttpLegacySocketHandler::
 HttpLegacySocketHandler(TcpSocket && socket)
-    : HttpSocketHandler(std::move(socket)), bodyStarted_(false)
+    : HttpSocketHandler(std::move(socket)),
+      headerPayload(HttpBufferPool::get()),
+      bodyPayload(HttpBufferPool::get()),
+      bodyStarted_(false),
+      responding_(false), closeAfterResponse_(false), headRequest_(false)
+{
+}
+
+HttpLegacySocketHandler::
+~HttpLegacySocketHandler()
 {
+    HttpBufferPool::release(std::move(headerPayload));
+    HttpBufferPool::release(std::move(bodyPayload));
 }
 
 void
@@ -151,7 +197,7 @@ send(std::string str,
                 requestClose();
             }
         };
-        requestWrite(str, onWritten);
+        requestWrite(std::move(str), onWritten);
     }
     else {
         if (action == NEXT_CLOSE || action == NEXT_RECYCLE) {
@@ -162,12 +208,23 @@ send(std::string str,
 
 void
 HttpLegacySocketHandler::
-putResponseOnWire(const HttpResponse & response,
+putResponseOnWire(HttpResponse response,
                   std::function<void ()> onSendFinished,
                   NextAction next)
 {
-    string responseStr;
-    responseStr.reserve(16384 + response.body.length());
+    bool complete;
+    bool closeAfter;
+    {
+        std::unique_lock<std::mutex> guard(pipelineMutex_);
+        complete = response.sendBody || headRequest_;
+        closeAfter = complete && closeAfterResponse_;
+    }
+    if (closeAfter) {
+        next = NEXT_CLOSE;
+    }
+
+    string responseStr = HttpBufferPool::get();
+    responseStr.reserve(1024);
 
     responseStr.append("HTTP/1.1 ");
     responseStr.append(to_string(response.responseCode));
@@ -185,7 +242,12 @@ putResponseOnWire(const HttpResponse & response,
         responseStr.append("Content-Length: ");
         responseStr.append(to_string(response.body.length()));
         responseStr.append("\r\n");
-        responseStr.append("Connection: Keep-Alive\r\n");
+        responseStr.append(closeAfter
+                           ? "Connection: close\r\n"
+                           : "Connection: Keep-Alive\r\n");
+    }
+    else if (closeAfter) {
+        responseStr.append("Connection: close\r\n");
     }
 
     for (auto & h: response.extraHeaders) {
@@ -196,9 +258,32 @@ putResponseOnWire(const HttpResponse & response,
     }
 
     responseStr.append("\r\n");
-    responseStr.append(response.body);
 
-    send(std::move(responseStr), std::move(next), std::move(onSendFinished));
+    vector<string> buffers;
+    buffers.emplace_back(std::move(responseStr));
+    if (!response.body.empty()) {
+        buffers.emplace_back(std::move(response.body));
+    }
+
+    auto onWritten = [=] (const boost::system::error_code & ec, size_t) {
+        if (onSendFinished) {
+            onSendFinished();
+        }
+        if (next == NEXT_CLOSE || next == NEXT_RECYCLE) {
+            requestClose();
+        }
+        else if (complete) {
+            dispatchWaitingRequest();
+        }
+    };
+
+    // The write is queued with the lock held, so that the response to a
+    // later request can't be queued before it
+    std::unique_lock<std::mutex> guard(pipelineMutex_);
+    requestWrite(std::move(buffers), onWritten);
+    if (complete) {
+        responding_ = false;
+    }
 }
 
 void
@@ -265,12 +350,73 @@ void
 HttpLegacySocketHandler::
 onDone(bool requireClose)
 {
-    HttpHeader header;
-    header.parse(headerPayload);
-    handleHttpPayload(header, bodyPayload);
-    headerPayload.clear();
-    bodyPayload.clear();
+    PendingRequest request;
+    request.header = std::move(headerPayload);
+    request.payload = std::move(bodyPayload);
+    request.requireClose = requireClose;
+    headerPayload = HttpBufferPool::get();
+    bodyPayload = HttpBufferPool::get();
     bodyStarted_ = false;
+
+    {
+        std::unique_lock<std::mutex> guard(pipelineMutex_);
+        if (responding_ || !waitingRequests_.empty()) {
+            // Wait for the response to the previous request
+            waitingRequests_.emplace_back(std::move(request));
+            if (waitingRequests_.size() >= MAX_PIPELINED_REQUESTS) {
+                pauseReceiving();
+            }
+            return;
+        }
+        responding_ = true;
+    }
+
+    dispatchRequest(std::move(request));
+}
+
+void
+HttpLegacySocketHandler::
+dispatchRequest(PendingRequest request)
+{
+    HttpHeader header;
+    header.parse(request.header);
+    {
+        std::unique_lock<std::mutex> guard(pipelineMutex_);
+        closeAfterResponse_ = request.requireClose;
+        headRequest_ = (header.verb == "HEAD");
+    }
+    handleHttpPayload(header, request.payload);
+    HttpBufferPool::release(std::move(request.header));
+    HttpBufferPool::release(std::move(request.payload));
+}
+
+void
+HttpLegacySocketHandler::
+dispatchWaitingRequest()
+{
+    PendingRequest request;
+    bool resume;
+    {
+        std::unique_lock<std::mutex> guard(pipelineMutex_);
+        if (responding_ || waitingRequests_.empty()) {
+            return;
+        }
+        request = std::move(waitingRequests_.front());
+        waitingRequests_.pop_front();
+        responding_ = true;
+        resume = waitingRequests_.size() < MAX_PIPELINED_REQUESTS;
+    }
+    if (resume) {
+        resumeReceiving();
+    }
+
+    // We are called from the event loop, which mustn't see exceptions
+    try {
+        dispatchRequest(std::move(request));
+    }
+    catch (const std::exception & exc) {
+        requestClose();
+    }
 }
 
 } // namespace MLDB
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <deque>
+#include <mutex>
 #include "mldb/ext/jsoncpp/value.h"
 #include "mldb/http/http_header.h"
 #include "mldb/http/http_parsers.h"
@@ -45,6 +47,12 @@ struct HttpSocketHandler : public TcpSocketHandler {
     /* Callback used to report the end of a response. */
     virtual void onDone(bool requireClose) = 0;
 
+protected:
+    /* Stop reading from the socket until resumeReceiving() is called, for
+       when too many requests are waiting to be handled. */
+    void pauseReceiving();
+    void resumeReceiving();
+
 private:
     /* TcpSocketHandler interface */
     virtual void bootstrap();
@@ -53,6 +61,10 @@ private:
                                 size_t bufferSize);
 
     HttpRequestParser parser_;
+
+    std::mutex receiveMutex_;
+    bool receivePaused_;
+    bool receivePending_;     ///< A receive was skipped while paused
 };
 
 
@@ -99,7 +111,14 @@ struct HttpResponse {
 
 /* A drop-in replacement class for PassiveSocketHandler. So that old
  * handler code can easily plugged into the recent versions of the service
- * classes. */
+ * classes.
+ *
+ * Requests pipelined on a keep-alive connection are handled in order: a
+ * request is only passed to handleHttpPayload() once the response to the
+ * previous one has been put on the wire, so that responses given from
+ * other threads can't be sent out of order. A response is complete when
+ * it has a body or answers a HEAD request; a response sent as a header
+ * followed by a stream of data ends by closing the connection. */
 
 struct HttpLegacySocketHandler : public HttpSocketHandler {
     /** Action to perform once we've finished sending. */
@@ -112,12 +131,19 @@ struct HttpLegacySocketHandler : public HttpSocketHandler {
     /* Type of function called when a write operation has finished. */
     typedef std::function<void ()> OnWriteFinished;
 
+    /* Maximum number of pipelined requests waiting for the response to an
+       earlier one, beyond which we stop reading from the connection. */
+    static constexpr size_t MAX_PIPELINED_REQUESTS = 64;
+
     HttpLegacySocketHandler(TcpSocket && socket);
+    virtual ~HttpLegacySocketHandler();
 
     virtual void handleHttpPayload(const HttpHeader & header,
                                    const std::string & payload) = 0;
 
-    void putResponseOnWire(const HttpResponse & response,
+    /* Send a response. The header and the body are written together
+       without being concatenated. */
+    void putResponseOnWire(HttpResponse response,
                            std::function<void ()> onSendFinished
                            = std::function<void ()>(),
                            NextAction next = NEXT_CONTINUE);
@@ -143,11 +169,28 @@ private:
 
     void handleExpect100Continue();
 
+    struct PendingRequest {
+        std::string header;
+        std::string payload;
+        bool requireClose;
+    };
+
+    /* Pass the request to handleHttpPayload(). */
+    void dispatchRequest(PendingRequest request);
+
+    /* Dispatch the next pipelined request, if the response to the previous
+       one is complete. */
+    void dispatchWaitingRequest();
+
     std::string headerPayload;
     std::string bodyPayload;
     bool bodyStarted_;
 
-    std::string writeData_;
+    std::mutex pipelineMutex_;
+    std::deque<PendingRequest> waitingRequests_;
+    bool responding_;          ///< The last request's response isn't complete
+    bool closeAfterResponse_;  ///< The last request asked for a close
+    bool headRequest_;         ///< The last request was a HEAD
 };
 
 } // namespace MLDB
@@ -0,0 +1,201 @@
+// This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+/* http_pipeline_bench.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+   Load test for the ASIO-based http services, which measures the number of
+   requests per second served on loopback, with or without keep-alive and
+   pipelining.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/exc_assert.h"
+
+#include <boost/asio.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "mldb/io/asio_thread_pool.h"
+#include "mldb/io/event_loop.h"
+#include "mldb/io/event_loop_impl.h"
+#include "mldb/http/http_socket_handler.h"
+#include "mldb/io/port_range_service.h"
+#include "mldb/io/tcp_acceptor.h"
+
+
+using namespace std;
+using namespace boost;
+using namespace MLDB;
+
+struct PongHandler : public HttpLegacySocketHandler {
+    PongHandler(TcpSocket && socket)
+        : HttpLegacySocketHandler(std::move(socket))
+    {
+    }
+
+    virtual void handleHttpPayload(const HttpHeader & header,
+                                   const std::string & payload)
+    {
+        putResponseOnWire(HttpResponse(200, "text/plain", "pong"));
+    }
+};
+
+int
+main(int argc, char * argv[])
+{
+    using namespace boost::program_options;
+    unsigned int connections(8);
+    unsigned int depth(1);
+    unsigned int threads(0);
+    double seconds(5.0);
+    bool reconnect(false);
+
+    options_description all_opt;
+    all_opt.add_options()
+        ("connections,c", value(&connections),
+         "number of concurrent client connections (8)")
+        ("depth,d", value(&depth),
+         "number of requests pipelined on each connection (1)")
+        ("threads,t", value(&threads),
+         "minimum number of server threads (scaled automatically)")
+        ("seconds,s", value(&seconds),
+         "duration of the test (5)")
+        ("reconnect,r", bool_switch(&reconnect),
+         "use a new connection for each request")
+        ("help,H", "show help");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv)
+          .options(all_opt)
+          .run(),
+          vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << all_opt << endl;
+        return 1;
+    }
+
+    ExcAssert(connections > 0);
+    ExcAssert(depth > 0);
+
+    EventLoop loop;
+    AsioThreadPool pool(loop);
+    if (threads > 0) {
+        pool.ensureThreads(threads);
+    }
+
+    auto onNewConnection = [&] (TcpSocket && socket) {
+        return std::make_shared<PongHandler>(std::move(socket));
+    };
+
+    TcpAcceptor acceptor(loop, onNewConnection);
+    acceptor.listen(0, "localhost");
+
+    auto address = asio::ip::address::from_string("127.0.0.1");
+    asio::ip::tcp::endpoint serverEndpoint(address,
+                                           acceptor.effectiveTCPv4Port());
+
+    string connection = reconnect ? "close" : "Keep-Alive";
+    string request = ("GET /ping HTTP/1.1\r\n"
+                      "Host: localhost\r\n"
+                      "Connection: " + connection + "\r\n"
+                      "\r\n");
+    string pipelined;
+    for (unsigned i = 0;  i < depth;  ++i) {
+        pipelined += request;
+    }
+    size_t responseSize = string("HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: text/plain\r\n"
+                                 "Content-Length: 4\r\n"
+                                 "Connection: \r\n"
+                                 "\r\n"
+                                 "pong").size() + connection.size();
+
+    std::atomic<uint64_t> numRequests(0);
+    std::atomic<bool> finished(false);
+
+    /* Keep-alive client: sends batches of pipelined requests, and waits for
+       all of their responses before sending the next one.  The responses
+       all have the same size, so we only need to count the bytes. */
+    auto runKeepAlive = [&] () {
+        asio::io_service ioService;
+        asio::ip::tcp::socket socket(ioService);
+        socket.connect(serverEndpoint);
+        socket.set_option(asio::ip::tcp::no_delay(true));
+
+        string received;
+        char recvBuffer[65536];
+        while (!finished) {
+            asio::write(socket, asio::buffer(pipelined));
+            received.clear();
+            while (received.size() < depth * responseSize) {
+                size_t nBytes = socket.read_some(asio::buffer(recvBuffer));
+                received.append(recvBuffer, nBytes);
+            }
+            numRequests += depth;
+        }
+    };
+
+    /* Reconnecting client: opens a connection for each request, and waits
+       for the server to close it. */
+    auto runReconnect = [&] () {
+        asio::io_service ioService;
+        char recvBuffer[4096];
+        while (!finished) {
+            asio::ip::tcp::socket socket(ioService);
+            socket.connect(serverEndpoint);
+            asio::write(socket, asio::buffer(request));
+            boost::system::error_code ec;
+            while (!ec) {
+                socket.read_some(asio::buffer(recvBuffer), ec);
+            }
+            ExcAssert(ec == asio::error::eof);
+            numRequests += 1;
+        }
+    };
+
+    cerr << ("running " + to_string(connections) + " connections"
+             + (reconnect
+                ? string(" with one connection per request")
+                : " with " + to_string(depth) + " pipelined requests")
+             + " for " + to_string(seconds) + " seconds\n");
+
+    auto start = std::chrono::steady_clock::now();
+
+    vector<std::thread> clients;
+    for (unsigned i = 0;  i < connections;  ++i) {
+        if (reconnect) {
+            clients.emplace_back(runReconnect);
+        }
+        else {
+            clients.emplace_back(runKeepAlive);
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    finished = true;
+    for (auto & c: clients) {
+        c.join();
+    }
+
+    std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+    cout << ("requests: " + to_string(numRequests.load())
+             + "\nseconds: " + to_string(elapsed.count())
+             + "\nrequests/second: "
+             + to_string(numRequests.load() / elapsed.count())
+             + "\n");
+
+    pool.shutdown();
+
+    return 0;
+}
@@ -6,6 +6,7 @@ $(eval $(call test,http_parsers_test,http,boost valgrind))
 $(eval $(call test,tcp_acceptor_test+http,http,boost))
 $(eval $(call test,tcp_acceptor_threaded_test+http,http,boost))
 $(eval $(call program,http_service_bench,boost_program_options http))
+$(eval $(call program,http_pipeline_bench,boost_program_options http io_base))
 $(eval $(call library,test_services,test_http_services.cc,http io_base))
 $(eval $(call program,http_client_bench,boost_program_options http test_services value_description))
 $(eval $(call test,http_client_test,http test_services,boost))
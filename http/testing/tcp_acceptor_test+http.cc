@@ -12,6 +12,7 @@
 
 #include <iostream>
 #include <string>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 #include <boost/asio.hpp>
 #include "base/exc_assert.h"
@@ -191,3 +192,92 @@ BOOST_AUTO_TEST_CASE( tcp_acceptor_http_100_continue )
 
     pool.shutdown();
 }
+
+
+/* Handler that responds to "/slow" from another thread, after a delay, and
+   to anything else immediately, with the resource as the body. */
+struct AsyncHandler : public HttpLegacySocketHandler {
+    AsyncHandler(TcpSocket && socket)
+        : HttpLegacySocketHandler(std::move(socket))
+    {
+    }
+
+    virtual void handleHttpPayload(const HttpHeader & header,
+                                   const std::string & payload)
+    {
+        string body = header.resource.substr(1);
+        if (header.resource == "/slow") {
+            auto handler = static_pointer_cast<AsyncHandler>
+                (acceptor().findHandlerPtr(this));
+            auto respond = [=] () {
+                ::usleep(200000);
+                handler->putResponseOnWire(HttpResponse(200, "text/plain",
+                                                        body));
+            };
+            std::thread(respond).detach();
+        }
+        else {
+            putResponseOnWire(HttpResponse(200, "text/plain", body));
+        }
+    }
+};
+
+/* Test that the responses to pipelined requests are sent in order, even
+   when they are given out of order, and that "Connection: close" is
+   honoured */
+BOOST_AUTO_TEST_CASE( tcp_acceptor_http_pipelining )
+{
+    EventLoop loop;
+    AsioThreadPool pool(loop);
+
+    auto onNewConnection = [&] (TcpSocket && socket) {
+        return std::make_shared<AsyncHandler>(std::move(socket));
+    };
+
+    TcpAcceptor acceptor(loop, onNewConnection);
+    acceptor.listen(0, "localhost");
+
+    auto address = asio::ip::address::from_string("127.0.0.1");
+    asio::ip::tcp::endpoint serverEndpoint(address,
+                                           acceptor.effectiveTCPv4Port());
+
+    {
+        auto socket = asio::ip::tcp::socket(loop.impl().ioService());
+        socket.connect(serverEndpoint);
+
+        string requests = ("GET /slow HTTP/1.1\r\n"
+                           "Host: *\r\n"
+                           "\r\n"
+                           "GET /first HTTP/1.1\r\n"
+                           "Host: *\r\n"
+                           "\r\n"
+                           "GET /second HTTP/1.1\r\n"
+                           "Host: *\r\n"
+                           "Connection: close\r\n"
+                           "\r\n");
+        socket.send(asio::buffer(requests.c_str(), requests.size()));
+
+        string received;
+        boost::system::error_code ec;
+        while (!ec) {
+            char recvBuffer[1024];
+            size_t nBytes = socket.read_some(asio::buffer(recvBuffer), ec);
+            received.append(recvBuffer, nBytes);
+        }
+        BOOST_CHECK(ec == asio::error::eof);
+
+        auto response = [] (const string & body, const string & connection) {
+            return ("HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/plain\r\n"
+                    "Content-Length: " + to_string(body.size()) + "\r\n"
+                    "Connection: " + connection + "\r\n"
+                    "\r\n" + body);
+        };
+        string expected = (response("slow", "Keep-Alive")
+                           + response("first", "Keep-Alive")
+                           + response("second", "close"));
+        BOOST_CHECK_EQUAL(received, expected);
+    }
+
+    pool.shutdown();
+}
@@ -184,3 +184,61 @@ handleHttpPayload(TestHttpSocketHandler & handler,
 
     handler.sendResponse(200, response.toString(), "application/json");
 }
+
+
+/****************************************************************************/
+/* TEST HTTP RANGE SERVICE                                                  */
+/****************************************************************************/
+
+TestHttpRangeService::
+TestHttpRangeService(EventLoop & eventLoop, string body, bool supportRanges)
+    : TestHttpService(eventLoop),
+      body_(std::move(body)),
+      etag_("\"" + to_string(std::hash<string>()(body_)) + "\""),
+      supportRanges_(supportRanges),
+      numRangeReqs(0)
+{}
+
+void
+TestHttpRangeService::
+handleHttpPayload(TestHttpSocketHandler & handler,
+                  const HttpHeader & header,
+                  const string & payload)
+{
+    numReqs++;
+
+    vector<pair<string, string> > headers{ { "ETag", etag_ } };
+    if (supportRanges_) {
+        headers.emplace_back("Accept-Ranges", "bytes");
+    }
+
+    if (header.verb == "HEAD") {
+        headers.emplace_back("Content-Length", to_string(body_.size()));
+        handler.putResponseOnWire(HttpResponse(200,
+                                               string("application/octet-stream"),
+                                               headers));
+        return;
+    }
+
+    string range = header.tryGetHeader("range");
+    if (!supportRanges_ || range.empty()) {
+        handler.putResponseOnWire(HttpResponse(200, "application/octet-stream",
+                                               body_, headers));
+        return;
+    }
+
+    numRangeReqs++;
+    size_t start, end;
+    if (sscanf(range.c_str(), "bytes=%zu-%zu", &start, &end) != 2
+        || start > end || end >= body_.size()) {
+        handler.sendResponse(416, "invalid range " + range, "text/plain");
+        return;
+    }
+
+    headers.emplace_back("Content-Range",
+                         "bytes " + to_string(start) + "-" + to_string(end)
+                         + "/" + to_string(body_.size()));
+    handler.putResponseOnWire(HttpResponse(206, "application/octet-stream",
+                                           body_.substr(start, end - start + 1),
+                                           headers));
+}
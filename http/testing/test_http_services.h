@@ -80,4 +80,22 @@ struct TestHttpUploadService : public TestHttpService
                            const std::string & payload);
 };
 
+/* Serves a single object at every resource, honouring HEAD requests and
+   single "Range: bytes=a-b" requests when supportRanges is set.  This is a
+   stand-in for a static file server or S3 in tests. */
+struct TestHttpRangeService : public TestHttpService
+{
+    TestHttpRangeService(EventLoop & eventLoop, std::string body,
+                         bool supportRanges = true);
+
+    void handleHttpPayload(TestHttpSocketHandler & handler,
+                           const HttpHeader & header,
+                           const std::string & payload);
+
+    std::string body_;
+    std::string etag_;
+    bool supportRanges_;
+    std::atomic<size_t> numRangeReqs;
+};
+
 } // namespace MLDB
@@ -70,6 +70,28 @@ requestWrite(string data, OnWritten onWritten)
     impl_->requestWrite(std::move(data), std::move(onWritten));
 }
 
+void
+TcpSocketHandler::
+requestWrite(vector<string> buffers, OnWritten onWritten)
+{
+    impl_->requestWrite(std::move(buffers), std::move(onWritten));
+}
+
+bool
+TcpSocketHandler::
+waitForWriteDrain(size_t maxBytes, double timeoutSeconds)
+{
+    return impl_->waitForWriteDrain(maxBytes, timeoutSeconds);
+}
+
+size_t
+TcpSocketHandler::
+bytesPendingWrite()
+    const
+{
+    return impl_->bytesPendingWrite();
+}
+
 void
 TcpSocketHandler::
 disableNagle()
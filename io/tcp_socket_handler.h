@@ -8,7 +8,9 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 
 
 namespace boost
@@ -59,15 +61,31 @@ struct TcpSocketHandler {
     /* Immediately close the connection. */
     void close();
 
-    /* Request the closing of the connection via the handling thread. */
+    /* Request the closing of the connection via the handling thread.  The
+       connection is closed once all pending writes have been sent. */
     void requestClose(OnClose onClose = nullptr);
 
     /* Request the sending of a given payload. */
     void requestWrite(std::string data, OnWritten onWritten = nullptr);
 
+    /* Request the sending of a payload made of several buffers, which are
+       written together without being concatenated first. */
+    void requestWrite(std::vector<std::string> buffers,
+                      OnWritten onWritten = nullptr);
+
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
+    /* Block until at most "maxBytes" bytes of previously requested writes
+       remain to be sent, or until the timeout expires.  Returns whether
+       the condition was met.  Another thread must be available to run
+       the event loop, as the writes complete asynchronously. */
+    bool waitForWriteDrain(size_t maxBytes, double timeoutSeconds);
+
+    /* Returns the number of bytes of requested writes that remain to be
+       sent. */
+    size_t bytesPendingWrite() const;
+
     /* Virtual base method called when data has been read from the associated
        socket. */
     virtual void onReceivedData(const char * buffer, size_t bufferSize) = 0;
@@ -5,7 +5,9 @@
    Copyright (c) 2015 mldb.ai inc.  All rights reserved.
 */
 
+#include <algorithm>
 #include <memory>
+#include <chrono>
 #include <boost/asio/write.hpp>
 #include <boost/system/error_code.hpp>
 #include "mldb/io/tcp_socket.h"
@@ -26,7 +28,10 @@ TcpSocketHandlerImpl(TcpSocketHandler & handler, TcpSocket && socket)
     : handler_(handler), socket_(std::move(socket.impl().socket)),
       recvBufferSize_(262144),
       recvBuffer_(new char[recvBufferSize_]),
-      closed_(false)
+      closed_(false),
+      bytesPendingWrite_(0),
+      writesInProgress_(0),
+      closeRequested_(false)
 {
     onReadSome_ = [&] (const system::error_code & ec, size_t bufferSize) {
         if (ec) {
@@ -51,12 +56,31 @@ close()
 {
     socket_.close();
     closed_ = true;
+    writeCond_.notify_all();
 }
 
 void
 TcpSocketHandlerImpl::
 requestClose(TcpSocketHandler::OnClose onClose)
 {
+    {
+        std::unique_lock<std::mutex> guard(writeMutex_);
+        if (writesInProgress_ > 0 || !writeQueue_.empty()) {
+            // Close once all of the pending data has been written
+            auto previous = std::move(onDrainedClose_);
+            onDrainedClose_ = [=] () {
+                if (previous) {
+                    previous();
+                }
+                if (onClose) {
+                    onClose();
+                }
+            };
+            closeRequested_ = true;
+            return;
+        }
+    }
+
     auto doCloseFn = [=] () {
         close();
         if (onClose) {
@@ -74,26 +98,157 @@ requestReceive()
                             onReadSome_);
 }
 
+constexpr size_t TcpSocketHandlerImpl::MAX_WRITE_BUFFERS;
+
 void
 TcpSocketHandlerImpl::
 requestWrite(string data, TcpSocketHandler::OnWritten onWritten)
 {
-    auto dataPtr = std::make_shared<std::string>(std::move(data));
-    auto writeCompleteCond = [=] (const system::error_code & ec,
-                                  std::size_t written) {
-        return written == dataPtr->size();
-    };
+    vector<string> buffers;
+    buffers.emplace_back(std::move(data));
+    requestWrite(std::move(buffers), std::move(onWritten));
+}
+
+void
+TcpSocketHandlerImpl::
+requestWrite(vector<string> buffers, TcpSocketHandler::OnWritten onWritten)
+{
+    size_t size = 0;
+    for (auto & b: buffers) {
+        size += b.size();
+    }
+    auto buffersPtr = std::make_shared<vector<string> >(std::move(buffers));
+    {
+        std::unique_lock<std::mutex> guard(writeMutex_);
+        bytesPendingWrite_ += size;
+        writeQueue_.push_back({ std::move(buffersPtr), size,
+                                std::move(onWritten) });
+    }
+    startNextWrite();
+}
+
+void
+TcpSocketHandlerImpl::
+startNextWrite()
+{
+    /* The buffers of the batch, which keep the data alive until it has
+       been written. */
+    vector<std::shared_ptr<vector<string> > > batch;
+    vector<asio::const_buffer> writeBuffers;
+    TcpSocketHandler::OnClose onClose;
+    bool doClose = false;
+
+    {
+        std::unique_lock<std::mutex> guard(writeMutex_);
+        if (writesInProgress_ > 0)
+            return;
+        if (writeQueue_.empty()) {
+            if (closeRequested_) {
+                closeRequested_ = false;
+                onClose = std::move(onDrainedClose_);
+                doClose = true;
+            }
+        }
+        else {
+            for (auto & w: writeQueue_) {
+                if (writesInProgress_ > 0
+                    && (writeBuffers.size() + w.buffers->size()
+                        > MAX_WRITE_BUFFERS)) {
+                    break;
+                }
+                for (auto & b: *w.buffers) {
+                    if (!b.empty()) {
+                        writeBuffers.emplace_back(b.data(), b.size());
+                    }
+                }
+                batch.push_back(w.buffers);
+                writesInProgress_ += 1;
+            }
+        }
+    }
+
+    if (doClose) {
+        requestClose(std::move(onClose));
+        return;
+    }
+
+    if (batch.empty())
+        return;
+
     auto onWriteComplete = [=] (const system::error_code & ec,
                                 size_t written)
-        mutable
     {
-        if (onWritten) {
-            onWritten(ec, written);
-        }
-        (void) dataPtr;
+        (void) batch;
+        this->onWriteDone(ec, written);
     };
-    asio::const_buffers_1 writeBuffer(dataPtr->c_str(), dataPtr->size());
-    async_write(socket_, writeBuffer, writeCompleteCond, onWriteComplete);
+    async_write(socket_, writeBuffers, onWriteComplete);
+}
+
+void
+TcpSocketHandlerImpl::
+onWriteDone(const system::error_code & ec, size_t written)
+{
+    std::deque<PendingWrite> done;
+    std::deque<PendingWrite> failed;
+
+    {
+        std::unique_lock<std::mutex> guard(writeMutex_);
+        for (size_t i = 0;  i < writesInProgress_;  ++i) {
+            bytesPendingWrite_ -= writeQueue_.front().size;
+            done.emplace_back(std::move(writeQueue_.front()));
+            writeQueue_.pop_front();
+        }
+        writesInProgress_ = 0;
+        if (ec) {
+            // The connection is broken, so nothing else will be written
+            failed.swap(writeQueue_);
+            bytesPendingWrite_ = 0;
+        }
+    }
+    writeCond_.notify_all();
+
+    for (auto & d: done) {
+        if (d.onWritten) {
+            // On error, we don't know how much of each write was sent
+            size_t doneWritten = std::min(d.size, written);
+            written -= doneWritten;
+            d.onWritten(ec, doneWritten);
+        }
+    }
+    for (auto & f: failed) {
+        if (f.onWritten) {
+            f.onWritten(ec, 0);
+        }
+    }
+
+    startNextWrite();
+}
+
+bool
+TcpSocketHandlerImpl::
+waitForWriteDrain(size_t maxBytes, double timeoutSeconds)
+{
+    auto deadline = std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>
+            (std::chrono::duration<double>(timeoutSeconds));
+
+    std::unique_lock<std::mutex> guard(writeMutex_);
+    while (bytesPendingWrite_ > maxBytes && !closed_) {
+        if (writeCond_.wait_until(guard, deadline)
+            == std::cv_status::timeout) {
+            break;
+        }
+    }
+    return bytesPendingWrite_ <= maxBytes;
+}
+
+size_t
+TcpSocketHandlerImpl::
+bytesPendingWrite()
+    const
+{
+    std::unique_lock<std::mutex> guard(writeMutex_);
+    return bytesPendingWrite_;
 }
 
 void
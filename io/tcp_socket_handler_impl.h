@@ -9,7 +9,11 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <boost/asio/ip/tcp.hpp>
 #include "mldb/io/tcp_socket_handler.h"
 
@@ -47,9 +51,19 @@ struct TcpSocketHandlerImpl {
     void requestWrite(std::string data,
                       TcpSocketHandler::OnWritten onWritten = nullptr);
 
+    /* Request the sending of a payload made of several buffers. */
+    void requestWrite(std::vector<std::string> buffers,
+                      TcpSocketHandler::OnWritten onWritten = nullptr);
+
     /* Request the reading of any available data from the socket. */
     void requestReceive();
 
+    /* Wait until at most "maxBytes" bytes remain to be written. */
+    bool waitForWriteDrain(size_t maxBytes, double timeoutSeconds);
+
+    /* Number of bytes of requested writes that have not been written. */
+    size_t bytesPendingWrite() const;
+
     TcpSocketHandlerImpl(const TcpSocketHandlerImpl & other) = delete;
     TcpSocketHandlerImpl &
         operator = (const TcpSocketHandlerImpl & other) = delete;
@@ -66,6 +80,31 @@ private:
                                size_t bufferSize)> OnReadSome;
     OnReadSome onReadSome_;
     std::atomic<bool> closed_;
+
+    /* Writes are queued and performed one batch at a time, so that the
+       data of concurrent requests can't be interleaved on the wire and so
+       that the amount of data waiting to be sent is known.  All of the
+       writes queued when a batch starts are sent together with a single
+       gathered write. */
+    struct PendingWrite {
+        std::shared_ptr<std::vector<std::string> > buffers;
+        size_t size;
+        TcpSocketHandler::OnWritten onWritten;
+    };
+
+    /* Maximum number of buffers in a batch */
+    static constexpr size_t MAX_WRITE_BUFFERS = 64;
+
+    void startNextWrite();
+    void onWriteDone(const boost::system::error_code & ec, size_t written);
+
+    mutable std::mutex writeMutex_;
+    std::condition_variable writeCond_;
+    std::deque<PendingWrite> writeQueue_;
+    size_t bytesPendingWrite_;
+    size_t writesInProgress_;    ///< Number of queued writes being sent
+    TcpSocketHandler::OnClose onDrainedClose_;
+    bool closeRequested_;
 };
 
 } // namespace MLDB
@@ -0,0 +1,353 @@
+/** hnsw_index.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Hierarchical Navigable Small World graph for approximate nearest
+    neighbour search.
+*/
+
+#include "hnsw_index.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/exception.h"
+#include <unordered_set>
+#include <algorithm>
+#include <queue>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+HnswIndex::
+HnswIndex(int maxNeighbors, int efConstruction)
+    : maxNeighbors(maxNeighbors), efConstruction(efConstruction),
+      entryPoint(-1), maxLevel(-1), locks(new std::mutex[NUM_LOCKS])
+{
+    if (maxNeighbors < 2)
+        throw MLDB::Exception("HNSW index needs at least 2 neighbors per "
+                              "item, not %d", maxNeighbors);
+    if (efConstruction < 1)
+        throw MLDB::Exception("HNSW index needs a positive efConstruction, "
+                              "not %d", efConstruction);
+}
+
+HnswIndex::
+HnswIndex(const HnswIndex & other)
+    : maxNeighbors(other.maxNeighbors),
+      efConstruction(other.efConstruction),
+      nodes(other.nodes),
+      entryPoint(other.entryPoint),
+      maxLevel(other.maxLevel),
+      locks(new std::mutex[NUM_LOCKS])
+{
+}
+
+int
+HnswIndex::
+levelFor(int item) const
+{
+    // splitmix64 of the item number gives a uniform number in (0, 1]
+    uint64_t z = (uint64_t)item + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z = z ^ (z >> 31);
+    double u = ((z >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+    // Levels are geometrically distributed with ratio 1 / maxNeighbors
+    return (int)std::floor(-std::log(u) / std::log((double)maxNeighbors));
+}
+
+std::vector<int>
+HnswIndex::
+getNeighbors(int item, int level) const
+{
+    std::unique_lock<std::mutex> guard(nodeLock(item));
+    return nodes[item].neighbors[level];
+}
+
+std::vector<std::pair<float, int> >
+HnswIndex::
+searchLevel(const QueryDistance & dist,
+            const std::vector<std::pair<float, int> > & entryPoints,
+            int ef, int level) const
+{
+    typedef std::pair<float, int> Entry;
+
+    std::unordered_set<int> visited;
+
+    // Candidates to expand, nearest on top
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> >
+        candidates;
+
+    // Best found so far, furthest on top
+    std::priority_queue<Entry> found;
+
+    for (auto & e: entryPoints) {
+        visited.insert(e.second);
+        candidates.push(e);
+        found.push(e);
+    }
+
+    while (found.size() > ef)
+        found.pop();
+
+    while (!candidates.empty()) {
+        Entry current = candidates.top();
+        if (current.first > found.top().first && found.size() >= ef)
+            break;
+        candidates.pop();
+
+        for (int n: getNeighbors(current.second, level)) {
+            if (!visited.insert(n).second)
+                continue;
+
+            float d = dist(n);
+            if (found.size() < ef || d < found.top().first) {
+                candidates.emplace(d, n);
+                found.emplace(d, n);
+                if (found.size() > ef)
+                    found.pop();
+            }
+        }
+    }
+
+    std::vector<Entry> result(found.size());
+    for (size_t i = result.size();  i > 0;  --i) {
+        result[i - 1] = found.top();
+        found.pop();
+    }
+    return result;
+}
+
+std::vector<int>
+HnswIndex::
+selectNeighbors(const std::vector<std::pair<float, int> > & candidates,
+                int n, const PairDistance & dist) const
+{
+    std::vector<int> result;
+    result.reserve(n);
+
+    for (auto & c: candidates) {
+        if (result.size() >= n)
+            break;
+        bool keep = true;
+        for (int r: result) {
+            if (dist(c.second, r) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep)
+            result.push_back(c.second);
+    }
+
+    // Fill up with the closest of the rejected ones, so that sparse
+    // regions stay well connected
+    for (auto & c: candidates) {
+        if (result.size() >= n)
+            break;
+        if (std::find(result.begin(), result.end(), c.second) == result.end())
+            result.push_back(c.second);
+    }
+
+    return result;
+}
+
+void
+HnswIndex::
+insertOne(int item, const PairDistance & dist)
+{
+    int level = nodes[item].level;
+
+    int currentEntry, currentMaxLevel;
+    {
+        std::unique_lock<std::mutex> guard(entryMutex);
+        if (entryPoint == -1) {
+            entryPoint = item;
+            maxLevel = level;
+            return;
+        }
+        currentEntry = entryPoint;
+        currentMaxLevel = maxLevel;
+    }
+
+    auto distToItem = [&] (int other) { return dist(item, other); };
+
+    // Greedy descent through the levels above this item's
+    std::vector<std::pair<float, int> > entries
+        = { { distToItem(currentEntry), currentEntry } };
+    for (int l = currentMaxLevel;  l > level;  --l)
+        entries = searchLevel(distToItem, entries, 1, l);
+
+    for (int l = std::min(level, currentMaxLevel);  l >= 0;  --l) {
+        entries = searchLevel(distToItem, entries, efConstruction, l);
+
+        std::vector<int> chosen
+            = selectNeighbors(entries, maxNeighbors, dist);
+
+        {
+            std::unique_lock<std::mutex> guard(nodeLock(item));
+            nodes[item].neighbors[l] = chosen;
+        }
+
+        // Link back from each neighbor, pruning its list if it's full
+        int maxAtLevel = maxNeighborsAt(l);
+        for (int n: chosen) {
+            std::unique_lock<std::mutex> guard(nodeLock(n));
+            std::vector<int> & links = nodes[n].neighbors[l];
+            if (std::find(links.begin(), links.end(), item) != links.end())
+                continue;
+            links.push_back(item);
+            if (links.size() <= maxAtLevel)
+                continue;
+
+            std::vector<std::pair<float, int> > candidates;
+            candidates.reserve(links.size());
+            for (int c: links)
+                candidates.emplace_back(dist(n, c), c);
+            std::sort(candidates.begin(), candidates.end());
+            links = selectNeighbors(candidates, maxAtLevel, dist);
+        }
+    }
+
+    if (level > currentMaxLevel) {
+        std::unique_lock<std::mutex> guard(entryMutex);
+        if (level > maxLevel) {
+            entryPoint = item;
+            maxLevel = level;
+        }
+    }
+}
+
+void
+HnswIndex::
+insert(int begin, int end, const PairDistance & dist)
+{
+    ExcAssertEqual(begin, nodes.size());
+    if (end <= begin)
+        return;
+
+    nodes.resize(end);
+    for (int i = begin;  i < end;  ++i) {
+        nodes[i].level = levelFor(i);
+        nodes[i].neighbors.resize(nodes[i].level + 1);
+    }
+
+    // Build the start of the graph sequentially, so that the parallel
+    // insertions have something to connect to
+    int sequentialEnd = std::min(end, std::max(begin, 1000));
+    for (int i = begin;  i < sequentialEnd;  ++i)
+        insertOne(i, dist);
+
+    if (sequentialEnd < end) {
+        auto doItems = [&] (size_t first, size_t last)
+            {
+                for (size_t i = first;  i < last;  ++i)
+                    insertOne(i, dist);
+            };
+
+        MLDB::parallelMapChunked(sequentialEnd, end, 256, doItems);
+    }
+}
+
+std::vector<std::pair<float, int> >
+HnswIndex::
+search(const QueryDistance & dist, int numNeighbors,
+       double maxDistance, int ef) const
+{
+    if (entryPoint == -1 || numNeighbors <= 0)
+        return {};
+
+    std::vector<std::pair<float, int> > entries
+        = { { dist(entryPoint), entryPoint } };
+    for (int l = maxLevel;  l > 0;  --l)
+        entries = searchLevel(dist, entries, 1, l);
+
+    entries = searchLevel(dist, entries, std::max(ef, numNeighbors), 0);
+
+    std::vector<std::pair<float, int> > result;
+    for (auto & e: entries) {
+        if (result.size() >= numNeighbors || e.first > maxDistance)
+            break;
+        result.push_back(e);
+    }
+
+    return result;
+}
+
+void
+HnswIndex::
+serialize(DB::Store_Writer & store) const
+{
+    store << string("HNSW") << DB::compact_size_t(0);  // version
+    store << DB::compact_size_t(maxNeighbors)
+          << DB::compact_size_t(efConstruction)
+          << DB::compact_size_t(nodes.size())
+          << DB::compact_size_t(entryPoint + 1);
+    for (auto & n: nodes) {
+        store << DB::compact_size_t(n.level);
+        for (auto & links: n.neighbors) {
+            store << DB::compact_size_t(links.size());
+            for (int l: links)
+                store << DB::compact_size_t(l);
+        }
+    }
+}
+
+void
+HnswIndex::
+reconstitute(DB::Store_Reader & store)
+{
+    string canary;
+    store >> canary;
+    if (canary != "HNSW")
+        throw MLDB::Exception("Unknown HNSW index canary");
+    DB::compact_size_t version(store);
+    if (version != 0)
+        throw MLDB::Exception("Unknown HNSW index version");
+
+    DB::compact_size_t maxNeighbors(store), efConstruction(store),
+        numNodes(store), entryPoint(store);
+
+    std::vector<Node> nodes(numNodes);
+    int maxLevel = -1;
+    for (auto & n: nodes) {
+        DB::compact_size_t level(store);
+        n.level = level;
+        n.neighbors.resize(n.level + 1);
+        for (auto & links: n.neighbors) {
+            DB::compact_size_t numLinks(store);
+            links.reserve(numLinks);
+            for (size_t i = 0;  i < numLinks;  ++i) {
+                DB::compact_size_t link(store);
+                if (link >= numNodes)
+                    throw MLDB::Exception("HNSW index link out of range");
+                links.push_back(link);
+            }
+        }
+    }
+
+    if (entryPoint > numNodes)
+        throw MLDB::Exception("HNSW index entry point out of range");
+    if (entryPoint != 0)
+        maxLevel = nodes[entryPoint - 1].level;
+
+    this->maxNeighbors = maxNeighbors;
+    this->efConstruction = efConstruction;
+    this->nodes = std::move(nodes);
+    this->entryPoint = (int)entryPoint - 1;
+    this->maxLevel = maxLevel;
+}
+
+
+} // namespace ML
@@ -0,0 +1,138 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Hierarchical Navigable Small World graph for approximate nearest
+    neighbour search.
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Approximate nearest neighbours index over items numbered from zero,
+    following Malkov and Yashunin, 2016, "Efficient and robust approximate
+    nearest neighbor search using Hierarchical Navigable Small World
+    graphs".
+
+    The index doesn't store the items themselves; distances are provided
+    by the caller as functions of item numbers.  Items can be added at any
+    time without rebuilding the rest of the graph, and queries are
+    answered in roughly logarithmic time whatever the dimensionality.
+
+    The recall of a search is traded off against its speed with the ef
+    (size of the candidate list) parameter; higher is more accurate.
+*/
+
+struct HnswIndex {
+
+    /** Distance between two items in the index. */
+    typedef std::function<float (int, int)> PairDistance;
+
+    /** Distance between the query and an item in the index. */
+    typedef std::function<float (int)> QueryDistance;
+
+    /** Create an index where each item is linked to up to maxNeighbors
+        others (twice that on the bottom layer), and insertions use a
+        candidate list of efConstruction items.
+    */
+    HnswIndex(int maxNeighbors = 16, int efConstruction = 200);
+
+    HnswIndex(const HnswIndex & other);
+
+    /** Add items begin to end - 1, which must follow on from the items
+        already in the index.  Large batches are inserted in parallel.
+    */
+    void insert(int begin, int end, const PairDistance & dist);
+
+    /** Return the (distance, item) pairs for up to numNeighbors items
+        closest to the query, nearest first, with distances no greater
+        than maxDistance.  The candidate list will have at least ef
+        entries.
+    */
+    std::vector<std::pair<float, int> >
+    search(const QueryDistance & dist, int numNeighbors,
+           double maxDistance, int ef) const;
+
+    /** Number of items in the index. */
+    size_t size() const { return nodes.size(); }
+
+    void serialize(DB::Store_Writer & store) const;
+    void reconstitute(DB::Store_Reader & store);
+
+private:
+    struct Node {
+        int level = 0;
+        std::vector<std::vector<int> > neighbors;  ///< One list per level
+    };
+
+    int maxNeighbors;
+    int efConstruction;
+    std::vector<Node> nodes;
+    int entryPoint;
+    int maxLevel;
+
+    /// Protects entryPoint and maxLevel during parallel insertion
+    std::mutex entryMutex;
+
+    /// Striped locks protecting the neighbor lists during parallel
+    /// insertion
+    static constexpr int NUM_LOCKS = 1024;
+    std::unique_ptr<std::mutex[]> locks;
+
+    std::mutex & nodeLock(int item) const
+    {
+        return locks[item % NUM_LOCKS];
+    }
+
+    /** Level of the graph that the given item goes up to.  This is a
+        deterministic function of the item number, so that indexes are
+        reproducible.
+    */
+    int levelFor(int item) const;
+
+    /** Most neighbors kept for an item at the given level. */
+    int maxNeighborsAt(int level) const
+    {
+        return level == 0 ? 2 * maxNeighbors : maxNeighbors;
+    }
+
+    /** Copy of the neighbors of an item at a level. */
+    std::vector<int> getNeighbors(int item, int level) const;
+
+    /** Best first search of a single level of the graph, returning the
+        (distance, item) pairs of up to ef closest items, nearest first.
+    */
+    std::vector<std::pair<float, int> >
+    searchLevel(const QueryDistance & dist,
+                const std::vector<std::pair<float, int> > & entryPoints,
+                int ef, int level) const;
+
+    /** Choose up to n neighbors for an item from its candidates (sorted
+        nearest first), preferring ones that aren't closer to an already
+        chosen neighbor than they are to the item, so that the links
+        point in diverse directions.
+    */
+    std::vector<int>
+    selectNeighbors(const std::vector<std::pair<float, int> > & candidates,
+                    int n, const PairDistance & dist) const;
+
+    void insertOne(int item, const PairDistance & dist);
+};
+
+
+} // namespace ML
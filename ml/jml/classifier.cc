@@ -481,6 +481,35 @@ predict(const float * features,
     return optimized_predict_impl(fv, info, context);
 }
 
+void
+Classifier_Impl::
+predict_batch(const float * features,
+              size_t num_rows,
+              size_t stride,
+              const Optimization_Info & info,
+              double * output,
+              PredictionContext * context) const
+{
+    int nl = label_count();
+    std::fill(output, output + num_rows * nl, 0.0);
+
+    if (!predict_is_optimized() || !info) {
+        for (size_t i = 0;  i < num_rows;  ++i) {
+            Label_Dist result = predict(features + i * stride, info, context);
+            std::copy(result.begin(), result.end(), output + i * nl);
+        }
+        return;
+    }
+
+    int nf = info.features_out();
+    std::vector<float> fv(num_rows * nf + 1);
+    for (size_t i = 0;  i < num_rows;  ++i)
+        info.apply(features + i * stride, &fv[i * nf]);
+
+    optimized_predict_batch_impl(fv.data(), num_rows, nf, info, output,
+                                 context);
+}
+
 float
 Classifier_Impl::
 predict(int label,
@@ -597,6 +626,21 @@ optimized_predict_impl(int label,
     return predict(label, fset, context);
 }
 
+void
+Classifier_Impl::
+optimized_predict_batch_impl(const float * features,
+                             size_t num_rows,
+                             size_t stride,
+                             const Optimization_Info & info,
+                             double * output,
+                             PredictionContext * context) const
+{
+    int nl = label_count();
+    for (size_t i = 0;  i < num_rows;  ++i)
+        optimized_predict_impl(features + i * stride, info,
+                               output + i * nl, 1.0, context);
+}
+
 namespace {
 
 struct Accuracy_Job_Info {
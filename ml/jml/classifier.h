@@ -360,6 +360,19 @@ public:
                           const Optimization_Info & info,
                           PredictionContext * context = 0) const;
 
+    /** Predict for a batch of num_rows dense feature vectors, laid out as
+        for the optimized predict above, with each row stride floats from
+        the previous one.  label_count() values per row are written to
+        output.  Classifiers that can evaluate many rows more efficiently
+        than one at a time override optimized_predict_batch_impl().
+    */
+    void predict_batch(const float * features,
+                       size_t num_rows,
+                       size_t stride,
+                       const Optimization_Info & info,
+                       double * output,
+                       PredictionContext * context = 0) const;
+
     //protected:
 
     /** Function to override to perform the optimization.  Default will
@@ -391,6 +404,19 @@ public:
                            const float * features,
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
+
+    /** Optimized predict for a batch of dense feature vectors, which have
+        already been converted by the optimization info.  The predictions
+        are added to output, which has label_count() entries per row.  The
+        default calls optimized_predict_impl() for each row.
+    */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t num_rows,
+                                 size_t stride,
+                                 const Optimization_Info & info,
+                                 double * output,
+                                 PredictionContext * context = 0) const;
     
 public:
     /** Run the classifier over the entire dataset, calling the predict
@@ -9,6 +9,8 @@
 */
 
 #include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/decision_tree.h"
+#include "mldb/ml/jml/flat_tree.h"
 #include <memory>
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/jml/db/persistent.h"
@@ -111,9 +113,56 @@ optimize_impl(Optimization_Info & info)
         if (succeeded) any_succeeded = true;
     }
 
+    flat_.reset();
+    flat_bias_.clear();
+
+    if (any_succeeded && !bias.empty()) {
+        auto flat = std::make_shared<Flat_Tree_Ensemble>(bias.size());
+        distribution<double> flat_bias(bias.size(), 0.0);
+        if (add_flat_trees(*this, info, 1.0, *flat, flat_bias)
+            && flat->finish()) {
+            flat_ = flat;
+            flat_bias_.swap(flat_bias);
+        }
+    }
+
     return optimized_ = any_succeeded;
 }
 
+bool
+Committee::
+add_flat_trees(const Committee & committee,
+               const Optimization_Info & info,
+               double weight,
+               Flat_Tree_Ensemble & flat,
+               distribution<double> & flat_bias)
+{
+    if (committee.bias.size() != flat_bias.size())
+        return false;
+
+    for (unsigned i = 0;  i < flat_bias.size();  ++i)
+        flat_bias[i] += weight * committee.bias[i];
+
+    for (unsigned i = 0;  i < committee.classifiers.size();  ++i) {
+        if (committee.weights[i] == 0.0) continue;
+
+        double w = weight * committee.weights[i];
+        const Classifier_Impl * c = committee.classifiers[i].get();
+
+        if (auto tree = dynamic_cast<const Decision_Tree *>(c)) {
+            if (!tree->predict_is_optimized() || !flat.add(tree->tree, info, w))
+                return false;
+        }
+        else if (auto sub = dynamic_cast<const Committee *>(c)) {
+            if (!add_flat_trees(*sub, info, w, flat, flat_bias))
+                return false;
+        }
+        else return false;
+    }
+
+    return true;
+}
+
 Label_Dist
 Committee::
 optimized_predict_impl(const float * features,
@@ -123,6 +172,13 @@ optimized_predict_impl(const float * features,
     int nl = bias.size();
 
     double accum[nl];
+
+    if (flat_) {
+        std::copy(flat_bias_.begin(), flat_bias_.end(), accum);
+        flat_->predict(features, accum);
+        return Label_Dist(accum, accum + nl);
+    }
+
     std::copy(&bias[0], &bias[0] + nl, accum);
 
     for (unsigned i = 0;  i < classifiers.size();  ++i) {
@@ -145,6 +201,13 @@ optimized_predict_impl(const float * features,
 {
     int nl = bias.size();
 
+    if (flat_) {
+        for (unsigned i = 0;  i < nl;  ++i)
+            accum[i] += weight * flat_bias_[i];
+        flat_->predict(features, accum, weight);
+        return;
+    }
+
     for (unsigned i = 0;  i < nl;  ++i)
         accum[i] += weight * bias[i];
 
@@ -166,6 +229,14 @@ optimized_predict_impl(int label,
     if (label >= bias.size())
         throw Exception("Committee::predict(): invalid label");
 
+    if (flat_) {
+        int nl = bias.size();
+        double accum[nl];
+        std::copy(flat_bias_.begin(), flat_bias_.end(), accum);
+        flat_->predict(features, accum);
+        return accum[label];
+    }
+
     float result = bias[label];
 
     for (unsigned i = 0;  i < classifiers.size();  ++i) {
@@ -179,6 +250,30 @@ optimized_predict_impl(int label,
     return result;
 }
 
+void
+Committee::
+optimized_predict_batch_impl(const float * features,
+                             size_t num_rows,
+                             size_t stride,
+                             const Optimization_Info & info,
+                             double * output,
+                             PredictionContext * context) const
+{
+    if (!flat_) {
+        Classifier_Impl::optimized_predict_batch_impl(features, num_rows,
+                                                      stride, info, output,
+                                                      context);
+        return;
+    }
+
+    int nl = bias.size();
+    for (size_t r = 0;  r < num_rows;  ++r)
+        for (unsigned i = 0;  i < nl;  ++i)
+            output[r * nl + i] += flat_bias_[i];
+
+    flat_->predict_batch(features, num_rows, stride, output);
+}
+
 Explanation
 Committee::
 explain(const Feature_Set & feature_set,
@@ -218,6 +313,7 @@ add(std::shared_ptr<Classifier_Impl> classifier, float weight)
     classifiers.push_back(classifier);
     weights.push_back(weight);
     optimized_ = false;
+    flat_.reset();
 }
 
 std::string
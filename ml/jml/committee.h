@@ -18,6 +18,9 @@
 namespace ML {
 
 
+struct Flat_Tree_Ensemble;
+
+
 /*****************************************************************************/
 /* COMMITTEE                                                                 */
 /*****************************************************************************/
@@ -50,6 +53,8 @@ public:
         classifiers.swap(other.classifiers);
         weights.swap(other.weights);
         bias.swap(other.bias);
+        flat_.swap(other.flat_);
+        flat_bias_.swap(other.flat_bias_);
     }
 
     void add(std::shared_ptr<Classifier_Impl> classifier, float weight = 1.0);
@@ -103,6 +108,14 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t num_rows,
+                                 size_t stride,
+                                 const Optimization_Info & info,
+                                 double * output,
+                                 PredictionContext * context = 0) const;
+
     virtual Explanation explain(const Feature_Set & feature_set,
                                 const ML::Label & label,
                                 double weight = 1.0,
@@ -126,6 +139,22 @@ public:
 
 private:
     bool optimized_;
+
+    /** Add the trees of the given committee, with their weights multiplied
+        by weight, to the flattened ensemble.  Returns false if a member
+        isn't an optimized decision tree or committee of them.
+    */
+    static bool add_flat_trees(const Committee & committee,
+                               const Optimization_Info & info,
+                               double weight,
+                               Flat_Tree_Ensemble & flat,
+                               distribution<double> & flat_bias);
+
+    /// When all members are decision trees (possibly in nested
+    /// committees), the optimized predict evaluates them all in one
+    /// flattened ensemble, adding flat_bias_.
+    std::shared_ptr<const Flat_Tree_Ensemble> flat_;
+    distribution<double> flat_bias_;
 };
 
 } // namespace ML
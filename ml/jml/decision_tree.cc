@@ -9,6 +9,7 @@
 */
 
 #include "decision_tree.h"
+#include "flat_tree.h"
 #include "classifier_persist_impl.h"
 #include <boost/progress.hpp>
 #include <boost/timer.hpp>
@@ -66,6 +67,7 @@ swap(Decision_Tree & other)
     std::swap(tree, other.tree);
     std::swap(encoding, other.encoding);
     std::swap(optimized_, other.optimized_);
+    std::swap(flat_, other.flat_);
 }
 
 namespace {
@@ -209,6 +211,12 @@ Decision_Tree::
 optimize_impl(Optimization_Info & info)
 {
     optimize_recursive(info, tree.root);
+
+    auto flat = std::make_shared<Flat_Tree_Ensemble>(label_count());
+    if (flat->add(tree, info, 1.0) && flat->finish())
+        flat_ = flat;
+    else flat_.reset();
+
     optimized_ = true;
     return true;
 }
@@ -235,12 +243,16 @@ optimized_predict_impl(const float * features,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-
     int nl = label_count();
     double accum[nl];
     DistResults results(accum, nl);
 
+    if (flat_) {
+        flat_->predict(features, accum);
+        return results;
+    }
+
+    OptimizedGetFeatures get_features(features);
     predict_recursive_impl(get_features, results, tree.root);
     return results;
 }
@@ -253,6 +265,11 @@ optimized_predict_impl(const float * features,
                        double weight,
                        PredictionContext * context) const
 {
+    if (flat_) {
+        flat_->predict(features, accum, weight);
+        return;
+    }
+
     OptimizedGetFeatures get_features(features);
     AccumResults results(accum, label_count(), weight);
 
@@ -266,6 +283,16 @@ optimized_predict_impl(int label,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
+    if (flat_) {
+        int nl = label_count();
+        if (label < 0 || label >= nl)
+            throw Exception("Decision_Tree::predict(): invalid label");
+        double accum[nl];
+        std::fill(accum, accum + nl, 0.0);
+        flat_->predict(features, accum);
+        return accum[label];
+    }
+
     OptimizedGetFeatures get_features(features);
     LabelResults results(label);
 
@@ -273,6 +300,24 @@ optimized_predict_impl(int label,
     return results;
 }
 
+void
+Decision_Tree::
+optimized_predict_batch_impl(const float * features,
+                             size_t num_rows,
+                             size_t stride,
+                             const Optimization_Info & info,
+                             double * output,
+                             PredictionContext * context) const
+{
+    if (flat_) {
+        flat_->predict_batch(features, num_rows, stride, output);
+        return;
+    }
+
+    Classifier_Impl::optimized_predict_batch_impl(features, num_rows, stride,
+                                                  info, output, context);
+}
+
 template<class GetFeatures, class Results>
 void
 Decision_Tree::
@@ -649,6 +694,7 @@ reconstitute(DB::Store_Reader & store,
         throw Exception("Decision_Tree::reconstitute: read bad marker at end");
 
     optimized_ = false;
+    flat_.reset();
 }
     
 std::string
@@ -19,6 +19,7 @@ namespace ML {
 
 
 class Training_Data;
+struct Flat_Tree_Ensemble;
 
 
 /*****************************************************************************/
@@ -55,6 +56,10 @@ public:
     Output_Encoding encoding;  ///< How the outputs are represented
     bool optimized_;           ///< Is predict() optimized?
 
+    /// Flattened copy of the tree used by the optimized predict, if it
+    /// could be built
+    std::shared_ptr<const Flat_Tree_Ensemble> flat_;
+
     using Classifier_Impl::predict;
 
     virtual float predict(int label, const Feature_Set & features,
@@ -104,6 +109,14 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t num_rows,
+                                 size_t stride,
+                                 const Optimization_Info & info,
+                                 double * output,
+                                 PredictionContext * context = 0) const;
+
     template<class GetFeatures, class Results>
     void predict_recursive_impl(const GetFeatures & get_features,
                                 Results & results,
@@ -0,0 +1,263 @@
+/* flat_tree.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Flattened representation of decision trees for fast prediction.
+*/
+
+#include "flat_tree.h"
+#include "split.h"
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* FLAT_TREE_ENSEMBLE                                                        */
+/*****************************************************************************/
+
+Flat_Tree_Ensemble::
+Flat_Tree_Ensemble(int label_count)
+    : ready_(false), failed_(label_count <= 0), nl_(label_count),
+      empty_leaf_(0)
+{
+}
+
+bool
+Flat_Tree_Ensemble::
+add(const Tree & tree, const Optimization_Info & info, float weight)
+{
+    if (ready_)
+        throw Exception("Flat_Tree_Ensemble::add(): already finished");
+    if (failed_)
+        return false;
+
+    int32_t root = add_recursive(tree.root, info, weight);
+    roots_.push_back(root);
+
+    return !failed_;
+}
+
+int32_t
+Flat_Tree_Ensemble::
+add_leaf(const distribution<float> & pred, float weight)
+{
+    if (pred.size() != nl_) {
+        failed_ = true;
+        return ~0;
+    }
+
+    int32_t result = leaf_values_.size() / nl_;
+    for (float p: pred)
+        leaf_values_.push_back(p * weight);
+    return ~result;
+}
+
+int32_t
+Flat_Tree_Ensemble::
+add_recursive(const Tree::Ptr & ptr, const Optimization_Info & info,
+              float weight)
+{
+    if (failed_)
+        return ~0;
+
+    if (!ptr) {
+        // Nothing is added for a null child
+        if (empty_leaf_ >= 0)
+            empty_leaf_ = add_leaf(distribution<float>(nl_, 0.0f), 1.0f);
+        return empty_leaf_;
+    }
+
+    if (!ptr.node())
+        return add_leaf(ptr.pred(), weight);
+
+    const Tree::Node & node = *ptr.node();
+    const Split & split = node.split;
+
+    Node result;
+    result.threshold = 0;
+
+    switch (split.op()) {
+    case Split::LESS:         result.op = OP_LESS;         break;
+    case Split::EQUAL:        result.op = OP_EQUAL;        break;
+    case Split::NOT_MISSING:  result.op = OP_NOT_MISSING;  break;
+    default:
+        failed_ = true;
+        return ~0;
+    }
+
+    if (result.op != OP_NOT_MISSING && std::isnan(split.split_val())) {
+        failed_ = true;
+        return ~0;
+    }
+
+    int index = info.get_optimized_index(split.feature());
+    auto it = feature_slot_.find(index);
+    if (it == feature_slot_.end()) {
+        it = feature_slot_.insert(make_pair(index, dense_index_.size())).first;
+        dense_index_.push_back(index);
+        thresholds_.emplace_back();
+    }
+    result.feature = it->second;
+
+    int32_t node_index = nodes_.size();
+    nodes_.push_back(result);
+
+    if (result.op != OP_NOT_MISSING) {
+        thresholds_[result.feature].push_back(split.split_val());
+        pending_.push_back({ (uint32_t)node_index, split.split_val() });
+    }
+
+    // nodes_ may be reallocated during the recursion, so the children are
+    // only written once they are known
+    int32_t child_true = add_recursive(node.child_true, info, weight);
+    int32_t child_false = add_recursive(node.child_false, info, weight);
+    int32_t child_missing = add_recursive(node.child_missing, info, weight);
+
+    Node & n = nodes_[node_index];
+    n.child[0] = child_true;
+    n.child[1] = child_false;
+    n.child[2] = child_missing;
+
+    return node_index;
+}
+
+bool
+Flat_Tree_Ensemble::
+finish()
+{
+    if (ready_)
+        return true;
+    if (failed_)
+        return false;
+
+    for (auto & t: thresholds_) {
+        std::sort(t.begin(), t.end());
+        t.erase(std::unique(t.begin(), t.end()), t.end());
+        if (t.size() > MAX_THRESHOLDS) {
+            failed_ = true;
+            return false;
+        }
+    }
+
+    for (const Pending & p: pending_) {
+        Node & node = nodes_[p.node];
+        const vector<float> & t = thresholds_[node.feature];
+        int j = std::lower_bound(t.begin(), t.end(), p.split_val) - t.begin();
+
+        // See quantize() for the encoding
+        node.threshold = (node.op == OP_LESS ? 2 * j : 2 * j + 1);
+    }
+
+    pending_.clear();
+    pending_.shrink_to_fit();
+    nodes_.shrink_to_fit();
+    leaf_values_.shrink_to_fit();
+
+    ready_ = true;
+    return true;
+}
+
+void
+Flat_Tree_Ensemble::
+quantize(const float * features, uint16_t * q) const
+{
+    /* A value x is encoded as 2k + e, where k is the number of split values
+       that are strictly less than x, and e is 1 if x is itself a split
+       value.  This preserves the results of the tests against each of the
+       split values t[j]:
+
+       x < t[j]   <=>  2k + e <= 2j
+       x == t[j]  <=>  2k + e == 2j + 1
+    */
+    for (unsigned i = 0;  i < dense_index_.size();  ++i) {
+        float x = features[dense_index_[i]];
+        if (std::isnan(x)) {
+            q[i] = MISSING_Q;
+            continue;
+        }
+        const vector<float> & t = thresholds_[i];
+        auto it = std::lower_bound(t.begin(), t.end(), x);
+        int k = it - t.begin();
+        q[i] = 2 * k + (it != t.end() && *it == x);
+    }
+}
+
+void
+Flat_Tree_Ensemble::
+predict(const float * features, double * accum, double weight) const
+{
+    if (!ready_)
+        throw Exception("Flat_Tree_Ensemble::predict(): not finished");
+
+    uint16_t q[dense_index_.size() + 1];
+    quantize(features, q);
+
+    for (int32_t root: roots_) {
+        int32_t n = root;
+        while (n >= 0)
+            n = step(nodes_[n], q);
+
+        const float * leaf = &leaf_values_[(size_t)(~n) * nl_];
+        for (unsigned i = 0;  i < nl_;  ++i)
+            accum[i] += weight * leaf[i];
+    }
+}
+
+void
+Flat_Tree_Ensemble::
+predict_batch(const float * features, size_t num_rows, size_t stride,
+              double * output) const
+{
+    if (!ready_)
+        throw Exception("Flat_Tree_Ensemble::predict_batch(): not finished");
+
+    size_t nf = dense_index_.size();
+    vector<uint16_t> qbuf(BLOCK_SIZE * nf + 1);
+
+    for (size_t block = 0;  block < num_rows;  block += BLOCK_SIZE) {
+        size_t n = std::min<size_t>(BLOCK_SIZE, num_rows - block);
+
+        for (size_t r = 0;  r < n;  ++r)
+            quantize(features + (block + r) * stride, &qbuf[r * nf]);
+
+        double * out = output + block * nl_;
+
+        for (int32_t root: roots_) {
+            for (size_t r0 = 0;  r0 < n;  r0 += INTERLEAVE) {
+                int m = std::min<size_t>(INTERLEAVE, n - r0);
+
+                // Walk several rows down the tree at once, so that the
+                // loads of their nodes overlap
+                int32_t cursor[INTERLEAVE];
+                for (int i = 0;  i < m;  ++i)
+                    cursor[i] = root;
+
+                for (bool more = root >= 0;  more;) {
+                    more = false;
+                    for (int i = 0;  i < m;  ++i) {
+                        if (cursor[i] < 0) continue;
+                        cursor[i] = step(nodes_[cursor[i]],
+                                         &qbuf[(r0 + i) * nf]);
+                        more |= cursor[i] >= 0;
+                    }
+                }
+
+                for (int i = 0;  i < m;  ++i) {
+                    const float * leaf
+                        = &leaf_values_[(size_t)(~cursor[i]) * nl_];
+                    double * o = out + (r0 + i) * nl_;
+                    for (unsigned j = 0;  j < nl_;  ++j)
+                        o[j] += leaf[j];
+                }
+            }
+        }
+    }
+}
+
+} // namespace ML
@@ -0,0 +1,146 @@
+/* flat_tree.h                                                     -*- C++ -*-
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Flattened representation of decision trees for fast prediction.
+*/
+
+#pragma once
+
+#include "tree.h"
+#include "classifier.h"
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* FLAT_TREE_ENSEMBLE                                                        */
+/*****************************************************************************/
+
+/** A set of decision trees, flattened into contiguous arrays for the
+    optimized (dense feature vector) predict path.
+
+    The nodes of all trees live in a single array, and the leaf outputs
+    (already multiplied by the weight of their tree) in another.  Split
+    values are quantized: the distinct split values of each feature are
+    collected into a sorted table, and an input value is converted once
+    per row into its position in that table.  Each node then tests a
+    16 bit integer against its own quantized threshold, which needs no
+    floating point comparison and handles LESS, EQUAL and missing values
+    with the same branch-free code.
+
+    Rows are evaluated in blocks: each tree is walked for all of the rows
+    of a block before moving to the next tree, so that the tree's nodes
+    stay in cache, and several rows are advanced through a tree at once
+    to hide the latency of the node loads.
+*/
+
+struct Flat_Tree_Ensemble {
+
+    /** Construct an empty ensemble producing label_count outputs. */
+    explicit Flat_Tree_Ensemble(int label_count);
+
+    /** Add the given tree, with its outputs multiplied by the given
+        weight.  The dense feature indexes are looked up in the
+        optimization info.  Returns false if the tree can't be
+        represented (in which case the ensemble must not be used).
+    */
+    bool add(const Tree & tree, const Optimization_Info & info,
+             float weight);
+
+    /** Finish construction, once all trees have been added.  Returns
+        false if the ensemble can't be used.
+    */
+    bool finish();
+
+    /** Is the ensemble ready to use? */
+    bool ready() const { return ready_; }
+
+    /** Number of labels output. */
+    int label_count() const { return nl_; }
+
+    /** Add weight times the output of all trees for the given dense
+        feature vector to accum, which has label_count() entries.
+    */
+    void predict(const float * features, double * accum,
+                 double weight = 1.0) const;
+
+    /** Predict for num_rows dense feature vectors, the first at features
+        and each stride floats from the previous one.  label_count()
+        outputs per row are added to output, which must be initialized.
+    */
+    void predict_batch(const float * features, size_t num_rows,
+                       size_t stride, double * output) const;
+
+    /** Number of rows evaluated together. */
+    static constexpr int BLOCK_SIZE = 64;
+
+private:
+    /// Quantized value used for a missing (NaN) input
+    static constexpr uint16_t MISSING_Q = 0xffff;
+
+    enum {
+        OP_LESS = 1,
+        OP_EQUAL = 2,
+        OP_NOT_MISSING = 4
+    };
+
+    struct Node {
+        uint32_t feature;     ///< Index into the quantized row
+        uint16_t threshold;   ///< Quantized split value
+        uint16_t op;          ///< Set of OP_ flags
+        int32_t child[3];     ///< True, false and missing; ~leaf if < 0
+    };
+
+    /// Temporary storage of a split value before quantization
+    struct Pending {
+        uint32_t node;
+        float split_val;
+    };
+
+    bool ready_;
+    bool failed_;
+    int nl_;
+    int32_t empty_leaf_;                ///< Leaf for null children or 0
+
+    std::vector<Node> nodes_;
+    std::vector<int32_t> roots_;        ///< Root of each tree
+    std::vector<float> leaf_values_;    ///< nl_ values per leaf
+    std::vector<Pending> pending_;
+
+    std::vector<int> dense_index_;      ///< Dense index of each feature
+    std::vector<std::vector<float> > thresholds_;  ///< Split values per feature
+    std::map<int, uint32_t> feature_slot_;  ///< Dense index -> feature
+
+    /// Maximum number of distinct split values of a single feature
+    static constexpr size_t MAX_THRESHOLDS = 32766;
+
+    /// Number of rows advanced through a tree together
+    static constexpr int INTERLEAVE = 8;
+
+    int32_t add_recursive(const Tree::Ptr & ptr,
+                          const Optimization_Info & info,
+                          float weight);
+
+    int32_t add_leaf(const distribution<float> & pred, float weight);
+
+    /** Convert the row into its quantized form. */
+    void quantize(const float * features, uint16_t * q) const;
+
+    MLDB_ALWAYS_INLINE int32_t step(const Node & node, const uint16_t * q) const
+    {
+        uint16_t v = q[node.feature];
+        int missing = v == MISSING_Q;
+        int result = ((v <= node.threshold) & ((node.op & OP_LESS) != 0))
+            | ((v == node.threshold) & ((node.op & OP_EQUAL) != 0))
+            | ((node.op & OP_NOT_MISSING) != 0);
+        return node.child[missing ? 2 : !result];
+    }
+};
+
+
+} // namespace ML
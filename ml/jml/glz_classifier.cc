@@ -12,6 +12,7 @@
 #include "null_feature_space.h"
 #include "mldb/ml/jml/dense_features.h"
 #include "mldb/ml/algebra/irls.h"
+#include "mldb/arch/simd_vector.h"
 #include <boost/timer.hpp>
 #include "training_index.h"
 
@@ -236,6 +237,40 @@ optimized_predict_impl(int label,
     return do_predict_impl(label, features_c, &feature_indexes[0]);
 }
 
+void
+GLZ_Classifier::
+optimized_predict_batch_impl(const float * features_c,
+                             size_t num_rows,
+                             size_t stride,
+                             const Optimization_Info & info,
+                             double * output,
+                             PredictionContext * context) const
+{
+    int nl = label_count();
+    size_t nf = features.size();
+    size_t nw = nf + add_bias;
+
+    // Decode the batch into a matrix, with a trailing 1 for the bias so
+    // that it's included in the dot product
+    std::vector<float> decoded(num_rows * nw);
+    for (size_t r = 0;  r < num_rows;  ++r) {
+        const float * row = features_c + r * stride;
+        float * out = &decoded[r * nw];
+        for (unsigned j = 0;  j < nf;  ++j)
+            out[j] = decode_value(row[feature_indexes[j]], features[j]);
+        if (add_bias)
+            out[nf] = 1.0;
+    }
+
+    for (size_t r = 0;  r < num_rows;  ++r) {
+        const float * row = &decoded[r * nw];
+        for (unsigned i = 0;  i < nl;  ++i) {
+            double accum = SIMD::vec_dotprod_dp(row, &weights[i][0], nw);
+            output[r * nl + i] += apply_link_inverse(accum, link);
+        }
+    }
+}
+
 float
 GLZ_Classifier::
 decode_value(float feat_val, const Feature_Spec & spec) const
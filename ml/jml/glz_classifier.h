@@ -150,6 +150,17 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    /** Decodes the whole batch into a matrix, and scores each row with
+        one dot product per label.
+    */
+    virtual void
+    optimized_predict_batch_impl(const float * features,
+                                 size_t num_rows,
+                                 size_t stride,
+                                 const Optimization_Info & info,
+                                 double * output,
+                                 PredictionContext * context = 0) const;
+
 #ifndef MLDB_TESTING_GLZ_CLASSIFIER
 protected:
 #endif
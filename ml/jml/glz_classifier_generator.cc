@@ -200,28 +200,17 @@ generate(Thread_Context & thread_context,
     return make_sp(current.make_copy());
 }
 
-float
+void
 GLZ_Classifier_Generator::
-train_weighted(Thread_Context & thread_context,
-               const Training_Data & data,
-               const boost::multi_array<float, 2> & weights,
-               const std::vector<Feature> & unfiltered,
-               GLZ_Classifier & result) const
+choose_features(Thread_Context & thread_context,
+                const Training_Data & data,
+                const std::vector<Feature> & unfiltered,
+                const Feature & predicted,
+                float feature_proportion,
+                GLZ_Classifier & result)
 {
-    /* Algorithm:
-       1.  Convert training data to a dense format;
-       2.  Train on each column
-    */
-
-    result = model;
-    result.features.clear();
-    result.add_bias = add_bias;
-    result.link = (do_decode ? link_function : LINEAR);
-
-    Feature predicted = model.predicted();
-    
     for (unsigned i = 0;  i < unfiltered.size();  ++i) {
-        if (unfiltered[i] == model.predicted())
+        if (unfiltered[i] == predicted)
             continue;  // don't use the label to predict itself
 
         // If we don't want to use all features then take a random subset
@@ -263,6 +252,30 @@ train_weighted(Thread_Context & thread_context,
             }
         }
     }
+}
+
+float
+GLZ_Classifier_Generator::
+train_weighted(Thread_Context & thread_context,
+               const Training_Data & data,
+               const boost::multi_array<float, 2> & weights,
+               const std::vector<Feature> & unfiltered,
+               GLZ_Classifier & result) const
+{
+    /* Algorithm:
+       1.  Convert training data to a dense format;
+       2.  Train on each column
+    */
+
+    result = model;
+    result.features.clear();
+    result.add_bias = add_bias;
+    result.link = (do_decode ? link_function : LINEAR);
+
+    Feature predicted = model.predicted();
+
+    choose_features(thread_context, data, unfiltered, predicted,
+                    feature_proportion, result);
     
     size_t nl = result.label_count();        // Number of labels
     bool regression_problem = (nl == 1);
@@ -82,6 +82,18 @@ public:
                          const boost::multi_array<float, 2> & weights,
                          const std::vector<Feature> & features,
                          GLZ_Classifier & result) const;
+
+    /** Fill in the variables of result from the features available for
+        training, skipping the predicted one.  Each categorical feature
+        gives one variable per category.  Shared with the other generators
+        that train a GLZ_Classifier.
+    */
+    static void choose_features(Thread_Context & thread_context,
+                                const Training_Data & data,
+                                const std::vector<Feature> & features,
+                                const Feature & predicted,
+                                float feature_proportion,
+                                GLZ_Classifier & result);
 };
 
 
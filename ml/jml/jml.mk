@@ -10,6 +10,7 @@ LIBBOOSTING_SOURCES := \
         data_aliases.cc \
         decoded_classifier.cc \
         decision_tree.cc \
+        flat_tree.cc \
         null_feature_space.cc \
         decoder.cc \
         dense_features.cc \
@@ -39,6 +40,7 @@ LIBBOOSTING_SOURCES := \
         decision_tree_generator.cc \
         feature_transformer.cc \
         glz_classifier_generator.cc \
+        sgd_classifier_generator.cc \
         classifier_generator.cc \
         stump_generator.cc \
         binary_symmetric.cc \
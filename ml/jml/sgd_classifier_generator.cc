@@ -0,0 +1,500 @@
+/* sgd_classifier_generator.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Generator for glz_classifiers trained with parallel stochastic gradient
+   descent.
+*/
+
+#include "sgd_classifier_generator.h"
+#include "glz_classifier_generator.h"
+#include "mldb/ml/jml/registry.h"
+#include "training_index.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/arch/timers.h"
+#include "mldb/base/parallel.h"
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <cmath>
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* SGD_CLASSIFIER_GENERATOR                                                  */
+/*****************************************************************************/
+
+SGD_Classifier_Generator::
+SGD_Classifier_Generator()
+{
+    defaults();
+}
+
+SGD_Classifier_Generator::~SGD_Classifier_Generator()
+{
+}
+
+void
+SGD_Classifier_Generator::
+configure(const Configuration & config, vector<string> & unparsedKeys)
+{
+    Classifier_Generator::configure(config, unparsedKeys);
+    config.findAndRemove(add_bias, "add_bias", unparsedKeys);
+    config.findAndRemove(do_decode, "decode", unparsedKeys);
+    config.findAndRemove(link_function, "link_function", unparsedKeys);
+    config.findAndRemove(update_alg, "update_alg", unparsedKeys);
+    config.findAndRemove(num_epochs, "num_epochs", unparsedKeys);
+    config.findAndRemove(learning_rate, "learning_rate", unparsedKeys);
+    config.findAndRemove(ftrl_alpha, "ftrl_alpha", unparsedKeys);
+    config.findAndRemove(ftrl_beta, "ftrl_beta", unparsedKeys);
+    config.findAndRemove(l1, "l1", unparsedKeys);
+    config.findAndRemove(l2, "l2", unparsedKeys);
+    config.findAndRemove(feature_proportion, "feature_proportion", unparsedKeys);
+
+    if (link_function != LOGIT && link_function != LINEAR)
+        throw Exception("sgd classifier only supports the logit and linear "
+                        "link functions, not " + print(link_function));
+    if (num_epochs < 1)
+        throw Exception("sgd classifier needs at least one epoch");
+    if (learning_rate <= 0.0 || ftrl_alpha <= 0.0 || ftrl_beta < 0.0)
+        throw Exception("sgd classifier learning rates must be positive");
+    if (l1 < 0.0 || l2 < 0.0)
+        throw Exception("sgd classifier regularization can't be negative");
+}
+
+void
+SGD_Classifier_Generator::
+defaults()
+{
+    Classifier_Generator::defaults();
+    link_function = LOGIT;
+    add_bias = true;
+    do_decode = true;
+    update_alg = SGD_UPDATE_FTRL;
+    num_epochs = 5;
+    learning_rate = 0.1;
+    ftrl_alpha = 0.1;
+    ftrl_beta = 1.0;
+    l1 = 0.0;
+    l2 = 1e-5;
+    feature_proportion = 1.0;
+}
+
+Config_Options
+SGD_Classifier_Generator::
+options() const
+{
+    Config_Options result = Classifier_Generator::options();
+    result
+        .add("add_bias", add_bias,
+             "add a constant bias term to the classifier?")
+        .add("decode", do_decode,
+             "run the decoder (link function) after classification?")
+        .add("link_function", link_function,
+             "which link function to use for the output function; only "
+             "logit (logistic regression) and linear (least squares) are "
+             "supported")
+        .add("update_alg", update_alg,
+             "update rule: sgd is plain stochastic gradient descent with a "
+             "decaying learning rate, ftrl adapts the learning rate of each "
+             "weight and gives sparse models with L1 regularization")
+        .add("num_epochs", num_epochs, "1 to infinite",
+             "number of passes over the training data")
+        .add("learning_rate", learning_rate, "positive number",
+             "learning rate of the first epoch for the sgd update rule; it "
+             "decays with the square root of the epoch number")
+        .add("ftrl_alpha", ftrl_alpha, "positive number",
+             "scale of the per-weight learning rates for the ftrl update "
+             "rule")
+        .add("ftrl_beta", ftrl_beta, "0 to infinite",
+             "smoothing of the per-weight learning rates for the ftrl "
+             "update rule")
+        .add("l1", l1, "0 to infinite",
+             "L1 regularization factor, which drives weights of useless "
+             "features to zero")
+        .add("l2", l2, "0 to infinite",
+             "L2 regularization factor")
+        .add("feature_proportion", feature_proportion, "0 to 1",
+             "use only a (random) portion of available features when training"
+             " classifier");
+
+    return result;
+}
+
+void
+SGD_Classifier_Generator::
+init(std::shared_ptr<const Feature_Space> fs, Feature predicted)
+{
+    Classifier_Generator::init(fs, predicted);
+    model = GLZ_Classifier(fs, predicted);
+}
+
+std::shared_ptr<Classifier_Impl>
+SGD_Classifier_Generator::
+generate(Thread_Context & thread_context,
+         const Training_Data & training_data,
+         const boost::multi_array<float, 2> & weights,
+         const std::vector<Feature> & features,
+         float & Z,
+         int) const
+{
+    GLZ_Classifier current(model);
+
+    train_weighted(thread_context, training_data, weights, features, current);
+
+    Z = 0.0;
+
+    return make_sp(current.make_copy());
+}
+
+namespace {
+
+/** The variables of the GLZ model that the values of a feature map
+    onto.
+*/
+struct Sparse_Variables {
+    int value = -1;      ///< VALUE or VALUE_IF_PRESENT variable
+    int presence = -1;   ///< PRESENCE variable
+    std::unordered_map<float, int> categories;  ///< VALUE_EQUALS variables
+};
+
+struct Feature_Hash {
+    size_t operator () (const Feature & feature) const
+    {
+        return feature.hash();
+    }
+};
+
+// The weights are shared between all threads without any locking.  Relaxed
+// loads and stores make this well defined; a race between two threads can
+// only lose one of the updates, which SGD tolerates.
+inline float load(const std::atomic<float> & val)
+{
+    return val.load(std::memory_order_relaxed);
+}
+
+inline void store(std::atomic<float> & val, float newVal)
+{
+    val.store(newVal, std::memory_order_relaxed);
+}
+
+} // file scope
+
+float
+SGD_Classifier_Generator::
+train_weighted(Thread_Context & thread_context,
+               const Training_Data & data,
+               const boost::multi_array<float, 2> & weights,
+               const std::vector<Feature> & unfiltered,
+               GLZ_Classifier & result) const
+{
+    /* Algorithm:
+       1.  Convert the training data to sparse rows of variables;
+       2.  Run epochs of SGD over the rows, in parallel and in a random
+           order, with all threads updating the same weights
+    */
+
+    result = model;
+    result.features.clear();
+    result.add_bias = add_bias;
+    result.link = (do_decode ? link_function : LINEAR);
+
+    Feature predicted = model.predicted();
+
+    GLZ_Classifier_Generator::choose_features(thread_context, data, unfiltered,
+                                              predicted, feature_proportion,
+                                              result);
+
+    size_t nl = result.label_count();        // Number of labels
+    bool regression_problem = (nl == 1);
+    size_t nx = data.example_count();        // Number of examples
+    size_t nv = result.features.size();      // Number of variables
+    if (add_bias) ++nv;
+    int bias = add_bias ? nv - 1 : -1;
+
+    // Binary problems only learn the weights of the first label
+    int nlr = nl;
+    if (nl == 2) nlr = 1;
+
+    Timer t;
+
+    // Where each feature value goes in the vector of variables
+    std::unordered_map<Feature, Sparse_Variables, Feature_Hash> variables;
+    for (unsigned i = 0;  i < result.features.size();  ++i) {
+        const GLZ_Classifier::Feature_Spec & spec = result.features[i];
+        Sparse_Variables & vars = variables[spec.feature];
+        switch (spec.type) {
+        case GLZ_Classifier::Feature_Spec::VALUE:
+        case GLZ_Classifier::Feature_Spec::VALUE_IF_PRESENT:
+            vars.value = i;
+            break;
+        case GLZ_Classifier::Feature_Spec::PRESENCE:
+            vars.presence = i;
+            break;
+        case GLZ_Classifier::Feature_Spec::VALUE_EQUALS:
+            vars.categories[spec.value] = i;
+            break;
+        default:
+            throw Exception("invalid feature spec type");
+        }
+    }
+
+    // This contains a list of non-zero weighted examples
+    std::vector<int> indexes;
+    indexes.reserve(nx);
+    for (unsigned x = 0;  x < nx;  ++x) {
+        double total_weight = 0.0;
+        for (unsigned l = 0;  l < weights.shape()[1];  ++l)
+            total_weight += weights[x][l];
+        if (total_weight > 0.0)
+            indexes.push_back(x);
+    }
+
+    size_t nx2 = indexes.size();
+
+    /* Get the labels by example. */
+    const vector<Label> & labels = data.index().labels(predicted);
+
+    // Target and weight of each example for each learnt label
+    std::vector<float> correct(nx2 * nlr), w(nx2 * nlr);
+
+    // Sparse variables of each example, in compressed row format
+    std::vector<std::vector<std::pair<int, float> > > rows(nx2);
+
+    auto onIndex = [&] (int index)
+        {
+            int x = indexes[index];
+
+            std::vector<std::pair<int, float> > & row = rows[index];
+
+            for (auto it = data[x].begin(), end = data[x].end();
+                 it != end;  ++it) {
+                auto found = variables.find(it.feature());
+                if (found == variables.end())
+                    continue;
+                float val = (*it).second;
+                if (!isfinite(val))
+                    continue;  // missing values decode to zero
+                const Sparse_Variables & vars = found->second;
+                if (vars.value != -1 && val != 0.0)
+                    row.emplace_back(vars.value, val);
+                if (vars.presence != -1)
+                    row.emplace_back(vars.presence, 1.0);
+                if (!vars.categories.empty()) {
+                    auto cat = vars.categories.find(val);
+                    if (cat != vars.categories.end())
+                        row.emplace_back(cat->second, 1.0);
+                }
+            }
+            if (add_bias)
+                row.emplace_back(bias, 1.0);
+
+            for (unsigned l = 0;  l < nlr;  ++l) {
+                correct[index * nlr + l]
+                    = regression_problem
+                    ? labels[x].value()
+                    : (double)(labels[x] == l);
+                w[index * nlr + l]
+                    = weights[x][std::min<size_t>(l, weights.shape()[1] - 1)];
+            }
+        };
+
+    MLDB::parallelMap(0, nx2, onIndex);
+
+    std::vector<size_t> offsets(nx2 + 1);
+    for (size_t i = 0;  i < nx2;  ++i)
+        offsets[i + 1] = offsets[i] + rows[i].size();
+
+    std::vector<int> rowVars(offsets.back());
+    std::vector<float> rowValues(offsets.back());
+    for (size_t i = 0;  i < nx2;  ++i) {
+        for (size_t j = 0;  j < rows[i].size();  ++j) {
+            rowVars[offsets[i] + j] = rows[i][j].first;
+            rowValues[offsets[i] + j] = rows[i][j].second;
+        }
+        std::vector<std::pair<int, float> >().swap(rows[i]);
+    }
+
+    // Scale the example weights to average one, so that the learning
+    // rates don't depend on how the weights were normalized
+    double weight_total = 0.0;
+    for (float ew: w)
+        weight_total += ew;
+    if (weight_total > 0.0) {
+        float scale = w.size() / weight_total;
+        for (float & ew: w)
+            ew *= scale;
+    }
+
+    if (verbosity > 0)
+        cerr << "sgd marshalling: " << nx2 << " examples with "
+             << offsets.back() << " values over " << nv << " variables in "
+             << t.elapsed() << endl;
+    t.restart();
+
+    // Weights (for sgd) or the z and n accumulators (for ftrl) of each
+    // variable, with the labels of a variable next to each other
+    size_t nw = nv * nlr;
+    std::unique_ptr<std::atomic<float>[]> weightsOrZ(new std::atomic<float>[nw]);
+    std::unique_ptr<std::atomic<float>[]> ftrlN;
+    for (size_t i = 0;  i < nw;  ++i)
+        store(weightsOrZ[i], 0.0f);
+    if (update_alg == SGD_UPDATE_FTRL) {
+        ftrlN.reset(new std::atomic<float>[nw]);
+        for (size_t i = 0;  i < nw;  ++i)
+            store(ftrlN[i], 0.0f);
+    }
+
+    // The bias is never regularized
+    auto getWeight = [&] (size_t i, bool regularize) -> float
+        {
+            if (update_alg == SGD_UPDATE_SGD)
+                return load(weightsOrZ[i]);
+
+            // FTRL-Proximal: the weight is a closed form function of the
+            // accumulated gradients
+            float z = load(weightsOrZ[i]);
+            float l1i = regularize ? l1 : 0.0;
+            if (fabs(z) <= l1i)
+                return 0.0;
+            float l2i = regularize ? l2 : 0.0;
+            return -(z - copysign(l1i, z))
+                / ((ftrl_beta + sqrt(load(ftrlN[i]))) / ftrl_alpha + l2i);
+        };
+
+    std::mutex lossMutex;
+    std::mt19937 rng(thread_context.random());
+
+    for (int epoch = 0;  epoch < num_epochs;  ++epoch) {
+        std::vector<int> order(nx2);
+        for (size_t i = 0;  i < nx2;  ++i)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+
+        double eta = learning_rate / sqrt(1.0 + epoch);
+        double epoch_loss = 0.0;
+
+        auto doExamples = [&] (size_t first, size_t last)
+            {
+                std::vector<float> current;
+                double loss = 0.0;
+
+                for (size_t i = first;  i < last;  ++i) {
+                    int index = order[i];
+                    size_t begin = offsets[index];
+                    int n = offsets[index + 1] - begin;
+                    const int * vars = &rowVars[begin];
+                    const float * vals = &rowValues[begin];
+
+                    current.resize(n);
+
+                    for (unsigned l = 0;  l < nlr;  ++l) {
+                        double margin = 0.0;
+                        for (int j = 0;  j < n;  ++j) {
+                            current[j] = getWeight(vars[j] * nlr + l,
+                                                   vars[j] != bias);
+                            margin += current[j] * vals[j];
+                        }
+
+                        float y = correct[index * nlr + l];
+                        float ew = w[index * nlr + l];
+                        double p;
+                        if (link_function == LOGIT) {
+                            p = 1.0 / (1.0 + exp(-margin));
+                            double pc = std::min(std::max(p, 1e-15), 1.0 - 1e-15);
+                            loss -= ew * (y * std::log(pc) + (1.0 - y) * std::log(1.0 - pc));
+                        }
+                        else {
+                            p = margin;
+                            loss += 0.5 * ew * (p - y) * (p - y);
+                        }
+
+                        double g = (p - y) * ew;
+                        if (g == 0.0)
+                            continue;
+
+                        for (int j = 0;  j < n;  ++j) {
+                            size_t k = vars[j] * nlr + l;
+                            bool regularize = vars[j] != bias;
+                            double gi = g * vals[j];
+
+                            if (update_alg == SGD_UPDATE_SGD) {
+                                double wi = load(weightsOrZ[k]);
+                                if (regularize)
+                                    gi += l2 * wi;
+                                wi -= eta * gi;
+                                if (regularize && l1 > 0.0)
+                                    wi = copysign(std::max(0.0, fabs(wi) - eta * l1),
+                                                  wi);
+                                store(weightsOrZ[k], wi);
+                            }
+                            else {
+                                double ni = load(ftrlN[k]);
+                                double sigma
+                                    = (sqrt(ni + gi * gi) - sqrt(ni)) / ftrl_alpha;
+                                store(weightsOrZ[k], load(weightsOrZ[k])
+                                      + gi - sigma * current[j]);
+                                store(ftrlN[k], ni + gi * gi);
+                            }
+                        }
+                    }
+                }
+
+                std::unique_lock<std::mutex> guard(lossMutex);
+                epoch_loss += loss;
+            };
+
+        if (nx2 > 0)
+            MLDB::parallelMapChunked(0, nx2, 1024, doExamples);
+
+        if (verbosity > 0)
+            cerr << "sgd epoch " << epoch << ": loss "
+                 << epoch_loss / std::max<size_t>(1, w.size())
+                 << " in " << t.elapsed() << endl;
+        t.restart();
+    }
+
+    result.weights.clear();
+    for (unsigned l = 0;  l < nlr;  ++l) {
+        distribution<float> trained(nv);
+        for (unsigned v = 0;  v < nv;  ++v)
+            trained[v] = getWeight(v * nlr + l, (int)v != bias);
+        result.weights.push_back(trained);
+    }
+
+    if (nl == 2) {
+        // weights for second label are the mirror of those of the first
+        // label
+        result.weights.push_back(-1.0F * result.weights.front());
+    }
+
+    return 0.0;
+}
+
+
+/*****************************************************************************/
+/* REGISTRATION                                                              */
+/*****************************************************************************/
+
+const Enum_Opt<ML::SGD_Update>
+Enum_Info<ML::SGD_Update>::OPT[2] = {
+    { "sgd",   ML::SGD_UPDATE_SGD  },
+    { "ftrl",  ML::SGD_UPDATE_FTRL } };
+
+const char * Enum_Info<ML::SGD_Update>::NAME
+   = "SGD_Update";
+
+namespace {
+
+Register_Factory<Classifier_Generator, SGD_Classifier_Generator>
+    SGD_CLASSIFIER_REGISTER("sgd");
+
+} // file scope
+
+} // namespace ML
@@ -0,0 +1,99 @@
+/* sgd_classifier_generator.h                                      -*- C++ -*-
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Generator for a glz_classifier trained with parallel stochastic gradient
+   descent over sparse features.
+*/
+
+#pragma once
+
+#include "classifier_generator.h"
+#include "glz_classifier.h"
+#include "mldb/jml/utils/enum_info.h"
+
+
+namespace ML {
+
+
+/** Update rule used by the SGD generator. */
+enum SGD_Update {
+    SGD_UPDATE_SGD,    ///< Plain SGD with a decaying learning rate
+    SGD_UPDATE_FTRL    ///< Follow the regularized leader (FTRL-Proximal)
+};
+
+
+/*****************************************************************************/
+/* SGD_CLASSIFIER_GENERATOR                                                  */
+/*****************************************************************************/
+
+/** Trains the same linear models as the GLZ_Classifier_Generator (logistic
+    or linear regression), but with stochastic gradient descent instead of
+    IRLS.  The examples are kept sparse and the weights are updated by all
+    threads at once without locking (Hogwild), so the cost is linear in the
+    number of non-zero feature values and it scales to millions of
+    features, for example from a feature hasher.
+
+    Only the logit and linear link functions are supported.
+*/
+
+class SGD_Classifier_Generator : public Classifier_Generator {
+public:
+    SGD_Classifier_Generator();
+
+    virtual ~SGD_Classifier_Generator();
+
+    /** Configure the generator with its parameters. */
+    virtual void
+    configure(const Configuration & config,
+              std::vector<std::string> & unparsedKeys) override;
+
+    /** Return to the default configuration. */
+    virtual void defaults() override;
+
+    /** Return possible configuration options. */
+    virtual Config_Options options() const override;
+
+    /** Initialize the generator, given the feature space to be used for
+        generation. */
+    virtual void init(std::shared_ptr<const Feature_Space> fs,
+                      Feature predicted) override;
+
+    using Classifier_Generator::generate;
+
+    /** Generate a classifier from one training set. */
+    virtual std::shared_ptr<Classifier_Impl>
+    generate(Thread_Context & context,
+             const Training_Data & training_data,
+             const boost::multi_array<float, 2> & weights,
+             const std::vector<Feature> & features,
+             float & Z,
+             int) const override;
+
+    bool add_bias;          ///< Do we add and learn a bias term?
+    bool do_decode;         ///< Do we run a decoder at all?
+    Link_Function link_function;
+    SGD_Update update_alg;  ///< Update rule
+    int num_epochs;         ///< Number of passes over the training data
+    double learning_rate;   ///< Initial learning rate for plain SGD
+    double ftrl_alpha;      ///< Per-coordinate learning rate scale for FTRL
+    double ftrl_beta;       ///< Per-coordinate learning rate smoothing
+    double l1;              ///< L1 regularization factor
+    double l2;              ///< L2 regularization factor
+    float feature_proportion;
+
+    /* Once init has been called, we clone our potential models from this
+       one. */
+    GLZ_Classifier model;
+
+    float train_weighted(Thread_Context & thread_context,
+                         const Training_Data & data,
+                         const boost::multi_array<float, 2> & weights,
+                         const std::vector<Feature> & features,
+                         GLZ_Classifier & result) const;
+};
+
+
+} // namespace ML
+
+DECLARE_ENUM_INFO(ML::SGD_Update, 2);
@@ -0,0 +1,174 @@
+/* flat_tree_test.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that the flattened trees predict the same as the tree walk.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+#include <random>
+#include <cmath>
+
+#include "mldb/ml/jml/decision_tree.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/flat_tree.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+/* Features are: 0 = label, 1 and 2 = real, 3 = categorical-like. */
+
+Tree::Ptr makeTree(Tree & tree, int depth, std::mt19937 & rng)
+{
+    std::uniform_real_distribution<float> pred(-1.0, 1.0);
+
+    if (depth == 0 || rng() % 5 == 0) {
+        float v = pred(rng);
+        return tree.new_leaf({ -v, v }, 1.0);
+    }
+
+    Tree::Node * node = tree.new_node();
+    int feature = 1 + rng() % 3;
+    if (feature == 3)
+        node->split = Split(Feature(feature), rng() % 4, Split::EQUAL);
+    else if (rng() % 10 == 0)
+        node->split = Split(Feature(feature), 0.0, Split::NOT_MISSING);
+    else node->split = Split(Feature(feature), (rng() % 20) / 4.0, Split::LESS);
+
+    node->child_true = makeTree(tree, depth - 1, rng);
+    node->child_false = makeTree(tree, depth - 1, rng);
+    // Sometimes leave the missing branch empty, which predicts nothing
+    if (rng() % 4 != 0)
+        node->child_missing = makeTree(tree, depth - 1, rng);
+    return node;
+}
+
+/* Rows with values landing on, between and outside the split values, and
+   with missing values. */
+vector<vector<float> > makeRows(int n, std::mt19937 & rng)
+{
+    vector<vector<float> > result;
+    for (int i = 0;  i < n;  ++i) {
+        vector<float> row(4, 0.0);
+        for (int f = 1;  f < 3;  ++f) {
+            switch (rng() % 5) {
+            case 0: row[f] = NAN;  break;
+            case 1: row[f] = (rng() % 24) / 4.0 - 0.5;  break;
+            case 2: row[f] = (rng() % 30) / 5.0 - 0.5;  break;
+            case 3: row[f] = (rng() % 2) ? INFINITY : -INFINITY;  break;
+            default: row[f] = (rng() % 20) / 4.0;
+            }
+        }
+        row[3] = (rng() % 6 == 0) ? NAN : rng() % 5;
+        result.push_back(row);
+    }
+    return result;
+}
+
+std::shared_ptr<Dense_Feature_Space> makeFeatureSpace()
+{
+    auto fs = std::make_shared<Dense_Feature_Space>();
+    fs->add_feature("label", Feature_Info(BOOLEAN));
+    fs->add_feature("x", Feature_Info(REAL));
+    fs->add_feature("y", Feature_Info(REAL));
+    fs->add_feature("c", Feature_Info(REAL));
+    return fs;
+}
+
+std::shared_ptr<Decision_Tree>
+makeDecisionTree(std::shared_ptr<Dense_Feature_Space> fs, std::mt19937 & rng)
+{
+    auto result = std::make_shared<Decision_Tree>(fs, Feature(0));
+    result->tree.root = makeTree(result->tree, 8, rng);
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_flat_decision_tree )
+{
+    std::mt19937 rng(42);
+    auto fs = makeFeatureSpace();
+
+    for (unsigned t = 0;  t < 20;  ++t) {
+        auto dt = makeDecisionTree(fs, rng);
+        Optimization_Info info = dt->optimize(fs->features());
+        BOOST_REQUIRE(dt->flat_);
+
+        auto rows = makeRows(200, rng);
+
+        vector<Label_Dist> flatResults;
+        vector<double> batch(rows.size() * 2);
+        vector<float> flatRows;
+        for (auto & r: rows) {
+            flatResults.push_back(dt->predict(&r[0], info));
+            flatRows.insert(flatRows.end(), r.begin(), r.end());
+        }
+        dt->predict_batch(&flatRows[0], rows.size(), 4, info, &batch[0]);
+
+        // Go back to the tree walk
+        dt->flat_.reset();
+
+        for (unsigned i = 0;  i < rows.size();  ++i) {
+            Label_Dist expected = dt->predict(&rows[i][0], info);
+            BOOST_REQUIRE_EQUAL(expected.size(), 2);
+            BOOST_CHECK_EQUAL(flatResults[i][0], expected[0]);
+            BOOST_CHECK_EQUAL(flatResults[i][1], expected[1]);
+            BOOST_CHECK_EQUAL(batch[i * 2], expected[0]);
+            BOOST_CHECK_EQUAL(batch[i * 2 + 1], expected[1]);
+            BOOST_CHECK_EQUAL(dt->predict(1, &rows[i][0], info), expected[1]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_flat_committee )
+{
+    std::mt19937 rng(1);
+    auto fs = makeFeatureSpace();
+
+    Committee committee(fs, Feature(0));
+    vector<std::shared_ptr<Decision_Tree> > trees;
+    for (unsigned t = 0;  t < 50;  ++t) {
+        trees.push_back(makeDecisionTree(fs, rng));
+        committee.add(trees.back(), 0.5 + (t % 3));
+    }
+    committee.bias = { 0.25, -0.25 };
+
+    Optimization_Info info = committee.optimize(fs->features());
+
+    auto rows = makeRows(1000, rng);
+    vector<float> flatRows;
+    for (auto & r: rows)
+        flatRows.insert(flatRows.end(), r.begin(), r.end());
+
+    vector<double> batch(rows.size() * 2);
+    committee.predict_batch(&flatRows[0], rows.size(), 4, info, &batch[0]);
+
+    for (auto & t: trees)
+        t->flat_.reset();
+
+    for (unsigned i = 0;  i < rows.size();  ++i) {
+        double expected[2] = { 0.25, -0.25 };
+        for (unsigned t = 0;  t < trees.size();  ++t) {
+            Label_Dist dist = trees[t]->predict(&rows[i][0], info);
+            expected[0] += committee.weights[t] * dist[0];
+            expected[1] += committee.weights[t] * dist[1];
+        }
+
+        Label_Dist result = committee.predict(&rows[i][0], info);
+        BOOST_CHECK_SMALL(result[0] - expected[0], 1e-4);
+        BOOST_CHECK_SMALL(result[1] - expected[1], 1e-4);
+        BOOST_CHECK_SMALL(batch[i * 2] - expected[0], 1e-4);
+        BOOST_CHECK_SMALL(batch[i * 2 + 1] - expected[1], 1e-4);
+    }
+}
@@ -0,0 +1,165 @@
+/* sgd_classifier_test.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the SGD trained GLZ classifier.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+#include <random>
+
+#include "mldb/ml/jml/sgd_classifier_generator.h"
+#include "mldb/ml/jml/training_data.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+
+int nfv = 1000;
+
+std::shared_ptr<Classifier_Impl>
+train(const std::string & config_options,
+      std::shared_ptr<Dense_Feature_Space> fsp,
+      const Training_Data & data)
+{
+    Configuration config;
+    config.parse_string(config_options, "inbuilt config file");
+
+    SGD_Classifier_Generator generator;
+    vector<string> unparsedKeys;
+    generator.configure(config, unparsedKeys);
+    BOOST_CHECK(unparsedKeys.empty());
+    generator.init(fsp, fsp->features()[0]);
+
+    distribution<float> training_weights(data.example_count(), 1);
+
+    vector<Feature> features = fsp->features();
+    features.erase(features.begin(), features.begin() + 1);
+
+    Thread_Context context;
+
+    return generator.generate(context, data, training_weights, features);
+}
+
+BOOST_AUTO_TEST_CASE( test_sgd_classifier_separable )
+{
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    fs.add_feature("feature1", REAL);
+    fs.add_feature("feature2", REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+
+    for (unsigned i = 0;  i < nfv;  ++i) {
+        distribution<float> features;
+        features.push_back(i % 3  == 0);
+        features.push_back(i % 3  == 0);
+        features.push_back(i % 5  == 0);
+        data.add_example(fs.encode(features));
+    }
+
+    for (string alg: { "sgd", "ftrl" }) {
+        auto classifier = train("update_alg=" + alg + "\nnum_epochs=10\n",
+                                fsp, data);
+        float accuracy = classifier->accuracy(data).first;
+        cerr << alg << " accuracy = " << accuracy << endl;
+        BOOST_CHECK_EQUAL(accuracy, 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_sgd_classifier_l1_sparsity )
+{
+    // Only feature0 is informative; with a strong L1 penalty FTRL should
+    // leave the weights of the noise features at exactly zero
+    int nf = 20;
+
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+    for (int f = 0;  f < nf;  ++f)
+        fs.add_feature("feature" + to_string(f), REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise;
+    for (unsigned i = 0;  i < 5000;  ++i) {
+        bool label = i % 2;
+        distribution<float> features;
+        features.push_back(label);
+        features.push_back(label ? 1.0 : -1.0);
+        for (int f = 1;  f < nf;  ++f)
+            features.push_back(noise(rng));
+        data.add_example(fs.encode(features));
+    }
+
+    auto classifier = train("update_alg=ftrl\nl1=30\nnum_epochs=3\n",
+                            fsp, data);
+    BOOST_CHECK_GT(classifier->accuracy(data).first, 0.99);
+
+    const GLZ_Classifier & glz
+        = dynamic_cast<const GLZ_Classifier &>(*classifier);
+    BOOST_REQUIRE_EQUAL(glz.weights.size(), 2);
+    BOOST_CHECK_NE(glz.weights[0][0], 0.0);
+
+    int numZero = 0;
+    for (int f = 1;  f < nf;  ++f)
+        numZero += glz.weights[0][f] == 0.0;
+    BOOST_CHECK_GE(numZero, nf - 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_sgd_classifier_regression )
+{
+    Dense_Feature_Space fs;
+    fs.add_feature("LABEL", REAL);
+    fs.add_feature("feature1", REAL);
+    fs.add_feature("feature2", REAL);
+
+    std::shared_ptr<Dense_Feature_Space> fsp(make_unowned_sp(fs));
+
+    Training_Data data(fsp);
+
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    for (unsigned i = 0;  i < 5000;  ++i) {
+        float x1 = uniform(rng), x2 = uniform(rng);
+        distribution<float> features;
+        features.push_back(2.0 * x1 - x2 + 0.5);
+        features.push_back(x1);
+        features.push_back(x2);
+        data.add_example(fs.encode(features));
+    }
+
+    auto classifier
+        = train("link_function=linear\nupdate_alg=ftrl\nftrl_alpha=0.5\n"
+                "num_epochs=10\n", fsp, data);
+
+    const GLZ_Classifier & glz
+        = dynamic_cast<const GLZ_Classifier &>(*classifier);
+    BOOST_REQUIRE_EQUAL(glz.weights.size(), 1);
+    BOOST_CHECK_CLOSE(glz.weights[0][0], 2.0, 5);
+    BOOST_CHECK_CLOSE(glz.weights[0][1], -1.0, 5);
+    BOOST_CHECK_CLOSE(glz.weights[0][2], 0.5, 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_sgd_classifier_bad_link )
+{
+    Configuration config;
+    config.parse_string("link_function=probit\n", "inbuilt config file");
+
+    SGD_Classifier_Generator generator;
+    vector<string> unparsedKeys;
+    BOOST_CHECK_THROW(generator.configure(config, unparsedKeys),
+                      std::exception);
+}
@@ -10,41 +10,170 @@
 #include "kmeans.h"
 
 #include <random>
+#include <algorithm>
+#include <numeric>
+#include <mutex>
 #include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/arch/simd_vector.h"
 
 namespace ML {
 
-void
-KMeans::
-train(const std::vector<distribution<float>> & points,
-      std::vector<int> & in_cluster,
-      int nbClusters,
-      int maxIterations,
-      int randomSeed
-      )
+namespace {
+
+/// Number of points given to each parallel job
+constexpr size_t CHUNK_SIZE = 1024;
+
+/// Number of sampling rounds for the k-means|| initialization
+constexpr int KMEANS_PARALLEL_ROUNDS = 5;
+
+/// Squared euclidean distance between x and y
+double sqDistance(const float * x, const float * y, size_t n)
 {
-    using namespace std;
+    return MLDB::SIMD::vec_euclid(x, y, n);
+}
 
-    if (nbClusters < 2)
-        throw MLDB::Exception("kmeans training requires at least 2 clusters");
-    if (points.size() == 0)
-        throw MLDB::Exception("kmeans training requires at least 1 datapoint");
 
-    mt19937 rng;
-    rng.seed(randomSeed);
+/*****************************************************************************/
+/* CENTROID TABLE                                                            */
+/*****************************************************************************/
 
-    int npoints = points.size();
-    in_cluster.resize(npoints, -1);
-    clusters.resize(nbClusters);
+/** The centroids, laid out so that the closest one to a point can be found
+    with a single dot product per centroid for the euclidean and cosine
+    metrics.  For the euclidean metric, the closest centroid minimizes
+    |c|^2 - 2 x.c; for the cosine metric it maximizes x.c/|c|.
+*/
+struct CentroidTable {
+    CentroidTable(const std::vector<KMeans::Cluster> & clusters,
+                  bool euclidean)
+        : nc(clusters.size()),
+          dim(clusters.at(0).centroid.size()),
+          euclidean(euclidean),
+          centroids(nc * dim), offsets(nc), zero(nc)
+    {
+        for (size_t c = 0;  c < nc;  ++c) {
+            const distribution<float> & centroid = clusters[c].centroid;
+            double norm = centroid.two_norm();
+            zero[c] = norm == 0.0;
+            for (size_t j = 0;  j < dim;  ++j)
+                centroids[c * dim + j]
+                    = euclidean || zero[c] ? centroid[j] : centroid[j] / norm;
+            offsets[c] = euclidean ? norm * norm : 0.0;
+        }
+    }
+
+    size_t nc;
+    size_t dim;
+    bool euclidean;
+    std::vector<float> centroids;
+    std::vector<double> offsets;
+    std::vector<char> zero;       ///< Is the centroid a zero vector?
+
+    const float * centroid(size_t c) const
+    {
+        return &centroids[c * dim];
+    }
+
+    /** Return the closest centroid to the point.  If second is not null,
+        the second closest one is put there (-1 if there is none).
+    */
+    int nearest(const float * x, int * second = nullptr) const
+    {
+        double best = INFINITY, secondBest = INFINITY;
+        int bestCluster = -1, secondCluster = -1;
+
+        auto consider = [&] (int c, double score)
+            {
+                if (score < best) {
+                    secondBest = best;
+                    secondCluster = bestCluster;
+                    best = score;
+                    bestCluster = c;
+                }
+                else if (score < secondBest) {
+                    secondBest = score;
+                    secondCluster = c;
+                }
+            };
+
+        if (euclidean) {
+            for (size_t c = 0;  c < nc;  ++c) {
+                double dotprod
+                    = MLDB::SIMD::vec_dotprod_dp(x, centroid(c), dim);
+                consider(c, offsets[c] - 2.0 * dotprod);
+            }
+        }
+        else {
+            // Same distances as KMeansCosineMetric, including for zero
+            // vectors
+            double xnorm = sqrt(MLDB::SIMD::vec_dotprod_dp(x, x, dim));
+            for (size_t c = 0;  c < nc;  ++c) {
+                if (xnorm == 0.0)
+                    consider(c, zero[c] ? -1.0 : 2.0);
+                else if (zero[c])
+                    consider(c, 2.0);
+                else consider(c, -MLDB::SIMD::vec_dotprod_dp(x, centroid(c), dim)
+                              / xnorm);
+            }
+        }
+
+        if (second)
+            *second = secondCluster;
+
+        // Points with infinite or nan distance go in cluster 0, as in
+        // KMeans::assign()
+        return bestCluster == -1 ? 0 : bestCluster;
+    }
+};
+
+
+/*****************************************************************************/
+/* INITIALIZATION                                                            */
+/*****************************************************************************/
+
+/** Cost of x being represented by c, which weights the sampling of the
+    k-means++ and k-means|| initializations.  This is the squared euclidean
+    distance, or its equivalent for the cosine metric.
+*/
+struct InitCost {
+    InitCost(const KMeansMetric & metric, bool euclidean, bool cosine)
+        : metric(metric), euclidean(euclidean), cosine(cosine)
+    {
+    }
+
+    const KMeansMetric & metric;
+    bool euclidean;
+    bool cosine;
+
+    double operator () (const distribution<float> & x,
+                        const distribution<float> & c) const
+    {
+        double result;
+        if (euclidean)
+            result = sqDistance(x.data(), c.data(), x.size());
+        else if (cosine)
+            result = std::max(0.0, 1.0 + metric.distance(x, c));
+        else {
+            double d = metric.distance(x, c);
+            result = d * d;
+        }
+        // Never sample points that we can't measure
+        return std::isfinite(result) ? result : 0.0;
+    }
+};
+
+/** The original initialization: each centroid is the farthest of a
+    sample of 100 random points from the closest centroid already chosen.
+*/
+void initSampled(const KMeansMetric & metric,
+                 const std::vector<distribution<float> > & points,
+                 std::vector<KMeans::Cluster> & clusters,
+                 std::mt19937 & rng)
+{
+    using namespace std;
 
-    // Smart initialization of the centroids
-    // FIXME http://en.wikipedia.org/wiki/K-means%2B%2B#Initialization_algorithm
     clusters[0].centroid = points[rng() % points.size()];
     int n = min(100, (int) points.size()/2);
-    for (int i=1; i < nbClusters; ++i) {
-        // This is my version of the wiki algorithm :
-        // Amongst 100 random points, I take the farthest from the closest
-        // centroid as the next centroid
+    for (int i=1; i < clusters.size(); ++i) {
         float distMax = -INFINITY;
         int bestPoint = -1;
         // We try it for 100 points
@@ -53,18 +182,11 @@ train(const std::vector<distribution<float>> & points,
             int randomIdx = rng() % points.size();
             // Find the closest cluster
             float distMin = INFINITY;
-            // For each cluster
             for (int k=0; k < i; ++k) {
-
-                float dist = metric->distance(points[randomIdx], clusters[k].centroid);
-
-                if (dist < distMin) {
+                float dist = metric.distance(points[randomIdx],
+                                             clusters[k].centroid);
+                if (dist < distMin)
                     distMin = dist;
-                    // cerr << "NEW MIN" << endl;
-                }
-                // cerr << "point " << j << " norm " << points[randomIdx].two_norm() << endl;
-                // cerr << "cluster " << k << " norm " << clusters[k].centroid.two_norm() << endl;
-                // cerr << "distance " << dist << endl;
             }
             if (distMin > distMax) {
                 distMax = distMin;
@@ -76,49 +198,501 @@ train(const std::vector<distribution<float>> & points,
             bestPoint = rng() % points.size();
         }
         clusters[i].centroid = points[bestPoint];
-        // cerr << "norm of best init centroid " << clusters[i].centroid.two_norm() << endl;
     }
+}
 
+/** k-means++ seeding (Arthur and Vassilvitskii, 2007): choose k of the n
+    candidates, each one with a probability proportional to its weight
+    times its cost against the closest one already chosen.  An empty
+    weights vector gives all candidates a weight of one.  The costs are
+    updated in parallel after each choice.
+*/
+std::vector<size_t>
+seedPlusPlus(const InitCost & cost,
+             const std::function<const distribution<float> & (size_t)> & candidate,
+             size_t n,
+             const std::vector<double> & weights,
+             int k,
+             size_t dim,
+             std::mt19937 & rng)
+{
+    size_t numChunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<double> minCost(n, INFINITY);
+    std::vector<double> chunkTotals(numChunks);
+    std::vector<size_t> result;
+
+    auto weight = [&] (size_t i)
+        {
+            return weights.empty() ? 1.0 : weights[i];
+        };
 
-    for (int iter = 0;  iter < maxIterations;  ++iter) {
+    auto addCenter = [&] (size_t chosen)
+        {
+            result.push_back(chosen);
+            if (result.size() == k)
+                return;
+
+            const distribution<float> & c = candidate(chosen);
+
+            auto onChunk = [&] (size_t begin, size_t end)
+                {
+                    double total = 0.0;
+                    for (size_t i = begin;  i < end;  ++i) {
+                        minCost[i] = std::min(minCost[i],
+                                              cost(candidate(i), c));
+                        total += weight(i) * minCost[i];
+                    }
+                    chunkTotals[begin / CHUNK_SIZE] = total;
+                };
+
+            MLDB::parallelMapChunked(0, n, CHUNK_SIZE, onChunk);
+        };
 
-        // How many have changed cluster?  Used to know when the cluster
-        // contents are stable
-        std::atomic<int> changes(0);
+    // Pick the first one in proportion to the weights only
+    if (weights.empty())
+        addCenter(rng() % n);
+    else {
+        double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+        double r = std::uniform_real_distribution<double>(0.0, total)(rng);
+        size_t chosen = 0;
+        while (chosen < n - 1 && r >= weights[chosen])
+            r -= weights[chosen++];
+        addCenter(chosen);
+    }
 
-        // Unfortunately, std::atomic can't be copied or moved, so we need
-        // a wrapper to put it in a vector
-        struct AI: public std::atomic<int> {
-            AI(int n = 0)
-                : std::atomic<int>(n)
-            {
+    while (result.size() < k) {
+        double total = std::accumulate(chunkTotals.begin(), chunkTotals.end(),
+                                       0.0);
+        if (!(total > 0.0)) {
+            // Every candidate is on top of a chosen one
+            addCenter(rng() % n);
+            continue;
+        }
+
+        double r = std::uniform_real_distribution<double>(0.0, total)(rng);
+
+        // Find the chunk, then the point within it
+        size_t chunk = 0;
+        while (chunk < numChunks - 1 && r >= chunkTotals[chunk])
+            r -= chunkTotals[chunk++];
+
+        size_t end = std::min(n, (chunk + 1) * CHUNK_SIZE);
+        size_t chosen = end - 1;
+        for (size_t i = chunk * CHUNK_SIZE;  i < end;  ++i) {
+            double w = weight(i) * minCost[i];
+            if (r < w) {
+                chosen = i;
+                break;
             }
+            r -= w;
+        }
+
+        addCenter(chosen);
+    }
+
+    return result;
+}
+
+/** k-means|| seeding (Bahmani et al., 2012).  A few rounds each sample
+    around 2k points independently, in parallel, in proportion to their
+    cost against the points sampled so far.  The sampled points are then
+    weighted by the number of points closest to them, and reduced to k
+    with k-means++.
+*/
+std::vector<size_t>
+seedParallel(const InitCost & cost,
+             const std::vector<distribution<float> > & points,
+             int k,
+             size_t dim,
+             int randomSeed,
+             std::mt19937 & rng)
+{
+    size_t n = points.size();
+    size_t numChunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    std::vector<size_t> centers = { rng() % n };
+    std::vector<double> minCost(n, INFINITY);
+    std::vector<int> nearest(n, 0);
+    std::vector<double> chunkTotals(numChunks);
+
+    // Update the costs against the centers from first onwards
+    auto updateCosts = [&] (size_t first)
+        {
+            auto onChunk = [&] (size_t begin, size_t end)
+                {
+                    double total = 0.0;
+                    for (size_t i = begin;  i < end;  ++i) {
+                        for (size_t c = first;  c < centers.size();  ++c) {
+                            double d = cost(points[i], points[centers[c]]);
+                            if (d < minCost[i]) {
+                                minCost[i] = d;
+                                nearest[i] = c;
+                            }
+                        }
+                        total += minCost[i];
+                    }
+                    chunkTotals[begin / CHUNK_SIZE] = total;
+                };
+
+            MLDB::parallelMapChunked(0, n, CHUNK_SIZE, onChunk);
+        };
+
+    updateCosts(0);
 
-            AI & operator = (const AI & other) noexcept
+    double oversampling = 2.0 * k;
+
+    for (int round = 0;  round < KMEANS_PARALLEL_ROUNDS;  ++round) {
+        double total = std::accumulate(chunkTotals.begin(), chunkTotals.end(),
+                                       0.0);
+        if (!(total > 0.0))
+            break;
+
+        std::vector<std::vector<size_t> > sampled(numChunks);
+
+        auto onChunk = [&] (size_t begin, size_t end)
             {
-                store(other.load());
-                return *this;
+                // Random numbers depend on the chunk only, so that the
+                // result doesn't depend on the scheduling
+                std::seed_seq seed{ randomSeed, round,
+                                    (int)(begin / CHUNK_SIZE) };
+                std::mt19937 chunkRng(seed);
+                std::uniform_real_distribution<double> uniform(0.0, total);
+
+                for (size_t i = begin;  i < end;  ++i) {
+                    if (uniform(chunkRng) < oversampling * minCost[i])
+                        sampled[begin / CHUNK_SIZE].push_back(i);
+                }
+            };
+
+        MLDB::parallelMapChunked(0, n, CHUNK_SIZE, onChunk);
+
+        size_t first = centers.size();
+        for (auto & s: sampled)
+            centers.insert(centers.end(), s.begin(), s.end());
+        if (centers.size() > first)
+            updateCosts(first);
+    }
+
+    if (centers.size() <= k) {
+        while (centers.size() < k)
+            centers.push_back(rng() % n);
+        return centers;
+    }
+
+    std::vector<double> weights(centers.size());
+    for (size_t i = 0;  i < n;  ++i)
+        weights[nearest[i]] += 1.0;
+
+    auto chosen = seedPlusPlus(cost,
+                               [&] (size_t i) -> const distribution<float> &
+                               {
+                                   return points[centers[i]];
+                               },
+                               centers.size(), weights, k, dim, rng);
+
+    std::vector<size_t> result;
+    for (size_t c: chosen)
+        result.push_back(centers[c]);
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* KMEANS                                                                    */
+/*****************************************************************************/
+
+void
+KMeans::
+train(const std::vector<distribution<float>> & points,
+      std::vector<int> & in_cluster,
+      int nbClusters,
+      int maxIterations,
+      int randomSeed
+      )
+{
+    using namespace std;
+
+    if (nbClusters < 2)
+        throw MLDB::Exception("kmeans training requires at least 2 clusters");
+    if (points.size() == 0)
+        throw MLDB::Exception("kmeans training requires at least 1 datapoint");
+
+    mt19937 rng;
+    rng.seed(randomSeed);
+
+    int npoints = points.size();
+    size_t dim = points[0].size();
+    in_cluster.resize(npoints, -1);
+    clusters.resize(nbClusters);
+
+    for (auto & p: points) {
+        if (p.size() != dim)
+            throw MLDB::Exception("kmeans training requires all points to "
+                                  "have the same number of dimensions");
+    }
+
+    bool euclidean = !!dynamic_cast<const KMeansEuclideanMetric *>(metric.get());
+    bool cosine = !!dynamic_cast<const KMeansCosineMetric *>(metric.get());
+
+    InitCost cost(*metric, euclidean, cosine);
+
+    switch (initialization) {
+    case INIT_SAMPLED:
+        initSampled(*metric, points, clusters, rng);
+        break;
+    case INIT_KMEANS_PLUS_PLUS: {
+        auto chosen = seedPlusPlus(cost,
+                                   [&] (size_t i) -> const distribution<float> &
+                                   {
+                                       return points[i];
+                                   },
+                                   npoints, {}, nbClusters, dim, rng);
+        for (int i = 0;  i < nbClusters;  ++i)
+            clusters[i].centroid = points[chosen[i]];
+        break;
+    }
+    case INIT_KMEANS_PARALLEL: {
+        auto chosen = seedParallel(cost, points, nbClusters, dim,
+                                   randomSeed, rng);
+        for (int i = 0;  i < nbClusters;  ++i)
+            clusters[i].centroid = points[chosen[i]];
+        break;
+    }
+    default:
+        throw MLDB::Exception("unknown kmeans initialization");
+    }
+
+    for (auto & c: clusters)
+        c.nbMembers = 0;
+
+    // The triangle inequality bounds of Hamerly's algorithm: upper is
+    // the distance from each point to its centroid, and lower a bound on
+    // the distance to the second closest centroid.
+    bool hamerly = euclidean && prune && miniBatchSize <= 0;
+    bool boundsValid = false;
+    std::vector<double> upper, lower;
+    std::vector<double> moved(nbClusters, 0.0);
+    if (hamerly) {
+        upper.resize(npoints);
+        lower.resize(npoints);
+    }
+
+    // Assign each point to its closest centroid, returning the number of
+    // points that changed cluster and setting nbMembers.
+    auto assignPoints = [&] () -> int
+        {
+            std::unique_ptr<CentroidTable> table;
+            if (euclidean || cosine)
+                table.reset(new CentroidTable(clusters, euclidean));
+
+            // A point can't be closer to another centroid than the one it's
+            // in if it's closer to its own than halfway to the closest
+            // other one
+            std::vector<double> halfGap;
+            double maxMoved = 0.0, secondMaxMoved = 0.0;
+            int maxMovedCluster = -1;
+
+            if (hamerly) {
+                halfGap.resize(nbClusters, INFINITY);
+                auto onCluster = [&] (size_t c)
+                    {
+                        for (size_t c2 = 0;  c2 < nbClusters;  ++c2) {
+                            if (c2 == c)
+                                continue;
+                            double d = sqDistance(table->centroid(c),
+                                                  table->centroid(c2), dim);
+                            halfGap[c] = std::min(halfGap[c], 0.5 * sqrt(d));
+                        }
+                    };
+                MLDB::parallelMap(0, nbClusters, onCluster);
+
+                for (int c = 0;  c < nbClusters;  ++c) {
+                    if (moved[c] > maxMoved) {
+                        secondMaxMoved = maxMoved;
+                        maxMoved = moved[c];
+                        maxMovedCluster = c;
+                    }
+                    else if (moved[c] > secondMaxMoved)
+                        secondMaxMoved = moved[c];
+                }
             }
+
+            int changes = 0;
+            std::vector<int> numMembers(nbClusters);
+            std::mutex mutex;
+
+            auto onChunk = [&] (size_t begin, size_t end)
+                {
+                    std::vector<int> counts(nbClusters);
+                    int chunkChanges = 0;
+
+                    for (size_t i = begin;  i < end;  ++i) {
+                        const float * x = points[i].data();
+
+                        if (hamerly && boundsValid) {
+                            int current = in_cluster[i];
+                            upper[i] += moved[current];
+                            lower[i] -= (current == maxMovedCluster
+                                         ? secondMaxMoved : maxMoved);
+                            double bound = std::max(halfGap[current], lower[i]);
+                            if (upper[i] <= bound) {
+                                ++counts[current];
+                                continue;
+                            }
+
+                            upper[i] = sqrt(sqDistance
+                                            (x, table->centroid(current), dim));
+                            if (upper[i] <= bound) {
+                                ++counts[current];
+                                continue;
+                            }
+                        }
+
+                        int cluster;
+                        if (hamerly) {
+                            int second;
+                            cluster = table->nearest(x, &second);
+                            upper[i] = sqrt(sqDistance
+                                            (x, table->centroid(cluster), dim));
+                            lower[i] = second == -1 ? INFINITY
+                                : sqrt(sqDistance
+                                       (x, table->centroid(second), dim));
+                        }
+                        else if (table)
+                            cluster = table->nearest(x);
+                        else cluster = this->assign(points[i]);
+
+                        if (cluster != in_cluster[i]) {
+                            ++chunkChanges;
+                            in_cluster[i] = cluster;
+                        }
+                        ++counts[cluster];
+                    }
+
+                    std::unique_lock<std::mutex> guard(mutex);
+                    changes += chunkChanges;
+                    for (int c = 0;  c < nbClusters;  ++c)
+                        numMembers[c] += counts[c];
+                };
+
+            MLDB::parallelMapChunked(0, npoints, CHUNK_SIZE, onChunk);
+
+            for (int c = 0;  c < nbClusters;  ++c)
+                clusters[c].nbMembers = numMembers[c];
+
+            boundsValid = hamerly;
+            return changes;
         };
 
-        std::vector<AI> clusterNumMembers(nbClusters);
+    // Move each centroid to the average of the points in its cluster
+    auto updateCentroids = [&] ()
+        {
+            std::vector<distribution<double> > sums(nbClusters);
+            std::mutex mutex;
+
+            auto onChunk = [&] (size_t begin, size_t end)
+                {
+                    std::vector<distribution<float> > local(nbClusters);
+
+                    for (size_t i = begin;  i < end;  ++i) {
+                        int c = in_cluster[i];
+                        if (local[c].empty())
+                            local[c].resize(dim, 0.0);
+
+                        const distribution<float> & point = points[i];
+                        if (euclidean || cosine) {
+                            // Same as contributeToAverage(), but without
+                            // allocating
+                            double norm = cosine ? point.two_norm() : 1.0;
+                            if (point.any() && norm > 0.0)
+                                MLDB::SIMD::vec_add(local[c].data(), 1.0 / norm,
+                                                    point.data(),
+                                                    local[c].data(), dim);
+                        }
+                        else metric->contributeToAverage(local[c], point, 1.0);
+                    }
+
+                    std::unique_lock<std::mutex> guard(mutex);
+                    for (int c = 0;  c < nbClusters;  ++c) {
+                        if (local[c].empty())
+                            continue;
+                        if (sums[c].empty())
+                            sums[c].resize(dim, 0.0);
+                        for (size_t j = 0;  j < dim;  ++j)
+                            sums[c][j] += local[c][j];
+                    }
+                };
+
+            MLDB::parallelMapChunked(0, npoints, CHUNK_SIZE, onChunk);
+
+            for (int c = 0;  c < nbClusters;  ++c) {
+                auto & cluster = clusters[c];
+
+                // If no member, we want to leave it there
+                if (cluster.nbMembers == 0) {
+                    moved[c] = 0.0;
+                    continue;
+                }
 
-        auto findNewCluster = [&] (int i) {
+                distribution<float> old = cluster.centroid;
+                for (size_t j = 0;  j < dim;  ++j)
+                    cluster.centroid[j] = sums[c].empty()
+                        ? 0.0 : sums[c][j] / cluster.nbMembers;
 
-            int best_cluster = this->assign(points[i]);
+                if (hamerly)
+                    moved[c] = sqrt(sqDistance(old.data(),
+                                               cluster.centroid.data(), dim));
+            }
+        };
 
-            if (best_cluster != in_cluster[i]) {
-                ++changes;
-                in_cluster[i] = best_cluster;
+    if (miniBatchSize > 0) {
+        // Mini-batch k-means (Sculley, 2010): each iteration assigns a
+        // random sample of points, and moves their centroids towards them
+        // with a per-centroid learning rate.
+        std::vector<int> seen(nbClusters);
+        std::vector<int> batch(miniBatchSize), batchCluster(miniBatchSize);
+
+        for (int iter = 0;  iter < maxIterations;  ++iter) {
+            for (auto & b: batch)
+                b = rng() % npoints;
+
+            std::unique_ptr<CentroidTable> table;
+            if (euclidean || cosine)
+                table.reset(new CentroidTable(clusters, euclidean));
+
+            auto onPoint = [&] (size_t j)
+                {
+                    const distribution<float> & point = points[batch[j]];
+                    batchCluster[j] = table
+                        ? table->nearest(point.data())
+                        : this->assign(point);
+                };
+
+            MLDB::parallelMap(0, miniBatchSize, onPoint);
+
+            for (int j = 0;  j < miniBatchSize;  ++j) {
+                int c = batchCluster[j];
+                double eta = 1.0 / ++seen[c];
+                clusters[c].centroid *= (1.0 - eta);
+                metric->contributeToAverage(clusters[c].centroid,
+                                            points[batch[j]], eta);
             }
+        }
 
-            ++clusterNumMembers[best_cluster];
-        };
+        int changes = assignPoints();
 
-        MLDB::parallelMap(0, points.size(), findNewCluster);
+        cerr << "done mini-batch clustering after " << maxIterations
+             << " iterations: " << changes << " changes" << endl;
+        return;
+    }
 
-        for (unsigned i = 0;  i < nbClusters;  ++i)
-            clusters[i].nbMembers = clusterNumMembers[i];
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+
+        // How many have changed cluster?  Used to know when the cluster
+        // contents are stable
+        int changes = assignPoints();
 
 #if KMEANS_DEBUG
         auto printDebug = [&] (const string & step, int iter) {
@@ -139,35 +713,8 @@ train(const std::vector<distribution<float>> & points,
         printDebug("assoc", iter);
 #endif
 
-        // std::cerr << "\niter " << iter << std::endl;
-
         // Calculate means
-        for (auto & c : clusters)
-            // If no member, we want to leave it there
-            if (c.nbMembers > 0)
-                std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
-
-        std::vector<std::mutex> locks(clusters.size());
-
-        auto addToMeanForPoint = [&] (int i) {
-            int cluster = in_cluster[i];
-            auto point = points[i];
-
-            {
-                // cerr << "cluster du point i " << cluster << endl;
-                std::unique_lock<std::mutex> guard(locks[cluster]);
-                // cerr << "patate pour mich" << endl;
-                metric->contributeToAverage(clusters[cluster].centroid, point, 1. / (double) clusters[cluster].nbMembers);
-            }
-        };
-
-        MLDB::parallelMap(0, points.size(), addToMeanForPoint);
-
-        // for (int i=0; i < clusters.size(); ++i) {
-            // cerr << "cluster " << i << " had " << clusters[i].nbMembers
-                 // << " members\n";
-            // cerr << "centroid " << clusters[i].centroid << endl;
-        // }
+        updateCentroids();
 
         cerr << "done clustering iter " << iter
              << ": " << changes << " changes" << endl;
@@ -179,10 +726,6 @@ train(const std::vector<distribution<float>> & points,
 
         if (changes == 0)
             break;
-        else
-            for (auto & c : clusters)
-                c.nbMembers = 0;
-
 
 #if KMEANS_DEBUG
         printDebug("average", iter);
@@ -230,6 +773,33 @@ assign(const distribution<float> & point) const
 
 }
 
+std::vector<int>
+KMeans::
+assign(const float * points, size_t numPoints, size_t dim) const
+{
+    if (clusters.size() == 0)
+        throw MLDB::Exception("Did you train your kmeans?");
+
+    bool euclidean = !!dynamic_cast<const KMeansEuclideanMetric *>(metric.get());
+    bool cosine = !!dynamic_cast<const KMeansCosineMetric *>(metric.get());
+
+    std::vector<int> result(numPoints);
+
+    if ((!euclidean && !cosine) || dim != clusters[0].centroid.size()) {
+        for (size_t i = 0;  i < numPoints;  ++i) {
+            distribution<float> point(points + i * dim, points + (i + 1) * dim);
+            result[i] = assign(point);
+        }
+        return result;
+    }
+
+    CentroidTable table(clusters, euclidean);
+    for (size_t i = 0;  i < numPoints;  ++i)
+        result[i] = table.nearest(points + i * dim);
+
+    return result;
+}
+
 void
 KMeans::
 serialize(ML::DB::Store_Writer & store) const
@@ -132,8 +132,18 @@ public:
 
 struct KMeans {
 
+    /// How the initial centroids are chosen
+    enum Initialization {
+        INIT_SAMPLED,          ///< Farthest of a sample of random points
+        INIT_KMEANS_PLUS_PLUS, ///< k-means++ (distance squared sampling)
+        INIT_KMEANS_PARALLEL   ///< k-means||, a parallel version of k-means++
+    };
+
     KMeans(KMeansMetric * metric = new KMeansEuclideanMetric())
-        : metric(metric)
+        : metric(metric),
+          initialization(INIT_SAMPLED),
+          miniBatchSize(0),
+          prune(true)
     {
     }
 
@@ -144,6 +154,21 @@ struct KMeans {
 
     std::vector<Cluster> clusters;
     std::shared_ptr<KMeansMetric> metric;
+
+    // Training options; these are not serialized
+
+    Initialization initialization;
+
+    // If non-zero, each iteration updates the centroids from a random
+    // sample of this many points (mini-batch k-means) instead of from
+    // all of the points.
+    int miniBatchSize;
+
+    // Use the triangle inequality (Hamerly's algorithm) to skip the
+    // distance calculations that can't change the cluster of a point.
+    // This only applies to the euclidean metric, and doesn't change the
+    // result.
+    bool prune;
     
     void train(const std::vector<distribution<float> > & points,
                std::vector<int> & in_cluster,
@@ -156,6 +181,13 @@ struct KMeans {
     // Find the closest cluster to `point` and returns its index
     int assign(const distribution<float> & point) const;
 
+    // Find the closest cluster to each of numPoints points, stored one
+    // after the other with dim values each.  This computes all of the
+    // products of the points with the centroids in one pass, which is
+    // much faster than calling assign() for each point.
+    std::vector<int> assign(const float * points, size_t numPoints,
+                            size_t dim) const;
+
     void serialize(ML::DB::Store_Writer & store) const;
     void reconstitute(ML::DB::Store_Reader & store);
     void save(const std::string & filename) const;
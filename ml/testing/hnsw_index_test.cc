@@ -0,0 +1,150 @@
+/* hnsw_index_test.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the HNSW approximate nearest neighbours index.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <random>
+#include <sstream>
+#include <algorithm>
+
+#include "mldb/ml/hnsw_index.h"
+#include "mldb/jml/db/persistent.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+struct Points {
+    Points(int n, int nd, int seed)
+        : nd(nd), coords(n * nd)
+    {
+        std::mt19937 rng(seed);
+        std::normal_distribution<float> dist;
+        for (float & c: coords)
+            c = dist(rng);
+    }
+
+    int nd;
+    vector<float> coords;
+
+    float dist(const float * p1, const float * p2) const
+    {
+        float result = 0.0;
+        for (int i = 0;  i < nd;  ++i)
+            result += (p1[i] - p2[i]) * (p1[i] - p2[i]);
+        return sqrtf(result);
+    }
+
+    float dist(int i, int j) const
+    {
+        return dist(&coords[i * nd], &coords[j * nd]);
+    }
+
+    size_t size() const { return coords.size() / nd; }
+};
+
+// Proportion of the true k nearest neighbours found by the index
+double recall(const HnswIndex & index, const Points & points,
+              const Points & queries, int k, int ef)
+{
+    int found = 0;
+    for (size_t q = 0;  q < queries.size();  ++q) {
+        const float * query = &queries.coords[q * queries.nd];
+        auto dist = [&] (int i) { return points.dist(&points.coords[i * points.nd], query); };
+
+        vector<pair<float, int> > exact;
+        for (size_t i = 0;  i < points.size();  ++i)
+            exact.emplace_back(dist(i), i);
+        std::partial_sort(exact.begin(), exact.begin() + k, exact.end());
+
+        auto approx = index.search(dist, k, INFINITY, ef);
+        BOOST_REQUIRE_EQUAL(approx.size(), k);
+        for (int i = 1;  i < k;  ++i)
+            BOOST_CHECK_LE(approx[i - 1].first, approx[i].first);
+
+        for (int i = 0;  i < k;  ++i) {
+            for (auto & a: approx) {
+                if (a.second == exact[i].second) {
+                    ++found;
+                    break;
+                }
+            }
+        }
+    }
+
+    return 1.0 * found / (k * queries.size());
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_hnsw_recall )
+{
+    Points points(5000, 64, 1);
+    Points queries(100, 64, 2);
+
+    auto dist = [&] (int i, int j) { return points.dist(i, j); };
+
+    // Insert in two batches, as an incremental commit would
+    HnswIndex index;
+    index.insert(0, 3000, dist);
+    index.insert(3000, 5000, dist);
+    BOOST_CHECK_EQUAL(index.size(), 5000);
+
+    double lowRecall = recall(index, points, queries, 10, 10);
+    double highRecall = recall(index, points, queries, 10, 200);
+    BOOST_CHECK_GE(highRecall, 0.9);
+    BOOST_CHECK_GE(highRecall, lowRecall);
+
+    // Distance limit
+    const float * query = &queries.coords[0];
+    auto queryDist = [&] (int i) { return points.dist(&points.coords[i * 64], query); };
+    auto all = index.search(queryDist, 10, INFINITY, 50);
+    auto limited = index.search(queryDist, 10, all[4].first, 50);
+    BOOST_CHECK_EQUAL(limited.size(), 5);
+
+    // Serialization round trip gives the same graph
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        index.serialize(store);
+    }
+
+    HnswIndex index2;
+    {
+        std::istringstream istream(stream.str());
+        DB::Store_Reader store(istream);
+        index2.reconstitute(store);
+    }
+
+    BOOST_CHECK_EQUAL(index2.size(), 5000);
+    auto all2 = index2.search(queryDist, 10, INFINITY, 50);
+    BOOST_CHECK(all == all2);
+}
+
+BOOST_AUTO_TEST_CASE( test_hnsw_small )
+{
+    HnswIndex index;
+    auto noQuery = [] (int) -> float { return 0.0; };
+    BOOST_CHECK(index.search(noQuery, 5, INFINITY, 10).empty());
+
+    vector<float> values = { 3.0, 1.0, 4.0, 1.5 };
+    auto dist = [&] (int i, int j) { return fabs(values[i] - values[j]); };
+    index.insert(0, values.size(), dist);
+
+    auto query = [&] (int i) { return fabs(values[i] - 1.2f); };
+    auto res = index.search(query, 2, INFINITY, 10);
+    BOOST_REQUIRE_EQUAL(res.size(), 2);
+    BOOST_CHECK_EQUAL(res[0].second, 1);
+    BOOST_CHECK_EQUAL(res[1].second, 3);
+
+    BOOST_CHECK_THROW(HnswIndex(1, 10), std::exception);
+}
@@ -15,6 +15,7 @@
 #include "mldb/utils/testing/fixtures.h"
 #include <iostream>
 #include <stdlib.h>
+#include <random>
 
 using namespace MLDB;
 using namespace ML;
@@ -103,3 +104,68 @@ BOOST_FIXTURE_TEST_CASE( test_kmeans, kmeans_test )
     test();
 
 }
+
+BOOST_AUTO_TEST_CASE( test_kmeans_training_options )
+{
+    // Well separated gaussian clusters
+    std::mt19937 rng(5);
+    std::normal_distribution<float> normal;
+    int nc = 8, dim = 16, n = 4000;
+
+    vector<distribution<float> > centers(nc, distribution<float>(dim));
+    for (auto & c: centers)
+        for (auto & v: c)
+            v = normal(rng) * 10;
+
+    vector<distribution<float> > data;
+    for (int i = 0;  i < n;  ++i) {
+        distribution<float> point = centers[i % nc];
+        for (auto & v: point)
+            v += normal(rng);
+        data.push_back(point);
+    }
+
+    for (auto init: { KMeans::INIT_SAMPLED, KMeans::INIT_KMEANS_PLUS_PLUS,
+                KMeans::INIT_KMEANS_PARALLEL }) {
+        for (int miniBatchSize: { 0, 256 }) {
+            for (bool cosine: { false, true }) {
+                KMeans kmeans(cosine
+                              ? (KMeansMetric *)new KMeansCosineMetric()
+                              : new KMeansEuclideanMetric());
+                kmeans.initialization = init;
+                kmeans.miniBatchSize = miniBatchSize;
+
+                vector<int> in_cluster;
+                kmeans.train(data, in_cluster, nc, miniBatchSize ? 200 : 100);
+
+                // Each point is with the others from the same gaussian, and
+                // in the cluster that assign() gives
+                for (int i = 0;  i < n;  ++i) {
+                    BOOST_CHECK_EQUAL(in_cluster[i], in_cluster[i % nc]);
+                    BOOST_CHECK_EQUAL(in_cluster[i], kmeans.assign(data[i]));
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_kmeans_pruning_is_exact )
+{
+    // Uniform data, where the clusters move around a lot
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> uniform;
+    vector<distribution<float> > data(20000, distribution<float>(8));
+    for (auto & p: data)
+        for (auto & v: p)
+            v = uniform(rng);
+
+    KMeans kmeans1, kmeans2;
+    kmeans1.prune = false;
+    kmeans2.prune = true;
+
+    vector<int> in_cluster1, in_cluster2;
+    kmeans1.train(data, in_cluster1, 30, 50);
+    kmeans2.train(data, in_cluster2, 30, 50);
+
+    BOOST_CHECK(in_cluster1 == in_cluster2);
+}
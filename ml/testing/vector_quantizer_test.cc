@@ -0,0 +1,139 @@
+/* vector_quantizer_test.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the scalar and product vector quantizers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <random>
+#include <sstream>
+
+#include "mldb/ml/vector_quantizer.h"
+#include "mldb/jml/db/persistent.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+vector<float> makeData(int n, int nd, int seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> dist;
+    vector<float> result(n * nd);
+    for (float & v: result)
+        v = dist(rng);
+    return result;
+}
+
+double dot(const float * x, const float * y, int nd)
+{
+    double result = 0.0;
+    for (int i = 0;  i < nd;  ++i)
+        result += x[i] * y[i];
+    return result;
+}
+
+// Mean squared reconstruction error per dimension
+double reconstructionError(const VectorQuantizer & q,
+                           const vector<float> & data, int nd)
+{
+    int n = data.size() / nd;
+    vector<uint8_t> code(q.codeSize());
+    vector<float> decoded(nd);
+    double err = 0.0;
+    for (int i = 0;  i < n;  ++i) {
+        q.encode(&data[i * nd], code.data());
+        q.decode(code.data(), decoded.data());
+        for (int j = 0;  j < nd;  ++j)
+            err += (decoded[j] - data[i * nd + j]) * (decoded[j] - data[i * nd + j]);
+    }
+    return err / data.size();
+}
+
+// The table based dot product must match the dot product with the
+// decoded vector, and single dimensions must decode the same way
+void checkDotProducts(const VectorQuantizer & q,
+                      const vector<float> & data, int nd)
+{
+    vector<float> query = makeData(1, nd, 99);
+    vector<float> table;
+    q.prepareQuery(query.data(), table);
+
+    vector<uint8_t> code(q.codeSize());
+    vector<float> decoded(nd);
+    for (int i = 0;  i < 100;  ++i) {
+        q.encode(&data[i * nd], code.data());
+        q.decode(code.data(), decoded.data());
+        BOOST_CHECK_SMALL(q.dotProduct(table, code.data())
+                          - dot(query.data(), decoded.data(), nd),
+                          1e-3);
+        for (int j = 0;  j < nd;  ++j)
+            BOOST_CHECK_EQUAL(q.decodeDimension(code.data(), j), decoded[j]);
+    }
+}
+
+std::shared_ptr<VectorQuantizer> roundTrip(const VectorQuantizer & q)
+{
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        q.serialize(store);
+    }
+    std::istringstream istream(stream.str());
+    DB::Store_Reader store(istream);
+    return VectorQuantizer::reconstitute(store);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_scalar_quantizer )
+{
+    int nd = 32;
+    auto data = makeData(2000, nd, 1);
+
+    ScalarQuantizer q(data.data(), 2000, nd);
+    BOOST_CHECK_EQUAL(q.codeSize(), nd);
+
+    // Normal data spans about 7 standard deviations; each step is then
+    // about 0.03 so the error is tiny
+    BOOST_CHECK_LT(reconstructionError(q, data, nd), 1e-3);
+    checkDotProducts(q, data, nd);
+
+    auto q2 = roundTrip(q);
+    BOOST_CHECK_EQUAL(q2->codeSize(), nd);
+    BOOST_CHECK_EQUAL(reconstructionError(*q2, data, nd),
+                      reconstructionError(q, data, nd));
+}
+
+BOOST_AUTO_TEST_CASE( test_product_quantizer )
+{
+    int nd = 32;
+    auto data = makeData(2000, nd, 2);
+
+    ProductQuantizer q(data.data(), 2000, nd, 8);
+    BOOST_CHECK_EQUAL(q.codeSize(), 8);
+
+    // Much better than zero, which has an error of 1 per dimension
+    double err = reconstructionError(q, data, nd);
+    BOOST_CHECK_LT(err, 0.5);
+    checkDotProducts(q, data, nd);
+
+    auto q2 = roundTrip(q);
+    BOOST_CHECK_EQUAL(q2->codeSize(), 8);
+    BOOST_CHECK_EQUAL(reconstructionError(*q2, data, nd), err);
+
+    // Uneven subvectors, and fewer vectors than centroids
+    ProductQuantizer q3(data.data(), 100, nd, 5);
+    BOOST_CHECK_EQUAL(q3.codeSize(), 5);
+    checkDotProducts(q3, data, nd);
+
+    BOOST_CHECK_THROW(ProductQuantizer(data.data(), 100, nd, 33),
+                      std::exception);
+}
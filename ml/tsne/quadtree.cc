@@ -11,6 +11,10 @@
 #include "mldb/jml/db/persistent.h"
 #include "mldb/arch/backtrace.h"
 #include "mldb/jml/utils/compact_vector_persistence.h"
+#include "mldb/base/parallel.h"
+#include <mutex>
+#include <numeric>
+#include <algorithm>
 
 using namespace ML::DB;
 using namespace std;
@@ -52,7 +56,8 @@ serialize(DB::Store_Writer & store) const
 
 QuadtreeNode::
 QuadtreeNode(DB::Store_Reader & store, int version)
-    : diag(0.0), type(EMPTY), numChildren(0), recipNumChildren{0, 0}
+    : arena(nullptr), diag(0.0), type(EMPTY), numChildren(0),
+      recipNumChildren{0, 0}
 {
     if (version != 0)
         throw MLDB::Exception("Unknown quadtree node version");
@@ -119,6 +124,171 @@ QuadtreeNode(DB::Store_Reader & store, int version)
     recipNumChildren[1] = 1.0 / (numChildren - 1);
 }
 
+
+/*****************************************************************************/
+/* QUADTREE NODE ARENA                                                       */
+/*****************************************************************************/
+
+QuadtreeNodeArena::
+QuadtreeNodeArena(size_t nodesPerBlock)
+    : nodesPerBlock(nodesPerBlock), numNodes(0), numInBlock(nodesPerBlock)
+{
+}
+
+QuadtreeNodeArena::
+~QuadtreeNodeArena()
+{
+    size_t done = 0;
+    for (auto & b: blocks) {
+        QuadtreeNode * nodes = reinterpret_cast<QuadtreeNode *>(b.get());
+        for (size_t i = 0;  i < nodesPerBlock && done < numNodes;  ++i, ++done)
+            nodes[i].~QuadtreeNode();
+    }
+}
+
+void *
+QuadtreeNodeArena::
+allocate()
+{
+    if (numInBlock == nodesPerBlock) {
+        blocks.emplace_back(new char[nodesPerBlock * sizeof(QuadtreeNode)]);
+        numInBlock = 0;
+    }
+
+    void * result = blocks.back().get() + numInBlock * sizeof(QuadtreeNode);
+    ++numInBlock;
+    ++numNodes;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* QUADTREE                                                                  */
+/*****************************************************************************/
+
+namespace {
+
+/// Below this many points, a subtree is built by inserting one at a time
+static constexpr size_t SEQUENTIAL_BUILD_POINTS = 4096;
+
+struct QuadtreeBuilder {
+    const float * coords;
+    int nd;
+    std::vector<std::unique_ptr<QuadtreeNodeArena> > & arenas;
+    std::mutex arenasMutex;
+
+    QuadtreeNodeArena * newArena()
+    {
+        std::unique_ptr<QuadtreeNodeArena> arena(new QuadtreeNodeArena());
+        std::unique_lock<std::mutex> guard(arenasMutex);
+        arenas.emplace_back(std::move(arena));
+        return arenas.back().get();
+    }
+
+    QCoord point(uint32_t i) const
+    {
+        return QCoord(coords + i * nd, coords + (i + 1) * nd);
+    }
+
+    bool allSame(const std::vector<uint32_t> & points) const
+    {
+        for (uint32_t p: points)
+            if (!std::equal(coords + p * nd, coords + (p + 1) * nd,
+                            coords + points[0] * nd))
+                return false;
+        return true;
+    }
+
+    /** Insert the given points into the empty node, which has an arena.
+        This does exactly what inserting them one by one would, except
+        that the quadrants of large nodes are built in parallel.
+    */
+    void build(QuadtreeNode & node, const std::vector<uint32_t> & points,
+               int depth)
+    {
+        if (points.size() <= SEQUENTIAL_BUILD_POINTS || allSame(points)) {
+            for (uint32_t p: points)
+                node.insert(point(p), depth);
+            node.finish();
+            return;
+        }
+
+        // At least two distinct points, so this is a node
+        int numQuadrants = 1 << nd;
+        std::vector<std::vector<uint32_t> > quadrantPoints(numQuadrants);
+        for (uint32_t p: points) {
+            quadrantPoints[QuadtreeNode::quadrant(node.center, point(p))]
+                .push_back(p);
+        }
+
+        node.type = QuadtreeNode::NODE;
+        for (int quad = 0;  quad < numQuadrants;  ++quad) {
+            if (quadrantPoints[quad].empty())
+                continue;
+
+            QCoord newMins(nd), newMaxs(nd);
+            for (unsigned i = 0;  i < nd;  ++i) {
+                bool less = quad & (1 << i);
+                newMins[i] = less ? node.mins[i] : node.center[i];
+                newMaxs[i] = less ? node.center[i] : node.maxs[i];
+            }
+
+            // Each quadrant gets its own arena, so that they can be built
+            // in parallel
+            node.quadrants[quad] = newArena()->create(newMins, newMaxs);
+        }
+
+        auto doQuadrant = [&] (int quad)
+            {
+                if (node.quadrants[quad])
+                    build(*node.quadrants[quad], quadrantPoints[quad],
+                          depth + 1);
+            };
+
+        MLDB::parallelMap(0, numQuadrants, doQuadrant);
+
+        node.numChildren = 0;
+        node.centerOfMass.clear();
+        node.centerOfMass.resize(nd);
+        for (auto & q: node.quadrants) {
+            if (!q)
+                continue;
+            node.numChildren += q->numChildren;
+            for (unsigned i = 0;  i < nd;  ++i)
+                node.centerOfMass[i] += q->centerOfMass[i];
+        }
+
+        node.finishNode();
+    }
+};
+
+} // file scope
+
+void
+Quadtree::
+build(const float * coords, size_t n)
+{
+    ExcAssert(root);
+    ExcAssertEqual(root->type, QuadtreeNode::EMPTY);
+
+    int nd = root->numDimensions();
+
+    // Check up front that the points fit, since it's much harder to
+    // report from within the parallel build
+    for (size_t i = 0;  i < n;  ++i) {
+        if (!root->contains(QCoord(coords + i * nd, coords + (i + 1) * nd)))
+            throw MLDB::Exception("Quadtree::build(): point is not within "
+                                  "the tree's bounding box");
+    }
+
+    std::vector<uint32_t> points(n);
+    std::iota(points.begin(), points.end(), 0);
+
+    QuadtreeBuilder builder{coords, nd, arenas};
+    root->arena = builder.newArena();
+    builder.build(*root, points, 0);
+}
+
 Quadtree::
 Quadtree(DB::Store_Reader & store)
 {
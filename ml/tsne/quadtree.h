@@ -13,6 +13,7 @@
 #include "mldb/base/exc_assert.h"
 #include "mldb/jml/db/persistent_fwd.h"
 #include <memory>
+#include <vector>
 #include <iostream>
 #include <cmath>
 
@@ -22,11 +23,13 @@ using MLDB::compact_vector;
 
 typedef compact_vector<float, 3, uint32_t, false> QCoord;
 
+struct QuadtreeNodeArena;
+
 struct QuadtreeNode {
 
     /** Construct with a single child. */
     QuadtreeNode(QCoord mins, QCoord maxs, QCoord child)
-        : mins(mins), maxs(maxs), type(TERMINAL),
+        : arena(nullptr), mins(mins), maxs(maxs), type(TERMINAL),
           numChildren(1), child(child), centerOfMass(child),
           quadrants(1 << mins.size())
     {
@@ -45,7 +48,7 @@ struct QuadtreeNode {
 
     /** Construct empty. */
     QuadtreeNode(QCoord mins, QCoord maxs)
-        : mins(mins), maxs(maxs), type(EMPTY), numChildren(0),
+        : arena(nullptr), mins(mins), maxs(maxs), type(EMPTY), numChildren(0),
           centerOfMass(mins.size()),
           quadrants(1 << mins.size())
     {
@@ -62,6 +65,9 @@ struct QuadtreeNode {
 
     ~QuadtreeNode()
     {
+        // Nodes allocated from an arena are freed with the arena
+        if (arena)
+            return;
         for (auto & q: quadrants)
             if (q)
                 delete q;
@@ -69,6 +75,11 @@ struct QuadtreeNode {
 
     int numDimensions() const { return mins.size(); }
 
+    /** Arena from which the children of this node are allocated.  If
+        null, they are allocated on the heap and owned by this node.
+    */
+    QuadtreeNodeArena * arena;
+
     QCoord mins;   ///< Minimum coordinates for bounding box
     QCoord maxs;   ///< Maximum coordinates for bounding box
     QCoord center; ///< Cached pre-computation of center of bounding box
@@ -138,7 +149,16 @@ struct QuadtreeNode {
                     newMaxs[i] = less ? center[i] : maxs[i];
                 }
 
-                quadrants[quad] = new QuadtreeNode(newMins, newMaxs, point);
+                quadrants[quad] = newNode(newMins, newMaxs, point);
+
+                // The new terminal node holds a single copy of the point;
+                // account for any duplicates that came with it
+                if (n != 1) {
+                    QuadtreeNode * q = quadrants[quad];
+                    q->numChildren = n;
+                    for (unsigned i = 0;  i < point.size();  ++i)
+                        q->centerOfMass[i] = n * point[i];
+                }
             } else {
                 // Recurse down into existing quadrant
                 quadrants[quad]->insert(point, depth + 1);
@@ -185,8 +205,7 @@ struct QuadtreeNode {
     /** Finish the structure, including calculating node numbers */
     int finish(int currentNodeNumber = 0)
     {
-        recipNumChildren[0] = 1.0 / numChildren;
-        recipNumChildren[1] = 1.0 / (numChildren - 1);
+        finishNode();
 
         currentNodeNumber += 1;
 
@@ -199,6 +218,16 @@ struct QuadtreeNode {
         return currentNodeNumber;
     }
 
+    /** Finish this node only, not its children. */
+    void finishNode()
+    {
+        recipNumChildren[0] = 1.0 / numChildren;
+        recipNumChildren[1] = 1.0 / (numChildren - 1);
+    }
+
+    /** Create a new child node, in the arena if there is one. */
+    QuadtreeNode * newNode(QCoord mins, QCoord maxs, QCoord child);
+
     static float sqr(float val)
     {
         return val * val;
@@ -291,6 +320,50 @@ struct QuadtreeNode {
     void reconstitute(DB::Store_Reader & store, int version);
 };
 
+/** Allocates quadtree nodes in large blocks rather than one at a time.
+    The nodes are all destroyed with the arena.  Not thread safe; each
+    thread that builds part of a tree needs its own arena.
+*/
+struct QuadtreeNodeArena {
+    QuadtreeNodeArena(size_t nodesPerBlock = 4096);
+    ~QuadtreeNodeArena();
+
+    QuadtreeNodeArena(const QuadtreeNodeArena &) = delete;
+    void operator = (const QuadtreeNodeArena &) = delete;
+
+    /** Construct a new node in the arena.  Its children will also be
+        allocated in this arena.
+    */
+    template<typename... Args>
+    QuadtreeNode * create(Args&&... args)
+    {
+        QuadtreeNode * result
+            = new (allocate()) QuadtreeNode(std::forward<Args>(args)...);
+        result->arena = this;
+        return result;
+    }
+
+    /** Number of nodes allocated. */
+    size_t size() const { return numNodes; }
+
+private:
+    void * allocate();
+
+    size_t nodesPerBlock;
+    size_t numNodes;
+    size_t numInBlock;
+    std::vector<std::unique_ptr<char[]> > blocks;
+};
+
+inline QuadtreeNode *
+QuadtreeNode::
+newNode(QCoord mins, QCoord maxs, QCoord child)
+{
+    if (arena)
+        return arena->create(mins, maxs, child);
+    return new QuadtreeNode(mins, maxs, child);
+}
+
 struct Quadtree {
 
     Quadtree(QCoord mins, QCoord maxs)
@@ -305,6 +378,19 @@ struct Quadtree {
         root->insert(coord);
     }
 
+    /** Insert all of the n points in coords, which is a row-major n by
+        numDimensions() array, into an empty tree.  Subtrees are built in
+        parallel, each with nodes allocated from its own arena.  The
+        resulting tree is the same as when inserting the points one at a
+        time, and is already finished.
+    */
+    void build(const float * coords, size_t n);
+
+    /** Arenas owning the nodes of the tree if it was built with build().
+        Declared before the root so that they are destroyed after it.
+    */
+    std::vector<std::unique_ptr<QuadtreeNodeArena> > arenas;
+
     std::unique_ptr<QuadtreeNode> root;
 
     void serialize(DB::Store_Writer & store) const;
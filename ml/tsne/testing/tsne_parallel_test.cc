@@ -0,0 +1,132 @@
+/* tsne_parallel_test.cc
+   Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Tests for the parallel quadtree construction and the FFT based
+   repulsive forces of the t-SNE.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/multi_array.hpp>
+#include <random>
+#include <cmath>
+
+#include "mldb/ml/tsne/quadtree.h"
+#include "mldb/ml/tsne/tsne_fft.h"
+
+using namespace ML;
+using namespace std;
+
+
+namespace {
+
+boost::multi_array<float, 2> randomPoints(int n, float scale, int seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> dist(0.0, scale);
+    boost::multi_array<float, 2> result(boost::extents[n][2]);
+    for (int i = 0;  i < n;  ++i) {
+        // Some clusters, and a few duplicate points
+        float offset = (i % 4) * scale * 3;
+        if (i % 97 == 1) {
+            result[i][0] = result[i - 1][0];
+            result[i][1] = result[i - 1][1];
+            continue;
+        }
+        result[i][0] = dist(rng) + offset;
+        result[i][1] = dist(rng) - offset;
+    }
+    return result;
+}
+
+void checkSameTree(const QuadtreeNode * n1, const QuadtreeNode * n2)
+{
+    BOOST_REQUIRE_EQUAL(n1 == nullptr, n2 == nullptr);
+    if (!n1)
+        return;
+    BOOST_REQUIRE_EQUAL(n1->type, n2->type);
+    BOOST_REQUIRE_EQUAL(n1->numChildren, n2->numChildren);
+    BOOST_REQUIRE_EQUAL(n1->quadrants.size(), n2->quadrants.size());
+    for (unsigned i = 0;  i < n1->centerOfMass.size();  ++i) {
+        BOOST_CHECK_CLOSE(n1->centerOfMass[i], n2->centerOfMass[i], 0.01);
+        BOOST_CHECK_EQUAL(n1->mins[i], n2->mins[i]);
+        BOOST_CHECK_EQUAL(n1->maxs[i], n2->maxs[i]);
+    }
+    if (n1->type == QuadtreeNode::NODE) {
+        for (unsigned i = 0;  i < n1->quadrants.size();  ++i)
+            checkSameTree(n1->quadrants[i], n2->quadrants[i]);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_quadtree_build_matches_insert )
+{
+    int n = 50000;
+    auto Y = randomPoints(n, 1.0, 1);
+
+    QCoord mins(2, INFINITY), maxs(2, -INFINITY);
+    for (int i = 0;  i < n;  ++i) {
+        for (unsigned j = 0;  j < 2;  ++j) {
+            mins[j] = std::min(mins[j], Y[i][j]);
+            maxs[j] = std::max(maxs[j], Y[i][j]);
+        }
+    }
+    for (float & c: maxs)
+        c = nextafterf(c, (float)INFINITY);
+
+    Quadtree inserted(mins, maxs);
+    for (int i = 0;  i < n;  ++i)
+        inserted.insert(QCoord(&Y[i][0], &Y[i][0] + 2));
+    inserted.root->finish();
+
+    Quadtree built(mins, maxs);
+    built.build(Y.data(), n);
+
+    checkSameTree(inserted.root.get(), built.root.get());
+}
+
+BOOST_AUTO_TEST_CASE( test_fft_repulsion_matches_exact )
+{
+    int n = 2000;
+    auto Y = randomPoints(n, 1.0, 2);
+
+    boost::multi_array<double, 2> FrepZExact(boost::extents[n][2]);
+    double ZExact = 0.0;
+    for (int i = 0;  i < n;  ++i) {
+        for (int j = 0;  j < n;  ++j) {
+            if (i == j)
+                continue;
+            double d0 = Y[j][0] - Y[i][0];
+            double d1 = Y[j][1] - Y[i][1];
+            double q = 1.0 / (1.0 + d0 * d0 + d1 * d1);
+            ZExact += q;
+            FrepZExact[i][0] += d0 * q * q;
+            FrepZExact[i][1] += d1 * q * q;
+        }
+    }
+
+    boost::multi_array<double, 2> FrepZ(boost::extents[n][2]);
+    double Z = tsneFftRepulsion(Y, FrepZ);
+
+    BOOST_CHECK_CLOSE(Z, ZExact, 0.1);
+
+    double errNorm = 0.0, exactNorm = 0.0;
+    for (int i = 0;  i < n;  ++i) {
+        for (int j = 0;  j < 2;  ++j) {
+            double err = FrepZ[i][j] - FrepZExact[i][j];
+            errNorm += err * err;
+            exactNorm += FrepZExact[i][j] * FrepZExact[i][j];
+        }
+    }
+
+    BOOST_CHECK_LT(sqrt(errNorm / exactNorm), 0.01);
+
+    // Only two dimensions are supported
+    boost::multi_array<float, 2> Y3(boost::extents[10][3]);
+    boost::multi_array<double, 2> FrepZ3(boost::extents[10][3]);
+    BOOST_CHECK_THROW(tsneFftRepulsion(Y3, FrepZ3), std::exception);
+}
@@ -1,3 +1,4 @@
 # This file is part of MLDB. Copyright 2015 mldb.ai inc. All rights reserved.
 
 $(eval $(call test,tsne_algorithm_test,tsne utils arch,boost timed manual))
+$(eval $(call test,tsne_parallel_test,tsne arch,boost))
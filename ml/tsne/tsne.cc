@@ -33,6 +33,7 @@
 #include "mldb/jml/utils/guard.h"
 #include "mldb/jml/utils/environment.h"
 #include "quadtree.h"
+#include "tsne_fft.h"
 #include "vantage_point_tree.h"
 #include <fstream>
 #include <functional>
@@ -914,21 +915,30 @@ void tsne_update(boost::multi_array<float, 2> & Y,
     // If on the other hand the direction changes, we reduce exponentially
     // the rate.
     
-    for (unsigned i = 0;  !first_iter && i < n;  ++i) {
-        // We use != here as we gradients in dY are the negatives of what
-        // we want.
-        for (unsigned j = 0;  j < d;  ++j) {
-            if (dY[i][j] * iY[i][j] < 0.0f)
-                gains[i][j] = gains[i][j] + 0.2f;
-            else gains[i][j] = gains[i][j] * 0.8f;
-            gains[i][j] = std::max(min_gain, gains[i][j]);
-        }
-    }
+    auto doRows = [&] (size_t begin, size_t end)
+        {
+            for (unsigned i = begin;  !first_iter && i < end;  ++i) {
+                // We use != here as we gradients in dY are the negatives of
+                // what we want.
+                for (unsigned j = 0;  j < d;  ++j) {
+                    if (dY[i][j] * iY[i][j] < 0.0f)
+                        gains[i][j] = gains[i][j] + 0.2f;
+                    else gains[i][j] = gains[i][j] * 0.8f;
+                    gains[i][j] = std::max(min_gain, gains[i][j]);
+                }
+            }
 
-    for (unsigned i = 0;  i < n;  ++i)
-        for (unsigned j = 0;  j < d;  ++j)
-            iY[i][j] = momentum * iY[i][j] - (eta * gains[i][j] * dY[i][j]);
-    Y = Y + iY;
+            for (unsigned i = begin;  i < end;  ++i) {
+                for (unsigned j = 0;  j < d;  ++j) {
+                    iY[i][j] = momentum * iY[i][j]
+                        - (eta * gains[i][j] * dY[i][j]);
+                    Y[i][j] += iY[i][j];
+                }
+            }
+        };
+
+    if (n > 0)
+        MLDB::parallelMapChunked(0, n, 4096, doRows);
 }
     
 template<typename Float>
@@ -937,18 +947,41 @@ void recenter_about_origin(boost::multi_array<Float, 2> & Y)
     int n = Y.shape()[0];
     int d = Y.shape()[1];
 
-    // Recenter Y values about the origin
-    double Y_means[d];
-    std::fill(Y_means, Y_means + d, 0.0);
-    for (unsigned i = 0;  i < n;  ++i)
+    if (n == 0)
+        return;
+
+    // Recenter Y values about the origin.  The sums are done per chunk and
+    // then added up in order, so that the result doesn't depend upon the
+    // number of threads.
+    static constexpr size_t CHUNK_SIZE = 4096;
+    size_t numChunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<double> chunkSums(numChunks * d, 0.0);
+
+    auto doSums = [&] (size_t begin, size_t end)
+        {
+            double * sums = &chunkSums[begin / CHUNK_SIZE * d];
+            for (unsigned i = begin;  i < end;  ++i)
+                for (unsigned j = 0;  j < d;  ++j)
+                    sums[j] += Y[i][j];
+        };
+
+    MLDB::parallelMapChunked(0, n, CHUNK_SIZE, doSums);
+
+    std::vector<double> Y_means(d, 0.0);
+    for (size_t c = 0;  c < numChunks;  ++c)
         for (unsigned j = 0;  j < d;  ++j)
-            Y_means[j] += Y[i][j];
+            Y_means[j] += chunkSums[c * d + j];
     
     Float n_recip = 1.0f / n;
     
-    for (unsigned i = 0;  i < n;  ++i)
-        for (unsigned j = 0;  j < d;  ++j)
-            Y[i][j] -= Y_means[j] * n_recip;
+    auto doRecenter = [&] (size_t begin, size_t end)
+        {
+            for (unsigned i = begin;  i < end;  ++i)
+                for (unsigned j = 0;  j < d;  ++j)
+                    Y[i][j] -= Y_means[j] * n_recip;
+        };
+
+    MLDB::parallelMapChunked(0, n, CHUNK_SIZE, doRecenter);
 }
 
 boost::multi_array<float, 2>
@@ -1723,6 +1756,11 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         }
     }
 
+    bool useFft = params.repulsion == TSNE_REPULSION_FFT;
+    if (useFft && nd != 2)
+        throw MLDB::Exception("tsneApproxFromSparse(): FFT repulsion only "
+                              "works for two output dimensions, not %d", nd);
+
     boost::multi_array<float, 2> Y = tsne_init(nx, nd, params.randomSeed);
 
     // Do we force calculations to be made exactly?
@@ -1772,23 +1810,34 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
     auto updateQtree = [&] () -> Quadtree &
         {
-            // Find the bounding box for the quadtree
-            distribution<float> mins(nd), maxs(nd);
+            // Find the bounding box for the quadtree, a chunk at a time
+            static constexpr size_t CHUNK_SIZE = 16384;
+            size_t numChunks = (nx + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            std::vector<QCoord> chunkMins(numChunks, QCoord(nd, INFINITY));
+            std::vector<QCoord> chunkMaxs(numChunks, QCoord(nd, -INFINITY));
 
-            for (unsigned j = 0;  j < nx;  ++j) {
-                distribution<float> y(nd);
-                for (unsigned i = 0;  i < nd;  ++i)
-                    y[i] = Y[j][i];
-            
-                if (j == 0)
-                    mins = maxs = y;
-                else {
-                    y.min_max(mins, maxs);
-                }
-            }
+            auto doBounds = [&] (size_t begin, size_t end)
+                {
+                    QCoord & mins = chunkMins[begin / CHUNK_SIZE];
+                    QCoord & maxs = chunkMaxs[begin / CHUNK_SIZE];
+                    for (unsigned j = begin;  j < end;  ++j) {
+                        for (unsigned i = 0;  i < nd;  ++i) {
+                            mins[i] = std::min(mins[i], Y[j][i]);
+                            maxs[i] = std::max(maxs[i], Y[j][i]);
+                        }
+                    }
+                };
+
+            MLDB::parallelMapChunked(0, nx, CHUNK_SIZE, doBounds);
 
             // Create the quadtree for this iteration
-            QCoord minc(mins.begin(), mins.end()), maxc(maxs.begin(), maxs.end());
+            QCoord minc = chunkMins[0], maxc = chunkMaxs[0];
+            for (size_t c = 1;  c < numChunks;  ++c) {
+                for (unsigned i = 0;  i < nd;  ++i) {
+                    minc[i] = std::min(minc[i], chunkMins[c][i]);
+                    maxc[i] = std::max(maxc[i], chunkMaxs[c][i]);
+                }
+            }
 
             // Bounding boxes are open ended on the max side, so move to the next float
             for (float & c: maxc) {
@@ -1798,17 +1847,8 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
             qtreePtr.reset(new Quadtree(minc, maxc));
             Quadtree & qtree = *qtreePtr;
 
-            // Insert the values into the quadtree
-            for (unsigned i = 0;  i < nx;  ++i) {
-                QCoord coord(nd);
-                for (unsigned j = 0;  j < nd;  ++j) {
-                    coord[j] = Y[i][j];
-                }
-
-                qtree.insert(coord);
-            }
-        
-            int numNodes MLDB_UNUSED = qtree.root->finish();
+            // Insert the values into the quadtree, in parallel
+            qtree.build(Y.data(), nx);
 
             return qtree;
         };
@@ -1828,32 +1868,34 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         }
 #endif     
    
-        // Create a new coordinate for each neighbour
-        std::vector<QCoord> pointCoords(nx);
+        // Do we calculate the cost?
+        bool calcC = iter < 10 || (iter + 1) % 100 == 0 || iter == params.max_iter - 1;
+        //calcC = true;
 
-        for (unsigned i = 0;  i < nx;  ++i) {
-            pointCoords[i] = QCoord(&Y[i][0], &Y[i][0] + nd);
+        // Create a new coordinate for each neighbour.  These are only
+        // needed to find the neighbours in the quadtree for the cost.
+        std::vector<QCoord> pointCoords;
+        if (calcC && !useFft) {
+            pointCoords.resize(nx);
+            auto doCoords = [&] (size_t begin, size_t end)
+                {
+                    for (unsigned i = begin;  i < end;  ++i)
+                        pointCoords[i] = QCoord(&Y[i][0], &Y[i][0] + nd);
+                };
+            MLDB::parallelMapChunked(0, nx, 16384, doCoords);
         }
 
-        Quadtree & qtree = updateQtree();
+        // The FFT method doesn't need a quadtree
+        if (!useFft)
+            updateQtree();
 
         // This accumulates the sum_j p[x][j] log Z*q[x][j] for each example.  From this and
         // Z, we can calculate the cost of each example.  Only relevant if calcC is true.
-        double exampleCFactor[nx];
-        std::fill(exampleCFactor, exampleCFactor + nx, 0.0);
-        
-        // clang 3.4: lambda can't capture a variable length array
-        auto * exampleCFactorPtr = exampleCFactor;
-        
-
-        // Do we calculate the cost?
-        bool calcC = iter < 10 || (iter + 1) % 100 == 0 || iter == params.max_iter - 1;
-        //calcC = true;
+        std::vector<double> exampleCFactor(nx, 0.0);
 
-        // Approximation for Z, accumulated here
-        Spinlock Zmutex;
-        std::vector<double> ZApproxValues;
-        ZApproxValues.reserve(nx);
+        // Approximation for Z for each example, summed once they are all
+        // done
+        std::vector<double> ZApproxValues(nx, 0.0);
 
 
         auto calcExample = [&] (int x)
@@ -1901,6 +1943,12 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
                     double factorAttr = pFactor * neighbours.probs[q] / (1.0 + D);
 
+                    // The FFT method gives no per-neighbour Z * q, so
+                    // it's calculated exactly here
+                    if (calcC && useFft)
+                        exampleCFactor[x] -= pFactor * neighbours.probs[q]
+                            * log(1.0 + D);
+
                     if (nd == 2) {
                         float dYj0 = y[0] - Y[j][0];
                         float dYj1 = y[1] - Y[j][1];
@@ -1944,7 +1992,7 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
 
                     double logqCellZ = log(qCellZ);
                     for (unsigned p: pointsOfInterest) {
-                        exampleCFactorPtr[x] += pFactor * neighbours.probs[p] * logqCellZ;
+                        exampleCFactor[x] += pFactor * neighbours.probs[p] * logqCellZ;
                     }
 
                     poiDone += pointsOfInterest.size();
@@ -1960,14 +2008,18 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     return pointCoords.at(neighbours.indexes.at(point));
                 };
 
-                if (calcC) {
+                if (useFft) {
+                    // Repulsive forces are calculated for all examples
+                    // at once below
+                }
+                else if (calcC) {
                     // Bring along the points of interest for the ride
                     vector<int> pointsOfInterest;
                     pointsOfInterest.reserve(neighbours.indexes.size());
                     for (unsigned i = 0;  i < neighbours.indexes.size();  ++i)
                         pointsOfInterest.push_back(i);
 
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtreePtr->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             onNode, pointsOfInterest, getPointCoord,
                             params.min_distance_ratio);
@@ -1983,58 +2035,42 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
                     ExcAssertEqual(poiDone, neighbours.indexes.size());
                     //if (!isfinite(exampleCFactor[x]))
                     //    cerr << "x = " << x << " factor " << exampleCFactor[x] << endl;
-                    ExcAssert(isfinite(exampleCFactorPtr[x]));
+                    ExcAssert(isfinite(exampleCFactor[x]));
                 } else {
-                    calcRep(*qtree.root, 0, true /* inside */,
+                    calcRep(*qtreePtr->root, 0, true /* inside */,
                             y, &FrepZ[x][0], exampleZ, nodesTouched, nd, exact,
                             nullptr, {}, nullptr, params.min_distance_ratio);
                 }
 
-                {
-                    std::unique_lock<Spinlock> guard(Zmutex);
-                    ZApproxValues.push_back(exampleZ);
-                }
+                ZApproxValues[x] = exampleZ;
 
                 //if (x == 1026)
                 //    cerr << "touched " << nodesTouched << " of " << numNodes << " nodes"
                 //         << endl;
             };
 
-#if 1
-        int totalThreads = std::max(1, std::min(16, MLDB::numCpus() / 2));
-
-        auto doThread = [&] (int n)
+        // Each example proceeds more or less independently
+        auto calcExamples = [&] (size_t begin, size_t end)
             {
-                int perThread = nx / totalThreads;
-                int start = n * perThread;
-                int end = start + perThread;
-                if (n == totalThreads)
-                    end = nx;
-
-                for (unsigned x = start;  x < end;  ++x)
+                for (unsigned x = begin;  x < end;  ++x)
                     calcExample(x);
-
-                //for (unsigned x = n;  x < nx;  x += totalThreads) {
-                //    calcExample(x);
-                //}
             };
 
-        MLDB::parallelMap(0, totalThreads, doThread);
-        //parallelMap(0, nx, calcExample);
-#else
-        // Each example proceeds more or less independently
-        for (unsigned x = 0;  x < nx;  ++x) {
-            calcExample(x);
-        }
-#endif
+        MLDB::parallelMapChunked(0, nx, 256, calcExamples);
 
-        // Sort from smallest to largest to accumulate.  This minimises
-        // rounding errors and makes the result independent of the order
-        // in which threads finish.
-        std::sort(ZApproxValues.begin(), ZApproxValues.end());
-        double ZApprox = std::accumulate(ZApproxValues.begin(),
-                                         ZApproxValues.end(),
-                                         0.0);
+        double ZApprox;
+        if (useFft) {
+            ZApprox = tsneFftRepulsion(Y, FrepZ, params.fft_min_intervals,
+                                       params.fft_intervals_per_unit);
+        }
+        else {
+            // Sort from smallest to largest to accumulate.  This minimises
+            // rounding errors.
+            std::sort(ZApproxValues.begin(), ZApproxValues.end());
+            ZApprox = std::accumulate(ZApproxValues.begin(),
+                                      ZApproxValues.end(),
+                                      0.0);
+        }
 
         ExcAssert(isfinite(ZApprox));
         ExcAssertNotEqual(0.0, ZApprox);
@@ -2042,12 +2078,11 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         double Zrecip = 1.0 / ZApprox;
         ExcAssert(isfinite(Zrecip));
         
-        for (unsigned x = 0;  x < nx;  ++x) {
-            for (unsigned i = 0;  i < nd;  ++i) {
-                ExcAssert(isfinite(FrepZ[x][i]));
-                FrepApprox[x][i] = FrepZ[x][i] * Zrecip;
-            }
-        }
+        // Chunk size for the per-example loops below.  Reductions are done
+        // per chunk and then combined in order, so that the results don't
+        // depend upon the number of threads.
+        static constexpr size_t CHUNK_SIZE = 4096;
+        size_t numChunks = (nx + CHUNK_SIZE - 1) / CHUNK_SIZE;
 
         double Capprox = 0.0;
         if (calcC) {
@@ -2061,42 +2096,40 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
             double logZapprox = log(ZApprox);
             double logpFactor = log(pFactor);
 
-            for (unsigned x = 0;  x < nx;  ++x) {
+            std::vector<double> chunkC(numChunks, 0.0);
 
-                const TsneSparseProbs & neighbours = exampleNeighbours[x];
+            auto doCost = [&] (size_t begin, size_t end)
+                {
+                    double & Cchunk = chunkC[begin / CHUNK_SIZE];
+
+                    for (unsigned x = begin;  x < end;  ++x) {
+
+                        const TsneSparseProbs & neighbours = exampleNeighbours[x];
 
-                double CExample = -exampleCFactor[x];
+                        double CExample = -exampleCFactor[x];
 
-                //cerr << "CExample1 = " << CExample << endl;
+                        ExcAssert(isfinite(CExample));
 
-                ExcAssert(isfinite(CExample));
+                        for (auto & p: neighbours.probs) {
+                            // Be robust to zero probabilities, even though we
+                            // shouldn't have them.
+                            if (p == 0.0)
+                                continue;
 
-                for (auto & p: neighbours.probs) {
-                    // Be robust to zero probabilities, even though we
-                    // shouldn't have them.
-                    if (p == 0.0)
-                        continue;
+                            double CNeighbour =  pFactor * p * (logZapprox + logpFactor + logf(p));
+                            CExample += CNeighbour;
+                        }
 
-                    double CNeighbour =  pFactor * p * (logZapprox + logpFactor + logf(p));
-                    if (!isfinite(CNeighbour)) {
-                        cerr << "cExample = " << CExample
-                             << "cNeighbour = " << CNeighbour
-                             << " pFactor = " << pFactor
-                             << " p = " << p
-                             << " logZapprox = " << logZapprox
-                             << " logpFactor = " << logpFactor
-                             << " logf(p) = " << logf(p)
-                             << endl;
+                        Cchunk += CExample;
                     }
-                    CExample += CNeighbour;
-                }
+                };
 
-                //cerr << "CExample2 = " << CExample << endl;
+            MLDB::parallelMapChunked(0, nx, CHUNK_SIZE, doCost);
 
-                Capprox += CExample;
+            for (double c: chunkC)
+                Capprox += c;
 
-                ExcAssert(isfinite(Capprox));
-            }
+            ExcAssert(isfinite(Capprox));
         }
 
 #if 0  // exact calculations for verification        
@@ -2226,44 +2259,22 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
         cerr << "Capprox = " << Capprox << " C = " << C << endl;
 #endif
 
-        float maxAbsDy = 0.0;
-        float maxAbsY = 0.0;
-
-        for (unsigned x = 0;  x < nx;  ++x) {
-            for (unsigned i = 0;  i < nd;  ++i) {
-                //dY[x][i] = 4.0 * (Fattr[x][i] + Frep[x][i]);
-                //dY[x][i] = 4.0 * (FattrApprox[x][i] + Frep[x][i]);
-                //dY[x][i] = 4.0 * (Fattr[x][i] + FrepApprox[x][i]);
-                dY[x][i] = 4.0 * (FattrApprox[x][i] + FrepApprox[x][i]);
-
-                ExcAssert(isfinite(FattrApprox[x][i]));
-                ExcAssert(isfinite(FrepApprox[x][i]));
-                ExcAssert(isfinite(dY[x][i]));
-
-                maxAbsDy = std::max(maxAbsDy, fabs(dY[x][i]));
-                maxAbsY = std::max(maxAbsY, Y[x][i]);
+        auto doGradient = [&] (size_t begin, size_t end)
+            {
+                for (unsigned x = begin;  x < end;  ++x) {
+                    for (unsigned i = 0;  i < nd;  ++i) {
+                        ExcAssert(isfinite(FrepZ[x][i]));
+                        FrepApprox[x][i] = FrepZ[x][i] * Zrecip;
 
-#if 0
-                if (x < 5) {
-                    cerr << "Fattr[" << x << "][" << i << "]: approx "
-                         << FattrApprox[x][i] << " real " << Fattr[x][i]
-                         << endl;
-                    cerr << "Frep[" << x << "][" << i << "]: approx "
-                         << FrepApprox[x][i] << " real " << Frep[x][i]
-                         << endl;
-                }
+                        dY[x][i] = 4.0 * (FattrApprox[x][i] + FrepApprox[x][i]);
 
-                if (x < 5) {
-                    cerr << "dY[" << x << "][" << i << "]: approx "
-                         << 4.0 * (FattrApprox[x][i] + FrepApprox[x][i])
-                         << " real " << 4.0 * (Fattr[x][i] + Frep[x][i])
-                         << endl;
-                    cerr << "Y = " << Y[x][i] << endl;
+                        ExcAssert(isfinite(FattrApprox[x][i]));
+                        ExcAssert(isfinite(dY[x][i]));
+                    }
                 }
-#endif
-            }
+            };
 
-        }
+        MLDB::parallelMapChunked(0, nx, CHUNK_SIZE, doGradient);
 
 #if 0
         cerr << "C = " << Capprox << endl;
@@ -2340,24 +2351,45 @@ tsneApproxFromSparse(const std::vector<TsneSparseProbs> & exampleNeighbours,
             timer.restart();
         }
         
-        float maxAbsCoord[nd];
-        std::fill(maxAbsCoord, maxAbsCoord + nd, 0.0);
+        std::vector<float> chunkMaxAbsCoord(numChunks * nd, 0.0f);
+
+        auto doMaxCoord = [&] (size_t begin, size_t end)
+            {
+                float * maxAbsCoord = &chunkMaxAbsCoord[begin / CHUNK_SIZE * nd];
+                for (unsigned x = begin;  x < end;  ++x) {
+                    for (unsigned i = 0;  i < nd;  ++i) {
+                        maxAbsCoord[i] = std::max(maxAbsCoord[i], fabs(Y[x][i]));
+                    }
+                }
+            };
+
+        MLDB::parallelMapChunked(0, nx, CHUNK_SIZE, doMaxCoord);
+
+        std::vector<float> maxAbsCoord(nd, 0.0f);
+        for (size_t c = 0;  c < numChunks;  ++c)
+            for (unsigned i = 0;  i < nd;  ++i)
+                maxAbsCoord[i] = std::max(maxAbsCoord[i],
+                                          chunkMaxAbsCoord[c * nd + i]);
 
         boost::multi_array<float, 2> normalizedY(boost::extents[nx][nd]);
-        for (unsigned x = 0;  x < nx;  ++x) {
-            for (unsigned i = 0;  i < nd;  ++i) {
-                maxAbsCoord[i] = std::max(maxAbsCoord[i], fabs(Y[x][i]));
-            }
-        }
+        std::vector<float> chunkMaxCoordChange(numChunks, 0.0f);
 
-        float maxCoordChange = 0.0;
+        auto doNormalize = [&] (size_t begin, size_t end)
+            {
+                float & maxCoordChange = chunkMaxCoordChange[begin / CHUNK_SIZE];
+                for (unsigned x = begin;  x < end;  ++x) {
+                    for (unsigned i = 0;  i < nd;  ++i) {
+                        normalizedY[x][i] = Y[x][i] / maxAbsCoord[i];
+                        maxCoordChange = std::max(maxCoordChange, fabs(normalizedY[x][i] - lastNormalizedY[x][i]));
+                    }
+                }
+            };
 
-        for (unsigned x = 0;  x < nx;  ++x) {
-            for (unsigned i = 0;  i < nd;  ++i) {
-                normalizedY[x][i] = Y[x][i] / maxAbsCoord[i];
-                maxCoordChange = std::max(maxCoordChange, fabs(normalizedY[x][i] - lastNormalizedY[x][i]));
-            }
-        }
+        MLDB::parallelMapChunked(0, nx, CHUNK_SIZE, doNormalize);
+
+        float maxCoordChange = 0.0;
+        for (float c: chunkMaxCoordChange)
+            maxCoordChange = std::max(maxCoordChange, c);
 
         lastNormalizedY = normalizedY;
 
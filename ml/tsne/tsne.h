@@ -118,6 +118,14 @@ distances_to_probabilities(boost::multi_array<float, 2> & D,
 boost::multi_array<float, 2>
 pca(boost::multi_array<float, 2> & coords, int num_dims = 50);
 
+/** Method used to calculate the repulsive forces in the approximate
+    (sparse) t-SNE.
+*/
+enum TSNE_Repulsion {
+    TSNE_REPULSION_BARNES_HUT,   ///< Barnes-Hut over a quadtree; any dims
+    TSNE_REPULSION_FFT           ///< Interpolation and FFTs; 2 dims only
+};
+
 struct TSNE_Params {
     
     TSNE_Params()
@@ -133,7 +141,10 @@ struct TSNE_Params {
           min_gain(0.01),
           min_prob(1e-12),
           min_distance_ratio(0.6),
-          max_coord_change(0.0005)
+          max_coord_change(0.0005),
+          repulsion(TSNE_REPULSION_BARNES_HUT),
+          fft_min_intervals(50),
+          fft_intervals_per_unit(1.0)
     {
     }
 
@@ -153,6 +164,10 @@ struct TSNE_Params {
 
     double min_distance_ratio;  // 0 means never approximate; 1 means approximate everything
     double max_coord_change;    // stop once no coordinate has changed its relative pos by this
+
+    TSNE_Repulsion repulsion;       // how to calculate the repulsive forces
+    int fft_min_intervals;          // minimum FFT interpolation intervals per dim
+    double fft_intervals_per_unit;  // FFT interpolation intervals per unit of distance
 };
 
 // Function that will be used as a callback to provide progress to a calling
@@ -6,9 +6,10 @@
 
 LIBTSNE_SOURCES := \
         tsne.cc \
-	quadtree.cc
+	quadtree.cc \
+	tsne_fft.cc
 
-LIBTSNE_LINK :=	utils algebra arch stats
+LIBTSNE_LINK :=	utils algebra arch stats pffft
 
 $(eval $(call library,tsne,$(LIBTSNE_SOURCES),$(LIBTSNE_LINK)))
 
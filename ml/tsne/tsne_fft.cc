@@ -0,0 +1,372 @@
+/** tsne_fft.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Interpolation based calculation of the t-SNE repulsive forces.
+*/
+
+#include "tsne_fft.h"
+#include "mldb/ext/pffft/pffft.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+namespace {
+
+/// Number of interpolation points within each interval
+static constexpr int NUM_INTERP = 3;
+
+/** Return the smallest number of intervals, not less than n, for which
+    pffft can do a complex transform of the (zero padded) grid.  That needs
+    a multiple of 16 with no prime factors other than 2, 3 and 5.
+*/
+int fftIntervals(int n)
+{
+    for (;;  ++n) {
+        int m = 2 * n * NUM_INTERP;
+        if (m % 16 != 0)
+            continue;
+        for (int f: { 2, 3, 5 })
+            while (m % f == 0)
+                m /= f;
+        if (m == 1)
+            return n;
+    }
+}
+
+/** Zero-initialized float buffer aligned as pffft requires. */
+struct FftBuffer {
+    FftBuffer(size_t n)
+        : data((float *)pffft_aligned_malloc(n * sizeof(float)),
+               pffft_aligned_free)
+    {
+        if (!data)
+            throw std::bad_alloc();
+        std::fill(data.get(), data.get() + n, 0.0f);
+    }
+
+    float * get() const { return data.get(); }
+
+    std::unique_ptr<float, void (*)(void *)> data;
+};
+
+/** Two dimensional complex FFT of an m by m array, done as a one
+    dimensional FFT of each of the rows, a transposition and another
+    one dimensional FFT of each of the rows.  The forward transform
+    therefore leaves the result transposed; the inverse transform undoes
+    that.  Neither is normalized.
+*/
+struct Fft2D {
+    Fft2D(int m)
+        : m(m), setup(pffft_new_setup(m, PFFFT_COMPLEX))
+    {
+        if (!setup)
+            throw MLDB::Exception("couldn't set up FFT of size %d", m);
+    }
+
+    ~Fft2D()
+    {
+        pffft_destroy_setup(setup);
+    }
+
+    Fft2D(const Fft2D &) = delete;
+    void operator = (const Fft2D &) = delete;
+
+    int m;
+    PFFFT_Setup * setup;
+
+    /** Forward transform.  Only the first nonZeroRows rows of the input
+        can be non-zero.
+    */
+    void forward(float * data, int nonZeroRows) const
+    {
+        rows(data, nonZeroRows, PFFFT_FORWARD);
+        transpose(data);
+        rows(data, m, PFFFT_FORWARD);
+    }
+
+    /** Inverse transform.  Only the first neededRows rows of the output
+        are calculated.
+    */
+    void inverse(float * data, int neededRows) const
+    {
+        rows(data, m, PFFFT_BACKWARD);
+        transpose(data);
+        rows(data, neededRows, PFFFT_BACKWARD);
+    }
+
+private:
+    void rows(float * data, int numRows, pffft_direction_t direction) const
+    {
+        auto doRows = [&] (size_t begin, size_t end)
+            {
+                FftBuffer work(2 * m);
+                for (size_t r = begin;  r < end;  ++r) {
+                    float * row = data + 2 * m * r;
+                    pffft_transform_ordered(setup, row, row, work.get(),
+                                            direction);
+                }
+            };
+
+        MLDB::parallelMapChunked(0, numRows, 16, doRows);
+    }
+
+    void transpose(float * data) const
+    {
+        auto doRow = [&] (size_t i)
+            {
+                for (size_t j = i + 1;  j < m;  ++j) {
+                    std::swap(data[2 * (i * m + j)], data[2 * (j * m + i)]);
+                    std::swap(data[2 * (i * m + j) + 1],
+                              data[2 * (j * m + i) + 1]);
+                }
+            };
+
+        MLDB::parallelMap(0, m, doRow);
+    }
+};
+
+/** Position of a point in the interpolation grid for one dimension: the
+    interval it's in and the weight of each of the interpolation points
+    within that interval.
+*/
+struct GridPosition {
+    int interval;
+    float weights[NUM_INTERP];
+};
+
+} // file scope
+
+double tsneFftRepulsion(const boost::multi_array<float, 2> & Y,
+                        boost::multi_array<double, 2> & FrepZ,
+                        int minIntervals,
+                        double intervalsPerUnit)
+{
+    int nx = Y.shape()[0];
+    if (Y.shape()[1] != 2)
+        throw MLDB::Exception("FFT repulsion only works in two dimensions");
+    ExcAssertEqual(FrepZ.shape()[0], nx);
+    ExcAssertEqual(FrepZ.shape()[1], 2);
+
+    if (nx == 0)
+        return 0.0;
+
+    // The grid covers a square bounding box of all of the points
+    float lo = Y[0][0], hi = Y[0][0];
+    for (unsigned x = 0;  x < nx;  ++x) {
+        lo = std::min(lo, std::min(Y[x][0], Y[x][1]));
+        hi = std::max(hi, std::max(Y[x][0], Y[x][1]));
+    }
+
+    double range = std::max<double>(hi - lo, 1e-6);
+    int numIntervals
+        = fftIntervals(std::max<int>(minIntervals,
+                                     ceil(range * intervalsPerUnit)));
+    double intervalWidth = range / numIntervals;
+
+    // Grid points per dimension, and the size of the FFT which needs zero
+    // padding to make the convolution non-circular
+    int n = numIntervals * NUM_INTERP;
+    int m = 2 * n;
+    double spacing = intervalWidth / NUM_INTERP;
+
+    // Denominators of the Lagrange polynomials for the interpolation
+    // points within an interval, which are at (k + 0.5) / NUM_INTERP
+    double nodes[NUM_INTERP], denoms[NUM_INTERP];
+    for (int k = 0;  k < NUM_INTERP;  ++k)
+        nodes[k] = (k + 0.5) / NUM_INTERP;
+    for (int k = 0;  k < NUM_INTERP;  ++k) {
+        denoms[k] = 1.0;
+        for (int l = 0;  l < NUM_INTERP;  ++l)
+            if (l != k)
+                denoms[k] *= nodes[k] - nodes[l];
+    }
+
+    auto gridPosition = [&] (float y)
+        {
+            GridPosition result;
+            double t = (y - lo) / intervalWidth;
+            result.interval = std::min<int>(t, numIntervals - 1);
+            t -= result.interval;
+            for (int k = 0;  k < NUM_INTERP;  ++k) {
+                double w = 1.0 / denoms[k];
+                for (int l = 0;  l < NUM_INTERP;  ++l)
+                    if (l != k)
+                        w *= t - nodes[l];
+                result.weights[k] = w;
+            }
+            return result;
+        };
+
+    std::vector<GridPosition> pos0(nx), pos1(nx);
+
+    auto doPositions = [&] (size_t begin, size_t end)
+        {
+            for (size_t x = begin;  x < end;  ++x) {
+                pos0[x] = gridPosition(Y[x][0]);
+                pos1[x] = gridPosition(Y[x][1]);
+            }
+        };
+
+    MLDB::parallelMapChunked(0, nx, 4096, doPositions);
+
+    // Sort the points by the row of intervals they're in, so that each
+    // row of the grid is written by a single thread
+    std::vector<int> rowStart(numIntervals + 1, 0);
+    for (unsigned x = 0;  x < nx;  ++x)
+        ++rowStart[pos0[x].interval + 1];
+    for (int i = 0;  i < numIntervals;  ++i)
+        rowStart[i + 1] += rowStart[i];
+    std::vector<int> byRow(nx);
+    {
+        std::vector<int> next(rowStart.begin(), rowStart.end() - 1);
+        for (unsigned x = 0;  x < nx;  ++x)
+            byRow[next[pos0[x].interval]++] = x;
+    }
+
+    // Interpolate the charges 1, y0 and y1 onto the grid.  Each grid value
+    // is complex, with a zero imaginary part.
+    static constexpr int NUM_CHARGES = 3;
+    std::vector<std::unique_ptr<FftBuffer> > charges;
+    for (int c = 0;  c < NUM_CHARGES;  ++c)
+        charges.emplace_back(new FftBuffer(2 * m * m));
+
+    auto doScatterRow = [&] (size_t row)
+        {
+            for (int i = rowStart[row];  i < rowStart[row + 1];  ++i) {
+                int x = byRow[i];
+                const GridPosition & p0 = pos0[x];
+                const GridPosition & p1 = pos1[x];
+                float charge[NUM_CHARGES] = { 1.0f, Y[x][0], Y[x][1] };
+
+                for (int k0 = 0;  k0 < NUM_INTERP;  ++k0) {
+                    int g0 = p0.interval * NUM_INTERP + k0;
+                    for (int k1 = 0;  k1 < NUM_INTERP;  ++k1) {
+                        int g1 = p1.interval * NUM_INTERP + k1;
+                        float w = p0.weights[k0] * p1.weights[k1];
+                        for (int c = 0;  c < NUM_CHARGES;  ++c)
+                            charges[c]->get()[2 * (g0 * m + g1)]
+                                += w * charge[c];
+                    }
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, numIntervals, doScatterRow);
+
+    // The two kernels, 1 / (1 + d^2) and its square, evaluated at each of
+    // the distances between grid points and laid out for a circular
+    // convolution.
+    FftBuffer kernel1(2 * m * m), kernel2(2 * m * m);
+
+    auto doKernelRow = [&] (size_t g0)
+        {
+            int d0 = g0 <= n ? g0 : (int)g0 - m;
+            for (int g1 = 0;  g1 < m;  ++g1) {
+                int d1 = g1 <= n ? g1 : g1 - m;
+                double k1 = 1.0 / (1.0 + (d0 * d0 + d1 * d1)
+                                   * spacing * spacing);
+                kernel1.get()[2 * (g0 * m + g1)] = k1;
+                kernel2.get()[2 * (g0 * m + g1)] = k1 * k1;
+            }
+        };
+
+    MLDB::parallelMap(0, m, doKernelRow);
+
+    Fft2D fft(m);
+    for (auto & c: charges)
+        fft.forward(c->get(), n);
+    fft.forward(kernel1.get(), m);
+    fft.forward(kernel2.get(), m);
+
+    // Multiply in the frequency domain, which convolves the charges with
+    // the kernels.  The outputs are:
+    // 0: kernel1 * 1; 1: kernel2 * 1; 2: kernel2 * y0; 3: kernel2 * y1
+    static constexpr int NUM_OUTPUTS = 4;
+    FftBuffer extra(2 * m * m);
+    float * outputs[NUM_OUTPUTS] = {
+        charges[0]->get(), extra.get(), charges[1]->get(), charges[2]->get()
+    };
+    const float * inputs[NUM_OUTPUTS] = {
+        charges[0]->get(), charges[0]->get(), charges[1]->get(),
+        charges[2]->get()
+    };
+    const float * kernels[NUM_OUTPUTS] = {
+        kernel1.get(), kernel2.get(), kernel2.get(), kernel2.get()
+    };
+
+    // Neither direction of the FFT is normalized
+    float scale = 1.0 / ((double)m * m);
+
+    auto doMultiplyRow = [&] (size_t row)
+        {
+            // Backwards, since output 1 needs input 0 before it's overwritten
+            for (int o = NUM_OUTPUTS - 1;  o >= 0;  --o) {
+                const float * a = inputs[o] + 2 * m * row;
+                const float * b = kernels[o] + 2 * m * row;
+                float * r = outputs[o] + 2 * m * row;
+                for (int i = 0;  i < m;  ++i) {
+                    float re = a[2 * i] * b[2 * i] - a[2 * i + 1] * b[2 * i + 1];
+                    float im = a[2 * i] * b[2 * i + 1] + a[2 * i + 1] * b[2 * i];
+                    r[2 * i] = re * scale;
+                    r[2 * i + 1] = im * scale;
+                }
+            }
+        };
+
+    MLDB::parallelMap(0, m, doMultiplyRow);
+
+    for (float * o: outputs)
+        fft.inverse(o, n);
+
+    // Interpolate the potentials back from the grid onto the points
+    static constexpr size_t CHUNK_SIZE = 4096;
+    std::vector<double> chunkZ((nx + CHUNK_SIZE - 1) / CHUNK_SIZE, 0.0);
+
+    auto doGather = [&] (size_t begin, size_t end)
+        {
+            double Z = 0.0;
+            for (size_t x = begin;  x < end;  ++x) {
+                const GridPosition & p0 = pos0[x];
+                const GridPosition & p1 = pos1[x];
+                double phi[NUM_OUTPUTS] = { 0, 0, 0, 0 };
+
+                for (int k0 = 0;  k0 < NUM_INTERP;  ++k0) {
+                    int g0 = p0.interval * NUM_INTERP + k0;
+                    for (int k1 = 0;  k1 < NUM_INTERP;  ++k1) {
+                        int g1 = p1.interval * NUM_INTERP + k1;
+                        double w = p0.weights[k0] * p1.weights[k1];
+                        for (int o = 0;  o < NUM_OUTPUTS;  ++o)
+                            phi[o] += w * outputs[o][2 * (g0 * m + g1)];
+                    }
+                }
+
+                // Remove the interaction of the point with itself, which is
+                // 1 for kernel1 and nothing for the forces
+                Z += phi[0] - 1.0;
+                FrepZ[x][0] = phi[2] - Y[x][0] * phi[1];
+                FrepZ[x][1] = phi[3] - Y[x][1] * phi[1];
+            }
+            chunkZ[begin / CHUNK_SIZE] = Z;
+        };
+
+    MLDB::parallelMapChunked(0, nx, CHUNK_SIZE, doGather);
+
+    double Z = 0.0;
+    for (double z: chunkZ)
+        Z += z;
+    return Z;
+}
+
+} // namespace ML
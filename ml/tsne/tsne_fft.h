@@ -0,0 +1,43 @@
+/** tsne_fft.h                                                      -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Interpolation based calculation of the t-SNE repulsive forces for
+    two dimensional embeddings.
+*/
+
+#pragma once
+
+#include <boost/multi_array.hpp>
+
+
+namespace ML {
+
+/** Calculate the repulsive forces between all pairs of points of a two
+    dimensional t-SNE embedding in O(n + m log m) time rather than the
+    O(n log n) of Barnes-Hut.
+
+    The kernels are interpolated with Lagrange polynomials onto a regular
+    grid of m points, over which the sums over all of the points become
+    convolutions that are calculated with FFTs.  This is the FIt-SNE
+    algorithm of Linderman et al., 2019, "Fast interpolation-based t-SNE
+    for improved visualization of single-cell RNA-seq data".
+
+    Input:
+    - Y: the nx by 2 matrix of embedded points.
+    - minIntervals: minimum number of interpolation intervals in each
+      dimension.  The grid is made finer as the embedding spreads out,
+      with intervalsPerUnit intervals per unit of distance.
+
+    Output:
+    - FrepZ: filled in with the un-normalized repulsive force on each
+      point, sum_j (y_j - y_i) / (1 + ||y_i - y_j||^2)^2.
+    - returns Z, the sum over all pairs i != j of 1 / (1 + ||y_i - y_j||^2)
+*/
+double tsneFftRepulsion(const boost::multi_array<float, 2> & Y,
+                        boost::multi_array<double, 2> & FrepZ,
+                        int minIntervals = 50,
+                        double intervalsPerUnit = 1.0);
+
+} // namespace ML
@@ -0,0 +1,391 @@
+/** vector_quantizer.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Compact lossy encodings of dense vectors.
+*/
+
+#include "vector_quantizer.h"
+#include "mldb/jml/db/persistent.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/exception.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <limits>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* VECTOR QUANTIZER                                                          */
+/*****************************************************************************/
+
+std::shared_ptr<VectorQuantizer>
+VectorQuantizer::
+reconstitute(DB::Store_Reader & store)
+{
+    string canary;
+    store >> canary;
+    if (canary == "SCALAR_QUANTIZER")
+        return std::make_shared<ScalarQuantizer>(store);
+    else if (canary == "PRODUCT_QUANTIZER")
+        return std::make_shared<ProductQuantizer>(store);
+    throw MLDB::Exception("Unknown vector quantizer type '%s'",
+                          canary.c_str());
+}
+
+
+/*****************************************************************************/
+/* SCALAR QUANTIZER                                                          */
+/*****************************************************************************/
+
+ScalarQuantizer::
+ScalarQuantizer(const float * data, size_t n, int nd)
+    : mins(nd, 0.0f), scales(nd, 0.0f)
+{
+    if (n == 0)
+        return;
+
+    std::vector<float> maxs(data, data + nd);
+    std::copy(data, data + nd, mins.begin());
+
+    for (size_t i = 1;  i < n;  ++i) {
+        const float * vec = data + i * nd;
+        for (int j = 0;  j < nd;  ++j) {
+            mins[j] = std::min(mins[j], vec[j]);
+            maxs[j] = std::max(maxs[j], vec[j]);
+        }
+    }
+
+    for (int j = 0;  j < nd;  ++j)
+        scales[j] = (maxs[j] - mins[j]) / 255.0f;
+}
+
+ScalarQuantizer::
+ScalarQuantizer(DB::Store_Reader & store)
+{
+    DB::compact_size_t version(store);
+    if (version != 0)
+        throw MLDB::Exception("Unknown scalar quantizer version");
+    store >> mins >> scales;
+    if (mins.size() != scales.size())
+        throw MLDB::Exception("Corrupt scalar quantizer");
+}
+
+int
+ScalarQuantizer::
+numDimensions() const
+{
+    return mins.size();
+}
+
+int
+ScalarQuantizer::
+codeSize() const
+{
+    return mins.size();
+}
+
+void
+ScalarQuantizer::
+encode(const float * vec, uint8_t * code) const
+{
+    for (unsigned j = 0;  j < mins.size();  ++j) {
+        if (scales[j] == 0.0f) {
+            code[j] = 0;
+            continue;
+        }
+        float c = std::round((vec[j] - mins[j]) / scales[j]);
+        code[j] = std::max(0.0f, std::min(255.0f, c));
+    }
+}
+
+void
+ScalarQuantizer::
+decode(const uint8_t * code, float * vec) const
+{
+    for (unsigned j = 0;  j < mins.size();  ++j)
+        vec[j] = mins[j] + scales[j] * code[j];
+}
+
+float
+ScalarQuantizer::
+decodeDimension(const uint8_t * code, int dim) const
+{
+    return mins.at(dim) + scales[dim] * code[dim];
+}
+
+void
+ScalarQuantizer::
+prepareQuery(const float * query, std::vector<float> & table) const
+{
+    // q . x = sum_j q[j] (mins[j] + scales[j] code[j])
+    //       = sum_j q[j] mins[j] + sum_j (q[j] scales[j]) code[j]
+    table.resize(mins.size() + 1);
+    double offset = 0.0;
+    for (unsigned j = 0;  j < mins.size();  ++j) {
+        offset += query[j] * mins[j];
+        table[j + 1] = query[j] * scales[j];
+    }
+    table[0] = offset;
+}
+
+float
+ScalarQuantizer::
+dotProduct(const std::vector<float> & table, const uint8_t * code) const
+{
+    // Simple enough for the compiler to vectorize
+    const float * weights = table.data() + 1;
+    float result = 0.0f;
+    for (unsigned j = 0;  j < mins.size();  ++j)
+        result += weights[j] * code[j];
+    return table[0] + result;
+}
+
+void
+ScalarQuantizer::
+serialize(DB::Store_Writer & store) const
+{
+    store << string("SCALAR_QUANTIZER") << DB::compact_size_t(0)
+          << mins << scales;
+}
+
+
+/*****************************************************************************/
+/* PRODUCT QUANTIZER                                                         */
+/*****************************************************************************/
+
+ProductQuantizer::
+ProductQuantizer(const float * data, size_t n, int nd,
+                 int numSubvectors,
+                 size_t maxTrainingVectors,
+                 int numIterations)
+    : nd(nd)
+{
+    if (numSubvectors < 1 || numSubvectors > nd)
+        throw MLDB::Exception("Product quantizer needs between 1 and %d "
+                              "subvectors, not %d", nd, numSubvectors);
+
+    for (int s = 0;  s <= numSubvectors;  ++s)
+        starts.push_back((size_t)s * nd / numSubvectors);
+
+    centroids.resize(numSubvectors);
+    for (int s = 0;  s < numSubvectors;  ++s)
+        centroids[s].resize(NUM_CENTROIDS * subvectorDims(s));
+
+    if (n == 0)
+        return;
+
+    // Choose the training vectors, in a random order, so that the first
+    // ones can be used as the initial centroids
+    std::vector<size_t> sample(n);
+    std::iota(sample.begin(), sample.end(), 0);
+    std::mt19937 rng(1);
+    size_t numSamples = std::min(n, maxTrainingVectors);
+    for (size_t i = 0;  i < numSamples;  ++i) {
+        std::uniform_int_distribution<size_t> pick(i, n - 1);
+        std::swap(sample[i], sample[pick(rng)]);
+    }
+    sample.resize(numSamples);
+
+    int k = std::min<size_t>(NUM_CENTROIDS, numSamples);
+
+    // k-means for each subvector, independently
+    auto trainSubvector = [&] (int s)
+        {
+            int start = starts[s];
+            int dims = subvectorDims(s);
+            std::vector<float> & cents = centroids[s];
+
+            auto subvec = [&] (size_t i) { return data + sample[i] * nd + start; };
+
+            for (int c = 0;  c < NUM_CENTROIDS;  ++c)
+                std::copy(subvec(c % k), subvec(c % k) + dims,
+                          cents.begin() + c * dims);
+
+            std::vector<int> assignments(numSamples, -1);
+            std::vector<double> sums(k * dims);
+            std::vector<size_t> counts(k);
+
+            for (int iter = 0;  iter < numIterations;  ++iter) {
+                bool changed = false;
+                for (size_t i = 0;  i < numSamples;  ++i) {
+                    const float * v = subvec(i);
+                    int best = 0;
+                    float bestDist = std::numeric_limits<float>::infinity();
+                    for (int c = 0;  c < k;  ++c) {
+                        const float * cent = &cents[c * dims];
+                        float d = 0.0f;
+                        for (int j = 0;  j < dims;  ++j)
+                            d += (v[j] - cent[j]) * (v[j] - cent[j]);
+                        if (d < bestDist) {
+                            bestDist = d;
+                            best = c;
+                        }
+                    }
+                    if (assignments[i] != best) {
+                        assignments[i] = best;
+                        changed = true;
+                    }
+                }
+
+                if (!changed)
+                    break;
+
+                std::fill(sums.begin(), sums.end(), 0.0);
+                std::fill(counts.begin(), counts.end(), 0);
+                for (size_t i = 0;  i < numSamples;  ++i) {
+                    const float * v = subvec(i);
+                    int c = assignments[i];
+                    counts[c] += 1;
+                    for (int j = 0;  j < dims;  ++j)
+                        sums[c * dims + j] += v[j];
+                }
+
+                // Empty clusters keep their old centroid
+                for (int c = 0;  c < k;  ++c) {
+                    if (counts[c] == 0)
+                        continue;
+                    for (int j = 0;  j < dims;  ++j)
+                        cents[c * dims + j] = sums[c * dims + j] / counts[c];
+                }
+            }
+
+            // With fewer than 256 training vectors, the spare centroids
+            // duplicate the real ones
+            for (int c = k;  c < NUM_CENTROIDS;  ++c)
+                std::copy(cents.begin() + (c % k) * dims,
+                          cents.begin() + (c % k + 1) * dims,
+                          cents.begin() + c * dims);
+        };
+
+    MLDB::parallelMap(0, numSubvectors, trainSubvector);
+}
+
+ProductQuantizer::
+ProductQuantizer(DB::Store_Reader & store)
+{
+    DB::compact_size_t version(store);
+    if (version != 0)
+        throw MLDB::Exception("Unknown product quantizer version");
+    DB::compact_size_t nd(store);
+    this->nd = nd;
+    store >> starts >> centroids;
+    if (starts.size() < 2 || starts.back() != this->nd
+        || centroids.size() != starts.size() - 1)
+        throw MLDB::Exception("Corrupt product quantizer");
+    for (unsigned s = 0;  s < centroids.size();  ++s) {
+        if (centroids[s].size() != NUM_CENTROIDS * subvectorDims(s))
+            throw MLDB::Exception("Corrupt product quantizer");
+    }
+}
+
+int
+ProductQuantizer::
+numDimensions() const
+{
+    return nd;
+}
+
+int
+ProductQuantizer::
+codeSize() const
+{
+    return centroids.size();
+}
+
+void
+ProductQuantizer::
+encode(const float * vec, uint8_t * code) const
+{
+    for (unsigned s = 0;  s < centroids.size();  ++s) {
+        int dims = subvectorDims(s);
+        const float * v = vec + starts[s];
+        int best = 0;
+        float bestDist = std::numeric_limits<float>::infinity();
+        for (int c = 0;  c < NUM_CENTROIDS;  ++c) {
+            const float * cent = &centroids[s][c * dims];
+            float d = 0.0f;
+            for (int j = 0;  j < dims;  ++j)
+                d += (v[j] - cent[j]) * (v[j] - cent[j]);
+            if (d < bestDist) {
+                bestDist = d;
+                best = c;
+            }
+        }
+        code[s] = best;
+    }
+}
+
+void
+ProductQuantizer::
+decode(const uint8_t * code, float * vec) const
+{
+    for (unsigned s = 0;  s < centroids.size();  ++s) {
+        int dims = subvectorDims(s);
+        const float * cent = &centroids[s][code[s] * dims];
+        std::copy(cent, cent + dims, vec + starts[s]);
+    }
+}
+
+float
+ProductQuantizer::
+decodeDimension(const uint8_t * code, int dim) const
+{
+    ExcAssertGreaterEqual(dim, 0);
+    ExcAssertLess(dim, nd);
+    // Subvector that the dimension belongs to
+    int s = std::upper_bound(starts.begin(), starts.end(), dim)
+        - starts.begin() - 1;
+    return centroids[s][code[s] * subvectorDims(s) + dim - starts[s]];
+}
+
+void
+ProductQuantizer::
+prepareQuery(const float * query, std::vector<float> & table) const
+{
+    // The table holds the dot product of each part of the query with
+    // each of the centroids for that part
+    table.resize(centroids.size() * NUM_CENTROIDS);
+    for (unsigned s = 0;  s < centroids.size();  ++s) {
+        int dims = subvectorDims(s);
+        const float * q = query + starts[s];
+        for (int c = 0;  c < NUM_CENTROIDS;  ++c) {
+            const float * cent = &centroids[s][c * dims];
+            float d = 0.0f;
+            for (int j = 0;  j < dims;  ++j)
+                d += q[j] * cent[j];
+            table[s * NUM_CENTROIDS + c] = d;
+        }
+    }
+}
+
+float
+ProductQuantizer::
+dotProduct(const std::vector<float> & table, const uint8_t * code) const
+{
+    const float * t = table.data();
+    float result = 0.0f;
+    for (unsigned s = 0;  s < centroids.size();  ++s, t += NUM_CENTROIDS)
+        result += t[code[s]];
+    return result;
+}
+
+void
+ProductQuantizer::
+serialize(DB::Store_Writer & store) const
+{
+    store << string("PRODUCT_QUANTIZER") << DB::compact_size_t(0)
+          << DB::compact_size_t(nd) << starts << centroids;
+}
+
+
+} // namespace ML
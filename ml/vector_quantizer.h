@@ -0,0 +1,159 @@
+/** vector_quantizer.h                                             -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Compact lossy encodings of dense vectors, with fast approximate dot
+    products between an encoded vector and a full precision query.
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* VECTOR QUANTIZER                                                          */
+/*****************************************************************************/
+
+/** Encodes vectors of floats into fixed length codes of bytes.
+
+    Dot products between a query and encoded vectors are calculated with
+    asymmetric distance computation: the query is turned once into a
+    lookup table with prepareQuery(), after which each dot product only
+    needs the code, without decoding the vector.
+
+    A quantizer is trained once and is immutable afterwards, so it can be
+    shared between threads.
+*/
+
+struct VectorQuantizer {
+    virtual ~VectorQuantizer()
+    {
+    }
+
+    /** Number of dimensions of the vectors. */
+    virtual int numDimensions() const = 0;
+
+    /** Number of bytes in the code of each vector. */
+    virtual int codeSize() const = 0;
+
+    /** Encode the vector into codeSize() bytes at code. */
+    virtual void encode(const float * vec, uint8_t * code) const = 0;
+
+    /** Decode the code into an approximation of the original vector. */
+    virtual void decode(const uint8_t * code, float * vec) const = 0;
+
+    /** Decode only the given dimension of the code.  This is much cheaper
+        than decode() when a single column is needed.
+    */
+    virtual float decodeDimension(const uint8_t * code, int dim) const = 0;
+
+    /** Fill in the lookup table used to calculate dot products of the
+        given query vector with encoded vectors.
+    */
+    virtual void prepareQuery(const float * query,
+                              std::vector<float> & table) const = 0;
+
+    /** Approximate dot product of the query that the table was prepared
+        from and the encoded vector.
+    */
+    virtual float dotProduct(const std::vector<float> & table,
+                             const uint8_t * code) const = 0;
+
+    /** Save the quantizer, including which kind it is. */
+    virtual void serialize(DB::Store_Writer & store) const = 0;
+
+    /** Load a quantizer saved by serialize(). */
+    static std::shared_ptr<VectorQuantizer>
+    reconstitute(DB::Store_Reader & store);
+};
+
+
+/*****************************************************************************/
+/* SCALAR QUANTIZER                                                          */
+/*****************************************************************************/
+
+/** Encodes each dimension into a byte, linearly between the minimum and
+    maximum of that dimension over the training data.  Values outside of
+    that range are clamped.  4x smaller than floats.
+*/
+
+struct ScalarQuantizer: public VectorQuantizer {
+
+    /** Train on the n row-major vectors of nd dimensions in data. */
+    ScalarQuantizer(const float * data, size_t n, int nd);
+
+    ScalarQuantizer(DB::Store_Reader & store);
+
+    virtual int numDimensions() const;
+    virtual int codeSize() const;
+    virtual void encode(const float * vec, uint8_t * code) const;
+    virtual void decode(const uint8_t * code, float * vec) const;
+    virtual float decodeDimension(const uint8_t * code, int dim) const;
+    virtual void prepareQuery(const float * query,
+                              std::vector<float> & table) const;
+    virtual float dotProduct(const std::vector<float> & table,
+                             const uint8_t * code) const;
+    virtual void serialize(DB::Store_Writer & store) const;
+
+private:
+    std::vector<float> mins;    ///< Value of a zero code per dimension
+    std::vector<float> scales;  ///< Value of each code step per dimension
+};
+
+
+/*****************************************************************************/
+/* PRODUCT QUANTIZER                                                         */
+/*****************************************************************************/
+
+/** Splits the dimensions into numSubvectors contiguous groups, and
+    encodes each group as the index of the nearest of 256 centroids learnt
+    for that group with k-means.  Each byte of code typically stands for 4
+    to 8 floats, giving a 16-32x reduction in size.
+*/
+
+struct ProductQuantizer: public VectorQuantizer {
+
+    /** Train on the n row-major vectors of nd dimensions in data.  At
+        most maxTrainingVectors of them are used.
+    */
+    ProductQuantizer(const float * data, size_t n, int nd,
+                     int numSubvectors,
+                     size_t maxTrainingVectors = 65536,
+                     int numIterations = 10);
+
+    ProductQuantizer(DB::Store_Reader & store);
+
+    static constexpr int NUM_CENTROIDS = 256;
+
+    virtual int numDimensions() const;
+    virtual int codeSize() const;
+    virtual void encode(const float * vec, uint8_t * code) const;
+    virtual void decode(const uint8_t * code, float * vec) const;
+    virtual float decodeDimension(const uint8_t * code, int dim) const;
+    virtual void prepareQuery(const float * query,
+                              std::vector<float> & table) const;
+    virtual float dotProduct(const std::vector<float> & table,
+                             const uint8_t * code) const;
+    virtual void serialize(DB::Store_Writer & store) const;
+
+private:
+    int nd;
+    std::vector<int> starts;   ///< First dimension of each subvector, plus nd
+
+    /// For each subvector, NUM_CENTROIDS row-major centroids of its
+    /// dimensions
+    std::vector<std::vector<float> > centroids;
+
+    int subvectorDims(int s) const { return starts[s + 1] - starts[s]; }
+};
+
+
+} // namespace ML
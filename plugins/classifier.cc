@@ -900,8 +900,6 @@ apply(const FunctionApplier & applier_,
 {
     auto & applier = (ClassifyFunctionApplier &)applier_;
 
-    int labelCount = itl->classifier.label_count();
-
     std::vector<float> dense;
     std::shared_ptr<ML::Mutable_Feature_Set> fset;
     Date ts;
@@ -909,6 +907,20 @@ apply(const FunctionApplier & applier_,
     std::tie(dense, fset, ts)
         = getFeatureSet(context, applier.optInfo /* try to optimize */);
 
+    return score(applier_, dense, fset.get(), ts);
+}
+
+ExpressionValue
+ClassifyFunction::
+score(const FunctionApplier & applier_,
+      const std::vector<float> & dense,
+      const ML::Mutable_Feature_Set * fset,
+      Date ts) const
+{
+    auto & applier = (ClassifyFunctionApplier &)applier_;
+
+    int labelCount = itl->classifier.label_count();
+
     StructValue result;
     result.reserve(1);
 
@@ -973,6 +985,84 @@ apply(const FunctionApplier & applier_,
     return std::move(result);
 }
 
+std::vector<ExpressionValue>
+ClassifyFunction::
+applyBatch(const FunctionApplier & applier_,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    auto & applier = (ClassifyFunctionApplier &)applier_;
+
+    if (!applier.optInfo || !supportsBatch())
+        return Function::applyBatch(applier_, inputs);
+
+    int labelCount = itl->classifier.label_count();
+    auto cat = itl->labelInfo.categorical();
+
+    std::vector<ExpressionValue> result(inputs.size());
+
+    // Rows with a dense feature vector are packed into a matrix and scored
+    // together; the others go through the normal path.
+    std::vector<size_t> denseRows;
+    std::vector<float> features;
+    std::vector<Date> timestamps;
+    size_t stride = 0;
+
+    for (size_t i = 0;  i < inputs.size();  ++i) {
+        std::vector<float> dense;
+        std::shared_ptr<ML::Mutable_Feature_Set> fset;
+        Date ts;
+
+        std::tie(dense, fset, ts) = getFeatureSet(inputs[i], true);
+
+        if (dense.empty() || (stride != 0 && dense.size() != stride)) {
+            result[i] = score(applier_, dense, fset.get(), ts);
+            continue;
+        }
+
+        stride = dense.size();
+        denseRows.push_back(i);
+        features.insert(features.end(), dense.begin(), dense.end());
+        timestamps.push_back(ts);
+    }
+
+    if (denseRows.empty())
+        return result;
+
+    std::vector<double> scores(denseRows.size() * labelCount);
+    itl->classifier.impl->predict_batch(features.data(), denseRows.size(),
+                                        stride, applier.optInfo,
+                                        scores.data());
+
+    for (size_t j = 0;  j < denseRows.size();  ++j) {
+        const double * rowScores = &scores[j * labelCount];
+        Date ts = timestamps[j];
+
+        StructValue row;
+        row.reserve(1);
+
+        if (cat) {
+            vector<tuple<PathElement, ExpressionValue> > labels;
+            for (unsigned i = 0;  i < labelCount;  ++i) {
+                labels.emplace_back(PathElement(cat->print(i)),
+                                    ExpressionValue((float)rowScores[i], ts));
+            }
+            row.emplace_back("scores", std::move(labels));
+        }
+        else if (itl->labelInfo.type() == ML::REAL) {
+            ExcAssertEqual(labelCount, 1);
+            row.emplace_back("score", ExpressionValue((float)rowScores[0], ts));
+        }
+        else {
+            ExcAssertEqual(labelCount, 2);
+            row.emplace_back("score", ExpressionValue((float)rowScores[1], ts));
+        }
+
+        result[denseRows[j]] = std::move(row);
+    }
+
+    return result;
+}
+
 FunctionInfo
 ClassifyFunction::
 getFunctionInfo() const
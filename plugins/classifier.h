@@ -129,9 +129,29 @@ struct ClassifyFunction: public Function {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Score all of the inputs that have dense features with a single
+        call to the classifier, which allows it to process them together.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
+    virtual bool supportsBatch() const
+    {
+        return true;
+    }
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 
+    /** Score the feature set returned by getFeatureSet(), using the dense
+        vector if there is one and the applier was optimized.
+    */
+    ExpressionValue score(const FunctionApplier & applier,
+                          const std::vector<float> & dense,
+                          const ML::Mutable_Feature_Set * fset,
+                          Date ts) const;
+
     /** Return the feature set for the given function context.  If
         returnDense is true, then it will attempt to return an optimized
         (dense) feature vector.
@@ -168,6 +188,12 @@ struct ExplainFunction: public ClassifyFunction {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
 
+    /** Explanations are done one row at a time. */
+    virtual bool supportsBatch() const
+    {
+        return false;
+    }
+
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
 };
@@ -9,6 +9,8 @@
 
 #include "embedding.h"
 #include "mldb/ml/tsne/vantage_point_tree.h"
+#include "mldb/ml/hnsw_index.h"
+#include "mldb/ml/vector_quantizer.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
@@ -23,6 +25,7 @@
 #include "mldb/types/jml_serialization.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
 #include "mldb/arch/timers.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/server/bucket.h"
@@ -55,6 +58,40 @@ operator >> (ML::DB::Store_Reader & store, Path & coords);
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+EmbeddingIndexTypeDescription::
+EmbeddingIndexTypeDescription()
+{
+    addValue("vptree", EMBEDDING_INDEX_VPTREE,
+             "Exact vantage point tree.  This gives exact answers, but is "
+             "rebuilt on each commit and becomes slow in high dimensions.");
+    addValue("hnsw", EMBEDDING_INDEX_HNSW,
+             "Approximate Hierarchical Navigable Small World graph.  Rows "
+             "are added to the graph on each commit without rebuilding it, "
+             "and lookups stay fast in high dimensions, but some true "
+             "neighbors may be missed.");
+}
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingQuantization);
+
+EmbeddingQuantizationDescription::
+EmbeddingQuantizationDescription()
+{
+    addValue("none", EMBEDDING_QUANTIZATION_NONE,
+             "Rows are only stored as full precision floats.");
+    addValue("int8", EMBEDDING_QUANTIZATION_INT8,
+             "Each dimension is also stored as a byte, scaled between the "
+             "minimum and maximum of that dimension.  This is 4 times "
+             "smaller than floats and loses very little precision.");
+    addValue("pq", EMBEDDING_QUANTIZATION_PQ,
+             "Product quantization: the dimensions are split into groups, "
+             "and each group is stored as a byte giving the closest of 256 "
+             "centroids learnt for that group.  This is 16 times smaller "
+             "than floats with the default groups of 4 dimensions, but "
+             "distances are much less precise.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 EmbeddingDatasetConfigDescription::
@@ -68,6 +105,61 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Index used to answer nearest neighbors queries.",
+             EMBEDDING_INDEX_VPTREE);
+    addField("hnswNeighbors", &EmbeddingDatasetConfig::hnswNeighbors,
+             "Number of neighbors each row is linked to in the hnsw index.  "
+             "Higher values give better recall at the expense of memory "
+             "and indexing time.", 16);
+    addField("hnswEfConstruction", &EmbeddingDatasetConfig::hnswEfConstruction,
+             "Number of candidates considered when adding a row to the "
+             "hnsw index.  Higher values give a better quality index at "
+             "the expense of indexing time.", 200);
+    addField("hnswEfSearch", &EmbeddingDatasetConfig::hnswEfSearch,
+             "Number of candidates considered when looking up neighbors "
+             "in the hnsw index.  This trades off recall against speed; "
+             "it is never less than the number of neighbors asked for.",
+             64);
+    addField("quantization", &EmbeddingDatasetConfig::quantization,
+             "Compact encoding of the rows used to calculate distances for "
+             "nearest neighbors queries.  The encoding is learnt from the "
+             "rows of the first commit.", EMBEDDING_QUANTIZATION_NONE);
+    addField("pqSubvectors", &EmbeddingDatasetConfig::pqSubvectors,
+             "Number of groups of dimensions, and so bytes per row, used "
+             "with the 'pq' quantization.  The default of 0 uses one "
+             "group per 4 dimensions.", 0);
+    addField("keepFullVectors", &EmbeddingDatasetConfig::keepFullVectors,
+             "With quantization, keep the full precision rows as well.  "
+             "They are used to re-rank the nearest neighbors found with the "
+             "quantized rows, and to return the values of the dataset.  "
+             "If false, only the quantized rows are kept, which saves "
+             "memory but makes distances and values approximate.", true);
+    addField("rerankFactor", &EmbeddingDatasetConfig::rerankFactor,
+             "With quantization and full vectors kept, this many times the "
+             "number of neighbors asked for are found with the quantized "
+             "rows, then re-ranked with exact distances.", 4);
+
+    onPostValidate = [] (EmbeddingDatasetConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->hnswNeighbors < 2)
+                throw HttpReturnException
+                    (400, "hnswNeighbors must be at least 2",
+                     "hnswNeighbors", config->hnswNeighbors);
+            if (config->hnswEfConstruction < 1 || config->hnswEfSearch < 1)
+                throw HttpReturnException
+                    (400, "hnswEfConstruction and hnswEfSearch must be "
+                     "positive",
+                     "hnswEfConstruction", config->hnswEfConstruction,
+                     "hnswEfSearch", config->hnswEfSearch);
+            if (config->pqSubvectors < 0 || config->rerankFactor < 1)
+                throw HttpReturnException
+                    (400, "pqSubvectors must not be negative and "
+                     "rerankFactor must be positive",
+                     "pqSubvectors", config->pqSubvectors,
+                     "rerankFactor", config->rerankFactor);
+        };
 }
 
 
@@ -76,33 +168,61 @@ EmbeddingDatasetConfigDescription()
 /*****************************************************************************/
 
 struct EmbeddingDatasetRepr {
-    EmbeddingDatasetRepr(MetricSpace metric)
+    EmbeddingDatasetRepr(const EmbeddingDatasetConfig & config)
         : vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+          hnsw(createHnsw(config)),
+          config(config),
+          distance(DistanceMetric::create(config.metric))
     {
     }
 
     EmbeddingDatasetRepr(std::vector<ColumnPath> columnNames,
-                         MetricSpace metric)
+                         const EmbeddingDatasetConfig & config)
         : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
           vpTree(new ML::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+          hnsw(createHnsw(config)),
+          config(config),
+          distance(DistanceMetric::create(config.metric))
     {
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
             columnIndex[this->columnNames[i]] = i;
         }
     }
 
+    /** Load a representation that was saved with serialize(). */
+    EmbeddingDatasetRepr(ML::DB::Store_Reader & store,
+                         const EmbeddingDatasetConfig & config)
+        : vpTree(new ML::VantagePointTreeT<int>()),
+          config(config),
+          distance(DistanceMetric::create(config.metric))
+    {
+        reconstitute(store);
+    }
+
     EmbeddingDatasetRepr(const EmbeddingDatasetRepr & other)
         : columnNames(other.columnNames),
           columns(other.columns),
           columnIndex(other.columnIndex),
           rows(other.rows),
           rowIndex(other.rowIndex),
-          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get())),
+          hnsw(other.hnsw ? new ML::HnswIndex(*other.hnsw) : nullptr),
+          config(other.config),
+          distance(other.distance->clone()),
+          quantizer(other.quantizer),
+          codes(other.codes),
+          codeNorms(other.codeNorms)
     {
     }
 
+    static ML::HnswIndex * createHnsw(const EmbeddingDatasetConfig & config)
+    {
+        if (config.index != EMBEDDING_INDEX_HNSW)
+            return nullptr;
+        return new ML::HnswIndex(config.hnswNeighbors,
+                                 config.hnswEfConstruction);
+    }
+
     // Unfortunately, both '0' and 'null' hash to the same thing.  To
     // allow loading with both of these present, we rehash those into
     // different identifiers.
@@ -148,6 +268,51 @@ struct EmbeddingDatasetRepr {
         }
     };
 
+    /** Are the full vectors of the rows thrown away once they have been
+        quantized?
+    */
+    bool dropsFullVectors() const
+    {
+        return config.quantization != EMBEDDING_QUANTIZATION_NONE
+            && !config.keepFullVectors;
+    }
+
+    /** Return the coordinates of the row; if only its quantized version
+        is held, this is an approximation.
+    */
+    distribution<float> getCoords(unsigned row) const
+    {
+        ExcAssertLess(row, rows.size());
+        if (!rows[row].coords.empty() || columns.empty())
+            return rows[row].coords;
+        ExcAssert(quantizer);
+        ExcAssertLess(row, codeNorms.size());
+        distribution<float> result(columns.size());
+        quantizer->decode(&codes[row * quantizer->codeSize()], result.data());
+        return result;
+    }
+
+    /** Return the values of the given column for each row.  They are
+        decoded into storage if the columns aren't held, in which case
+        only that dimension of each code is decoded.
+    */
+    const std::vector<float> &
+    getColumnValues(int column, std::vector<float> & storage) const
+    {
+        if (!dropsFullVectors())
+            return columns.at(column);
+        ExcAssertLess(column, columns.size());
+        storage.resize(rows.size());
+        int codeSize = quantizer ? quantizer->codeSize() : 0;
+        for (unsigned i = 0;  i < rows.size();  ++i) {
+            if (!rows[i].coords.empty())
+                storage[i] = rows[i].coords[column];
+            else storage[i] = quantizer->decodeDimension
+                     (&codes[i * codeSize], column);
+        }
+        return storage;
+    }
+
     float dist(unsigned row1, unsigned row2) const
     {
         ExcAssertLess(row1, rows.size());
@@ -155,10 +320,17 @@ struct EmbeddingDatasetRepr {
 
         if (row1 == row2)
             return 0.0f;
-        
-        float result = distance->dist(row1, row2,
-                                      rows[row1].coords,
-                                      rows[row2].coords);
+
+        float result;
+        if (rows[row1].coords.empty() || rows[row2].coords.empty()) {
+            // Full vectors have been dropped; compare the decoded ones
+            result = distance->dist(-1, -1, getCoords(row1), getCoords(row2));
+        }
+        else {
+            result = distance->dist(row1, row2,
+                                    rows[row1].coords,
+                                    rows[row2].coords);
+        }
         
         ExcAssert(isfinite(result));
         return result;
@@ -169,12 +341,115 @@ struct EmbeddingDatasetRepr {
         ExcAssertLess(row1, rows.size());
         ExcAssertEqual(row2.size(), columns.size());
         
-        float result = distance->dist(row1, -1,
-                                      rows[row1].coords,
-                                      row2);
+        float result;
+        if (rows[row1].coords.empty())
+            result = distance->dist(-1, -1, getCoords(row1), row2);
+        else result = distance->dist(row1, -1, rows[row1].coords, row2);
         ExcAssert(isfinite(result));
         return result;
     }
+
+    /** Return a function that gives the approximate distance between
+        the query and a quantized row, using asymmetric distance
+        computation from lookup tables.
+    */
+    std::function<float (int)>
+    quantizedDistance(const distribution<float> & query) const
+    {
+        ExcAssert(quantizer);
+        ExcAssertEqual(query.size(), columns.size());
+
+        auto table = std::make_shared<std::vector<float> >();
+        quantizer->prepareQuery(query.data(), *table);
+        double queryNorm = sqrt(ML::SIMD::vec_dotprod_dp(query.data(),
+                                                         query.data(),
+                                                         query.size()));
+        bool cosine = config.metric == METRIC_COSINE;
+
+        return [=] (int row) -> float
+            {
+                float dp = quantizer->dotProduct
+                    (*table, &codes[row * quantizer->codeSize()]);
+                double rowNorm = codeNorms[row];
+                if (cosine) {
+                    if (rowNorm == 0.0 || queryNorm == 0.0)
+                        return rowNorm == queryNorm ? 0.0 : 1.0;
+                    return std::max(1.0 - dp / (rowNorm * queryNorm), 0.0);
+                }
+                double distSquared = queryNorm * queryNorm
+                    + rowNorm * rowNorm - 2.0 * dp;
+                return sqrt(std::max(distSquared, 0.0));
+            };
+    }
+
+    /** Train the quantizer if necessary, and encode the rows added since
+        the last commit.
+    */
+    void quantize()
+    {
+        if (config.quantization == EMBEDDING_QUANTIZATION_NONE)
+            return;
+
+        size_t nd = columns.size();
+
+        if (!quantizer && !rows.empty()) {
+            // Train on an even sample of the rows
+            size_t stride = std::max<size_t>(1, rows.size() / 65536);
+            std::vector<float> sample;
+            for (size_t i = 0;  i < rows.size();  i += stride)
+                sample.insert(sample.end(), rows[i].coords.begin(),
+                              rows[i].coords.end());
+            size_t numSamples = sample.size() / nd;
+
+            if (config.quantization == EMBEDDING_QUANTIZATION_INT8) {
+                quantizer = std::make_shared<ML::ScalarQuantizer>
+                    (sample.data(), numSamples, nd);
+            }
+            else {
+                // By default, each byte of code stands for 4 dimensions
+                int numSubvectors = config.pqSubvectors;
+                if (numSubvectors <= 0)
+                    numSubvectors = std::max<int>(1, nd / 4);
+                if (numSubvectors > nd)
+                    throw HttpReturnException
+                        (400, "pqSubvectors can't be more than the number "
+                         "of columns in the embedding",
+                         "pqSubvectors", numSubvectors,
+                         "numColumns", nd);
+                quantizer = std::make_shared<ML::ProductQuantizer>
+                    (sample.data(), numSamples, nd, numSubvectors);
+            }
+        }
+
+        if (!quantizer)
+            return;
+
+        size_t first = codeNorms.size();
+        if (first == rows.size())
+            return;
+
+        int codeSize = quantizer->codeSize();
+        codes.resize(rows.size() * codeSize);
+        codeNorms.resize(rows.size());
+
+        auto encodeRows = [&] (size_t begin, size_t end)
+            {
+                for (size_t i = begin;  i < end;  ++i) {
+                    const distribution<float> & coords = rows[i].coords;
+                    quantizer->encode(coords.data(), &codes[i * codeSize]);
+                    codeNorms[i] = coords.two_norm();
+                }
+            };
+
+        parallelMapChunked(first, rows.size(), 4096, encodeRows);
+    }
+
+    /** Throw away the full vectors of rows that have been quantized. */
+    void dropQuantizedVectors()
+    {
+        for (size_t i = 0;  i < codeNorms.size();  ++i)
+            distribution<float>().swap(rows[i].coords);
+    }
     
     std::pair<Date, Date> getTimestampRange() const
     {
@@ -205,8 +480,69 @@ struct EmbeddingDatasetRepr {
     Lightweight_Hash<uint64_t, int> rowIndex;
     
     std::unique_ptr<ML::VantagePointTreeT<int> > vpTree;
+
+    /// Approximate index, used instead of the vpTree if set
+    std::unique_ptr<ML::HnswIndex> hnsw;
+
+    EmbeddingDatasetConfig config;
+
     std::unique_ptr<DistanceMetric> distance;
 
+    /// Quantized copies of the rows, used for nearest neighbors lookups
+    /// if set.  It's trained on the first commit.
+    std::shared_ptr<const ML::VectorQuantizer> quantizer;
+    std::vector<uint8_t> codes;    ///< codeSize() bytes per quantized row
+    std::vector<float> codeNorms;  ///< Two norm of each quantized row
+
+    /** Return the (distance, row number) of the closest rows, nearest
+        first, using whichever index is in use.
+    */
+    std::vector<std::pair<float, int> >
+    search(const std::function<float (int)> & dist,
+           int numNeighbors, double maxDistance) const
+    {
+        if (hnsw)
+            return hnsw->search(dist, numNeighbors, maxDistance,
+                                config.hnswEfSearch);
+        return vpTree->search(dist, numNeighbors, maxDistance);
+    }
+
+    /** Return the (distance, row number) of the closest rows to the
+        query, nearest first.  With quantization, the index is searched
+        with approximate distances, and the best candidates re-ranked
+        with exact distances if their full vectors are still held.
+    */
+    std::vector<std::pair<float, int> >
+    neighbors(const distribution<float> & query,
+              int numNeighbors, double maxDistance) const
+    {
+        if (!quantizer) {
+            auto exactDist = [&] (int row) { return dist(row, query); };
+            return search(exactDist, numNeighbors, maxDistance);
+        }
+
+        if (dropsFullVectors()) {
+            return search(quantizedDistance(query), numNeighbors,
+                          maxDistance);
+        }
+
+        int numCandidates = numNeighbors * std::max(1, config.rerankFactor);
+        auto candidates = search(quantizedDistance(query), numCandidates,
+                                 INFINITY);
+
+        std::vector<std::pair<float, int> > result;
+        result.reserve(candidates.size());
+        for (auto & c: candidates) {
+            float d = dist(c.second, query);
+            if (d <= maxDistance)
+                result.emplace_back(d, c.second);
+        }
+        std::sort(result.begin(), result.end());
+        if (result.size() > numNeighbors)
+            result.resize(numNeighbors);
+        return result;
+    }
+
     void save(const std::string & filename)
     {
         filter_ostream stream(filename);
@@ -217,7 +553,16 @@ struct EmbeddingDatasetRepr {
         // Make sure that we saved properly
         stream.close();
     }
+    static EmbeddingDatasetRepr *
+    load(const std::string & filename, const EmbeddingDatasetConfig & config)
+    {
+        filter_istream stream(filename);
+        ML::DB::Store_Reader store(stream);
+        return new EmbeddingDatasetRepr(store, config);
+    }
+
     void serialize(ML::DB::Store_Writer & store) const;
+    void reconstitute(ML::DB::Store_Reader & store);
 };
 
 const RowHash EmbeddingDatasetRepr::nullHashIn(RowPath("null"));
@@ -233,25 +578,129 @@ void
 EmbeddingDatasetRepr::
 serialize(ML::DB::Store_Writer & store) const
 {
+    if (quantizer) {
+        store << string("EMBEDDING_DATASET")
+              << ML::DB::compact_size_t(3);  // version
+        store << columnNames << columns << rows;
+        store << ML::DB::compact_size_t(hnsw ? 1 : 0);  // index type
+        if (hnsw)
+            hnsw->serialize(store);
+        else vpTree->serialize(store);
+        quantizer->serialize(store);
+        store << ML::DB::compact_size_t(quantizer->codeSize())
+              << ML::DB::compact_size_t(codeNorms.size());
+        store.save_binary(codes.data(), codes.size());
+        store << codeNorms;
+        return;
+    }
+
+    if (hnsw) {
+        store << string("EMBEDDING_DATASET")
+              << ML::DB::compact_size_t(2);  // version
+        store << columnNames << columns << rows;
+        hnsw->serialize(store);
+        return;
+    }
+
     store << string("EMBEDDING_DATASET")
           << ML::DB::compact_size_t(1);  // version
     store << columnNames << columns << rows;
     vpTree->serialize(store);
 }
 
+void
+EmbeddingDatasetRepr::
+reconstitute(ML::DB::Store_Reader & store)
+{
+    string canary;
+    store >> canary;
+    if (canary != "EMBEDDING_DATASET")
+        throw HttpReturnException(400, "Not an embedding dataset file");
+    ML::DB::compact_size_t version(store);
+    if (version < 1 || version > 3)
+        throw HttpReturnException(400, "Unknown embedding dataset version",
+                                  "version", (size_t)version);
+
+    store >> columnNames >> columns;
+
+    ML::DB::compact_size_t numRows(store);
+    rows.clear();
+    rows.reserve(numRows);
+    for (size_t i = 0;  i < numRows;  ++i) {
+        Utf8String rowName;
+        distribution<float> coords;
+        Date timestamp;
+        store >> rowName >> coords >> timestamp;
+        rows.emplace_back(RowPath::parse(rowName), std::move(coords),
+                          timestamp);
+    }
+
+    // Version 1 always has a vantage point tree, version 2 always an HNSW
+    // index, and version 3 says which one it has
+    bool hasHnsw = version == 2;
+    if (version == 3) {
+        ML::DB::compact_size_t indexType(store);
+        hasHnsw = indexType == 1;
+    }
+
+    if (hasHnsw) {
+        hnsw.reset(new ML::HnswIndex(config.hnswNeighbors,
+                                     config.hnswEfConstruction));
+        hnsw->reconstitute(store);
+    }
+    else {
+        hnsw.reset();
+        vpTree->reconstitute(store);
+    }
+
+    quantizer.reset();
+    codes.clear();
+    codeNorms.clear();
+
+    if (version == 3) {
+        quantizer = ML::VectorQuantizer::reconstitute(store);
+        ML::DB::compact_size_t codeSize(store), numCodes(store);
+        if (codeSize != quantizer->codeSize()
+            || quantizer->numDimensions() != columnNames.size()
+            || numCodes > rows.size())
+            throw HttpReturnException(400, "Corrupt embedding dataset codes");
+        codes.resize(codeSize * numCodes);
+        store.load_binary(codes.data(), codes.size());
+        store >> codeNorms;
+        if (codeNorms.size() != numCodes)
+            throw HttpReturnException(400, "Corrupt embedding dataset codes");
+    }
+
+    columnIndex.clear();
+    for (unsigned i = 0;  i < columnNames.size();  ++i)
+        columnIndex[columnNames[i]] = i;
+
+    rowIndex.clear();
+    for (unsigned i = 0;  i < rows.size();  ++i) {
+        if (rows[i].coords.empty() && i >= codeNorms.size())
+            throw HttpReturnException(400, "Embedding dataset row has "
+                                      "neither coordinates nor a code",
+                                      "rowName", rows[i].rowName);
+        rowIndex[getRowHashForIndex(rows[i].rowName)] = i;
+        distance->addRow(i, getCoords(i));
+    }
+}
+
 struct EmbeddingDataset::Itl
     : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr),
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
     }
 
-    // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address),
+    Itl(const std::string & address, const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr), address(address),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
+        // Pick up what was saved by a previous commit, if anything
+        if (tryGetUriObjectInfo(address))
+            committed.replace(EmbeddingDatasetRepr::load(address, config));
     }
 
     ~Itl()
@@ -259,7 +708,7 @@ struct EmbeddingDataset::Itl
         delete uncommitted.load();
     }
 
-    MetricSpace metric;
+    EmbeddingDatasetConfig config;
 
     GcLock lock;
     RcuProtected<EmbeddingDatasetRepr> committed;
@@ -384,10 +833,11 @@ struct EmbeddingDataset::Itl
 
         MatrixNamedRow result;
         result.rowHash = result.rowName = rowName;
-        result.columns.reserve(row.coords.size());
+        distribution<float> coords = repr->getCoords(it->second);
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -408,10 +858,11 @@ struct EmbeddingDataset::Itl
         MatrixRow result;
         result.rowHash = rowHash;
         result.rowName = row.rowName;
-        result.columns.reserve(row.coords.size());
+        distribution<float> coords = repr->getCoords(it->second);
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -494,7 +945,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        std::vector<float> storage;
+        const vector<float> & columnVals
+            = repr->getColumnValues(it->second, storage);
 
         toStoreResult.isNumeric_ = true;
         toStoreResult.atMostOne_ = true;
@@ -519,7 +972,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        std::vector<float> storage;
+        const vector<float> & columnVals
+            = repr->getColumnValues(it->second, storage);
 
         MatrixColumn result;
 
@@ -543,7 +998,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        std::vector<float> storage;
+        const vector<float> & columnVals
+            = repr->getColumnValues(it->second, storage);
 
         std::vector<CellValue> result(columnVals.begin(), columnVals.end());
 
@@ -562,7 +1019,9 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        std::vector<float> storage;
+        const vector<float> & columnVals
+            = repr->getColumnValues(it->second, storage);
         auto sortedVals = columnVals;
         std::sort(sortedVals.begin(), sortedVals.end());
         sortedVals.erase(std::unique(sortedVals.begin(), sortedVals.end()),
@@ -666,7 +1125,7 @@ struct EmbeddingDataset::Itl
         if (!uncommitted) {
             if (!repr->initialized()) {
                 // First commit; we just learnt the column names
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -785,7 +1244,7 @@ struct EmbeddingDataset::Itl
                 
                 //DEBUG_MSG(logger) << "columnNames = " << columnNames;
                 
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -870,17 +1329,59 @@ struct EmbeddingDataset::Itl
         if (!uncommitted)
             return;
 
-        for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-            (*uncommitted).columns[j].resize((*uncommitted).rows.size());
+        // Without the full vectors, the columns are decoded on demand
+        bool dropVectors = (*uncommitted).dropsFullVectors();
 
-        // Create the column index; this is a standard matrix inversion
-        auto indexRow = [&] (size_t i)
-            {
-                for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-                    (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
-            };
+        if (!dropVectors) {
+            for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                (*uncommitted).columns[j].resize((*uncommitted).rows.size());
+
+            // Create the column index; this is a standard matrix inversion
+            auto indexRow = [&] (size_t i)
+                {
+                    for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
+                        (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
+                };
+
+            parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        }
 
-        parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        // Encode the new rows; the quantizer is trained on the first commit
+        {
+            Timer timer;
+            (*uncommitted).quantize();
+            if ((*uncommitted).quantizer)
+                INFO_MSG(logger) << "quantization done in " << timer.elapsed();
+        }
+
+        if ((*uncommitted).hnsw) {
+            // Only the rows recorded since the last commit need to be
+            // added to the graph
+            INFO_MSG(logger) << "adding to hnsw index";
+            Timer timer;
+
+            auto dist = [&] (int row1, int row2)
+                {
+                    return (*uncommitted).dist(row1, row2);
+                };
+
+            ML::HnswIndex & hnsw = *(*uncommitted).hnsw;
+            hnsw.insert(hnsw.size(), (*uncommitted).rows.size(), dist);
+
+            INFO_MSG(logger) << "hnsw index done in " << timer.elapsed();
+
+            if (dropVectors)
+                (*uncommitted).dropQuantizedVectors();
+
+            committed.replace(uncommitted);
+            uncommitted = nullptr;
+
+            if (!address.empty()) {
+                INFO_MSG(logger) << "saving embedding";
+                committed()->save(address);
+            }
+            return;
+        }
 
         // Create the vantage point tree
         INFO_MSG(logger) << "creating vantage point tree";
@@ -929,6 +1430,9 @@ struct EmbeddingDataset::Itl
         (*uncommitted).vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
 
         INFO_MSG(logger) << "VP tree done in " << timer.elapsed();
+
+        if (dropVectors)
+            (*uncommitted).dropQuantizedVectors();
         
         committed.replace(uncommitted);
         uncommitted = nullptr;
@@ -948,16 +1452,9 @@ struct EmbeddingDataset::Itl
         if (!repr->initialized())
             return {};
 
-        auto dist = [&] (int item) -> float
-        {
-            float result = repr->dist(item, coord);
-            ExcAssert(isfinite(result));
-            return result;
-        };
-
         //Timer timer;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->neighbors(coord, numNeighbors, maxDistance);
 
         //DEBUG_MSG(logger) << "neighbors took " << timer.elapsed();
 
@@ -989,15 +1486,23 @@ struct EmbeddingDataset::Itl
         }
        
         //const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
-        
-        auto dist = [&] (int item) -> float
-            {
-                float result = repr->dist(item, it->second);
-                ExcAssert(isfinite(result));
-                return result;
-            };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        std::vector<std::pair<float, int> > neighbors;
+        if (repr->quantizer) {
+            // Search with the row as a query against the quantized rows
+            neighbors = repr->neighbors(repr->getCoords(it->second),
+                                        numNeighbors, maxDistance);
+        }
+        else {
+            auto dist = [&] (int item) -> float
+                {
+                    float result = repr->dist(item, it->second);
+                    ExcAssert(isfinite(result));
+                    return result;
+                };
+
+            neighbors = repr->search(dist, numNeighbors, maxDistance);
+        }
 
         vector<tuple<RowPath, RowHash, float> > result;
         for (auto & n: neighbors) {
@@ -1032,7 +1537,7 @@ EmbeddingDataset(MldbServer * owner,
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
 #if 1
-    itl.reset(new Itl(datasetConfig.metric));
+    itl.reset(new Itl(datasetConfig));
 #else // once persistence is done
 
     if (!config.address.empty()) {
@@ -22,13 +22,44 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+enum EmbeddingIndexType {
+    EMBEDDING_INDEX_VPTREE,    ///< Exact vantage point tree
+    EMBEDDING_INDEX_HNSW       ///< Approximate HNSW graph
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+enum EmbeddingQuantization {
+    EMBEDDING_QUANTIZATION_NONE,   ///< Full precision floats only
+    EMBEDDING_QUANTIZATION_INT8,   ///< One byte per dimension
+    EMBEDDING_QUANTIZATION_PQ      ///< Product quantization
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingQuantization);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN),
+          index(EMBEDDING_INDEX_VPTREE),
+          hnswNeighbors(16),
+          hnswEfConstruction(200),
+          hnswEfSearch(64),
+          quantization(EMBEDDING_QUANTIZATION_NONE),
+          pqSubvectors(0),
+          keepFullVectors(true),
+          rerankFactor(4)
     {
     }
 
     MetricSpace metric;
+    EmbeddingIndexType index;
+    int hnswNeighbors;
+    int hnswEfConstruction;
+    int hnswEfSearch;
+    EmbeddingQuantization quantization;
+    int pqSubvectors;
+    bool keepFullVectors;
+    int rerankFactor;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
@@ -0,0 +1,599 @@
+/** gbdt.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Histogram-based gradient boosted decision trees.
+*/
+
+#include "gbdt.h"
+#include "mldb/ml/jml/decision_tree.h"
+#include "mldb/ml/jml/tree.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/timers.h"
+#include "mldb/utils/log.h"
+#include <random>
+#include <numeric>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Sums over the rows that fall into a histogram bucket
+struct HistBin {
+    HistBin()
+        : g(0), h(0), n(0)
+    {
+    }
+
+    double g;    ///< Sum of gradients
+    double h;    ///< Sum of hessians
+    uint64_t n;  ///< Number of rows
+
+    HistBin & operator += (const HistBin & other)
+    {
+        g += other.g;
+        h += other.h;
+        n += other.n;
+        return *this;
+    }
+
+    HistBin & operator -= (const HistBin & other)
+    {
+        g -= other.g;
+        h -= other.h;
+        n -= other.n;
+        return *this;
+    }
+
+    HistBin operator - (const HistBin & other) const
+    {
+        HistBin result = *this;
+        result -= other;
+        return result;
+    }
+};
+
+/// Number of rows per work item for the passes over all rows
+static constexpr size_t ROW_CHUNK_SIZE = 65536;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* GBDT TRAINER                                                              */
+/*****************************************************************************/
+
+struct GbdtTrainer::Itl {
+
+    Itl(std::shared_ptr<const DatasetFeatureSpace> fs,
+        GbdtParams params,
+        std::shared_ptr<spdlog::logger> logger)
+        : fs(std::move(fs)), params(std::move(params)),
+          logger(std::move(logger)), totalBins(0)
+    {
+        if (!this->logger)
+            this->logger = MLDB::getMldbLog<GbdtTrainer>();
+
+        for (auto & c: this->fs->columnInfo) {
+            if (c.second.distinctValues <= 1)
+                continue;
+            if (c.second.buckets.numBuckets <= 0)
+                throw MLDB::Exception("gbdt requires a bucketized feature "
+                                      "space");
+            Feature f;
+            f.info = &c.second;
+            f.buckets = &c.second.buckets;
+            f.numBuckets = c.second.buckets.numBuckets;
+            f.ordinal = c.second.bucketDescriptions.isOnlyNumeric();
+            features.push_back(f);
+        }
+
+        // Iteration order of the column map isn't stable; make the
+        // feature order (and so the trees) reproducible
+        std::sort(features.begin(), features.end(),
+                  [] (const Feature & f1, const Feature & f2)
+                  {
+                      return f1.info->index < f2.info->index;
+                  });
+        for (auto & f: features) {
+            f.offset = totalBins;
+            totalBins += f.numBuckets;
+        }
+    }
+
+    struct Feature {
+        const DatasetFeatureSpace::ColumnInfo * info;
+        const BucketList * buckets;
+        int numBuckets;
+        bool ordinal;   ///< If false, splits are one bucket versus the rest
+        size_t offset;  ///< Offset of the first bucket in the histogram
+    };
+
+    /// A node of the tree being grown
+    struct GrowNode {
+        GrowNode()
+            : feature(-1), bucket(-1), value(0), examples(0), gain(0),
+              childTrue(-1), childFalse(-1)
+        {
+        }
+
+        int feature;      ///< Feature split on, or -1 for a leaf
+        int bucket;       ///< Bucket split on
+        double value;     ///< Prediction if we stopped here
+        double examples;  ///< Number of rows under this node
+        double gain;      ///< Reduction in loss from the split
+        int childTrue;
+        int childFalse;
+    };
+
+    /// A leaf of the tree being grown, that may still be split
+    struct Leaf {
+        Leaf()
+            : depth(0), node(-1), gain(-INFINITY), feature(-1), bucket(-1)
+        {
+        }
+
+        std::vector<uint32_t> rows;   ///< Rows in this leaf
+        std::vector<HistBin> hist;    ///< Per bucket sums for each feature
+        HistBin total;                ///< Sums over all rows
+        int depth;
+        int node;                     ///< Index in the GrowNode list
+
+        // Best split found for this leaf
+        double gain;
+        int feature;
+        int bucket;
+        HistBin left;                 ///< Sums for the rows going left
+    };
+
+    std::shared_ptr<const DatasetFeatureSpace> fs;
+    GbdtParams params;
+    std::shared_ptr<spdlog::logger> logger;
+
+    std::vector<Feature> features;   ///< Features that can be split on
+    size_t totalBins;                ///< Number of buckets over all features
+
+    // Training rows, structure of arrays so the passes over them stream
+    std::vector<float> labels;
+    std::vector<float> weights;
+    std::vector<uint32_t> exampleNums;
+
+    std::vector<double> scores;  ///< Current ensemble output for each row
+    std::vector<float> grad;
+    std::vector<float> hess;
+
+    double leafValue(const HistBin & b) const
+    {
+        if (b.h + params.l2Regularization <= 0)
+            return 0.0;
+        return -b.g / (b.h + params.l2Regularization) * params.learningRate;
+    }
+
+    double splitScore(const HistBin & b) const
+    {
+        return b.g * b.g / (b.h + params.l2Regularization);
+    }
+
+    /** Calculate the gradient and hessian of the loss for each row, and
+        return the current value of the loss.
+    */
+    double calcGradients()
+    {
+        size_t n = labels.size();
+        std::vector<double> chunkLoss((n + ROW_CHUNK_SIZE - 1) / ROW_CHUNK_SIZE);
+
+        auto onChunk = [&] (size_t begin, size_t end)
+            {
+                double loss = 0;
+                for (size_t i = begin;  i < end;  ++i) {
+                    double s = scores[i], y = labels[i], w = weights[i];
+                    if (params.logistic) {
+                        double p = 1.0 / (1.0 + exp(-s));
+                        grad[i] = w * (p - y);
+                        hess[i] = w * std::max(p * (1.0 - p), 1e-16);
+                        // log(1 + exp(-s)) for y = 1, log(1 + exp(s)) for y = 0
+                        double m = y > 0.5 ? -s : s;
+                        loss += w * (m > 0 ? m + log1p(exp(-m)) : log1p(exp(m)));
+                    }
+                    else {
+                        grad[i] = w * (s - y);
+                        hess[i] = w;
+                        loss += 0.5 * w * (s - y) * (s - y);
+                    }
+                }
+                chunkLoss[begin / ROW_CHUNK_SIZE] = loss;
+            };
+
+        parallelMapChunked(0, n, ROW_CHUNK_SIZE, onChunk);
+
+        double totalWeight = 0, totalLoss = 0;
+        for (auto & l: chunkLoss)
+            totalLoss += l;
+        for (auto & w: weights)
+            totalWeight += w;
+        return totalLoss / totalWeight;
+    }
+
+    /** Build the histogram of the leaf over the given features.  Each
+        feature's buckets occupy their own range of the histogram, so the
+        features can be done in parallel without synchronization.
+    */
+    void buildHistogram(Leaf & leaf, const std::vector<int> & activeFeatures)
+    {
+        leaf.hist.assign(totalBins, HistBin());
+
+        auto doFeature = [&] (size_t i)
+            {
+                const Feature & f = features[activeFeatures[i]];
+                HistBin * h = leaf.hist.data() + f.offset;
+                const BucketList & buckets = *f.buckets;
+                for (uint32_t r: leaf.rows) {
+                    HistBin & b = h[buckets[exampleNums[r]]];
+                    b.g += grad[r];
+                    b.h += hess[r];
+                    b.n += 1;
+                }
+            };
+
+        parallelMap(0, activeFeatures.size(), doFeature);
+    }
+
+    /** Find the best split of the leaf from its histogram. */
+    void findSplit(Leaf & leaf, const std::vector<int> & activeFeatures)
+    {
+        leaf.gain = -INFINITY;
+        leaf.feature = -1;
+
+        size_t minExamples = std::max(params.minExamplesPerLeaf, 1);
+        if (leaf.rows.size() < 2 * minExamples)
+            return;
+        if (params.maxDepth >= 0 && leaf.depth >= params.maxDepth)
+            return;
+
+        struct Best {
+            Best() : gain(-INFINITY), bucket(-1) {}
+            double gain;
+            int bucket;
+            HistBin left;
+        };
+
+        std::vector<Best> best(activeFeatures.size());
+        double parentScore = splitScore(leaf.total);
+
+        auto doFeature = [&] (size_t i)
+            {
+                const Feature & f = features[activeFeatures[i]];
+                const HistBin * h = leaf.hist.data() + f.offset;
+                Best & result = best[i];
+
+                auto tryLeft = [&] (const HistBin & left, int bucket)
+                {
+                    HistBin right = leaf.total - left;
+                    if (left.n < minExamples || right.n < minExamples)
+                        return;
+                    double gain = splitScore(left) + splitScore(right)
+                        - parentScore;
+                    if (gain > result.gain) {
+                        result.gain = gain;
+                        result.bucket = bucket;
+                        result.left = left;
+                    }
+                };
+
+                if (f.ordinal) {
+                    // Rows in bucket <= j go left
+                    HistBin left;
+                    for (int j = 0;  j < f.numBuckets - 1;  ++j) {
+                        if (h[j].n == 0)
+                            continue;
+                        left += h[j];
+                        tryLeft(left, j);
+                    }
+                }
+                else {
+                    // Rows in bucket j go left
+                    for (int j = 0;  j < f.numBuckets;  ++j) {
+                        if (h[j].n != 0)
+                            tryLeft(h[j], j);
+                    }
+                }
+            };
+
+        parallelMap(0, activeFeatures.size(), doFeature);
+
+        for (size_t i = 0;  i < best.size();  ++i) {
+            if (best[i].bucket != -1 && best[i].gain > leaf.gain) {
+                leaf.gain = best[i].gain;
+                leaf.feature = activeFeatures[i];
+                leaf.bucket = best[i].bucket;
+                leaf.left = best[i].left;
+            }
+        }
+
+        if (leaf.gain <= params.minSplitGain)
+            leaf.feature = -1;
+    }
+
+    /** Split the leaf according to its best split, returning the rows
+        going to each side (true side first).
+    */
+    std::pair<Leaf, Leaf> splitLeaf(Leaf & leaf)
+    {
+        const Feature & f = features[leaf.feature];
+        const BucketList & buckets = *f.buckets;
+
+        std::pair<Leaf, Leaf> result;
+        Leaf & left = result.first;
+        Leaf & right = result.second;
+
+        left.rows.reserve(leaf.left.n);
+        right.rows.reserve(leaf.total.n - leaf.left.n);
+
+        for (uint32_t r: leaf.rows) {
+            uint32_t bucket = buckets[exampleNums[r]];
+            bool isLeft = f.ordinal
+                ? bucket <= (uint32_t)leaf.bucket
+                : bucket == (uint32_t)leaf.bucket;
+            (isLeft ? left : right).rows.push_back(r);
+        }
+
+        ExcAssertEqual(left.rows.size(), leaf.left.n);
+
+        left.total = leaf.left;
+        right.total = leaf.total - leaf.left;
+        left.depth = right.depth = leaf.depth + 1;
+
+        leaf.rows.clear();
+        leaf.rows.shrink_to_fit();
+
+        return result;
+    }
+
+    /** Grow one tree over the current gradients.  Returns the nodes of the
+        tree, with the root first, and adds its output to the scores.
+    */
+    std::vector<GrowNode> growTree(const std::vector<int> & activeFeatures)
+    {
+        std::vector<GrowNode> nodes;
+        std::vector<std::unique_ptr<Leaf> > leaves;
+
+        auto addNode = [&] (Leaf & leaf)
+            {
+                leaf.node = nodes.size();
+                nodes.emplace_back();
+                nodes.back().value = leafValue(leaf.total);
+                nodes.back().examples = leaf.total.n;
+            };
+
+        std::unique_ptr<Leaf> root(new Leaf());
+        root->rows.resize(labels.size());
+        std::iota(root->rows.begin(), root->rows.end(), 0);
+        for (size_t i = 0;  i < labels.size();  ++i) {
+            root->total.g += grad[i];
+            root->total.h += hess[i];
+        }
+        root->total.n = labels.size();
+        addNode(*root);
+        buildHistogram(*root, activeFeatures);
+        findSplit(*root, activeFeatures);
+        leaves.emplace_back(std::move(root));
+
+        int maxLeaves = std::max(params.maxLeaves, 2);
+
+        while (leaves.size() < maxLeaves) {
+            // Leaf-wise growth: split the leaf that reduces the loss most
+            int bestLeaf = -1;
+            for (size_t i = 0;  i < leaves.size();  ++i) {
+                if (leaves[i]->feature != -1
+                    && (bestLeaf == -1
+                        || leaves[i]->gain > leaves[bestLeaf]->gain))
+                    bestLeaf = i;
+            }
+            if (bestLeaf == -1)
+                break;
+
+            Leaf & parent = *leaves[bestLeaf];
+            std::unique_ptr<Leaf> children[2];
+            {
+                auto split = splitLeaf(parent);
+                children[0].reset(new Leaf(std::move(split.first)));
+                children[1].reset(new Leaf(std::move(split.second)));
+            }
+
+            GrowNode & node = nodes[parent.node];
+            node.feature = parent.feature;
+            node.bucket = parent.bucket;
+            node.gain = parent.gain;
+            addNode(*children[0]);
+            addNode(*children[1]);
+            nodes[parent.node].childTrue = children[0]->node;
+            nodes[parent.node].childFalse = children[1]->node;
+
+            // Only build the histogram of the smaller child; the other is
+            // what's left over from the parent.
+            int small = children[0]->rows.size() <= children[1]->rows.size()
+                ? 0 : 1;
+            Leaf & smaller = *children[small];
+            Leaf & larger = *children[1 - small];
+
+            buildHistogram(smaller, activeFeatures);
+            larger.hist = std::move(parent.hist);
+            for (size_t i = 0;  i < totalBins;  ++i)
+                larger.hist[i] -= smaller.hist[i];
+
+            findSplit(*children[0], activeFeatures);
+            findSplit(*children[1], activeFeatures);
+
+            leaves[bestLeaf] = std::move(children[0]);
+            leaves.emplace_back(std::move(children[1]));
+        }
+
+        // Add the tree's output to the scores of the rows in each leaf
+        auto updateLeaf = [&] (size_t i)
+            {
+                const Leaf & leaf = *leaves[i];
+                double value = nodes[leaf.node].value;
+                for (uint32_t r: leaf.rows)
+                    scores[r] += value;
+            };
+
+        parallelMap(0, leaves.size(), updateLeaf);
+
+        return nodes;
+    }
+
+    ML::Tree::Ptr makeTreeNode(const std::vector<GrowNode> & nodes,
+                               int n, ML::Tree & tree)
+    {
+        const GrowNode & node = nodes.at(n);
+
+        auto pred = [&] (double value) -> distribution<float>
+            {
+                if (params.logistic)
+                    return { float(-value), float(value) };
+                else return { float(value) };
+            };
+
+        if (node.feature == -1)
+            return tree.new_leaf(pred(node.value), node.examples);
+
+        const Feature & f = features.at(node.feature);
+
+        // Same conventions as the random forest, so that the classifier
+        // sees the same encoding of the bucket values.
+        float splitVal = 0;
+        if (f.ordinal) {
+            auto splitCell = f.info->bucketDescriptions.getSplit(node.bucket);
+            if (splitCell.isNumeric())
+                splitVal = splitCell.toDouble();
+            else splitVal = node.bucket;
+        }
+        else {
+            splitVal = node.bucket;
+        }
+
+        ML::Tree::Node * result = tree.new_node();
+        result->split = ML::Split(fs->getFeature(f.info->columnName),
+                                  splitVal,
+                                  f.ordinal
+                                  ? ML::Split::LESS : ML::Split::EQUAL);
+        result->z = node.gain;
+        result->pred = pred(node.value);
+        result->examples = node.examples;
+        result->child_true = makeTreeNode(nodes, node.childTrue, tree);
+        result->child_false = makeTreeNode(nodes, node.childFalse, tree);
+        // Missing values stop here
+        result->child_missing = tree.new_leaf(pred(node.value), 0);
+        return result;
+    }
+
+    std::shared_ptr<ML::Committee> train(const OnTree & onTree)
+    {
+        size_t n = labels.size();
+        if (n == 0)
+            throw MLDB::Exception("gbdt: no training rows");
+
+        // Initial score is the best constant
+        double initScore = 0;
+        {
+            double sumW = 0, sumWY = 0;
+            for (size_t i = 0;  i < n;  ++i) {
+                sumW += weights[i];
+                sumWY += weights[i] * labels[i];
+            }
+            if (params.logistic) {
+                double pos = std::max(sumWY, 1e-6);
+                double neg = std::max(sumW - sumWY, 1e-6);
+                initScore = log(pos / neg);
+            }
+            else initScore = sumWY / sumW;
+        }
+
+        scores.assign(n, initScore);
+        grad.resize(n);
+        hess.resize(n);
+
+        auto result = std::make_shared<ML::Committee>(fs, labelFeature);
+        result->encoding = ML::OE_PM_INF;
+
+        std::vector<int> allFeatures(features.size());
+        std::iota(allFeatures.begin(), allFeatures.end(), 0);
+
+        for (int t = 0;  t < params.numTrees;  ++t) {
+            Timer timer;
+
+            double loss = calcGradients();
+
+            std::vector<int> activeFeatures = allFeatures;
+            if (params.featureSamplingProp < 1.0) {
+                std::mt19937 rng(1234 + t);
+                std::shuffle(activeFeatures.begin(), activeFeatures.end(), rng);
+                size_t numActive
+                    = std::max<size_t>(1, activeFeatures.size()
+                                       * params.featureSamplingProp);
+                activeFeatures.resize(std::min(numActive,
+                                               activeFeatures.size()));
+                std::sort(activeFeatures.begin(), activeFeatures.end());
+            }
+
+            auto nodes = growTree(activeFeatures);
+
+            auto dt = std::make_shared<ML::Decision_Tree>(fs, labelFeature);
+            dt->encoding = ML::OE_PM_INF;
+            dt->tree.root = makeTreeNode(nodes, 0, dt->tree);
+            result->add(dt, 1.0);
+
+            DEBUG_MSG(logger)
+                << "tree " << t << " had " << (nodes.size() + 1) / 2
+                << " leaves; loss before was " << loss << " in "
+                << timer.elapsed();
+
+            if (onTree && !onTree(t + 1, loss))
+                break;
+        }
+
+        if (result->classifiers.empty())
+            throw MLDB::Exception("gbdt: no trees were trained");
+
+        if (params.logistic) {
+            result->bias[0] = -initScore;
+            result->bias[1] = initScore;
+        }
+        else result->bias[0] = initScore;
+
+        return result;
+    }
+};
+
+GbdtTrainer::
+GbdtTrainer(std::shared_ptr<const DatasetFeatureSpace> fs,
+            GbdtParams params,
+            std::shared_ptr<spdlog::logger> logger)
+    : itl(new Itl(std::move(fs), std::move(params), std::move(logger)))
+{
+}
+
+void
+GbdtTrainer::
+addRow(float label, float weight, uint32_t exampleNum)
+{
+    itl->labels.push_back(label);
+    itl->weights.push_back(weight);
+    itl->exampleNums.push_back(exampleNum);
+}
+
+std::shared_ptr<ML::Committee>
+GbdtTrainer::
+train(const OnTree & onTree)
+{
+    return itl->train(onTree);
+}
+
+} // namespace MLDB
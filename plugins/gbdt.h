@@ -0,0 +1,92 @@
+/** gbdt.h                                                          -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Histogram-based gradient boosted decision trees, trained over the
+    bucketized features of a DatasetFeatureSpace.
+*/
+
+#pragma once
+
+#include "mldb/plugins/dataset_feature_space.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/utils/log_fwd.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GBDT PARAMS                                                               */
+/*****************************************************************************/
+
+/** Parameters that control the boosting. */
+struct GbdtParams {
+    GbdtParams()
+        : numTrees(100), learningRate(0.1), maxLeaves(31), maxDepth(-1),
+          minExamplesPerLeaf(20), l2Regularization(1.0),
+          minSplitGain(0.0), featureSamplingProp(1.0),
+          logistic(true)
+    {
+    }
+
+    int numTrees;              ///< Number of boosting rounds
+    double learningRate;       ///< Shrinkage applied to each tree
+    int maxLeaves;             ///< Maximum number of leaves per tree
+    int maxDepth;              ///< Maximum depth of a tree; -1 is unlimited
+    int minExamplesPerLeaf;    ///< Minimum number of rows in each leaf
+    double l2Regularization;   ///< L2 penalty on the leaf values
+    double minSplitGain;       ///< Minimum loss reduction to split a leaf
+    double featureSamplingProp;  ///< Proportion of features per tree
+    bool logistic;             ///< Logistic loss if true, otherwise squared
+};
+
+
+/*****************************************************************************/
+/* GBDT TRAINER                                                              */
+/*****************************************************************************/
+
+/** Trains an ensemble of gradient boosted regression trees.
+
+    Rows refer to the bucketized values of each feature in the feature
+    space, which must have been created with bucketize set.  For each
+    leaf, a histogram of the gradient and hessian sums per bucket is built
+    for every feature, in parallel over features; the histogram of the
+    larger child of a split is obtained by subtracting the smaller child's
+    from its parent's.  Trees are grown leaf-wise, always splitting the
+    leaf with the largest reduction in loss.
+
+    The result is a Committee of Decision_Trees whose summed output is the
+    raw score (the log-odds for logistic loss), so it can be saved as a
+    classifier and applied with the classifier function.
+*/
+struct GbdtTrainer {
+
+    GbdtTrainer(std::shared_ptr<const DatasetFeatureSpace> fs,
+                GbdtParams params,
+                std::shared_ptr<spdlog::logger> logger = nullptr);
+
+    /** Add a training row.  exampleNum is the index of the row in the
+        feature space's bucket lists; the label is 0 or 1 for logistic
+        loss.
+    */
+    void addRow(float label, float weight, uint32_t exampleNum);
+
+    /** Called after each tree is trained with the number of trees done
+        and the current training loss.  Returning false stops training.
+    */
+    typedef std::function<bool (int numTrees, double loss)> OnTree;
+
+    /** Train the ensemble over the rows that have been added. */
+    std::shared_ptr<ML::Committee> train(const OnTree & onTree = nullptr);
+
+private:
+    struct Itl;
+    std::shared_ptr<Itl> itl;
+};
+
+} // namespace MLDB
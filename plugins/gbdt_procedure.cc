@@ -0,0 +1,286 @@
+/** gbdt_procedure.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Procedure to train gradient boosted decision trees.
+*/
+
+#include "gbdt_procedure.h"
+#include "mldb/arch/timers.h"
+#include "mldb/plugins/gbdt.h"
+#include "mldb/ml/jml/classifier.h"
+#include "mldb/plugins/sql_expression_extractors.h"
+#include "mldb/plugins/sql_config_validator.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/column_scope.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/utils/progress.h"
+#include "mldb/utils/log.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+DEFINE_STRUCTURE_DESCRIPTION(GbdtProcedureConfig);
+
+GbdtProcedureConfigDescription::
+GbdtProcedureConfigDescription()
+{
+    addField("trainingData", &GbdtProcedureConfig::trainingData,
+             "Specification of the data for input to the procedure. "
+             "The select expression must contain these sub-expressions: one row expression "
+             "to identify the features on which to train and one scalar expression "
+             "to identify the label, and optionally a scalar `weight` expression. "
+             "Labels with a null value will have their row skipped. "
+             "As for the ![](%%doclink randomforest.binary.train procedure), "
+             "only whole columns can be selected as features.");
+    addField("modelFileUrl", &GbdtProcedureConfig::modelFileUrl,
+             "URL where the model file (with extension '.cls') should be saved. "
+             "This file can be loaded by the ![](%%doclink classifier function). ");
+    addField("mode", &GbdtProcedureConfig::mode,
+             "Model mode: `boolean` to predict a label of 0 or 1 with logistic "
+             "loss, or `regression` to predict a real value with squared "
+             "loss.", CM_BOOLEAN);
+    addField("numTrees", &GbdtProcedureConfig::numTrees,
+             "Number of boosting rounds, which is the number of trees in "
+             "the model.", 100);
+    addField("learningRate", &GbdtProcedureConfig::learningRate,
+             "Shrinkage factor applied to the output of each tree.", 0.1);
+    addField("maxLeaves", &GbdtProcedureConfig::maxLeaves,
+             "Maximum number of leaves in each tree.  Trees are grown "
+             "leaf-wise, by splitting the leaf that most reduces the loss.",
+             31);
+    addField("maxDepth", &GbdtProcedureConfig::maxDepth,
+             "Maximum depth of the trees, or -1 for no limit other than "
+             "`maxLeaves`.", -1);
+    addField("minExamplesPerLeaf", &GbdtProcedureConfig::minExamplesPerLeaf,
+             "Minimum number of training rows in each leaf.", 20);
+    addField("l2Regularization", &GbdtProcedureConfig::l2Regularization,
+             "L2 regularization of the leaf values.", 1.0);
+    addField("minSplitGain", &GbdtProcedureConfig::minSplitGain,
+             "Minimum reduction in loss required to split a leaf.", 0.0);
+    addField("featureSamplingProp", &GbdtProcedureConfig::featureSamplingProp,
+             "Proportion of the features considered by each tree.", 1.0);
+    addField("functionName", &GbdtProcedureConfig::functionName,
+             "If specified, an instance of the ![](%%doclink classifier function) of this name will be created using "
+             "the trained model. Note that to use this parameter, the `modelFileUrl` must "
+             "also be provided.");
+    addField("verbosity", &GbdtProcedureConfig::verbosity,
+             "Should the procedure be verbose for debugging and tuning purposes", false);
+    addParent<ProcedureConfig>();
+
+    onPostValidate = chain(validateQuery(&GbdtProcedureConfig::trainingData,
+                                         NoGroupByHaving(),
+                                         PlainColumnSelect(),
+                                         MustContainFrom(),
+                                         FeaturesLabelSelect()),
+                           chain<GbdtProcedureConfig>
+                           (validateFunction<GbdtProcedureConfig>(),
+                            [] (GbdtProcedureConfig * cfg,
+                                JsonParsingContext & context)
+                            {
+                                if (cfg->mode == CM_CATEGORICAL)
+                                    throw MLDB::Exception
+                                        ("gbdt.train supports only the "
+                                         "'boolean' and 'regression' modes");
+                                if (cfg->numTrees < 1)
+                                    throw MLDB::Exception
+                                        ("gbdt.train requires numTrees >= 1");
+                            }));
+}
+
+
+/*****************************************************************************/
+/* GBDT PROCEDURE                                                            */
+/*****************************************************************************/
+
+GbdtProcedure::
+GbdtProcedure(MldbServer * owner,
+              PolyConfig config,
+              const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    this->procedureConfig = config.params.convert<GbdtProcedureConfig>();
+}
+
+Any
+GbdtProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+RunOutput
+GbdtProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    GbdtProcedureConfig runProcConf =
+        applyRunConfOverProcConf(procedureConfig, run);
+
+    Timer timer;
+
+    // this includes being empty
+    if(!runProcConf.modelFileUrl.valid()) {
+         throw MLDB::Exception("modelFileUrl is not valid");
+    }
+
+    checkWritability(runProcConf.modelFileUrl.toDecodedString(),
+                     "modelFileUrl");
+
+    bool isRegression = runProcConf.mode == CM_REGRESSION;
+
+    // 1.  Get the input dataset
+    SqlExpressionMldbScope context(server);
+
+    ConvertProgressToJson convertProgressToJson(onProgress);
+    auto boundDataset = runProcConf.trainingData.stm->from->bind(context, convertProgressToJson);
+
+    ML::Mutable_Feature_Info labelInfo
+        = ML::Mutable_Feature_Info(isRegression ? ML::REAL : ML::BOOLEAN);
+    labelInfo.set_biased(true);
+
+    auto labelVal = extractNamedSubSelect("label", runProcConf.trainingData.stm->select);
+    auto featuresVal = extractNamedSubSelect("features", runProcConf.trainingData.stm->select);
+    if (!labelVal || !featuresVal) {
+        throw HttpReturnException(400, "trainingData must return a 'features' row and a 'label'");
+    }
+
+    auto weightVal = extractNamedSubSelect("weight", runProcConf.trainingData.stm->select);
+    auto weight = weightVal ? weightVal->expression : SqlExpression::ONE;
+
+    auto withinExpression = std::dynamic_pointer_cast<const SelectWithinExpression>
+        (featuresVal->expression);
+    if (!withinExpression) {
+        throw HttpReturnException(400, "trainingData must return a 'features' row");
+    }
+
+    ColumnScope colScope(server, boundDataset.dataset);
+    auto boundLabel = labelVal->expression->bind(colScope);
+    auto boundWhere = runProcConf.trainingData.stm->where->bind(colScope);
+    auto boundWeight = weight->bind(colScope);
+
+    std::vector<std::vector<CellValue> > labelsWhereWeight
+        = colScope.run({boundLabel, boundWhere, boundWeight});
+
+    const std::vector<CellValue> & labels = labelsWhereWeight[0];
+    const std::vector<CellValue> & wheres = labelsWhereWeight[1];
+    const std::vector<CellValue> & weights = labelsWhereWeight[2];
+
+    INFO_MSG(logger) << "got " << labels.size() << " labels in " << timer.elapsed();
+
+    // Find only those columns used by the features
+    std::set<ColumnPath> knownInputColumns;
+    {
+        SelectExpression select({withinExpression->select});
+        SqlExpressionDatasetScope scope(boundDataset);
+        auto selectBound = select.bind(scope);
+        for (auto & c : selectBound.info->getKnownColumns())
+            knownInputColumns.insert(c.columnName);
+    }
+
+    auto featureSpace = std::make_shared<DatasetFeatureSpace>
+        (boundDataset.dataset, labelInfo, knownInputColumns, true /* bucketize */);
+
+    INFO_MSG(logger) << "feature space construction took " << timer.elapsed();
+    timer.restart();
+
+    GbdtParams params;
+    params.numTrees = runProcConf.numTrees;
+    params.learningRate = runProcConf.learningRate;
+    params.maxLeaves = runProcConf.maxLeaves;
+    params.maxDepth = runProcConf.maxDepth;
+    params.minExamplesPerLeaf = runProcConf.minExamplesPerLeaf;
+    params.l2Regularization = runProcConf.l2Regularization;
+    params.minSplitGain = runProcConf.minSplitGain;
+    params.featureSamplingProp = runProcConf.featureSamplingProp;
+    params.logistic = !isRegression;
+
+    GbdtTrainer trainer(featureSpace, params, logger);
+
+    // Rows are referred to by their index in the dataset, which is how the
+    // feature space's buckets are indexed.
+    size_t numRows = 0;
+    for (size_t i = 0;  i < labels.size();  ++i) {
+        if (!wheres[i].isTrue() || labels[i].empty()
+            || weights[i].empty() || weights[i].toDouble() <= 0)
+            continue;
+        float label = isRegression ? labels[i].toDouble() : labels[i].isTrue();
+        trainer.addRow(label, weights[i].toDouble(), i);
+        ++numRows;
+    }
+
+    if (numRows == 0)
+        throw HttpReturnException(400, "gbdt.train: no rows to train on");
+
+    Progress progress;
+    std::shared_ptr<Step> trainingStep = progress.steps({
+        make_pair("training", "percentile")
+    });
+
+    double lastLoss = 0;
+    int numTrees = 0;
+    auto onTree = [&] (int treesDone, double loss)
+        {
+            lastLoss = loss;
+            numTrees = treesDone;
+            if (runProcConf.verbosity)
+                INFO_MSG(logger) << "tree " << treesDone << " loss " << loss
+                                 << " after " << timer.elapsed();
+            trainingStep->value = (float)treesDone / runProcConf.numTrees;
+            return onProgress(jsonEncode(trainingStep));
+        };
+
+    auto committee = trainer.train(onTree);
+
+    INFO_MSG(logger) << "trained " << numTrees << " trees on " << numRows
+                     << " rows in " << timer.elapsed();
+
+    ML::Classifier classifier(committee);
+
+    //Save the model, create the function
+
+    bool saved = true;
+    try {
+        makeUriDirectory(
+            runProcConf.modelFileUrl.toDecodedString());
+        classifier.save(runProcConf.modelFileUrl.toString());
+    }
+    catch (const std::exception & exc) {
+        saved = false;
+        INFO_MSG(logger) << "Error saving classifier: " << exc.what();
+    }
+
+    if(saved && !runProcConf.functionName.empty()) {
+        PolyConfig clsFuncPC;
+        clsFuncPC.type = "classifier";
+        clsFuncPC.id = runProcConf.functionName;
+        clsFuncPC.params = ClassifyFunctionConfig(runProcConf.modelFileUrl);
+
+        obtainFunction(server, clsFuncPC, onProgress);
+    }
+
+    Json::Value status;
+    status["numRows"] = numRows;
+    status["numTrees"] = numTrees;
+    status["trainingLoss"] = lastLoss;
+
+    return Any(status);
+}
+
+namespace {
+
+RegisterProcedureType<GbdtProcedure, GbdtProcedureConfig>
+regGbdt(builtinPackage(),
+        "Train gradient boosted decision trees",
+        "procedures/Gbdt.md.html");
+
+} // file scope
+
+} // namespace MLDB
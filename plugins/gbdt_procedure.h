@@ -0,0 +1,100 @@
+/** gbdt_procedure.h                                                -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Procedure to train gradient boosted decision trees.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/core/procedure.h"
+#include "mldb/core/function.h"
+#include "mldb/plugins/classifier.h"
+#include "mldb/types/value_description_fwd.h"
+
+
+namespace MLDB {
+
+
+struct GbdtProcedureConfig : public ProcedureConfig {
+    static constexpr const char * name = "gbdt.train";
+
+    GbdtProcedureConfig()
+        : mode(CM_BOOLEAN),
+          numTrees(100),
+          learningRate(0.1),
+          maxLeaves(31),
+          maxDepth(-1),
+          minExamplesPerLeaf(20),
+          l2Regularization(1.0),
+          minSplitGain(0.0),
+          featureSamplingProp(1.0),
+          verbosity(false)
+    {
+    }
+
+    /// Query to select the training data
+    InputQuery trainingData;
+
+    /// Where to save the classifier to
+    Url modelFileUrl;
+
+    /// Boolean (logistic loss) or regression (squared loss)
+    ClassifierMode mode;
+
+    /// Number of boosting rounds, ie trees in the model
+    int numTrees;
+
+    /// Shrinkage applied to the output of each tree
+    double learningRate;
+
+    /// Maximum number of leaves in each tree
+    int maxLeaves;
+
+    /// Maximum depth of each tree, or -1 for no limit
+    int maxDepth;
+
+    /// Minimum number of rows in a leaf
+    int minExamplesPerLeaf;
+
+    /// L2 regularization of the leaf values
+    double l2Regularization;
+
+    /// Minimum loss reduction required to split a leaf
+    double minSplitGain;
+
+    /// Proportion of features considered by each tree
+    double featureSamplingProp;
+
+    /// Debug verbosity
+    bool verbosity;
+
+    /// Function name
+    Utf8String functionName;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(GbdtProcedureConfig);
+
+
+/*****************************************************************************/
+/* GBDT PROCEDURE                                                            */
+/*****************************************************************************/
+
+struct GbdtProcedure: public Procedure {
+
+    GbdtProcedure(MldbServer * owner,
+                  PolyConfig config,
+                  const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(const ProcedureRunConfig & run,
+                          const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    GbdtProcedureConfig procedureConfig;
+};
+
+
+} // namespace MLDB
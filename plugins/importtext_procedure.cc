@@ -17,12 +17,15 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/types/optional_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/utils/progress.h"
 #include "mldb/jml/utils/vector_utils.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/metrics.h"
+#include <fnmatch.h>
 
 
 using namespace std;
@@ -35,7 +38,14 @@ DEFINE_STRUCTURE_DESCRIPTION(ImportTextConfig);
 ImportTextConfigDescription::ImportTextConfigDescription()
 {
     addField("dataFileUrl", &ImportTextConfig::dataFileUrl,
-             "URL of the text data to import");
+             "URL of the text data to import.  This may contain `*` "
+             "wildcards to import all of the matching files, or end with "
+             "`/` to import all of the files under a prefix.");
+    addField("dataFileUrls", &ImportTextConfig::dataFileUrls,
+             "List of URLs of text data to import into the same dataset, "
+             "in addition to `dataFileUrl`.  Each may contain wildcards "
+             "like `dataFileUrl`.  All of the files must have the same "
+             "header.");
     addField("outputDataset", &ImportTextConfig::outputDataset,
              "Dataset to record the data into.",
              PolyConfigT<Dataset>().withType("tabular"));
@@ -78,8 +88,9 @@ ImportTextConfigDescription::ImportTextConfigDescription()
              SqlExpression::TRUE);
     addField("named", &ImportTextConfig::named,
              "Row name expression for output dataset. Note that each row "
-             "must have a unique name.",
-             SqlExpression::parse("lineNumber()"));
+             "must have a unique name.  The default is `lineNumber()` when "
+             "importing a single file, and `dataFileUrl() + ':' + "
+             "CAST (lineNumber() AS STRING)` when importing several.");
     addField("timestamp", &ImportTextConfig::timestamp,
              "Expression for row timestamp.",
              SqlExpression::parse("fileTimestamp()"));
@@ -385,6 +396,15 @@ const char * findInvalidAscii(const char * start, size_t length, char*buf, char
 namespace {
     const string unclosedQuoteError = "Unclosed quoted CSV value";
     const string notEnoughColsError = "not enough columns in row";
+
+    const Counter importedLines
+        = MetricsRegistry::instance()
+        .counter("mldb_import_text_lines_total",
+                 "Lines read by the import.text procedure");
+    const Counter importedBytes
+        = MetricsRegistry::instance()
+        .counter("mldb_import_text_bytes_total",
+                 "Bytes read by the import.text procedure");
 }
 
 // Inline version of isascii
@@ -657,16 +677,95 @@ parseFixedWidthCsvRow(const char * & line,
     return errorMsg;
 }
 
+/*****************************************************************************/
+/* DATA FILE EXPANSION                                                       */
+/*****************************************************************************/
+
+/// Files smaller than this are read by a single thread, as they fit within
+/// one block of forEachLineBlock and so can't be split anyway.  Many of
+/// them are imported at the same time instead.
+static constexpr int64_t SMALL_FILE_SIZE = 20000000;
+
+/** A file to import, with its size (or -1 if unknown). */
+struct DataFile {
+    Url url;
+    int64_t size;
+};
+
+/** Turn one of the data file URLs into the list of files that it refers
+    to.  A URL containing a '*' is a glob pattern, matched against the
+    objects under the directory containing the first '*'; a URL ending in
+    '/' refers to every object under that prefix.  Anything else is a
+    single file, returned as is.
+*/
+static void
+expandDataFileUrl(const Url & url, std::vector<DataFile> & files)
+{
+    string str = url.toDecodedString();
+
+    size_t wildcard = str.find('*');
+    bool isPrefix = !str.empty() && str.back() == '/';
+
+    if (wildcard == string::npos && !isPrefix) {
+        files.push_back({ url, -1 });
+        return;
+    }
+
+    // Split into the part we can list, and the pattern to match under it
+    size_t dirEnd = isPrefix ? str.size() : str.rfind('/', wildcard) + 1;
+    string prefix(str, 0, dirEnd);
+    string pattern(str, dirEnd);
+    bool recursive = isPrefix || pattern.find('/') != string::npos;
+
+    std::vector<DataFile> found;
+
+    auto onObject = [&] (const std::string & uri,
+                         const FsObjectInfo & info,
+                         const OpenUriObject & open,
+                         int depth)
+        {
+            if (uri.compare(0, prefix.size(), prefix) != 0)
+                return true;
+            if (!isPrefix
+                && fnmatch(pattern.c_str(), uri.c_str() + prefix.size(),
+                           FNM_PATHNAME) != 0)
+                return true;
+            found.push_back({ Url(uri), info.size });
+            return true;
+        };
+
+    auto onSubdir = [&] (const std::string & dirName, int depth)
+        {
+            return recursive;
+        };
+
+    forEachUriObject(prefix, onObject, onSubdir);
+
+    if (found.empty())
+        throw HttpReturnException(400, "No files match the data file URL '"
+                                  + str + "'",
+                                  "dataFileUrl", url);
+
+    // Listing order depends upon the filesystem; make it reproducible
+    std::sort(found.begin(), found.end(),
+              [] (const DataFile & f1, const DataFile & f2)
+              {
+                  return f1.url.toString() < f2.url.toString();
+              });
+
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+
 /*****************************************************************************/
 /* IMPORT TEXT PROCEDURE WORK INSTANCE                                       */
-/* Manages all the temporary data and work to load a text file               */
+/* Manages all the temporary data and work to load text files                */
 /*****************************************************************************/
 
 struct ImportTextProcedureWorkInstance
 {
     ImportTextProcedureWorkInstance(std::shared_ptr<spdlog::logger> logger)
         : logger(logger),
-          lineOffset(1), // we start at line 1
           isTextLine(false),
           areOutputColumnNamesKnown(true),
           separator(0),
@@ -675,18 +774,46 @@ struct ImportTextProcedureWorkInstance
           hasQuoteChar(false),
           isIdentitySelect(false),
           rowCount(0),
-          numLineErrors(0)
+          numLineErrors(0),
+          totalBytes(0),
+          nextChunkNumber(0),
+          numSkipped(0),
+          totalLinesProcessed(0),
+          lineCount(0),
+          byteCount(0)
     {
         
     }
 
+    /** Everything that depends upon which of the files is being read. */
+    struct FileState {
+        FileState(Url url)
+            : url(std::move(url)),
+              name(this->url.toDecodedUtf8String()),
+              lineOffset(1) // we start at line 1
+        {
+        }
+
+        Url url;
+        Utf8String name;  ///< Decoded URL, as returned by dataFileUrl()
+        Date ts;
+        int64_t lineOffset;
+
+        // Our expressions are bound against a scope that knows about the
+        // file timestamp and URL, so each file needs its own.
+        std::unique_ptr<SqlCsvScope> scope;
+        BoundSqlExpression whereBound;
+        BoundSqlExpression selectBound;
+        BoundSqlExpression namedBound;
+        BoundSqlExpression timestampBound;
+    };
+
     std::shared_ptr<spdlog::logger> logger;
     vector<ColumnPath> knownColumnNames;
     Lightweight_Hash<ColumnHash, int> columnIndex; //To check for duplicates column names
-    int64_t lineOffset;
     // Column names in the CSV file.  This is distinct from the
     // output column names that will be created once parsing has
-    // happened.
+    // happened.  All files must have the same ones.
     vector<ColumnPath> inputColumnNames;
     bool isTextLine;
     std::atomic<int> areOutputColumnNamesKnown;
@@ -695,33 +822,33 @@ struct ImportTextProcedureWorkInstance
     int replaceInvalidCharactersWith;
     Encoding encoding;
     bool hasQuoteChar = false;
-    Date ts;
     bool isIdentitySelect;
 
-    BoundSqlExpression whereBound;
-    BoundSqlExpression selectBound;
-    BoundSqlExpression namedBound;
-    BoundSqlExpression timestampBound;
+    /// Row name expression; config.named, or the default for the number
+    /// of files.
+    std::shared_ptr<SqlExpression> named;
 
     size_t rowCount;
     uint64_t numLineErrors;
 
-    /*    Load a text file and filter according to the configuration  */
+    // State shared between all of the files being loaded
+    std::unique_ptr<Dataset::MultiChunkRecorder> recorder;
+    Progress progress;
+    std::shared_ptr<Step> iterationStep;
+    uint64_t totalBytes;  ///< Total size of the files, for progress
+    std::atomic<int64_t> nextChunkNumber;
+    std::atomic<uint64_t> numSkipped;
+    std::atomic<uint64_t> totalLinesProcessed;
+    atomic<ssize_t> lineCount;
+    atomic<ssize_t> byteCount;
+    Timer timer;
+
+    /*    Load the text files and filter according to the configuration  */
     void loadText(const ImportTextConfig& config,
                   std::shared_ptr<Dataset> dataset,
                   MldbServer * server,
                   const std::function<bool (const Json::Value &)> & onProgress)
     {
-        string filename = config.dataFileUrl.toDecodedString();
-
-        // Ask for a memory mappable stream if possible
-        filter_istream stream(config.dataFileUrl, { { "mapped", "true" } });
-
-        // Get the file timestamp out
-        ts = stream.info().lastModified;
-
-        string header;
-
         if (config.delimiter.length() == 1) {
             separator = config.delimiter[0];
         }
@@ -751,11 +878,134 @@ struct ImportTextProcedureWorkInstance
 
         encoding = parseEncoding(config.encoding);
 
+        std::vector<DataFile> files;
+        if (!config.dataFileUrl.empty())
+            expandDataFileUrl(config.dataFileUrl, files);
+        for (auto & url: config.dataFileUrls)
+            expandDataFileUrl(url, files);
+
+        if (files.empty())
+            throw HttpReturnException(400, "import.text requires either "
+                                      "dataFileUrl or dataFileUrls");
+
+        bool multipleFiles = files.size() > 1;
+
+        // The default row name of lineNumber() is only unique within a
+        // file, so qualify it with the file it came from.  A row name that
+        // was given is used as is, even if it's the same expression.
+        if (config.named)
+            named = *config.named;
+        else if (multipleFiles)
+            named = SqlExpression::parse
+                ("dataFileUrl() + ':' + CAST (lineNumber() AS STRING)");
+        else named = SqlExpression::parse("lineNumber()");
+
+        recorder.reset(new Dataset::MultiChunkRecorder
+                       (dataset->getChunkRecorder()));
+
+        if (multipleFiles) {
+            for (auto & f: files)
+                totalBytes += std::max<int64_t>(f.size, 0);
+        }
+
+        iterationStep = progress.steps({
+            make_pair("iterating", totalBytes ? "percentile" : "lines"),
+        });
+
+        // The first file determines the columns that the others must have
+        // and is used to check the select expression.
+        FileState first(files[0].url);
+        filter_istream stream;
+        openFile(config, first, stream, server, dataset.get());
+
+        if (!multipleFiles) {
+            loadTextData(stream, config, first,
+                         numCpus() /* parallelism */, onProgress);
+        }
+        else {
+            stream.close();
+
+            auto loadFile = [&] (const DataFile & file, int parallelism)
+                {
+                    FileState state(file.url);
+                    filter_istream fileStream;
+                    openFile(config, state, fileStream, server, nullptr);
+                    loadTextData(fileStream, config, state, parallelism,
+                                 onProgress);
+                };
+
+            std::vector<const DataFile *> smallFiles, largeFiles;
+            for (auto & f: files) {
+                if (f.size >= 0 && f.size < SMALL_FILE_SIZE)
+                    smallFiles.push_back(&f);
+                else largeFiles.push_back(&f);
+            }
+
+            INFO_MSG(logger)
+                << "importing " << files.size() << " files ("
+                << smallFiles.size() << " small, " << largeFiles.size()
+                << " large) totalling " << totalBytes * 0.000001
+                << " megabytes";
+
+            // Small files are read one thread per file, many at once
+            parallelMap(0, smallFiles.size(),
+                        [&] (size_t i)
+                        {
+                            loadFile(*smallFiles[i], 1 /* parallelism */);
+                        });
+
+            // Large ones are split into blocks and use all of the CPUs
+            for (auto f: largeFiles)
+                loadFile(*f, numCpus());
+        }
+
+        double wall = timer.elapsed_wall();
+        INFO_MSG(logger)
+            << "imported " << totalLinesProcessed << " in " << wall
+            << "s at " << totalLinesProcessed / wall * 0.000001
+            << "M lines/second on "
+            << timer.elapsed_cpu() / timer.elapsed_wall() << " CPUs";
+        INFO_MSG(logger)
+            << "done " << byteCount * 0.000001 << " megabytes at "
+            << byteCount / timer.elapsed_wall() * 0.000001 << " megabytes/sec";
+        INFO_MSG(logger) << "processed " << totalLinesProcessed << " lines";
+        importedBytes.inc(byteCount);
+
+        recorder->commit();
+
+        numLineErrors = numSkipped;
+        rowCount = lineCount;
+    }
+
+    /** Open the given file, read its header and bind the expressions for
+        it, leaving the stream positioned at the first line of data to be
+        imported.  The first file to be opened sets the input columns;
+        subsequent files must have the same header.  The dataset is only
+        needed for the first one.
+    */
+    void openFile(const ImportTextConfig & config,
+                  FileState & file,
+                  filter_istream & stream,
+                  MldbServer * server,
+                  const Dataset * dataset)
+    {
+        bool isFirst = !!dataset;
+        string filename = file.name.rawString();
+
+        // Ask for a memory mappable stream if possible
+        stream.open(file.url, { { "mapped", "true" } });
+
+        // Get the file timestamp out
+        file.ts = stream.info().lastModified;
+
+        vector<ColumnPath> columnNames;
+
+        string header;
 
         if (isTextLine) {
             //MLDB-1312 optimize if there is no delimiter: only 1 column
             if (config.headers.empty()) {
-                inputColumnNames = { ColumnPath(config.autoGenerateHeaders ? 0 : "lineText") };
+                columnNames = { ColumnPath(config.autoGenerateHeaders ? 0 : "lineText") };
             }
             else if (config.headers.size() != 1) {
                 throw HttpReturnException(
@@ -764,7 +1014,7 @@ struct ImportTextProcedureWorkInstance
                     "no delimiter");
             }
             else {
-                inputColumnNames = { ColumnPath(config.headers[0]) };
+                columnNames = { ColumnPath(config.headers[0]) };
             }
         }
         else {
@@ -815,42 +1065,83 @@ struct ImportTextProcedureWorkInstance
 
                 if (config.autoGenerateHeaders) {
                     // Re-open stream
-                    stream.open(config.dataFileUrl, { { "mapped", "true" } });
+                    stream.open(file.url, { { "mapped", "true" } });
                     auto nfields = fields.size();
                     for (ssize_t i = 0; i < nfields; ++i) {
-                        inputColumnNames.emplace_back(i);
+                        columnNames.emplace_back(i);
                     }
                 }
                 else {
-                    lineOffset += 1;
+                    file.lineOffset += 1;
                     switch (encoding) {
                     case ASCII:
                         for (const auto & f: fields)
-                            inputColumnNames.emplace_back(parseColumnName(f));
+                            columnNames.emplace_back(parseColumnName(f));
                         break;
                     case UTF8:
                         for (const auto & f: fields)
-                            inputColumnNames.emplace_back(parseColumnName(Utf8String(f)));
+                            columnNames.emplace_back(parseColumnName(Utf8String(f)));
                         break;
                     case LATIN1:
                         for (const auto & f: fields)
-                            inputColumnNames.emplace_back(parseColumnName(Utf8String::fromLatin1(f)));
+                            columnNames.emplace_back(parseColumnName(Utf8String::fromLatin1(f)));
                         break;
                     };
                 }
             }
             else {
                 for (const auto & f: config.headers) {
-                    inputColumnNames.emplace_back(parseColumnName(f));
+                    columnNames.emplace_back(parseColumnName(f));
                 }
             }
 
             // MLDB-1649
             // A trailing comma on the header row should be accepted
-            if (!inputColumnNames.empty() && inputColumnNames.back().empty())
-                inputColumnNames.pop_back();
+            if (!columnNames.empty() && columnNames.back().empty())
+                columnNames.pop_back();
+        }
+
+        if (isFirst) {
+            inputColumnNames = std::move(columnNames);
+        }
+        else if (columnNames != inputColumnNames) {
+            throw HttpReturnException
+                (400, "Header of data file '" + filename
+                 + "' doesn't match that of the first file; all files "
+                 "imported together must have the same columns",
+                 "dataFileUrl", file.name,
+                 "expectedColumnNames", inputColumnNames,
+                 "columnNames", columnNames);
+        }
+
+        // Now we know the columns, we can bind our SQL expressions for the
+        // select, where, named and timestamp parts of the expression.
+        file.scope.reset(new SqlCsvScope(server, inputColumnNames, file.ts,
+                                         file.name));
+
+        file.selectBound = config.select.bind(*file.scope);
+        file.whereBound = config.where->bind(*file.scope);
+        file.namedBound = named->bind(*file.scope);
+        file.timestampBound = config.timestamp->bind(*file.scope);
+
+        if (isFirst)
+            analyzeColumns(config, file, *dataset);
+
+        std::string line;
+
+        // Skip those up to the offset
+        for (size_t i = 0;  stream && i < config.offset;  ++i, ++file.lineOffset) {
+            getline(stream, line);
         }
+    }
 
+    /** Check the input columns and the output columns of the select
+        expression, once the first file has been opened.
+    */
+    void analyzeColumns(const ImportTextConfig & config,
+                        const FileState & file,
+                        const Dataset & dataset)
+    {
         // Early check for duplicate column names in input
         Lightweight_Hash<ColumnHash, int> inputColumnIndex;
         for (unsigned i = 0;  i < inputColumnNames.size();  ++i) {
@@ -861,29 +1152,19 @@ struct ImportTextProcedureWorkInstance
                                           "columnName", c);
         }
 
-        // Now we know the columns, we can bind our SQL expressions for the
-        // select, where, named and timestamp parts of the expression.
-        SqlCsvScope scope(server, inputColumnNames, ts,
-                          Utf8String(config.dataFileUrl.toDecodedString()));
-
-        selectBound = config.select.bind(scope);
-        whereBound = config.where->bind(scope);
-        namedBound = config.named->bind(scope);
-        timestampBound = config.timestamp->bind(scope);
-
         // Do we have a "select *"?  In that case, we can perform various
         // optimizations to avoid calling into the SQL layer
-        SqlExpressionDatasetScope noContext(*dataset, ""); //needs a context because x.* is ambiguous
+        SqlExpressionDatasetScope noContext(dataset, ""); //needs a context because x.* is ambiguous
         isIdentitySelect = config.select.isIdentitySelect(noContext);  
 
         // Figure out our output column names from the bound
         // select clause
 
-        if (selectBound.info->getSchemaCompletenessRecursive() != SCHEMA_CLOSED) {
+        if (file.selectBound.info->getSchemaCompletenessRecursive() != SCHEMA_CLOSED) {
             areOutputColumnNamesKnown = false;
         }
 
-        auto cols = selectBound.info->getKnownColumns();
+        auto cols = file.selectBound.info->getKnownColumns();
 
         for (unsigned i = 0;  i < cols.size();  ++i) {
             const auto& col = cols[i];
@@ -892,7 +1173,7 @@ struct ImportTextProcedureWorkInstance
                     (400,
                      "Import select expression cannot have row-valued columns.",
                      "select", config.select,
-                     "selectOutputInfo", selectBound.info,
+                     "selectOutputInfo", file.selectBound.info,
                      "columnName", col.columnName);
 
             ColumnHash ch(col.columnName);
@@ -913,39 +1194,20 @@ struct ImportTextProcedureWorkInstance
         DEBUG_MSG(logger)
             << "writing " << knownColumnNames.size() << " columns "
             << jsonEncodeStr(knownColumnNames);
-
-        std::string line;
-
-        // Skip those up to the offset
-        for (size_t i = 0;  stream && i < config.offset;  ++i, ++lineOffset) {
-            getline(stream, line);
-        }
-
-        loadTextData(dataset, stream, config, scope, onProgress);
     }
 
-    /*    Load, filter and format all lines and process them  */
+    /*    Load, filter and format all lines of a file and process them  */
     void
-    loadTextData(std::shared_ptr<Dataset> dataset,
-                 std::istream& stream,
+    loadTextData(std::istream& stream,
                  const ImportTextConfig& config,
-                 SqlCsvScope& scope,
+                 FileState & file,
+                 int parallelism,
                  const std::function<bool (const Json::Value &)> & onProgress)
     {
-        Progress progress;
-        std::shared_ptr<Step> iterationStep = progress.steps({
-            make_pair("iterating", "lines"),
-        });
-
         // Do we have a "where true'?  In that case, we don't need to
         // call the SQL parser
         bool isWhereTrue = config.where->isConstantTrue();
 
-        std::atomic<uint64_t> numSkipped(0);
-        std::atomic<uint64_t> totalLinesProcessed(0);
-
-        Timer timer;
-
         auto handleError = [&](const std::string & message,
                                int64_t lineNumber,
                                int64_t columnNumber,
@@ -957,14 +1219,12 @@ struct ImportTextProcedureWorkInstance
 
             throw HttpReturnException(400, "Error parsing CSV row: "
                                       + message,
+                                      "dataFileUrl", file.name,
                                       "lineNumber", lineNumber,
                                       "columnNumber", columnNumber,
                                       "line", line);
         };
 
-        Dataset::MultiChunkRecorder recorder
-            = dataset->getChunkRecorder();
-
         struct ThreadAccum {
             /// Recorder object for this thread that the dataset gives us
             /// to record into the dataset.
@@ -981,14 +1241,19 @@ struct ImportTextProcedureWorkInstance
 
         };
 
+        // One per file, so that files loaded at the same time on the same
+        // thread can't see each other's recorders.
         PerThreadAccumulator<ThreadAccum> accum;
 
         auto startChunk = [&] (int64_t chunkNumber, size_t lineNumber)
             {
                 DEBUG_MSG(logger)
-                    << "started chunk " << chunkNumber << " at line " << lineNumber;
+                    << "started chunk " << chunkNumber << " at line " << lineNumber
+                    << " of " << file.name;
                 auto & threadAccum = accum.get();
-                threadAccum.threadRecorder = recorder.newChunk(chunkNumber);
+                // Chunks are numbered across all of the files
+                threadAccum.threadRecorder
+                    = recorder->newChunk(nextChunkNumber.fetch_add(1));
                 if (isIdentitySelect)
                     threadAccum.specializedRecorder
                         = threadAccum.threadRecorder
@@ -1007,21 +1272,23 @@ struct ImportTextProcedureWorkInstance
                 return true;
             };
 
-        atomic<ssize_t> lineCount(0);
-        atomic<ssize_t> byteCount(0);
         auto onLine = [&] (const char * line,
                            size_t length,
                            int chunkNum,
                            int64_t lineNum)
         {
-            byteCount += length + 1;
+            ssize_t bytesDone = (byteCount += length + 1);
             if (++lineCount % PROGRESS_RATE == 0) {
-                iterationStep->value = lineCount;
+                if (totalBytes)
+                    iterationStep->value
+                        = std::min<double>(1.0, 1.0 * bytesDone / totalBytes);
+                else iterationStep->value = lineCount;
                 onProgress(jsonEncode(iterationStep));
             }
-            int64_t actualLineNum = lineNum + lineOffset;
+            int64_t actualLineNum = lineNum + file.lineOffset;
 #if 1
             uint64_t linesDone = totalLinesProcessed.fetch_add(1);
+            importedLines.inc();
 
             if (linesDone && linesDone % 100000 == 0) {
 
@@ -1073,25 +1340,25 @@ struct ImportTextProcedureWorkInstance
                                            string(line, length));
                 }
 
-            auto row = scope.bindRow(&values[0], ts, actualLineNum,
-                                         0 /* todo: chunk ofs */);
+            auto row = file.scope->bindRow(&values[0], file.ts, actualLineNum,
+                                           0 /* todo: chunk ofs */);
 
             ExpressionValue nameStorage;
-            RowPath rowName(namedBound(row, nameStorage, GET_ALL)
+            RowPath rowName(file.namedBound(row, nameStorage, GET_ALL)
                                 .toUtf8String());
             row.rowName = &rowName;
 
             // If it doesn't match the where, don't add it
             if (!isWhereTrue) {
                 ExpressionValue storage;
-                if (!whereBound(row, storage, GET_ALL).isTrue())
+                if (!file.whereBound(row, storage, GET_ALL).isTrue())
                     return true;
             }
 
             // Get the timestamp for the row
-            Date rowTs = ts;
+            Date rowTs = file.ts;
             ExpressionValue tsStorage;
-            rowTs = timestampBound(row, tsStorage, GET_ALL)
+            rowTs = file.timestampBound(row, tsStorage, GET_ALL)
                     .coerceToTimestamp().toTimestamp();
 
             //ExcAssert(!(isIdentitySelect && outputColumnNamesUnknown));
@@ -1111,7 +1378,7 @@ struct ImportTextProcedureWorkInstance
 
                 ExpressionValue selectStorage;
                 const ExpressionValue & selectOutput
-                        = selectBound(row, selectStorage, GET_ALL);
+                        = file.selectBound(row, selectStorage, GET_ALL);
 
                 if (&selectOutput == &selectStorage) {
                     // We can destructively work with it
@@ -1134,7 +1401,7 @@ struct ImportTextProcedureWorkInstance
 
         if(!config.allowMultiLines) {
             forEachLineBlock(stream, onLine, config.limit,
-                             numCpus() /* parallelism */,
+                             parallelism,
                              startChunk, doneChunk);
         }
         else {
@@ -1171,26 +1438,9 @@ struct ImportTextProcedureWorkInstance
 
             doneChunk(0, lineNum);
         }
-
-        double wall = timer.elapsed_wall();
-        INFO_MSG(logger)
-            << "imported " << totalLinesProcessed << " in " << wall
-            << "s at " << totalLinesProcessed / wall * 0.000001
-            << "M lines/second on "
-            << timer.elapsed_cpu() / timer.elapsed_wall() << " CPUs";
-        INFO_MSG(logger)
-            << "done " << byteCount * 0.000001 << " megabytes at "
-            << byteCount / timer.elapsed_wall() * 0.000001 << " megabytes/sec";
-        INFO_MSG(logger) << "processed " << totalLinesProcessed << " lines";
-        
-        recorder.commit();
-
-        numLineErrors = numSkipped;
-        rowCount = lineCount;
     }
 };
 
-
 /*****************************************************************************/
 /* IMPORT TEXT PROCEDURE                                                     */
 /*****************************************************************************/
@@ -1225,7 +1475,7 @@ run(const ProcedureRunConfig & run,
 
     ImportTextProcedureWorkInstance instance(logger);
 
-    instance.loadText(config, dataset, server, onProgress);
+    instance.loadText(runProcConf, dataset, server, onProgress);
 
     Json::Value status;
     status["numLineErrors"] = instance.numLineErrors;
@@ -36,13 +36,13 @@ struct ImportTextConfig : public ProcedureConfig  {
           autoGenerateHeaders(false),
           select(SelectExpression::STAR),
           where(SqlExpression::TRUE),
-          named(SqlExpression::parse("lineNumber()")),
           timestamp(SqlExpression::parse("fileTimestamp()"))
     {
         outputDataset.withType("tabular");
     }
 
     Url dataFileUrl;
+    std::vector<Url> dataFileUrls;
     PolyConfigT<Dataset> outputDataset;
     std::vector<Utf8String> headers;
     std::string delimiter;
@@ -58,7 +58,9 @@ struct ImportTextConfig : public ProcedureConfig  {
 
     SelectExpression select;               ///< What to select from the CSV
     std::shared_ptr<SqlExpression> where;  ///< Filter for the CSV
-    std::shared_ptr<SqlExpression> named;  ///< Row name to output
+    /// Row name to output; unset for the default, which depends on the
+    /// number of files
+    Optional<std::shared_ptr<SqlExpression> > named;
     std::shared_ptr<SqlExpression> timestamp;   ///< Timestamp for row
 
     PolyConfigT<Dataset> output;
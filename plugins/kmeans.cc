@@ -36,6 +36,27 @@ using namespace std;
 
 namespace MLDB {
 
+DEFINE_ENUM_DESCRIPTION(KmeansInitialization);
+
+KmeansInitializationDescription::
+KmeansInitializationDescription()
+{
+    addValue("sampled", KMEANS_INIT_SAMPLED,
+             "Each centroid is the farthest of a small random sample of "
+             "points from the centroids already chosen.  This is fast but "
+             "can give poor initial centroids.");
+    addValue("kmeans++", KMEANS_INIT_PLUS_PLUS,
+             "k-means++: each centroid is sampled in proportion to the "
+             "squared distance to the closest centroid already chosen.  "
+             "This needs a pass over the data per centroid.");
+    addValue("kmeans||", KMEANS_INIT_PARALLEL,
+             "k-means||: a few parallel passes over the data each sample "
+             "many candidate centroids at once, which are then reduced "
+             "to the number of clusters with k-means++.  This gives "
+             "centroids as good as k-means++ for large datasets and "
+             "numbers of clusters in a fraction of the time.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(KmeansConfig);
 
 
@@ -80,6 +101,23 @@ KmeansConfigDescription()
              "Normally this will be Cosine for an orthonormal basis, and "
              "Euclidian for another basis",
              METRIC_COSINE);
+    addField("initialization", &KmeansConfig::initialization,
+             "How the initial centroids are chosen.",
+             KMEANS_INIT_SAMPLED);
+    addField("miniBatchSize", &KmeansConfig::miniBatchSize,
+             "If greater than zero, use mini-batch k-means: each iteration "
+             "moves the centroids towards a random sample of this many "
+             "points rather than recalculating them from the whole "
+             "dataset.  This is much faster on large datasets, at the cost "
+             "of a slightly worse clustering.  In this mode, `maxIterations` "
+             "is the number of mini-batches, and all of them are run.",
+             0);
+    addField("useTriangleInequality", &KmeansConfig::useTriangleInequality,
+             "Use the triangle inequality to skip the distance calculations "
+             "that can't change the cluster of a point (Hamerly's "
+             "algorithm).  This gives the same result, and is usually much "
+             "faster once the clusters start to settle.  It only applies to "
+             "the `euclidean` metric.", true);
     addField("modelFileUrl", &KmeansConfig::modelFileUrl,
              "URL where the model file (with extension '.kms') should be saved. "
              "This file can be loaded by the ![](%%doclink kmeans function). "
@@ -96,8 +134,6 @@ KmeansConfigDescription()
                            validateFunction<KmeansConfig>());
 }
 
-// TODO: see http://www.eecs.tufts.edu/~dsculley/papers/fastkmeans.pdf
-
 namespace {
 
 ML::KMeansMetric * makeMetric(MetricSpace metric)
@@ -193,6 +229,22 @@ run(const ProcedureRunConfig & run,
 
     ML::KMeans kmeans;
     kmeans.metric.reset(makeMetric(runProcConf.metric));
+    kmeans.miniBatchSize = runProcConf.miniBatchSize;
+    kmeans.prune = runProcConf.useTriangleInequality;
+
+    switch (runProcConf.initialization) {
+    case KMEANS_INIT_SAMPLED:
+        kmeans.initialization = ML::KMeans::INIT_SAMPLED;
+        break;
+    case KMEANS_INIT_PLUS_PLUS:
+        kmeans.initialization = ML::KMeans::INIT_KMEANS_PLUS_PLUS;
+        break;
+    case KMEANS_INIT_PARALLEL:
+        kmeans.initialization = ML::KMeans::INIT_KMEANS_PARALLEL;
+        break;
+    default:
+        throw HttpReturnException(400, "Unknown k-means initialization");
+    }
 
     vector<int> inCluster;
 
@@ -385,6 +437,39 @@ call(KmeansFunctionArgs input) const
              ts)};
 }
 
+std::vector<KmeansExpressionValue>
+KmeansFunction::
+applyBatchT(const ApplierT & applier,
+            std::vector<KmeansFunctionArgs> inputs) const
+{
+    size_t n = inputs.size();
+    std::vector<float> points(n * dimension);
+    std::vector<Date> ts(n);
+
+    for (size_t i = 0;  i < n;  ++i) {
+        ts[i] = inputs[i].embedding.getEffectiveTimestamp();
+        auto embedding
+            = inputs[i].embedding.getEmbedding(impl->columnNames.data(),
+                                               impl->columnNames.size())
+            .cast<float>();
+        if (embedding.size() != dimension)
+            throw HttpReturnException(400, "k-means function received an "
+                                      "embedding of the wrong size",
+                                      "expected", dimension,
+                                      "received", embedding.size());
+        std::copy(embedding.begin(), embedding.end(),
+                  points.begin() + i * dimension);
+    }
+
+    std::vector<int> clusters = impl->kmeans.assign(points.data(), n, dimension);
+
+    std::vector<KmeansExpressionValue> result;
+    result.reserve(n);
+    for (size_t i = 0;  i < n;  ++i)
+        result.push_back({ ExpressionValue(clusters[i], ts[i]) });
+    return result;
+}
+
 namespace {
 
 RegisterProcedureType<KmeansProcedure, KmeansConfig>
@@ -26,6 +26,14 @@ namespace MLDB {
 /* KMEANS CONFIG                                                             */
 /*****************************************************************************/
 
+enum KmeansInitialization {
+    KMEANS_INIT_SAMPLED,
+    KMEANS_INIT_PLUS_PLUS,
+    KMEANS_INIT_PARALLEL
+};
+
+DECLARE_ENUM_DESCRIPTION(KmeansInitialization);
+
 struct KmeansConfig : public ProcedureConfig {
     static constexpr const char * name = "kmeans.train";
 
@@ -33,7 +41,10 @@ struct KmeansConfig : public ProcedureConfig {
         : numInputDimensions(-1),
           numClusters(10),
           maxIterations(100),
-          metric(METRIC_COSINE)
+          metric(METRIC_COSINE),
+          initialization(KMEANS_INIT_SAMPLED),
+          miniBatchSize(0),
+          useTriangleInequality(true)
     {
     }
 
@@ -47,6 +58,9 @@ struct KmeansConfig : public ProcedureConfig {
     int numClusters;
     int maxIterations;
     MetricSpace metric;
+    KmeansInitialization initialization;
+    int miniBatchSize;
+    bool useTriangleInequality;
 
     Utf8String functionName;
 };
@@ -103,6 +117,15 @@ struct KmeansFunction: public ValueFunctionT<KmeansFunctionArgs, KmeansExpressio
                    const std::function<bool (const Json::Value &)> & onProgress);
     
     virtual KmeansExpressionValue call(KmeansFunctionArgs input) const override; 
+
+    virtual std::vector<KmeansExpressionValue>
+    applyBatchT(const ApplierT & applier,
+                std::vector<KmeansFunctionArgs> inputs) const override;
+
+    virtual bool supportsBatch() const override
+    {
+        return true;
+    }
     
     KmeansFunctionConfig functionConfig;
 
@@ -130,6 +130,13 @@ dist(int rowNum1, int rowNum2,
     return sqrtf(distSquared);
 }
 
+DistanceMetric *
+EuclideanDistanceMetric::
+clone() const
+{
+    return new EuclideanDistanceMetric(*this);
+}
+
 
 /*****************************************************************************/
 /* COSINE DISTANCE METRIC                                                    */
@@ -206,10 +213,28 @@ dist(int rowNum1, int rowNum2,
 {
     ExcAssertEqual(coords1.size(), coords2.size());
 
-    if (rowNum1 == -1 || rowNum2 == -1) {
+    if (rowNum1 == -1 && rowNum2 == -1) {
         return calc(coords1, coords2);
     }
 
+    if (rowNum1 == -1)
+        return dist(rowNum2, rowNum1, coords2, coords1);
+
+    if (rowNum2 == -1) {
+        // Comparing a known row with a query, as for nearest neighbors
+        // lookups.  We use the cached norm of the row, so that only
+        // two dot products are needed.
+        double recip1 = two_norm_recip.at(rowNum1);
+        double norm2 = sqrt(ML::SIMD::vec_dotprod_dp(&coords2[0], &coords2[0],
+                                                     coords2.size()));
+        if (!isfinite(recip1) || norm2 == 0.0)
+            return (!isfinite(recip1) && norm2 == 0.0) ? 0.0 : 1.0;
+
+        double dp = ML::SIMD::vec_dotprod_dp(&coords1[0], &coords2[0],
+                                             coords1.size());
+        return std::max(1.0 - dp * recip1 / norm2, 0.0);
+    }
+
     // Make sure dist(x,y) == dist(y,x) irrespective of rounding
     if (rowNum2 < rowNum1)
         return dist(rowNum2, rowNum1, coords2, coords1);
@@ -238,6 +263,13 @@ dist(int rowNum1, int rowNum2,
     return result;
 }
 
+DistanceMetric *
+CosineDistanceMetric::
+clone() const
+{
+    return new CosineDistanceMetric(*this);
+}
+
 
 
 } // namespace MLDB
@@ -44,6 +44,11 @@ struct DistanceMetric {
                        const distribution<float> & coords1,
                        const distribution<float> & coords2) const = 0;
 
+    /** Return a copy of this metric, including the cached row
+        information.
+    */
+    virtual DistanceMetric * clone() const = 0;
+
     /** Factor for distance metric objects. */
     static DistanceMetric * create(MetricSpace space);
 };
@@ -61,6 +66,8 @@ struct EuclideanDistanceMetric: public DistanceMetric {
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
+    DistanceMetric * clone() const;
+
     /// Pre cached ||vec||^2 for each row, to allow optimization of the
     /// calculation.
     std::vector<double> sum_dist;
@@ -83,6 +90,8 @@ struct CosineDistanceMetric: public DistanceMetric {
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
+    DistanceMetric * clone() const;
+
     /// Pre-cached reciprocal of the two norm of each vector, to allow
     /// optimization of the calculation.
     std::vector<double> two_norm_recip;
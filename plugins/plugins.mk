@@ -33,6 +33,8 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	tabular_dataset_column.cc \
 	tabular_dataset_chunk.cc \
 	randomforest_procedure.cc \
+	gbdt.cc \
+	gbdt_procedure.cc \
 	classifier.cc \
 	sql_functions.cc \
 	embedding.cc \
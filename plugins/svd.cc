@@ -35,6 +35,9 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/utils/progress.h"
 #include "mldb/utils/log.h"
+#include "mldb/ml/algebra/lapack.h"
+#include "mldb/rest/cancellation_exception.h"
+#include <random>
 #include <sstream>
 
 using namespace std;
@@ -56,6 +59,24 @@ T jsonDecodeFile(const std::string & filename, T * = 0)
     return result;
 }
 
+DEFINE_ENUM_DESCRIPTION(SvdSolver);
+
+SvdSolverDescription::
+SvdSolverDescription()
+{
+    addValue("lanczos", SVD_SOLVER_LANCZOS,
+             "Lanczos iteration (svdlibc).  This is accurate even for the "
+             "smallest singular values, but runs on a single thread and "
+             "needs many passes over the basis.");
+    addValue("randomized", SVD_SOLVER_RANDOMIZED,
+             "Randomized range finder (Halko, Martinsson and Tropp).  The "
+             "basis is multiplied by a block of random vectors in a few "
+             "multi-threaded passes.  The largest singular values are "
+             "nearly as accurate as with Lanczos; the smallest ones less "
+             "so.  Accuracy is controlled with the `oversampling` and "
+             "`powerIterations` parameters.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(SvdConfig);
 
 SvdConfigDescription::
@@ -89,6 +110,21 @@ SvdConfigDescription()
              "The runtime goes up with the square of this parameter, "
              "in other words 10 times as many is 100 times as long to run.",
              2000);
+    addField("solver", &SvdConfig::solver,
+             "Algorithm used to decompose the dense basis.  The "
+             "randomized solver is much faster for large values of "
+             "`numDenseBasisVectors` and `numSingularValues`, at the cost "
+             "of some accuracy in the smallest singular values.",
+             SVD_SOLVER_LANCZOS);
+    addField("oversampling", &SvdConfig::oversampling,
+             "Number of extra random vectors used by the randomized solver "
+             "over `numSingularValues`.  Higher values give more accurate "
+             "singular vectors.  Ignored by the Lanczos solver.", 10);
+    addField("powerIterations", &SvdConfig::powerIterations,
+             "Number of power iterations done by the randomized solver.  "
+             "Each one is another pass over the basis, and makes the "
+             "singular values more accurate when they decay slowly.  "
+             "Ignored by the Lanczos solver.", 2);
     addField("outputColumn", &SvdConfig::outputColumn,
              "Base name of the column that will be written by the SVD.  "
              "It will be an embedding with numSingularValues elements.",
@@ -361,6 +397,61 @@ doLeftSingularVector(const std::vector<Tuple> & row,
     return make_pair(std::move(result), ts);
 }
 
+std::vector<Date>
+SvdBasis::
+leftSingularVectors(const std::vector<RowValue> & rows,
+                    int maxValues,
+                    bool acceptUnknownValues,
+                    float * output,
+                    shared_ptr<spdlog::logger> logger) const
+{
+    if (maxValues < 0 || maxValues > singularValues.size())
+        maxValues = singularValues.size();
+
+    std::fill(output, output + rows.size() * maxValues, 0.0f);
+    std::vector<Date> result(rows.size(), modelTs);
+
+    for (size_t i = 0;  i < rows.size();  ++i) {
+        float * embedding = output + i * maxValues;
+
+        for (auto & v: rows[i]) {
+            const ColumnPath & column = std::get<0>(v);
+            const CellValue & value = std::get<1>(v);
+
+            // Values seen in training map straight to a column of the
+            // basis, which is accumulated without any copy.  Others
+            // (eg, numbers) need to be transformed first.
+            auto it = columnIndex.find(column);
+            if (it != columnIndex.end()) {
+                auto it2 = it->second.values.find(value);
+                if (it2 != it->second.values.end()) {
+                    const distribution<float> & sv
+                        = columns[it2->second].singularVector;
+                    size_t n = std::min<size_t>(maxValues, sv.size());
+                    for (size_t j = 0;  j < n;  ++j)
+                        embedding[j] += sv[j];
+                    result[i].setMax(std::get<2>(v));
+                    continue;
+                }
+            }
+
+            const distribution<float> & rsv
+                = rightSingularVectorForColumn(column, value, maxValues,
+                                               acceptUnknownValues, logger);
+            if (rsv.empty())
+                continue;
+            for (size_t j = 0;  j < maxValues;  ++j)
+                embedding[j] += rsv[j];
+            result[i].setMax(std::get<2>(v));
+        }
+
+        for (unsigned j = 0;  j < maxValues;  ++j)
+            embedding[j] /= singularValues[j];
+    }
+
+    return result;
+}
+
 void
 SvdBasis::
 validate()
@@ -388,50 +479,118 @@ SvdBasisDescription()
     addField("modelTs", &SvdBasis::modelTs, "Timestamp of latest information incorporated into model");
 }
 
+namespace {
+
+/** Multiply the symmetric matrix C by each of the vectors in X, in
+    parallel over blocks of rows of C.
+*/
+std::vector<distribution<double> >
+multiplySymmetric(const boost::multi_array<float, 2> & C,
+                  const std::vector<distribution<double> > & X)
+{
+    size_t n = C.shape()[0];
+    std::vector<distribution<double> > result
+        (X.size(), distribution<double>(n));
+
+    auto doRows = [&] (size_t begin, size_t end)
+        {
+            for (size_t i = begin;  i < end;  ++i)
+                for (size_t j = 0;  j < X.size();  ++j)
+                    result[j][i] = ML::SIMD::vec_dotprod_dp(&C[i][0],
+                                                            &X[j][0], n);
+        };
+
+    if (n > 0)
+        parallelMapChunked(0, n, 16, doRows);
+
+    return result;
+}
+
+/** Orthonormalize the given vectors in place by Gram-Schmidt, done twice
+    for numerical stability.  Vectors that are (numerically) linear
+    combinations of the previous ones are dropped.
+*/
+void orthonormalize(std::vector<distribution<double> > & vectors)
+{
+    size_t n = vectors.empty() ? 0 : vectors[0].size();
+    size_t numDone = 0;
+
+    for (size_t j = 0;  j < vectors.size();  ++j) {
+        distribution<double> & v = vectors[j];
+        double initialNorm = v.two_norm();
+
+        for (unsigned pass = 0;  pass < 2;  ++pass) {
+            for (size_t k = 0;  k < numDone;  ++k) {
+                double d = ML::SIMD::vec_dotprod_dp(&vectors[k][0], &v[0], n);
+                ML::SIMD::vec_add(&v[0], -d, &vectors[k][0], &v[0], n);
+            }
+        }
+
+        double norm = v.two_norm();
+        if (!(norm > 1e-10 * initialNorm))
+            continue;
+
+        v /= norm;
+        if (numDone != j)
+            vectors[numDone] = std::move(v);
+        ++numDone;
+    }
+
+    vectors.resize(numDone);
+}
+
+} // file scope
+
 struct SvdTrainer {
     static SvdBasis calcSvdBasis(const ColumnCorrelations & correlations,
                                  int numSingularValues,
+                                 const SvdConfig & config,
+                                 const std::function<bool (float)> & onProgress,
                                  shared_ptr<spdlog::logger> logger);
 
+    /** Calculate the singular values (square roots of the largest
+        eigenvalues) and singular vectors of the correlation matrix using
+        svdlibc.
+    */
+    static void calcLanczos(const ColumnCorrelations & correlations,
+                            int numSingularValues,
+                            std::vector<double> & singularValues,
+                            std::vector<distribution<double> > & singularVectors,
+                            shared_ptr<spdlog::logger> logger);
+
+    /** Same as calcLanczos, but using the randomized algorithm of Halko,
+        Martinsson and Tropp (2011), "Finding structure with randomness".
+        The progress function is called with the proportion done after
+        each pass over the matrix; if it returns false the calculation is
+        cancelled.
+    */
+    static void calcRandomized(const ColumnCorrelations & correlations,
+                               int numSingularValues,
+                               int oversampling,
+                               int powerIterations,
+                               std::vector<double> & singularValues,
+                               std::vector<distribution<double> > & singularVectors,
+                               const std::function<bool (float)> & onProgress,
+                               shared_ptr<spdlog::logger> logger);
+
     static SvdBasis calcRightSingular(const ClassifiedColumns & columns,
                                       const ColumnIndexEntries & columnIndex,
                                       const SvdBasis & svd,
                                       shared_ptr<spdlog::logger> logger);
 };
 
-SvdBasis
+void
 SvdTrainer::
-calcSvdBasis(const ColumnCorrelations & correlations,
-             int numSingularValues,
-             shared_ptr<spdlog::logger> logger)
+calcLanczos(const ColumnCorrelations & correlations,
+            int numSingularValues,
+            std::vector<double> & singularValues,
+            std::vector<distribution<double> > & singularVectors,
+            shared_ptr<spdlog::logger> logger)
 {
-#if 0
-    static int n = 0;
-    {
-        INFO_MSG(logger) << "saving correlations " << n;
-        filter_ostream stream(MLDB::format("correlations-%d.json", n++));
-        stream << jsonEncode(correlations.columns);
-        for (unsigned i = 0;  i < correlations.correlations.shape()[0];  ++i) {
-            for (unsigned j = 0;  j < correlations.correlations.shape()[1];  ++j) {
-                stream << i << " " << j << " " << correlations.correlations[i][j]
-                       << endl;
-            }
-        }
-        INFO_MSG(logger) << "done saving correlations ";
-    }
-#endif
-
     int ndims = correlations.columnCount();
 
     Timer timer;
 
-    if (logger->should_log(spdlog::level::trace)) {
-        for (unsigned i = 0;  i < ndims;  ++i) {
-            logger->trace() << "correlation between " << 0 << " and "
-                            << i << " is " << correlations.correlations[0][i];
-        }
-    }
-
     /**************************************************************
      * multiplication of matrix B by vector x, where B = A'A,     *
      * and A is nrow by ncol (nrow >> ncol). Hence, B is of order *
@@ -459,33 +618,196 @@ calcSvdBasis(const ColumnCorrelations & correlations,
 
     INFO_MSG(logger) << "done SVD " << timer.elapsed();
 
+    singularValues.assign(svdResult->S, svdResult->S + svdResult->d);
+    singularVectors.clear();
+    for (unsigned j = 0;  j < svdResult->d;  ++j)
+        singularVectors.emplace_back(svdResult->Vt->value[j],
+                                     svdResult->Vt->value[j] + ndims);
+}
+
+void
+SvdTrainer::
+calcRandomized(const ColumnCorrelations & correlations,
+               int numSingularValues,
+               int oversampling,
+               int powerIterations,
+               std::vector<double> & singularValues,
+               std::vector<distribution<double> > & singularVectors,
+               const std::function<bool (float)> & onProgress,
+               shared_ptr<spdlog::logger> logger)
+{
+    const boost::multi_array<float, 2> & C = correlations.correlations;
+    int ndims = correlations.columnCount();
+
+    Timer timer;
+
+    // The correlation matrix is symmetric, so its range and co-range are
+    // the same and we only need to find a basis Q for its range.  The
+    // eigenvectors are then those of the small matrix Q'CQ mapped back
+    // through Q.
+    int numVectors = std::min(ndims, numSingularValues + oversampling);
+    int numPasses = powerIterations + 2;
+    int passesDone = 0;
+
+    auto pass = [&] ()
+        {
+            if (!onProgress(1.0 * ++passesDone / numPasses))
+                throw CancellationException("svd.train was cancelled");
+        };
+
+    // Gaussian test matrix; seeded so that training is repeatable
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gaussian;
+    std::vector<distribution<double> > Q(numVectors,
+                                         distribution<double>(ndims));
+    for (auto & v: Q)
+        for (auto & x: v)
+            x = gaussian(rng);
+
+    Q = multiplySymmetric(C, Q);
+    orthonormalize(Q);
+    pass();
+
+    // Power iterations sharpen the decay of the spectrum, so that the
+    // range of the largest singular values is found more accurately
+    for (int i = 0;  i < powerIterations;  ++i) {
+        Q = multiplySymmetric(C, Q);
+        orthonormalize(Q);
+        pass();
+    }
+
+    int l = Q.size();
+
+    INFO_MSG(logger) << "randomized range finder gave " << l
+                     << " basis vectors in " << timer.elapsed();
+
+    std::vector<distribution<double> > CQ = multiplySymmetric(C, Q);
+    pass();
+
+    if (l == 0) {
+        singularValues.clear();
+        singularVectors.clear();
+        return;
+    }
+
+    // B = Q'CQ, which is symmetric; LAPACK's column major order is
+    // therefore irrelevant
+    boost::multi_array<double, 2> B(boost::extents[l][l]);
+    for (int i = 0;  i < l;  ++i)
+        for (int j = 0;  j <= i;  ++j)
+            B[i][j] = B[j][i]
+                = 0.5 * (Q[i].dotprod(CQ[j]) + Q[j].dotprod(CQ[i]));
+
+    boost::multi_array<double, 2> Bcopy = B;
+    distribution<double> svalues(l);
+    boost::multi_array<double, 2> U(boost::extents[l][l]);
+    boost::multi_array<double, 2> VT(boost::extents[l][l]);
+
+    int res = ML::LAPack::gesdd("S", l, l, Bcopy.data(), l, &svalues[0],
+                                U.data(), l, VT.data(), l);
+    if (res != 0)
+        throw HttpReturnException(500, "gesdd returned non-zero in randomized "
+                                  "SVD", "result", res);
+
+    // Row k of U (in C order) is now the k-th eigenvector of B.  As in
+    // svdlibc, the singular value is the square root of the eigenvalue,
+    // and eigenvectors with negative eigenvalues (the correlation matrix
+    // isn't quite positive definite) are skipped.
+    singularValues.clear();
+    singularVectors.clear();
+    for (int k = 0;  k < l && (int)singularValues.size() < numSingularValues;
+         ++k) {
+        const double * u = &U[k][0];
+        double eigenvalue = 0.0;
+        for (int i = 0;  i < l;  ++i)
+            eigenvalue += u[i] * ML::SIMD::vec_dotprod_dp(&B[i][0], u, l);
+        if (!(eigenvalue > 0.0))
+            continue;
+
+        distribution<double> v(ndims);
+        for (int i = 0;  i < l;  ++i)
+            ML::SIMD::vec_add(&v[0], u[i], &Q[i][0], &v[0], ndims);
+
+        singularValues.push_back(sqrt(eigenvalue));
+        singularVectors.emplace_back(std::move(v));
+    }
+
+    INFO_MSG(logger) << "done randomized SVD " << timer.elapsed();
+}
+
+SvdBasis
+SvdTrainer::
+calcSvdBasis(const ColumnCorrelations & correlations,
+             int numSingularValues,
+             const SvdConfig & config,
+             const std::function<bool (float)> & onProgress,
+             shared_ptr<spdlog::logger> logger)
+{
+#if 0
+    static int n = 0;
+    {
+        INFO_MSG(logger) << "saving correlations " << n;
+        filter_ostream stream(MLDB::format("correlations-%d.json", n++));
+        stream << jsonEncode(correlations.columns);
+        for (unsigned i = 0;  i < correlations.correlations.shape()[0];  ++i) {
+            for (unsigned j = 0;  j < correlations.correlations.shape()[1];  ++j) {
+                stream << i << " " << j << " " << correlations.correlations[i][j]
+                       << endl;
+            }
+        }
+        INFO_MSG(logger) << "done saving correlations ";
+    }
+#endif
+
+    int ndims = correlations.columnCount();
+
+    if (logger->should_log(spdlog::level::trace)) {
+        for (unsigned i = 0;  i < ndims;  ++i) {
+            logger->trace() << "correlation between " << 0 << " and "
+                            << i << " is " << correlations.correlations[0][i];
+        }
+    }
+
+    std::vector<double> singularValues;
+    std::vector<distribution<double> > singularVectors;
+
+    if (config.solver == SVD_SOLVER_RANDOMIZED) {
+        calcRandomized(correlations, numSingularValues,
+                       config.oversampling, config.powerIterations,
+                       singularValues, singularVectors, onProgress, logger);
+    }
+    else {
+        calcLanczos(correlations, numSingularValues,
+                    singularValues, singularVectors, logger);
+        if (!onProgress(1.0))
+            throw CancellationException("svd.train was cancelled");
+    }
+
     // It doesn't clean up the ones that didn't converge properly... do it ourselves
     // We go until we get a NaN or one with too small a ratio.
     // Eg, seen in the wild:
     // svalues = { 3.06081 2.01797 1.91045 1.39165 1.20556 1.0859 1.01295 0.973041 0.96686 0.795663 0.787847 0.753074 0.663018 0.58732 0.566861 0.53674 0.507972 0.481893 0.476135 0.451054 0.434212 0.428739 0.406749 0.396502 0.388368 0.383147 0.381553 0.34724 0.322744 0.311273 0.297784 0.285271 0.275972 0.272025 0.271609 0.265779 0.254749 0.244108 0.234286 0.229235 0.21586 0.208849 0.207129 0.194427 0.186311 0.184302 0.18284 0.170876 0.1612 0.153722 0.145908 0.145039 0.139881 0.136478 0.134853 0.131319 0.124427 0.112027 0.0839514 0.0766772 0.0687135 0.0484199 0.0354719 0.034498 9.62614e-05 7.98612e-05 7.48308e-05 6.6479e-05 5.5881e-05 5.00391e-05 4.59796e-05 4.33525e-05 3.0214e-05 2.67698e-05 2.66379e-05 1.749e-05 1.64916e-05 1.20429e-05 5.02268e-08 -nan -nan -nan -nan 2.46486e-09 -nan -nan -nan -nan -nan -nan -nan -nan -nan -nan -nan 1.61711e-08 }
 
     unsigned realD = 0;
-    while (realD < svdResult->d
-           && isfinite(svdResult->S[realD])
-           && svdResult->S[realD] / svdResult->S[0] > 1e-9)
+    while (realD < singularValues.size()
+           && isfinite(singularValues[realD])
+           && singularValues[realD] / singularValues[0] > 1e-9)
         ++realD;
 
-    INFO_MSG(logger) << "skipped " << svdResult->d - realD << " bad singular values";
-    ExcAssertLessEqual(realD, svdResult->d);
+    INFO_MSG(logger) << "skipped " << singularValues.size() - realD
+                     << " bad singular values";
+    ExcAssertLessEqual(realD, singularValues.size());
     ExcAssertLessEqual(realD, numSingularValues);
-    svdResult->d = realD;
-
-    INFO_MSG(logger) << "got " << svdResult->d << " singular values";
 
-    numSingularValues = svdResult->d;
+    INFO_MSG(logger) << "got " << realD << " singular values";
 
-    TRACE_MSG(logger) << "Vt rows " << svdResult->Vt->rows;
-    TRACE_MSG(logger) << "Vt cols " << svdResult->Vt->cols;
+    numSingularValues = realD;
 
     SvdBasis result;
     result.modelTs = correlations.modelTs;
     result.singularValues.resize(numSingularValues);
-    std::copy(svdResult->S, svdResult->S + numSingularValues,
+    std::copy(singularValues.begin(),
+              singularValues.begin() + numSingularValues,
               result.singularValues.begin());
 
     INFO_MSG(logger) << "svalues = " << result.singularValues;
@@ -501,18 +823,13 @@ calcSvdBasis(const ColumnCorrelations & correlations,
         distribution<float> & d = result.columns[i].singularVector;
         d.resize(numSingularValues);
         for (unsigned j = 0;  j < numSingularValues;  ++j)
-            d[j] = svdResult->Vt->value[j][i];
+            d[j] = singularVectors[j][i];
 
         ColumnPath columnName = result.columns[i].columnName;
         CellValue cellValue = result.columns[i].cellValue;
 
         result.columnIndex[columnName].values[cellValue] = i;
         result.columnIndex[columnName].columnName = columnName;
-
-
-        //std::copy(svdResult->Vt->value[i],
-        //          svdResult->Vt->value[i] + numSingularValues,
-        //          d.begin());
     }
 #endif
 
@@ -680,6 +997,13 @@ run(const ProcedureRunConfig & run,
              "config", runProcConf);
     }
 
+    if (runProcConf.oversampling < 0 || runProcConf.powerIterations < 0) {
+        throw HttpReturnException
+            (400, "SVD training procedure requires non-negative oversampling "
+             "and powerIterations",
+             "config", runProcConf);
+    }
+
     if (!runProcConf.modelFileUrl.empty()) {
         checkWritability(runProcConf.modelFileUrl.toDecodedString(), "modelFileUrl");
     }
@@ -696,7 +1020,8 @@ run(const ProcedureRunConfig & run,
             make_pair("classifying columns", "percentile"), 
             make_pair("extracting features", "percentile"),
             make_pair("inverting features", "percentile"),
-            make_pair("calculating correlations", "percentile")
+            make_pair("calculating correlations", "percentile"),
+            make_pair("decomposing", "percentile")
             });
 
 
@@ -749,9 +1074,22 @@ run(const ProcedureRunConfig & run,
 
     ColumnIndexEntries columnIndex = invertFeatures(columns, extractedFeatures, logger, convertProgressToJson);
 
+    auto correlationStep = inversionStep->nextStep(1);
+
     ColumnCorrelations correlations = calculateCorrelations(columnIndex, numBasisVectors, logger);
+
+    auto decompositionStep = correlationStep->nextStep(1);
+
+    auto onDecompositionProgress = [&] (float done)
+        {
+            decompositionStep->value = done;
+            return onProgress(jsonEncode(svdProgress));
+        };
+
     SvdBasis svd = SvdTrainer::calcSvdBasis(correlations,
                                             runProcConf.numSingularValues,
+                                            runProcConf,
+                                            onDecompositionProgress,
                                             logger);
 
     auto outputSvdColumns = [](const SvdBasis & basis) {
@@ -1021,6 +1359,31 @@ call(SvdInput input) const
     return result;
 }
 
+std::vector<SvdOutput>
+SvdEmbedRow::
+applyBatchT(const ApplierT & applier,
+            std::vector<SvdInput> inputs) const
+{
+    std::vector<RowValue> rows(inputs.size());
+    for (size_t i = 0;  i < inputs.size();  ++i)
+        inputs[i].row.mergeToRowDestructive(rows[i]);
+
+    std::vector<float> embeddings(rows.size() * nsv);
+    std::vector<Date> ts
+        = svd.leftSingularVectors(rows, nsv,
+                                  functionConfig.acceptUnknownValues,
+                                  embeddings.data(), logger);
+
+    std::vector<SvdOutput> result(rows.size());
+    for (size_t i = 0;  i < rows.size();  ++i) {
+        vector<float> embedding(embeddings.begin() + i * nsv,
+                                embeddings.begin() + (i + 1) * nsv);
+        result[i].embedding = ExpressionValue(std::move(embedding), ts[i]);
+    }
+
+    return result;
+}
+
 namespace {
 
 RegisterProcedureType<SvdProcedure, SvdConfig>
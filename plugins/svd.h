@@ -24,13 +24,23 @@ namespace MLDB {
 struct SelectExpression;
 struct SqlExpression;
 
+enum SvdSolver {
+    SVD_SOLVER_LANCZOS,
+    SVD_SOLVER_RANDOMIZED
+};
+
+DECLARE_ENUM_DESCRIPTION(SvdSolver);
+
 struct SvdConfig : ProcedureConfig {
     static constexpr char const * name = "svd.train";
 
     SvdConfig()
         : outputColumn("embedding"),
           numSingularValues(100),
-          numDenseBasisVectors(1000)
+          numDenseBasisVectors(1000),
+          solver(SVD_SOLVER_LANCZOS),
+          oversampling(10),
+          powerIterations(2)
     {
     }
 
@@ -43,6 +53,9 @@ struct SvdConfig : ProcedureConfig {
     PathElement outputColumn;
     int numSingularValues;
     int numDenseBasisVectors;
+    SvdSolver solver;
+    int oversampling;
+    int powerIterations;
     Utf8String functionName;
 };
 
@@ -104,6 +117,17 @@ struct SvdBasis {
                        bool acceptUnknownValues,
                        std::shared_ptr<spdlog::logger> logger) const;
 
+    /** Calculate the embeddings of many rows at once.  The embedding of
+        row i is written to output + i * maxValues, and its timestamp is
+        returned in element i of the result.
+    */
+    std::vector<Date>
+    leftSingularVectors(const std::vector<RowValue> & rows,
+                        int maxValues,
+                        bool acceptUnknownValues,
+                        float * output,
+                        std::shared_ptr<spdlog::logger> logger) const;
+
     template<typename Tuple>
     std::pair<distribution<float>, Date>
     doLeftSingularVector(const std::vector<Tuple> & row,
@@ -191,6 +215,15 @@ struct SvdEmbedRow: public ValueFunctionT<SvdInput, SvdOutput> {
                 const std::function<bool (const Json::Value &)> & onProgress);
     
     virtual SvdOutput call(SvdInput input) const;
+
+    virtual std::vector<SvdOutput>
+    applyBatchT(const ApplierT & applier,
+                std::vector<SvdInput> inputs) const;
+
+    virtual bool supportsBatch() const
+    {
+        return true;
+    }
     
     SvdBasis svd;
     SvdEmbedConfig functionConfig;
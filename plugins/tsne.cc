@@ -38,6 +38,21 @@ using namespace std;
 
 namespace MLDB {
 
+DEFINE_ENUM_DESCRIPTION(TsneRepulsion);
+
+TsneRepulsionDescription::
+TsneRepulsionDescription()
+{
+    addValue("barnesHut", TSNE_REPULSION_BARNES_HUT,
+             "Approximate the repulsive forces with the Barnes-Hut "
+             "algorithm over a quadtree of the embedding.  This works for "
+             "any number of output dimensions.");
+    addValue("fft", TSNE_REPULSION_FFT,
+             "Interpolate the repulsive forces onto a grid and calculate "
+             "them with FFTs.  This is much faster than Barnes-Hut for "
+             "large datasets, but only works for 2 output dimensions.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(TsneConfig);
 
 TsneConfigDescription::
@@ -80,6 +95,10 @@ TsneConfigDescription()
              "may jump over the best optimal point. In general, the learning rate "
              "should be between 100 and 1000.",
              500.0);
+    addField("repulsion", &TsneConfig::repulsion,
+             "Method used to calculate the repulsive forces between the "
+             "points at each iteration.  See below for the options.",
+             TSNE_REPULSION_BARNES_HUT);
     addField("modelFileUrl", &TsneConfig::modelFileUrl,
              "URL where the model file (with extension '.tsn') should be saved. "
              "This file can be loaded by the ![](%%doclink tsne.embedRow function). "
@@ -242,6 +261,15 @@ run(const ProcedureRunConfig & run,
     itl->params.tolerance = runProcConf.tolerance;
     itl->params.eta = runProcConf.learningRate;
 
+    if (runProcConf.repulsion == TSNE_REPULSION_FFT) {
+        if (runProcConf.numOutputDimensions != 2)
+            throw HttpReturnException
+                (400, "The fft repulsion for t-SNE only works with 2 "
+                 "output dimensions",
+                 "numOutputDimensions", runProcConf.numOutputDimensions);
+        itl->params.repulsion = ML::TSNE_REPULSION_FFT;
+    }
+
     DEBUG_MSG(logger) << "perplexity = " << itl->params.perplexity;
     DEBUG_MSG(logger) << "tolerance = " << itl->params.tolerance;
     DEBUG_MSG(logger) << "learningRate = " << itl->params.eta;
@@ -20,6 +20,13 @@ namespace MLDB {
 
 struct TsneItl;
 
+enum TsneRepulsion {
+    TSNE_REPULSION_BARNES_HUT,
+    TSNE_REPULSION_FFT
+};
+
+DECLARE_ENUM_DESCRIPTION(TsneRepulsion);
+
 struct TsneConfig : public ProcedureConfig {
     static constexpr const char * name = "tsne.train";
 
@@ -28,7 +35,8 @@ struct TsneConfig : public ProcedureConfig {
           numOutputDimensions(2),
           tolerance(1e-5),
           perplexity(30.0),
-          learningRate(500.0)
+          learningRate(500.0),
+          repulsion(TSNE_REPULSION_BARNES_HUT)
     {
         output.withType("embedding");
     }
@@ -43,6 +51,7 @@ struct TsneConfig : public ProcedureConfig {
     double tolerance;
     double perplexity;
     double learningRate;
+    TsneRepulsion repulsion;
 
     Utf8String functionName;
 };
@@ -246,7 +246,19 @@ sendHttpChunk(std::string chunk,
               NextAction next,
               OnWriteFinished onWriteFinished)
 {
-    HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
+    // Frame the chunk as per RFC 7230 section 4.1.  An empty chunk is the
+    // last-chunk marker which terminates the body.
+    char lengthBuf[32];
+    int lengthLen = snprintf(lengthBuf, sizeof(lengthBuf), "%zx\r\n",
+                             chunk.size());
+
+    std::string framed;
+    framed.reserve(lengthLen + chunk.size() + 2);
+    framed.append(lengthBuf, lengthLen);
+    framed.append(chunk);
+    framed.append("\r\n");
+
+    HttpLegacySocketHandler::send(std::move(framed), next, onWriteFinished);
 }
 
 inline void
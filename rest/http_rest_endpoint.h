@@ -97,7 +97,7 @@ struct HttpRestEndpoint {
                                 RestParams headers = RestParams());
 
         /** Send an HTTP chunk with the appropriate headers back down the
-            wire. */
+            wire.  An empty chunk terminates a chunked response. */
         void sendHttpChunk(std::string chunk,
                            NextAction next = NEXT_CONTINUE,
                            OnWriteFinished onWriteFinished = OnWriteFinished());
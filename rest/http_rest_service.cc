@@ -12,6 +12,7 @@
 #include "mldb/ext/cityhash/src/city.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/io/event_loop.h"
+#include "mldb/base/metrics.h"
 #include "http_rest_endpoint.h"
 #include "http_rest_service.h"
 #include "mldb/utils/log.h"
@@ -21,6 +22,37 @@ using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+struct HttpMetrics {
+    HttpMetrics()
+    {
+        auto & registry = MetricsRegistry::instance();
+        const char * classes[5] = { "1xx", "2xx", "3xx", "4xx", "5xx" };
+        for (unsigned i = 0;  i < 5;  ++i) {
+            responses[i]
+                = registry.counter("mldb_http_responses_total",
+                                   "HTTP responses sent, by status class",
+                                   string("code=\"") + classes[i] + "\"");
+        }
+        latency = registry.histogram("mldb_http_response_seconds",
+                                     "Time from receiving an HTTP request "
+                                     "to sending the response header");
+    }
+
+    Counter responses[5];
+    LatencyHistogram latency;
+};
+
+const HttpMetrics & httpMetrics()
+{
+    static const HttpMetrics result;
+    return result;
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* REST SERVICE ENDPOINT CONNECTION ID                                       */
 /*****************************************************************************/
@@ -32,6 +64,8 @@ sendResponse(int responseCode, std::string response, std::string contentType)
     if (responseSent_)
         throw MLDB::Exception("response already sent");
 
+    recordResponse(responseCode);
+
     if (endpoint->logResponse)
         endpoint->logResponse(*this, responseCode, response,
                               contentType);
@@ -55,6 +89,8 @@ sendResponse(int responseCode,
     if (responseSent_)
         throw MLDB::Exception("response already sent");
 
+    recordResponse(responseCode);
+
     if (endpoint->logResponse)
         endpoint->logResponse(*this, responseCode, response.toString(),
                                    contentType);
@@ -75,6 +111,8 @@ sendErrorResponse(int responseCode, string error, string contentType)
         throw MLDB::Exception("response already sent");
 
 
+    recordResponse(responseCode);
+
     if (endpoint->logResponse)
         endpoint->logResponse(*this, responseCode, error,
                               contentType);
@@ -94,6 +132,8 @@ sendErrorResponse(int responseCode, const Json::Value & error)
     if (responseSent_)
         throw MLDB::Exception("response already sent");
     
+    recordResponse(responseCode);
+
     if (endpoint->logResponse)
         endpoint->logResponse(*this, responseCode, error.toString(),
                               "application/json");
@@ -110,6 +150,8 @@ sendRedirect(int responseCode, std::string location)
     if (responseSent_)
         throw MLDB::Exception("response already sent");
     
+    recordResponse(responseCode);
+
     if (endpoint->logResponse)
         endpoint->logResponse(*this, responseCode, location,
                                    "REDIRECT");
@@ -129,6 +171,8 @@ sendHttpResponse(int responseCode,
     if (responseSent_)
         throw MLDB::Exception("response already sent");
 
+    recordResponse(responseCode);
+
     if (endpoint->logResponse)
         endpoint->logResponse(*this, responseCode, response,
                               contentType);
@@ -150,6 +194,8 @@ sendHttpResponseHeader(int responseCode,
     if (!http)
         throw MLDB::Exception("sendHttpResponseHeader only works on HTTP connections");
 
+    recordResponse(responseCode);
+
     if (endpoint->logResponse)
         endpoint->logResponse(*this, responseCode, "", contentType);
 
@@ -169,6 +215,17 @@ sendHttpResponseHeader(int responseCode,
                              std::move(contentType), std::move(headers));
 }
 
+void
+HttpRestConnection::
+recordResponse(int responseCode) const
+{
+    const HttpMetrics & metrics = httpMetrics();
+    int cls = responseCode / 100 - 1;
+    if (cls >= 0 && cls < 5)
+        metrics.responses[cls].inc();
+    metrics.latency.record(startDate.secondsUntil(Date::now()));
+}
+
 bool
 HttpRestConnection::
 isConnected()
@@ -206,6 +263,28 @@ finishResponse()
     responseSent_ = true;
 }
 
+void
+HttpRestConnection::
+abortResponse(const std::string & reason)
+{
+    // Closing the connection without the final chunk (or before the
+    // announced content length) makes the response incomplete
+    http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
+    responseSent_ = true;
+}
+
+bool
+HttpRestConnection::
+waitForPayloadDrain(size_t maxBytes)
+{
+    // Wake up periodically to notice a peer that went away
+    while (http->isConnected()) {
+        if (http->waitForWriteDrain(maxBytes, 1.0 /* seconds */))
+            return http->isConnected();
+    }
+    return false;
+}
+
 std::shared_ptr<RestConnection>
 HttpRestConnection::
 capture(std::function<void ()> onDisconnect)
@@ -106,6 +106,16 @@ struct HttpRestConnection: public RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse();
 
+    /** Close the connection without finishing the response. */
+    virtual void abortResponse(const std::string & reason);
+
+    /** Record the response code and the time taken to respond in the
+        server's metrics.
+    */
+    void recordResponse(int responseCode) const;
+
+    virtual bool waitForPayloadDrain(size_t maxBytes);
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -92,6 +92,13 @@ finishResponse()
 {
 }
 
+void InProcessRestConnection::
+abortResponse(const std::string & reason)
+{
+    sendErrorResponse(500, "response was cut short: " + reason,
+                      "text/plain");
+}
+
 /** Send the given error string back on the connection. */
 void InProcessRestConnection::
 sendErrorResponse(int responseCode,
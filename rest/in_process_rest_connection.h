@@ -52,6 +52,11 @@ struct InProcessRestConnection: public HttpRestConnection {
 
     virtual void finishResponse();
 
+    /** There is no connection to close, so this replaces the partial
+        response with a 500 error carrying the reason.
+    */
+    virtual void abortResponse(const std::string & reason);
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
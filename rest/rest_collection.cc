@@ -762,6 +762,7 @@ setProgress(const Json::Value & _progress)
             for (auto & f: onProgressFunctions) {
                 f(progress);
             }
+            triggerProgressWatches();
         }
     }
 }
@@ -789,6 +790,25 @@ getState() const
     }
 }
 
+WatchT<Utf8String, Json::Value>
+BackgroundTaskBase::
+watchProgress()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto result = progressWatches.add();
+    // Catch up; this is queued until the watch is bound
+    result.trigger(getState(), progress);
+    return result;
+}
+
+void
+BackgroundTaskBase::
+triggerProgressWatches()
+{
+    if (!progressWatches.empty())
+        progressWatches.trigger(getState(), progress);
+}
+
 void validatePayloadForPut(const RestRequest & req,
                            const Utf8String & nounPlural)
 {
@@ -150,12 +150,25 @@ struct BackgroundTaskBase {
 
     Utf8String getState() const;
 
+    /** Watch the state and progress of the task.  The watch is first
+        triggered with the current state and progress, and then each time
+        that either of them changes, up to and including the final state.
+    */
+    WatchT<Utf8String, Json::Value> watchProgress();
+
+    /** Trigger the progress watches with the current state and progress.
+        Must be called with the mutex held, so that the events are seen
+        in order.
+    */
+    void triggerProgressWatches();
+
     typedef std::function<bool (const Json::Value &)> OnProgress;
 
     /** A task is running until it is CANCELLED, FINISHED or in ERROR state */
     std::atomic<bool>  running;
     std::atomic<State> state;
     WatchesT<bool> cancelledWatches;
+    WatchesT<Utf8String, Json::Value> progressWatches;
     
     /// Everything below here is protected by this mutex
     mutable std::mutex mutex;
@@ -513,6 +526,18 @@ struct RestConfigurableCollection: public RestCollection<Key, Value> {
     virtual Status handlePost(Key key, Config config, bool mustBeNew = false);
     virtual Status handlePostSync(Key key, Config config, bool mustBeNew = false);
 
+    /* Creation of a new object without waiting for it.  onDone is called
+       once the object exists, with a null exception, or with the exception
+       that stopped it from being created.  It may be called before this
+       returns, or from the thread that created the object, with the
+       object's task locked.
+    */
+    typedef std::function<void (std::exception_ptr exc,
+                                std::shared_ptr<Value> value)> OnCreated;
+    virtual void handlePutDeferred(Key key, Config config,
+                                   const OnCreated & onDone,
+                                   bool mustBeNew = false);
+
     virtual void handleDelete(Key key);
 
     struct RouteManager: public RestCollection<Key, Value>::RouteManager {
@@ -538,9 +563,24 @@ struct RestConfigurableCollection: public RestCollection<Key, Value> {
 
         GetCollection getCollection;
 
+        /** If set before the routes are added, the synchronous PUT and
+            POST routes don't hold the thread that handles the request
+            while the object is created.  The connection is captured and
+            the response is sent from the thread that created the object.
+        */
+        bool deferSyncResponses = false;
+
         void addPutRoute();
         void addPostRoute();
         void addDeleteRoute();
+
+    private:
+        /** Create the object for a deferred synchronous PUT or POST, and
+            respond on the captured connection once it exists.
+        */
+        static void respondWhenCreated(RestConfigurableCollection * collection,
+                                       Key key, Config config,
+                                       RestConnection & connection);
     };
 
 #if 0
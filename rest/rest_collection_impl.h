@@ -16,6 +16,8 @@
 #include "mldb/types/utility_descriptions.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/rest/cancellation_exception.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/rest/in_process_rest_connection.h"
 
 
 namespace MLDB {
@@ -576,9 +578,14 @@ addBackgroundJobInThread(Key key,
         std::shared_ptr<WatchT<bool> > cancelledPtr
             (new WatchT<bool>(task->cancelledWatches.add()));
 
+        // The job keeps the priority of the thread that submitted it
+        JobPriority priority = currentJobPriority();
+        bool admitted = currentJobAdmitted();
+
         auto toRun = [=] ()
             {
                 MLDB_TRACE_EXCEPTIONS(false);
+                JobPriorityScope priorityScope(priority, admitted);
                 try {
                     WatchT<bool> cancelled = std::move(*cancelledPtr);
                     task->value = fn(onProgressFn, std::move(cancelled));
@@ -670,6 +677,9 @@ finishedBackgroundJob(Key key,
         for (auto & f: task->onDoneFunctions)
             f(task->value);
     }
+
+    // Tell anyone watching the task that it's done
+    task->triggerProgressWatches();
 }
 
 template<typename Key, class Value>
@@ -1537,6 +1547,8 @@ addPutRoute()
                               "Create a new " + this->nounSingular + " asynchronously",
                               putAsyncRoute, help);
 
+    bool deferred = this->deferSyncResponses;
+
     RestRequestRouter::OnProcessRequest putSyncRoute
         = [=] (RestConnection & connection,
                const RestRequest & req,
@@ -1553,6 +1565,14 @@ addPutRoute()
 
                 MLDB_TRACE_EXCEPTIONS(false);
                 auto config = jsonDecodeStr<Config>(req.payload);
+
+                if (deferred
+                    && !dynamic_cast<InProcessRestConnection *>(&connection)) {
+                    respondWhenCreated(collection, key, std::move(config),
+                                       connection);
+                    return RestRequestRouter::MR_ASYNC;
+                }
+
                 Status status = collection->handlePutSync(key, config);
 
                 ResourcePath path = collection->getPath();
@@ -1602,6 +1622,8 @@ addPostRoute()
 
     auto validater = createRequestValidater(help, {});
 
+    bool deferred = this->deferSyncResponses;
+
     RestRequestRouter::OnProcessRequest postSyncRoute
         = [=] (RestConnection & connection,
                const RestRequest & req,
@@ -1618,6 +1640,14 @@ addPostRoute()
                 MLDB_TRACE_EXCEPTIONS(false);
                 auto config = jsonDecodeStr<Config>(req.payload);
                 Key key = collection->getKey(config);
+
+                if (deferred
+                    && !dynamic_cast<InProcessRestConnection *>(&connection)) {
+                    respondWhenCreated(collection, key, std::move(config),
+                                       connection);
+                    return RestRequestRouter::MR_ASYNC;
+                }
+
                 Status status = collection->handlePostSync(key, config);
 
                 ResourcePath path = collection->getPath();
@@ -1684,6 +1714,54 @@ addPostRoute()
                                    postSyncRoute, help);
 }
 
+template<typename Key, typename Value,
+         typename Config, typename Status>
+void
+RestConfigurableCollection<Key, Value, Config, Status>::RouteManager::
+respondWhenCreated(RestConfigurableCollection * collection,
+                   Key key, Config config,
+                   RestConnection & connection)
+{
+    // Nothing to do on a disconnection; the object is still created, as
+    // it would be for an asynchronous request
+    std::shared_ptr<RestConnection> captured
+        = connection.capture([] () {});
+
+    auto onCreated = [=] (std::exception_ptr exc,
+                          std::shared_ptr<Value> value)
+        {
+            try {
+                if (exc)
+                    std::rethrow_exception(exc);
+
+                // The object's task is locked, so its status comes from
+                // the object rather than from getStatus()
+                Status status = collection->getStatusFinished(key, *value);
+
+                ResourcePath path = collection->getPath();
+                path.push_back(encodeUriComponent(restEncode(key)));
+                Utf8String uri = collection->getUriForPath(path);
+
+                RestParams headers = {
+                    { "Location", uri, },
+                    { "EntityPath", jsonEncodeStr(path) }
+                };
+
+                captured->sendHttpResponse(201, jsonEncodeStr(status),
+                                           "application/json", headers);
+            } catch (const std::exception & exc) {
+                sendExceptionResponse(*captured, exc);
+            }
+        };
+
+    try {
+        MLDB_TRACE_EXCEPTIONS(false);
+        collection->handlePutDeferred(key, std::move(config), onCreated);
+    } catch (const std::exception & exc) {
+        sendExceptionResponse(*captured, exc);
+    }
+}
+
 template<typename Key, typename Value,
          typename Config, typename Status>
 void
@@ -1800,6 +1878,8 @@ Status
 RestConfigurableCollection<Key, Value, Config, Status>::
 handlePut(Key key, Config config, bool mustBeNew /* = false */)
 {
+    // Nobody waits for asynchronous creation, so it's background work
+    JobPriorityScope priority(PRIORITY_BACKGROUND);
     handlePutItl(key, config, nullptr, mustBeNew);
     return getStatus(key);
 }
@@ -1839,6 +1919,39 @@ handlePutSync(Key key, Config config, bool mustBeNew /* = false */)
     }
 }
 
+template<typename Key, typename Value,
+         typename Config, typename Status>
+void
+RestConfigurableCollection<Key, Value, Config, Status>::
+handlePutDeferred(Key key, Config config, const OnCreated & onDone,
+                  bool mustBeNew /* = false */)
+{
+    auto onFinished = [=] (std::shared_ptr<Value> val)
+        {
+            if (val) {
+                onDone(nullptr, val);
+                return;
+            }
+
+            std::exception_ptr exc;
+            try {
+                auto entry = this->getEntry(key);
+                if (entry.second && entry.second->exc)
+                    exc = entry.second->exc;
+                else this->throwEntryNotObtained(key);
+            } catch (...) {
+                exc = std::current_exception();
+            }
+            onDone(exc, nullptr);
+        };
+
+    if (!handlePutItl(key, config, onFinished, mustBeNew)) {
+        // Created synchronously
+        auto entry = this->getEntry(key);
+        onFinished(entry.first);
+    }
+}
+
 template<typename Key, typename Value,
          typename Config, typename Status>
 void
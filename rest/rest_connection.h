@@ -83,6 +83,25 @@ struct RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse() = 0;
 
+    /** Abandon a response that was started but can't be finished, for
+        example because of an error partway through a streamed payload.
+        The connection is closed without finishing the response, so that
+        the client can tell that it was cut short.  The reason is passed
+        back where the transport allows it.
+    */
+    virtual void abortResponse(const std::string & reason) = 0;
+
+    /** Wait until at most maxBytes of the payload sent so far remain to be
+        written to the peer.  This allows a producer to stream a large
+        response without buffering it in memory, as it will be held back
+        by a slow peer.  Returns false if the connection was closed.  The
+        default implementation doesn't wait.
+    */
+    virtual bool waitForPayloadDrain(size_t maxBytes)
+    {
+        return isConnected();
+    }
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -16,6 +16,7 @@
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/jml/utils/less.h"
 #include "mldb/types/value_description.h"
+#include <cstring>
 
 
 using namespace std;
@@ -58,6 +59,8 @@ PathSpec(Regex rex)
       path(rex.surface()),
       rex(std::move(rex))
 {
+    if (!(this->rex.flags() & std::regex_constants::icase))
+        simpleRex = SimpleRegex::parse(path.rawString());
 }
 
 void
@@ -122,6 +125,177 @@ operator < (const PathSpec & other) const
     return path < other.path;
 }
 
+namespace {
+
+bool isRegexSpecial(char c)
+{
+    return c != 0 && strchr("\\^$.|?*+()[]{}", c) != nullptr;
+}
+
+bool isQuantifier(char c)
+{
+    return c == '*' || c == '+' || c == '?' || c == '{';
+}
+
+/** Return the literal text at the start of the regex, stopping before
+    any character that is made optional or repeated by a quantifier.
+*/
+std::string regexLiteralPrefix(const std::string & rex)
+{
+    // With an alternation, even the start isn't fixed
+    if (rex.find('|') != std::string::npos)
+        return std::string();
+
+    size_t i = 0;
+    while (i < rex.size() && !isRegexSpecial(rex[i]))
+        ++i;
+    if (i > 0 && i < rex.size() && isQuantifier(rex[i]))
+        --i;
+    return std::string(rex, 0, i);
+}
+
+} // file scope
+
+std::string
+PathSpec::
+literalPrefix() const
+{
+    switch (type) {
+    case STRING:
+        return path.rawString();
+    case REGEX:
+        if (simpleRex)
+            return simpleRex->prefix + simpleRex->capturePrefix;
+        if (rex.flags() & std::regex_constants::icase)
+            return std::string();
+        return regexLiteralPrefix(path.rawString());
+    case NONE:
+    default:
+        return std::string();
+    }
+}
+
+std::shared_ptr<const PathSpec::SimpleRegex>
+PathSpec::SimpleRegex::
+parse(const std::string & rex)
+{
+    // The form is prefix(capturePrefix class quantifier), where the class
+    // is either . or a bracket expression of ASCII characters and ranges
+    auto result = std::make_shared<SimpleRegex>();
+
+    size_t i = 0, n = rex.size();
+
+    auto literal = [&] ()
+        {
+            size_t start = i;
+            while (i < n && !isRegexSpecial(rex[i]))
+                ++i;
+            return std::string(rex, start, i - start);
+        };
+
+    result->prefix = literal();
+    if (i == n || rex[i++] != '(' || (i < n && rex[i] == '?'))
+        return nullptr;
+    result->capturePrefix = literal();
+    if (i == n)
+        return nullptr;
+
+    bool negated = false;
+    if (rex[i] == '.') {
+        // Matches anything but line terminators
+        result->chars.set();
+        result->chars.reset('\n');
+        result->chars.reset('\r');
+        negated = true;
+        ++i;
+    }
+    else if (rex[i] == '[') {
+        ++i;
+        if (i < n && rex[i] == '^') {
+            negated = true;
+            ++i;
+        }
+        std::bitset<256> chars;
+        size_t start = i;
+        while (i < n && rex[i] != ']') {
+            unsigned char c = rex[i];
+            if (c == '\\' || c == '[' || c >= 0x80)
+                return nullptr;
+            if (i + 2 < n && rex[i + 1] == '-' && rex[i + 2] != ']') {
+                unsigned char last = rex[i + 2];
+                if (last == '\\' || last == '[' || last >= 0x80 || last < c)
+                    return nullptr;
+                for (unsigned j = c;  j <= last;  ++j)
+                    chars.set(j);
+                i += 3;
+            }
+            else {
+                chars.set(c);
+                ++i;
+            }
+        }
+        if (i == n || i == start)
+            return nullptr;
+        ++i;  // closing bracket
+        // A negated class matches every non-ASCII character, so all the
+        // bytes of their UTF-8 encoding
+        result->chars = negated ? ~chars : chars;
+    }
+    else return nullptr;
+
+    if (i == n)
+        return nullptr;
+    if (rex[i] == '*') {
+        ++i;
+    }
+    else if (rex[i] == '+') {
+        result->minCount = 1;
+        ++i;
+    }
+    else if (rex[i] == '{' && !negated) {
+        // Counting bytes only works when all characters are ASCII
+        ++i;
+        size_t start = i;
+        int count = 0;
+        while (i < n && isdigit(rex[i]) && i - start < 6)
+            count = count * 10 + (rex[i++] - '0');
+        if (i == start || i == n || rex[i] != '}')
+            return nullptr;
+        ++i;
+        result->minCount = result->maxCount = count;
+    }
+    else return nullptr;
+
+    // The capture must close the regex
+    if (i + 1 != n || rex[i] != ')')
+        return nullptr;
+
+    return result;
+}
+
+bool
+PathSpec::SimpleRegex::
+match(const std::string & path, size_t & captureStart, size_t & length) const
+{
+    if (path.compare(0, prefix.size(), prefix) != 0)
+        return false;
+    captureStart = prefix.size();
+    if (path.compare(captureStart, capturePrefix.size(), capturePrefix) != 0)
+        return false;
+
+    // Greedy, as the regex would be
+    size_t i = captureStart + capturePrefix.size();
+    size_t start = i;
+    while (i < path.size() && chars.test((unsigned char)path[i])
+           && (maxCount == -1 || i - start < (size_t)maxCount))
+        ++i;
+    if (i - start < (size_t)minCount)
+        return false;
+
+    length = i;
+    return true;
+}
+
 PathSpec
 Rx(const Utf8String & regexString, const Utf8String & desc)
 {
@@ -386,7 +560,9 @@ processRequest(RestConnection & connection,
         return rootHandler(connection, request, context);
     }
 
-    for (auto & sr: subRoutes) {
+    // Only the routes whose path can match are tried
+    for (int i: routeIndex.candidates(context.remaining.rawString())) {
+        const Route & sr = subRoutes[i];
         if (debug)
             cerr << "  trying subroute " << sr.router->description << endl;
         try {
@@ -437,6 +613,23 @@ matchPath(RestRequestParsingContext & context) const
         else return false;
     }
     case PathSpec::REGEX: {
+        if (path.simpleRex) {
+            const std::string & remaining = context.remaining.rawString();
+            size_t captureStart, length;
+            if (!path.simpleRex->match(remaining, captureStart, length))
+                return false;
+            // Same elements as for the regex: the whole match, then the
+            // capture
+            context.resources.push_back
+                (Url::decodeUri(Utf8String(remaining.substr(0, length))));
+            context.resources.push_back
+                (Url::decodeUri(Utf8String(remaining.substr
+                                           (captureStart,
+                                            length - captureStart))));
+            context.remaining = Utf8String(remaining.substr(length));
+            break;
+        }
+
         MatchResults results;
         bool found
             = regex_search(context.remaining, results, path.rex,
@@ -624,6 +817,7 @@ addRoute(PathSpec path, RequestFilter filter,
 
         throw HttpReturnException(500, message.str());
     }
+    routeIndex.add(route.path.literalPrefix(), subRoutes.size());
     subRoutes.emplace_back(std::move(route));
 }
 
@@ -977,10 +1171,69 @@ addSubRouter(PathSpec path,
     route.router->notFoundHandler = notFoundHandler;
     route.extractObject = extractObject;
 
+    routeIndex.add(route.path.literalPrefix(), subRoutes.size());
     subRoutes.push_back(route);
     return *route.router;
 }
 
+
+/*****************************************************************************/
+/* ROUTE INDEX                                                               */
+/*****************************************************************************/
+
+RestRequestRouter::RouteIndex::
+RouteIndex()
+    : nodes(1)
+{
+}
+
+void
+RestRequestRouter::RouteIndex::
+add(const std::string & prefix, int route)
+{
+    int node = 0;
+    for (char c: prefix) {
+        auto it = nodes[node].children.find(c);
+        if (it != nodes[node].children.end()) {
+            node = it->second;
+            continue;
+        }
+        // A new node starts with the routes of its parent, as their
+        // prefixes are also prefixes of its text
+        int child = nodes.size();
+        Node newNode;
+        newNode.routes = nodes[node].routes;
+        nodes.emplace_back(std::move(newNode));
+        nodes[node].children[c] = child;
+        node = child;
+    }
+
+    // The route goes in the node and in all of those below it.  As it was
+    // added last, the lists stay in order.
+    std::vector<int> toAdd(1, node);
+    while (!toAdd.empty()) {
+        int n = toAdd.back();
+        toAdd.pop_back();
+        nodes[n].routes.push_back(route);
+        for (auto & c: nodes[n].children)
+            toAdd.push_back(c.second);
+    }
+}
+
+const std::vector<int> &
+RestRequestRouter::RouteIndex::
+candidates(const std::string & path) const
+{
+    int node = 0;
+    for (char c: path) {
+        auto it = nodes[node].children.find(c);
+        if (it == nodes[node].children.end())
+            break;
+        node = it->second;
+    }
+    return nodes[node].routes;
+}
+
 void
 RestRequestRouter::
 defaultNotFoundHandler(RestConnection & connection,
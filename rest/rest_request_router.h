@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <bitset>
+#include <map>
+#include <memory>
 #include <set>
 
 #include "mldb/rest/rest_request_fwd.h"
@@ -79,6 +82,40 @@ struct PathSpec {
     bool operator != (const PathSpec & other) const;
 
     bool operator < (const PathSpec & other) const;
+
+    /** Return the literal text that every path matched by this spec starts
+        with.  For a string it's the whole path; for a regex it may be
+        empty.  It's used to index the routes of a router.
+    */
+    std::string literalPrefix() const;
+
+    /** Almost all regex routes are of the form "/prefix/(class*)", to
+        capture the name of an entity.  Those are matched directly rather
+        than through the regex engine, which is much slower.
+    */
+    struct SimpleRegex {
+        std::string prefix;         ///< Literal text before the capture
+        std::string capturePrefix;  ///< Literal text starting the capture
+        std::bitset<256> chars;     ///< Characters matched by the class
+        int minCount = 0;           ///< Minimum number of characters
+        int maxCount = -1;          ///< Maximum number; -1 is unbounded
+
+        /** Parse the given regex, returning null if it's not of the
+            simple form.
+        */
+        static std::shared_ptr<const SimpleRegex>
+        parse(const std::string & rex);
+
+        /** Match at the start of the path.  On success, captureStart is
+            the start of the capture and length the length of the match,
+            both in bytes.
+        */
+        bool match(const std::string & path,
+                   size_t & captureStart, size_t & length) const;
+    };
+
+    /// Set when the regex is simple enough to be matched directly
+    std::shared_ptr<const SimpleRegex> simpleRex;
 };
 
 /// A shortcut way to construct a PathSpec that's a regular expression
@@ -588,16 +625,44 @@ struct RestRequestRouter {
         route.router = res;
         route.router->description = description;
         route.extractObject = getExtractObject(res.get());
+        routeIndex.add(route.path.literalPrefix(), subRoutes.size());
         subRoutes.push_back(route);
         return *res;
     }
 
     static void defaultNotFoundHandler (RestConnection & connection,
                                         const RestRequest & request);
-    
+
+    /** Index of the subroutes by the literal text that their paths start
+        with, so that a request only tries the routes that could match it
+        rather than each one in turn.  It's a trie of the literal prefixes;
+        each node has the routes whose prefix is a prefix of the node's
+        text, in the order in which they were added.
+    */
+    struct RouteIndex {
+        RouteIndex();
+
+        /** Add the route with the given index in subRoutes. */
+        void add(const std::string & prefix, int route);
+
+        /** Return the indexes of the routes whose prefix is a prefix
+            of the given path, in the order in which they were added.
+        */
+        const std::vector<int> & candidates(const std::string & path) const;
+
+    private:
+        struct Node {
+            std::map<char, int> children;
+            std::vector<int> routes;
+        };
+
+        std::vector<Node> nodes;  ///< Root is the first one
+    };
+
     OnProcessRequest rootHandler;
     OnNotFoundRequest notFoundHandler;
     std::vector<Route> subRoutes;
+    RouteIndex routeIndex;
     Utf8String description;
     bool terminal;
     Json::Value argHelp;
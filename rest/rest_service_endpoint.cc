@@ -219,6 +219,14 @@ finishResponse()
     itl->responseSent = true;
 }
 
+void
+RestServiceEndpoint::ConnectionId::
+abortResponse(const std::string & reason)
+{
+    itl->http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
+    itl->responseSent = true;
+}
+
 std::shared_ptr<RestConnection>
 RestServiceEndpoint::ConnectionId::
 capture(std::function<void ()> onDisconnect)
@@ -144,6 +144,9 @@ struct RestServiceEndpoint {
         /** Finish the response, recycling or closing the connection. */
         void finishResponse();
 
+        /** Close the connection without finishing the response. */
+        void abortResponse(const std::string & reason);
+
         /** Send the given error string back on the connection. */
         void sendErrorResponse(int responseCode,
                                std::string error,
@@ -117,3 +117,71 @@ BOOST_AUTO_TEST_CASE( test_hidden_route )
                                        "Not matching regex", callback,
                     Json::Value());
 }
+
+BOOST_AUTO_TEST_CASE( test_route_dispatch )
+{
+    RestRequestRouter router;
+
+    auto respond = [] (const std::string & name)
+        {
+            return [=] (RestConnection & connection,
+                        const RestRequest & request,
+                        RestRequestParsingContext & context)
+            {
+                connection.sendResponse(200,
+                                        name + ":"
+                                        + context.resources.back().rawString(),
+                                        "text/plain");
+                return RestRequestRouter::MR_YES;
+            };
+        };
+
+    router.addRoute("/items/special", "GET", "Special item",
+                    respond("special"), Json::Value());
+    router.addRoute(Rx("/items/([^/]*)", "/items/<item>"), "GET",
+                    "Item", respond("item"), Json::Value());
+    router.addRoute(Rx("/items/([0-9]+)", "/items/<number>"), "POST",
+                    "Numbered item", respond("number"), Json::Value());
+    router.addRoute(Rx("/(a|b)x", "/<letter>x"), "GET",
+                    "Not a simple regex", respond("letter"), Json::Value());
+    router.addRoute("/other", "GET", "Other", respond("other"),
+                    Json::Value());
+
+    auto & v1 = router.addSubRouter("/v1", "Version 1");
+    auto & functions = v1.addSubRouter("/functions", "Functions");
+    auto & function
+        = functions.addSubRouter(Rx("/([^/]*)", "/<function>"), "Function");
+    function.addRoute("/application", "GET", "Apply",
+                      respond("apply"), Json::Value());
+    function.addRoute("", "GET", "Get", respond("get"), Json::Value());
+
+    auto call = [&] (const std::string & verb, const std::string & resource)
+        {
+            RestRequest request;
+            request.verb = verb;
+            request.resource = resource;
+            InProcessRestConnection conn;
+            router.handleRequest(conn, request);
+            if (conn.responseCode != 200)
+                return std::to_string(conn.responseCode);
+            return conn.response;
+        };
+
+    // Routes are tried in the order they were added
+    BOOST_CHECK_EQUAL(call("GET", "/items/special"),
+                      "special:/items/special");
+    BOOST_CHECK_EQUAL(call("GET", "/items/thing"), "item:thing");
+    BOOST_CHECK_EQUAL(call("GET", "/items/a%20b"), "item:a b");
+    BOOST_CHECK_EQUAL(call("GET", "/items/"), "item:");
+    BOOST_CHECK_EQUAL(call("POST", "/items/123"), "number:123");
+    BOOST_CHECK_EQUAL(call("POST", "/items/abc"), "404");
+    BOOST_CHECK_EQUAL(call("GET", "/bx"), "letter:b");
+    BOOST_CHECK_EQUAL(call("GET", "/cx"), "404");
+    BOOST_CHECK_EQUAL(call("GET", "/other"), "other:/other");
+    BOOST_CHECK_EQUAL(call("GET", "/otherwise"), "404");
+    BOOST_CHECK_EQUAL(call("GET", "/v1/functions/f1/application"),
+                      "apply:/application");
+    BOOST_CHECK_EQUAL(call("GET", "/v1/functions/f%2F1"), "get:");
+    BOOST_CHECK_EQUAL(call("GET", "/v1/functions/f1/unknown"), "404");
+    BOOST_CHECK_EQUAL(call("GET", "/v2/functions/f1"), "404");
+}
@@ -0,0 +1,283 @@
+/** admission_control.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "admission_control.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/cancellation.h"
+#include <algorithm>
+#include <chrono>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<int, true /* trace */>
+MLDB_MAX_BATCH_TASKS("MLDB_MAX_BATCH_TASKS", 0);
+
+EnvOption<int, true /* trace */>
+MLDB_MAX_BACKGROUND_TASKS("MLDB_MAX_BACKGROUND_TASKS", 0);
+
+EnvOption<int, true /* trace */>
+MLDB_MAX_QUEUED_TASKS("MLDB_MAX_QUEUED_TASKS", 1000);
+
+EnvOption<double, true /* trace */>
+MLDB_ADMISSION_TIMEOUT("MLDB_ADMISSION_TIMEOUT", 600.0);
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROLLER                                                      */
+/*****************************************************************************/
+
+AdmissionController::
+AdmissionController()
+    : nextId(0)
+{
+    // Interactive tasks are never held back
+
+    Limits & batch = classes[PRIORITY_BATCH].limits;
+    batch.maxRunning = MLDB_MAX_BATCH_TASKS;
+    if (batch.maxRunning <= 0)
+        batch.maxRunning = std::max(numCpus(), 2);
+    batch.maxQueued = MLDB_MAX_QUEUED_TASKS;
+    batch.maxWaitSeconds = MLDB_ADMISSION_TIMEOUT;
+
+    // Background tasks are asynchronous, so there is nobody waiting on
+    // the other end and they may queue for as long as necessary
+    Limits & background = classes[PRIORITY_BACKGROUND].limits;
+    background.maxRunning = MLDB_MAX_BACKGROUND_TASKS;
+    if (background.maxRunning <= 0)
+        background.maxRunning = std::max(numCpus() / 2, 2);
+    background.maxQueued = MLDB_MAX_QUEUED_TASKS;
+}
+
+AdmissionController::Ticket
+AdmissionController::
+admit(JobPriority priority, const Utf8String & description,
+      const CancellationToken * token)
+{
+    ExcAssertGreaterEqual(priority, 0);
+    ExcAssertLess(priority, NUM_JOB_PRIORITIES);
+
+    Ticket result;
+
+    // Work done on behalf of a task that already holds a slot was
+    // already admitted
+    if (currentJobAdmitted())
+        return result;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    PriorityClass & cls = classes[priority];
+
+    auto canRun = [&] ()
+        {
+            return cls.limits.maxRunning < 0
+                || cls.running < cls.limits.maxRunning;
+        };
+
+    if (!cls.waiting.empty() || !canRun()) {
+        if (cls.limits.maxQueued >= 0
+            && cls.waiting.size() >= cls.limits.maxQueued) {
+            ++cls.rejected;
+            throw HttpReturnException
+                (503, "Too many " + string(jobPriorityName(priority))
+                 + " tasks are waiting to run; try again later",
+                 "task", description,
+                 "running", cls.running,
+                 "waiting", (uint64_t)cls.waiting.size());
+        }
+
+        uint64_t id = nextId++;
+        auto it = cls.waiting.insert(cls.waiting.end(), id);
+        auto started = std::chrono::steady_clock::now();
+
+        auto ourTurn = [&] ()
+            {
+                return cls.waiting.front() == id && canRun();
+            };
+
+        auto toWait = [] (double seconds)
+            {
+                return std::chrono::duration_cast<std::chrono::steady_clock::duration>
+                    (std::chrono::duration<double>(seconds));
+            };
+
+        auto deadline = started + toWait(cls.limits.maxWaitSeconds);
+
+        // Nothing wakes us up when the token is cancelled, so we check it
+        // regularly while we wait
+        auto slice = toWait(token ? 0.1 : 3600.0);
+
+        bool admitted = false;
+        bool cancelled = false;
+        for (;;) {
+            if (ourTurn()) {
+                admitted = true;
+                break;
+            }
+            if (token && token->isCancelled()) {
+                cancelled = true;
+                break;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            auto wakeup = now + slice;
+            if (cls.limits.maxWaitSeconds >= 0) {
+                if (now >= deadline)
+                    break;
+                wakeup = std::min(wakeup, deadline);
+            }
+            changed.wait_until(guard, wakeup);
+        }
+
+        cls.waiting.erase(it);
+
+        double waited = std::chrono::duration<double>
+            (std::chrono::steady_clock::now() - started).count();
+        cls.totalWaitSeconds += waited;
+        cls.longestWaitSeconds = std::max(cls.longestWaitSeconds, waited);
+
+        if (cancelled) {
+            ++cls.cancelled;
+            changed.notify_all();
+            throw HttpReturnException
+                (400, "Task was cancelled while waiting to run: "
+                 + token->reason(),
+                 "task", description,
+                 "waitedSeconds", waited);
+        }
+
+        if (!admitted) {
+            ++cls.timedOut;
+            // The next in line may be able to run now
+            changed.notify_all();
+            throw HttpReturnException
+                (503, "Timed out waiting to run " + string(jobPriorityName(priority))
+                 + " task; try again later",
+                 "task", description,
+                 "waitedSeconds", waited,
+                 "running", cls.running);
+        }
+
+        ++cls.queued;
+        // Let the next in line check whether it can run too
+        changed.notify_all();
+    }
+
+    ++cls.admitted;
+    ++cls.running;
+
+    result.owner = this;
+    result.priority = priority;
+    return result;
+}
+
+void
+AdmissionController::
+releaseSlot(JobPriority priority)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    --classes[priority].running;
+    changed.notify_all();
+}
+
+void
+AdmissionController::
+setLimits(JobPriority priority, const Limits & limits)
+{
+    ExcAssertGreaterEqual(priority, 0);
+    ExcAssertLess(priority, NUM_JOB_PRIORITIES);
+    std::unique_lock<std::mutex> guard(mutex);
+    classes[priority].limits = limits;
+    changed.notify_all();
+}
+
+AdmissionController::Limits
+AdmissionController::
+getLimits(JobPriority priority) const
+{
+    ExcAssertGreaterEqual(priority, 0);
+    ExcAssertLess(priority, NUM_JOB_PRIORITIES);
+    std::unique_lock<std::mutex> guard(mutex);
+    return classes[priority].limits;
+}
+
+Json::Value
+AdmissionController::
+getStats() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    Json::Value result;
+    for (int p = 0;  p < NUM_JOB_PRIORITIES;  ++p) {
+        const PriorityClass & cls = classes[p];
+        Json::Value & entry = result[jobPriorityName((JobPriority)p)];
+        entry["maxRunning"] = cls.limits.maxRunning;
+        entry["maxQueued"] = cls.limits.maxQueued;
+        entry["maxWaitSeconds"] = cls.limits.maxWaitSeconds;
+        entry["running"] = cls.running;
+        entry["waiting"] = (uint64_t)cls.waiting.size();
+        entry["admitted"] = cls.admitted;
+        entry["queued"] = cls.queued;
+        entry["rejected"] = cls.rejected;
+        entry["timedOut"] = cls.timedOut;
+        entry["cancelled"] = cls.cancelled;
+        entry["totalWaitSeconds"] = cls.totalWaitSeconds;
+        entry["longestWaitSeconds"] = cls.longestWaitSeconds;
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* TICKET                                                                    */
+/*****************************************************************************/
+
+AdmissionController::Ticket::
+Ticket(Ticket && other)
+    : owner(other.owner), priority(other.priority)
+{
+    other.owner = nullptr;
+}
+
+AdmissionController::Ticket &
+AdmissionController::Ticket::
+operator = (Ticket && other)
+{
+    if (&other == this)
+        return *this;
+    release();
+    owner = other.owner;
+    priority = other.priority;
+    other.owner = nullptr;
+    return *this;
+}
+
+AdmissionController::Ticket::
+~Ticket()
+{
+    release();
+}
+
+void
+AdmissionController::Ticket::
+release()
+{
+    if (!owner)
+        return;
+    owner->releaseSlot(priority);
+    owner = nullptr;
+}
+
+} // namespace MLDB
@@ -0,0 +1,121 @@
+/** admission_control.h                                            -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Admission control for the tasks (queries, procedure runs) that the
+    server runs, by priority class.
+*/
+
+#pragma once
+
+#include "mldb/base/thread_pool.h"
+#include "mldb/types/string.h"
+#include "mldb/ext/jsoncpp/value.h"
+#include <condition_variable>
+#include <list>
+#include <mutex>
+
+
+namespace MLDB {
+
+struct CancellationToken;
+
+
+/*****************************************************************************/
+/* ADMISSION CONTROLLER                                                      */
+/*****************************************************************************/
+
+/** Limits the number of tasks of each priority class that run at once.
+    Tasks over the limit wait in a first-come first-served queue for their
+    class; when the queue is full, or a task waits too long, it is
+    rejected with a 503 error so that the client can retry later.
+
+    This works at the granularity of whole tasks, and complements the
+    per-class thread limits of the ThreadPool which work at the granularity
+    of jobs.
+
+    Admission is reentrant: work done on behalf of a task that was already
+    admitted (for example a procedure that runs a query through the REST
+    API) is not held back again.  Once admitted, a task must mark the
+    threads doing its work as such with a JobPriorityScope; the ThreadPool
+    and background tasks carry the mark along.
+*/
+
+struct AdmissionController {
+
+    /// Limits for a priority class
+    struct Limits {
+        int maxRunning = -1;        ///< Running tasks; -1 is unlimited
+        int maxQueued = -1;         ///< Waiting tasks; -1 is unlimited
+        double maxWaitSeconds = -1; ///< Time to wait; -1 is forever
+    };
+
+    /** Create a controller, with limits taken from the environment. */
+    AdmissionController();
+
+    /** Holds the admission of a task.  The task's slot is released when
+        it is destroyed.
+    */
+    struct Ticket {
+        Ticket() = default;
+        Ticket(Ticket && other);
+        Ticket & operator = (Ticket && other);
+        ~Ticket();
+
+        void release();
+
+        /// Was a slot taken (false for reentrant admissions)?
+        bool holdsSlot() const { return owner; }
+
+    private:
+        friend struct AdmissionController;
+        AdmissionController * owner = nullptr;
+        JobPriority priority = PRIORITY_INTERACTIVE;
+    };
+
+    /** Wait until a task of the given priority class may run, and return
+        its ticket.  The calling thread's job priority is not modified.
+        Returns an empty ticket if the calling thread is already doing
+        admitted work.  Throws an HttpReturnException with a 503 code if
+        the task is rejected, or with a 400 code if the given token is
+        cancelled while the task waits.
+    */
+    Ticket admit(JobPriority priority, const Utf8String & description,
+                 const CancellationToken * token = nullptr);
+
+    void setLimits(JobPriority priority, const Limits & limits);
+
+    Limits getLimits(JobPriority priority) const;
+
+    /** Return the number of tasks running and waiting in each class,
+        along with counters and wait times.
+    */
+    Json::Value getStats() const;
+
+private:
+    void releaseSlot(JobPriority priority);
+
+    struct PriorityClass {
+        Limits limits;
+        int running = 0;
+
+        /// Ids of waiting tasks, in arrival order
+        std::list<uint64_t> waiting;
+
+        uint64_t admitted = 0;
+        uint64_t queued = 0;        ///< Admitted after waiting
+        uint64_t rejected = 0;      ///< Rejected as the queue was full
+        uint64_t timedOut = 0;      ///< Rejected as it waited too long
+        uint64_t cancelled = 0;     ///< Cancelled while it waited
+        double totalWaitSeconds = 0.0;
+        double longestWaitSeconds = 0.0;
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    PriorityClass classes[NUM_JOB_PRIORITIES];
+    uint64_t nextId;
+};
+
+} // namespace MLDB
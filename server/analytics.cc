@@ -11,10 +11,12 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/cancellation.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/sql/execution_pipeline.h"
+#include "mldb/sql/query_profile.h"
 #include <boost/algorithm/string.hpp>
 #include "mldb/server/bound_queries.h"
 #include "mldb/server/parallel_merge_sort.h"
@@ -473,6 +475,11 @@ queryFromStatementExpr(const SelectStatement & stm,
             // released.
             output->group.clear();
 
+            if (n % 1000 == 0) {
+                if (CancellationToken * token = currentCancellationToken())
+                    token->throwIfCancelled();
+            }
+
             if (n < offset) {
                 continue;
             }
@@ -495,6 +502,18 @@ queryFromStatementExpr(const SelectStatement & stm,
     }
 }
 
+/** Record the operators of a pipeline that is explained without being
+    run, from the description returned by BoundPipelineElement::explain().
+*/
+static void addPlanOperators(const Json::Value & plan)
+{
+    auto op = QueryProfile::addOperator(plan["operator"].asStringUtf8(),
+                                        plan["details"]);
+    QueryProfile::Nest nest(op);
+    for (auto & input: plan["inputs"])
+        addPlanOperators(input);
+}
+
 /** Select from the given statement.  This will choose the most
     appropriate execution method based upon what is in the query.
 
@@ -522,7 +541,8 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
              stm.having,
              stm.rowName,
              stm.offset, stm.limit, 
-             table.asName);
+             table.asName,
+             onProgress);
     }
     else if (table.table.runQuery && stm.from) {
 
@@ -543,7 +563,14 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
 
         auto boundPipeline = pipeline->bind();
 
-        auto executor = boundPipeline->start(params);
+        // Starting a pipeline can already read rows, so when explaining
+        // without running we record the plan and stop here
+        if (QueryProfile::current() && !QueryProfile::current()->analyze) {
+            addPlanOperators(boundPipeline->explain());
+            return true;
+        }
+
+        auto executor = BoundPipelineElement::startInput(boundPipeline, params);
         
         std::vector<MatrixNamedRow> rows;
 
@@ -561,6 +588,11 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
             // released.
             output->group.clear();
 
+            if (n % 1000 == 0) {
+                if (CancellationToken * token = currentCancellationToken())
+                    token->throwIfCancelled();
+            }
+
             if (n < offset) {
                 continue;
             }
@@ -576,7 +608,19 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
     }
     else {
         // No from at all
-        auto rows = queryWithoutDataset(stm, scope);
+        Json::Value details;
+        details["select"] = stm.select.surface;
+        auto profile = QueryProfile::addOperator("selectWithoutFrom", details);
+        if (profile && !QueryProfile::current()->analyze)
+            return true;
+
+        std::vector<MatrixNamedRow> rows;
+        {
+            OperatorProfile::Activity activity(profile.get());
+            rows = queryWithoutDataset(stm, scope);
+            if (profile)
+                profile->rowsOut = rows.size();
+        }
         for (auto & r: rows) {
             ExpressionValue val(std::move(r.columns));
             if (!onRow(r.rowName, val))
@@ -586,6 +630,35 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
     }
 }
 
+Json::Value
+explainStatement(const SelectStatement & stm,
+                 SqlBindingScope & scope,
+                 bool analyze,
+                 BoundParameters params)
+{
+    QueryProfile profile(analyze);
+
+    {
+        QueryProfile::Scope profileScope(profile);
+        OperatorProfile::Activity activity(analyze ? profile.root.get() : nullptr,
+                                           true /* measureMemory */);
+
+        // The output is discarded; only its size is recorded
+        std::function<bool (Path &, ExpressionValue &)> onRow
+            = [&] (Path & rowName, ExpressionValue & val)
+            {
+                profile.root->rowsOut += 1;
+                return true;
+            };
+
+        queryFromStatement(onRow, stm, scope, params, nullptr /* onProgress */);
+    }
+
+    Json::Value result = profile.toJson();
+    result["statement"] = stm.surface;
+    return result;
+}
+
 RowPath getValidatedRowName(const ExpressionValue& rowNameEV)
 {
     RowPath name;
@@ -207,6 +207,19 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
                    BoundParameters params = nullptr,
                    const ProgressFunc & onProgress = nullptr);
 
+/** Explain how the given statement is executed, as a tree of operators
+    (see QueryProfile).  With analyze (EXPLAIN ANALYZE), the statement is
+    run with its output discarded, and each operator reports its wall and
+    CPU time, rows in and out, heap growth and number of threads.
+    Otherwise (EXPLAIN), the statement is bound but not run, and only the
+    plan is returned.
+*/
+Json::Value
+explainStatement(const SelectStatement & stm,
+                 SqlBindingScope & scope,
+                 bool analyze,
+                 BoundParameters params = nullptr);
+
 /** Build a RowPath from an expression value and throw if
     it is not valid (row, empty, etc)
 */
@@ -10,12 +10,14 @@
 #include "mldb/core/dataset.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/metrics.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/server/parallel_merge_sort.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/sql/sql_utils.h"
+#include "mldb/sql/query_profile.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/utils/log.h"
 #include "mldb/arch/demangle.h"
@@ -36,9 +38,30 @@ int numCpus();
 
 namespace MLDB {
 
+namespace {
+
+const Counter & rowsScanned()
+{
+    static const Counter result
+        = MetricsRegistry::instance()
+        .counter("mldb_query_rows_scanned_total",
+                 "Rows of datasets scanned by queries");
+    return result;
+}
+
+} // file scope
+
 const int MIN_ROW_PER_TASK = 32;
 const int TASK_PER_THREAD = 8;
 
+/// Number of rows that are produced in parallel before being passed, in
+/// order, to a sequential row processor.
+const size_t OUTPUT_BLOCK_SIZE = 16384;
+
+/// Number of rows whose select expression is evaluated together, when it
+/// calls functions that can process many rows at once.
+const size_t FUNCTION_BATCH_SIZE = 256;
+
 __thread int QueryThreadTracker::depth = 0;
 
 
@@ -91,6 +114,24 @@ struct BoundSelectQuery::Executor {
     }
 
     virtual std::shared_ptr<ExpressionValueInfo> getOutputInfo() const = 0;
+
+    /// Records the execution when the query is being explained
+    std::shared_ptr<OperatorProfile> profile;
+
+    /// If true, the query is only being explained (EXPLAIN without
+    /// ANALYZE), and must not be run
+    bool planOnly = false;
+
+    /** Add a stage of the execution to the profile.  Returns null when
+        the query isn't being explained.
+    */
+    std::shared_ptr<OperatorProfile> addStage(Utf8String name)
+    {
+        if (!profile)
+            return nullptr;
+        QueryProfile::Nest nest(profile);
+        return QueryProfile::addOperator(std::move(name));
+    }
 };
 
 struct UnorderedExecutor: public BoundSelectQuery::Executor {
@@ -104,6 +145,9 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
     int numBuckets;
     std::shared_ptr<spdlog::logger> logger;
 
+    /// Stage that evaluates the rows, when the query is being explained
+    std::shared_ptr<OperatorProfile> scanStage;
+
 
     typedef std::function<bool (NamedRowValue & output,
                                              std::vector<ExpressionValue> & calcd,
@@ -164,7 +208,22 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
 
         // Get a list of rows that we run over
         // Ordering is arbitrary but deterministic
-        auto rows = whereGenerator(-1, Any(), BoundParameters(), onProgress).first;
+        std::vector<RowPath> rows;
+        {
+            auto generateStage = addStage("generateRows");
+            OperatorProfile::Activity activity(generateStage.get(),
+                                               true /* measureMemory */);
+            rows = whereGenerator(-1, Any(), BoundParameters(), onProgress).first;
+            rowsScanned().inc(rows.size());
+            if (generateStage)
+                generateStage->rowsOut = rows.size();
+        }
+
+        scanStage = addStage("scan");
+        OperatorProfile::Activity scanActivity(scanStage.get(),
+                                               true /* measureMemory */);
+        if (scanStage)
+            scanStage->rowsIn = rows.size();
 
         //cerr << "ROWS MEMORY SIZE " << rows.size() * sizeof(RowName) << endl;
 
@@ -178,6 +237,10 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         size_t numRows = rows.size();
         size_t numPerBucket = std::max((size_t)std::floor((float)numRows / numBuckets), (size_t)1);
         size_t effectiveNumBucket = std::min((size_t)numBuckets, numRows);
+        // Does the select call functions that prefer to see many rows
+        // at once?
+        bool batchSelect = !selectStar && boundSelect.supportsBatch();
+
         std::atomic_ulong rowCount(0);
         ProgressState progress(numRows);
         auto doRow = [&] (size_t rowNum) -> bool
@@ -208,6 +271,37 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                                  std::get<2>(output), bucketNumber);
             };
 
+        // Same as doRow, for the rows in [begin, end) together
+        auto doRows = [&] (size_t begin, size_t end) -> bool
+            {
+                size_t before = rowCount.fetch_add(end - begin);
+                if (onProgress
+                    && before / PROGRESS_RATE != (before + end - begin) / PROGRESS_RATE) {
+                    progress = before + end - begin;
+                    if (!onProgress(progress)) {
+                        DEBUG_MSG(logger) << "dataset iteration was cancelled";
+                        return false;
+                    }
+                }
+
+                std::vector<RowPath> rowNames(rows.begin() + begin,
+                                              rows.begin() + end);
+                auto output = processRows(rowNames);
+
+                for (size_t i = 0;  i < output.size();  ++i) {
+                    size_t rowNum = begin + i;
+                    int bucketNumber
+                        = numBuckets > 0
+                        ? std::min((size_t)(rowNum/numPerBucket), (size_t)(numBuckets-1))
+                        : -1;
+
+                    if (!processor(std::get<0>(output[i]), std::get<1>(output[i]),
+                                   std::get<2>(output[i]), bucketNumber))
+                        return false;
+                }
+                return true;
+            };
+
         if (numBuckets > 0) {
             ExcAssert(processInParallel);
             ExcAssertEqual(limit, -1);
@@ -217,6 +311,15 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 {
                     size_t it = bucketNumber * numPerBucket;
                     int stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
+                    if (batchSelect) {
+                        for (; it < stopIt;  it += FUNCTION_BATCH_SIZE) {
+                            if (!doRows(it, std::min<size_t>(it + FUNCTION_BATCH_SIZE,
+                                                             stopIt)))
+                                return false;
+                        }
+                        return true;
+                    }
+
                     for (; it < stopIt; ++it)
                     {
                         if (!doRow(it))
@@ -235,20 +338,35 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 upper = std::min((size_t)(offset+limit), upper);
 
             if (offset <= upper) {
-                if (processInParallel) {
+                if (processInParallel && batchSelect) {
+                    DEBUG_MSG(logger) << "iterating row batches in parallel";
+                    size_t numBatches = (upper - offset + FUNCTION_BATCH_SIZE - 1)
+                        / FUNCTION_BATCH_SIZE;
+                    auto doBatch = [&] (size_t batch) -> bool
+                        {
+                            size_t begin = offset + batch * FUNCTION_BATCH_SIZE;
+                            size_t end = std::min(begin + FUNCTION_BATCH_SIZE, upper);
+                            return doRows(begin, end);
+                        };
+                    return parallelMapHaltable(0, numBatches, doBatch);
+                }
+                else if (processInParallel) {
                     DEBUG_MSG(logger) << "iterating rows in parallel";
                     return parallelMapHaltable(offset, upper, doRow);
                 }
                 else {
-                    // TODO: to reduce memory usage, we should fill blocks of
-                    // output on worker threads
-                    // in order as much as possible
-                    // while calling the aggregator on the caller thread.
+                    // Fill blocks of output on worker threads, and pass
+                    // each block in order to the processor on the caller
+                    // thread.  Only one block of output is held in memory
+                    // at once, and a processor that is slow to consume its
+                    // rows (for example when streaming them to a client)
+                    // holds back the production of the following blocks.
                     ExcAssert(offset >= 0 && offset <= upper);
                     std::vector<std::tuple<Path, ExpressionValue, std::vector<ExpressionValue> > >
-                        output(upper-offset);
+                        output;
                 
                     ProgressState progress(upper-offset);
+                    size_t blockStart = offset;
                     auto copyRow = [&] (int rowNum) -> bool
                         {
                             if (rowNum % PROGRESS_RATE == 0) {
@@ -263,19 +381,55 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                             auto row = dataset.getRowExpr(rows[rowNum]);
                             auto outputRow = processRow(rows[rowNum], row, rowNum,
                                                         numPerBucket, selectStar);
-                            output[rowNum-offset] = std::move(outputRow);
+                            output[rowNum-blockStart] = std::move(outputRow);
                             return true;
                         };
 
-                    DEBUG_MSG(logger) << "iterating rows sequentially";
-                    if (!parallelMapHaltable(offset, upper, copyRow))
-                        return false;
+                    auto copyRows = [&] (size_t batch) -> bool
+                        {
+                            size_t begin = blockStart + batch * FUNCTION_BATCH_SIZE;
+                            size_t end = std::min(begin + FUNCTION_BATCH_SIZE,
+                                                  std::min(blockStart + OUTPUT_BLOCK_SIZE,
+                                                           upper));
+                            if (onProgress
+                                && (begin - offset) / PROGRESS_RATE
+                                   != (end - offset) / PROGRESS_RATE) {
+                                progress = end - offset;
+                                if (!onProgress(progress)) {
+                                    DEBUG_MSG(logger) << "dataset iteration was cancelled";
+                                    return false;
+                                }
+                            }
+                            std::vector<RowPath> rowNames(rows.begin() + begin,
+                                                          rows.begin() + end);
+                            auto outputRows = processRows(rowNames);
+                            for (size_t i = 0;  i < outputRows.size();  ++i)
+                                output[begin + i - blockStart] = std::move(outputRows[i]);
+                            return true;
+                        };
 
-                    for (size_t i = offset; i < upper; ++i) {
-                        auto& outputRow = output[i-offset];
-                        if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
-                                       std::get<2>(outputRow), -1))
+                    DEBUG_MSG(logger) << "iterating rows sequentially";
+                    for (;  blockStart < upper;  blockStart += OUTPUT_BLOCK_SIZE) {
+                        size_t blockEnd = std::min(blockStart + OUTPUT_BLOCK_SIZE,
+                                                   upper);
+                        output.clear();
+                        output.resize(blockEnd - blockStart);
+
+                        if (batchSelect) {
+                            size_t numBatches
+                                = (blockEnd - blockStart + FUNCTION_BATCH_SIZE - 1)
+                                / FUNCTION_BATCH_SIZE;
+                            if (!parallelMapHaltable(0, numBatches, copyRows))
+                                return false;
+                        }
+                        else if (!parallelMapHaltable(blockStart, blockEnd, copyRow))
                             return false;
+
+                        for (auto & outputRow: output) {
+                            if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
+                                           std::get<2>(outputRow), -1))
+                                return false;
+                        }
                     }
                 }
             }
@@ -310,6 +464,12 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         bool selectStar = boundSelect.expr->isIdentitySelect(context);
 
         int64_t numRows = whereGenerator.rowStreamTotalRows;
+
+        scanStage = addStage("scan");
+        OperatorProfile::Activity scanActivity(scanStage.get(),
+                                               true /* measureMemory */);
+        if (scanStage)
+            scanStage->rowsIn = numRows;
         
         size_t numPerBucket = std::max((size_t)std::floor((float)numRows / numBuckets), (size_t)1);
         size_t effectiveNumBucket = std::min((size_t)numBuckets, (size_t)numRows);
@@ -320,6 +480,8 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
 
         ExcAssert(processInParallel);
 
+        bool batchSelect = !selectStar && boundSelect.supportsBatch();
+
         std::atomic_ulong bucketCount(0);
         ProgressState progress(effectiveNumBucket);
         auto doBucket = [&] (int bucketNumber) -> bool
@@ -328,6 +490,24 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                 int stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
                 auto stream = whereGenerator.rowStream->clone();
                 stream->initAt(it);
+                while (batchSelect && it < stopIt) {
+                    size_t end = std::min<size_t>(it + FUNCTION_BATCH_SIZE, stopIt);
+                    std::vector<RowPath> rowNames;
+                    rowNames.reserve(end - it);
+                    for (size_t i = it;  i < end;  ++i)
+                        rowNames.emplace_back(stream->next());
+
+                    auto output = processRows(rowNames);
+                    for (auto & outputRow: output) {
+                        int bucketNumber
+                            = std::min((size_t)(it/numPerBucket),
+                                       (size_t)(numBuckets-1));
+                        ++it;
+                        if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
+                                       std::get<2>(outputRow), bucketNumber))
+                            return false;
+                    }
+                }
                 for (;  it < stopIt; ++it) {
                     RowPath rowName = stream->next();
                     auto row = dataset.getRowExpr(rowName);
@@ -353,6 +533,54 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         return parallelMapHaltable(0, effectiveNumBucket, doBucket);
     }
 
+    /** Same as processRow(), for a batch of rows which are all selected
+        together.  This is used when the select expression can evaluate
+        many rows more efficiently than one at a time.
+    */
+    std::vector<std::tuple<RowPath, ExpressionValue, std::vector<ExpressionValue> > >
+    processRows(const std::vector<RowPath> & rowNames)
+    {
+        size_t n = rowNames.size();
+
+        std::vector<ExpressionValue> rows;
+        rows.reserve(n);
+        for (auto & rowName: rowNames)
+            rows.emplace_back(dataset.getRowExpr(rowName));
+
+        std::vector<std::tuple<RowPath, ExpressionValue, std::vector<ExpressionValue> > >
+            output(n);
+        std::vector<SqlExpressionDatasetScope::RowScope> scopes;
+        scopes.reserve(n);
+        std::vector<const SqlRowScope *> scopePtrs;
+        scopePtrs.reserve(n);
+
+        for (size_t i = 0;  i < n;  ++i) {
+            auto rowContext = context.getRowScope(rowNames[i], rows[i]);
+            whenBound.filterInPlace(rows[i], rowContext);
+
+            scopes.emplace_back(context.getRowScope(rowNames[i], rows[i]));
+            scopePtrs.push_back(&scopes.back());
+
+            std::get<0>(output[i]) = rowNames[i];
+            vector<ExpressionValue>& calcd = std::get<2>(output[i]);
+            calcd.resize(boundCalc.size());
+            for (unsigned j = 0;  j < boundCalc.size();  ++j) {
+                calcd[j] = boundCalc[j](scopes.back(), GET_LATEST);
+            }
+        }
+
+        auto selected = boundSelect.applyBatch(scopePtrs, GET_ALL);
+        for (size_t i = 0;  i < n;  ++i)
+            std::get<1>(output[i]) = std::move(selected[i]);
+
+        if (scanStage) {
+            scanStage->noteThread();
+            scanStage->rowsOut += n;
+        }
+
+        return output;
+    }
+
     std::tuple<RowPath, ExpressionValue, std::vector<ExpressionValue> >
     processRow(const RowPath & rowName,
                ExpressionValue & row,
@@ -388,6 +616,11 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
             std::get<1>(output) = boundSelect(selectRowScope, GET_ALL);
         }
 
+        if (scanStage) {
+            scanStage->noteThread();
+            scanStage->rowsOut += 1;
+        }
+
         return output;
     }
 
@@ -441,7 +674,16 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
 
         // Get a list of rows that we run over
         // Ordering is arbitrary but deterministic
-        auto rows = whereGenerator(-1, Any()).first;
+        std::vector<RowPath> rows;
+        {
+            auto generateStage = addStage("generateRows");
+            OperatorProfile::Activity activity(generateStage.get(),
+                                               true /* measureMemory */);
+            rows = whereGenerator(-1, Any()).first;
+            rowsScanned().inc(rows.size());
+            if (generateStage)
+                generateStage->rowsOut = rows.size();
+        }
 
         // cerr << "doing " << rows.size() << " rows with order by" << endl;
         // We have a defined order, so we need to sort here
@@ -465,6 +707,8 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         std::atomic<int64_t> rowsAdded(0);
         ProgressState progress(rows.size());
 
+        auto scanStage = addStage("scan");
+
         auto doWhere = [&] (int rowNum) -> bool
             {
                 QueryThreadTracker childTracker = parentTracker.child();
@@ -517,29 +761,39 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                                          std::move(calcd));
 
                 ++rowsAdded;
+                if (scanStage)
+                    scanStage->noteThread();
                 return true;
             };
 
-        Timer timer;
-
-        if (!parallelMapHaltable(0, rows.size(), doWhere)) {
-            return false;  // the processing has been cancelled
+        {
+            OperatorProfile::Activity activity(scanStage.get(),
+                                               true /* measureMemory */);
+            if (!parallelMapHaltable(0, rows.size(), doWhere)) {
+                return false;  // the processing has been cancelled
+            }
+            if (scanStage) {
+                scanStage->rowsIn = rows.size();
+                scanStage->rowsOut = rowsAdded;
+            }
         }
 
-        //cerr << "map took " << timer.elapsed() << endl;
-        timer.restart();
-        
         // Compare two rows according to the sort criteria
         auto compareRows = [&] (const SortedRow & row1,
                                 const SortedRow & row2) -> bool
             {
                 return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
             };
-            
-        auto rowsSorted = parallelMergeSort(accum.threads, compareRows);
 
-        //cerr << "shuffle took " << timer.elapsed() << endl;
-        timer.restart(); 
+        auto sortStage = addStage("sort");
+        std::vector<SortedRow> rowsSorted;
+        {
+            OperatorProfile::Activity activity(sortStage.get(),
+                                               true /* measureMemory */);
+            rowsSorted = parallelMergeSort(accum.threads, compareRows);
+            if (sortStage)
+                sortStage->rowsOut = rowsSorted.size();
+        }
 
         // Now select only the required subset of sorted rows
         if (limit == -1)
@@ -607,9 +861,6 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
             }
         }
 
-     
-
-        cerr << "reduce took " << timer.elapsed() << endl;
 
         return true;
     }
@@ -689,24 +940,29 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
         QueryThreadTracker parentTracker;
 
-        Timer rowsTimer;
-
         // Get a list of rows that we run over
         // Ordering is arbitrary but deterministic
-        auto rows = whereGenerator(-1, Any()).first;
+        std::vector<RowPath> rows;
+        {
+            auto generateStage = addStage("generateRows");
+            OperatorProfile::Activity activity(generateStage.get(),
+                                               true /* measureMemory */);
+            rows = whereGenerator(-1, Any()).first;
+            rowsScanned().inc(rows.size());
+
+            if (!std::is_sorted(rows.begin(), rows.end(), SortByRowHash()))
+                std::sort(rows.begin(), rows.end(), SortByRowHash());
 
-        if (!std::is_sorted(rows.begin(), rows.end(), SortByRowHash()))
-            std::sort(rows.begin(), rows.end(), SortByRowHash());
+            if (generateStage)
+                generateStage->rowsOut = rows.size();
+        }
 
         //cerr << "ROWS MEMORY SIZE " << rows.size() * sizeof(RowName) << endl;
 
-        cerr << "Generated " << rows.size() << " rows in "
-             << rowsTimer.elapsed()
-             << " on " << (rowsTimer.elapsed_cpu() / rowsTimer.elapsed_wall()) << " cpus "
-             << " at " << rows.size() / rowsTimer.elapsed_wall() << "/second and "
-             << rows.size() / rowsTimer.elapsed_cpu() << " /cpu-second" << endl;
-        
-        Timer scanTimer;
+        auto scanStage = addStage("scan");
+        std::unique_ptr<OperatorProfile::Activity> scanActivity
+            (new OperatorProfile::Activity(scanStage.get(),
+                                           true /* measureMemory */));
 
         // Special but exceedingly common case: we sort by row hash.
 
@@ -792,6 +1048,9 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                         selectOutput.mergeToRowDestructive(outputRow.columns);
                     }
 
+                    if (scanStage)
+                        scanStage->noteThread();
+
                     std::unique_lock<Spinlock> guard(mutex);
                     sorted.emplace_back(outputRow.rowHash,
                                         std::move(outputRow),
@@ -838,9 +1097,13 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                                         (offset + limit) / hitRate));
             }
 
-            cerr << "hit rate after " << numProcessed << " is "
-                 << 100.0 * hitRate << "%; estimate that we need to scan "
-                 << numRequired << " rows in total" << endl;
+            if (scanStage) {
+                Json::Value estimate;
+                estimate["after"] = numProcessed;
+                estimate["hitRate"] = hitRate;
+                estimate["rowsRequired"] = numRequired;
+                scanStage->details["estimates"].append(estimate);
+            }
 
             // Do another block
             if (numRequired - numProcessed <= 100) {
@@ -859,12 +1122,15 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
         //cerr << "got " << maxRowNumNeeded << " rows with min row num " << minRowNum << endl;
         //cerr << "sorted.size() = " << sorted.size() << endl;
-        cerr << "Scanned " << sorted.size() << " in " << scanTimer.elapsed()
-             << " on " << (scanTimer.elapsed_cpu() / scanTimer.elapsed_wall()) << " cpus "
-             << " at " << sorted.size() / scanTimer.elapsed_wall() << "/second and "
-             << sorted.size() / scanTimer.elapsed_cpu() << " /cpu-second" << endl;
+        if (scanStage) {
+            scanStage->rowsIn = numProcessed;
+            scanStage->rowsOut = sorted.size();
+        }
+        scanActivity.reset();
 
-        scanTimer.restart();
+        auto sortStage = addStage("sort");
+        std::unique_ptr<OperatorProfile::Activity> sortActivity
+            (new OperatorProfile::Activity(sortStage.get()));
 
         // Now select only the required subset of sorted rows
         if (limit == -1)
@@ -885,12 +1151,9 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
 
         ExcAssertGreaterEqual(offset, 0);
 
-        cerr << "Sorted " << sorted.size() << " in " << scanTimer.elapsed()
-             << " on " << (scanTimer.elapsed_cpu() / scanTimer.elapsed_wall()) << " cpus "
-             << " at " << sorted.size() / scanTimer.elapsed_wall() << "/second and "
-             << sorted.size() / scanTimer.elapsed_cpu() << " /cpu-second" << endl;
-
-        scanTimer.restart();
+        if (sortStage)
+            sortStage->rowsOut = limit;
+        sortActivity.reset();
 
         ssize_t begin = std::min<ssize_t>(offset, sorted.size());
         ssize_t end = std::min<ssize_t>(offset + limit, sorted.size());
@@ -923,11 +1186,6 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                 return false;
         }
 
-        cerr << "Output " << sorted.size() << " in " << scanTimer.elapsed()
-             << " on " << (scanTimer.elapsed_cpu() / scanTimer.elapsed_wall()) << " cpus "
-             << " at " << sorted.size() / scanTimer.elapsed_wall() << "/second and "
-             << sorted.size() / scanTimer.elapsed_cpu() << " /cpu-second" << endl;
-
         return true;
     }
 
@@ -947,8 +1205,6 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
         if (limit == 0)
           throw HttpReturnException(400, "limit must be non-zero");
 
-        Timer rowsTimer;
-
         typedef std::vector<RowPath> AccumRows;
         
         PerThreadAccumulator<AccumRows> accum;
@@ -1006,7 +1262,21 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
           }
         };      
 
-        parallelMap(0, numChunk, doChunk);        
+        {
+            // Each chunk keeps the rows with the lowest hashes
+            auto generateStage = addStage("generateRows");
+            OperatorProfile::Activity activity(generateStage.get(),
+                                               true /* measureMemory */);
+            parallelMap(0, numChunk, doChunk);
+            rowsScanned().inc(upperBound);
+            if (generateStage) {
+                generateStage->rowsIn = upperBound;
+                accum.forEach([&] (AccumRows * rows)
+                              {
+                                  generateStage->rowsOut += rows->size();
+                              });
+            }
+        }
        
         // Compare two rows according to the sort criteria
         auto compareRows = [&] (const RowPath & row1,
@@ -1014,8 +1284,15 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
             {
                 return RowHash(row1) < RowHash(row2);
             };
-            
-        auto rowsMerged = parallelMergeSort(accum.threads, compareRows);
+
+        std::vector<RowPath> rowsMerged;
+        {
+            auto sortStage = addStage("sort");
+            OperatorProfile::Activity activity(sortStage.get());
+            rowsMerged = parallelMergeSort(accum.threads, compareRows);
+            if (sortStage)
+                sortStage->rowsOut = rowsMerged.size();
+        }
         
         if (rowsMerged.size() < offset )
             return true;
@@ -1030,6 +1307,12 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
          // Do we select *?  In that case we can avoid a lot of copying
         bool selectStar = boundSelect.expr->isIdentitySelect(context);
 
+        auto scanStage = addStage("scan");
+        OperatorProfile::Activity scanActivity(scanStage.get(),
+                                               true /* measureMemory */);
+        if (scanStage)
+            scanStage->rowsIn = rowsMerged.size();
+
         // TODO: parallel...
         int count = 0;
         for (auto & r : rowsMerged) {
@@ -1059,6 +1342,8 @@ struct RowHashOrderedExecutor: public BoundSelectQuery::Executor {
                 ExpressionValue selectOutput = boundSelect(rowContext, GET_ALL);
                 selectOutput.mergeToRowDestructive(outputRow.columns);
             }
+            if (scanStage)
+                scanStage->rowsOut += 1;
             if (!processor(outputRow, calcd, count))
                 return false;
 
@@ -1135,8 +1420,20 @@ BoundSelectQuery(const SelectExpression & select,
             newOrderBy.clauses.emplace_back(SqlExpression::parse("rowHash()"), ASC);
         }
  
+        // Describe the plan, in case the query is being explained
+        Json::Value details;
+        details["rowGenerator"] = whereGenerator.explain;
+        details["rowStream"] = !!whereGenerator.rowStream;
+        details["select"] = select.surface;
+        details["where"] = where.surface;
+        if (!orderBy.clauses.empty())
+            details["orderBy"] = orderBy.surface;
+        if (numBuckets > 0)
+            details["numBuckets"] = numBuckets;
+
         if (orderByRowHash) {
             ExcAssert(numBuckets < 0);
+            details["strategy"] = "rowHashOrdered";
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(RowHashOrderedExecutor));
             executor.reset(new RowHashOrderedExecutor(from,
                                                       std::move(whereGenerator),
@@ -1150,6 +1447,7 @@ BoundSelectQuery(const SelectExpression & select,
         }
         else if (!newOrderBy.clauses.empty()) {
             ExcAssert(numBuckets < 0);
+            details["strategy"] = "ordered";
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(OrderedExecutor));
             executor.reset(new OrderedExecutor(from,
                                                std::move(whereGenerator),
@@ -1160,6 +1458,7 @@ BoundSelectQuery(const SelectExpression & select,
                                                std::move(newOrderBy),
                                                select.distinctExpr.size()));
         } else {
+            details["strategy"] = "unordered";
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(UnorderedExecutor));
             executor.reset(new UnorderedExecutor(from,
                                                  std::move(whereGenerator),
@@ -1172,6 +1471,11 @@ BoundSelectQuery(const SelectExpression & select,
                                                  logger));
         }
 
+        if (auto profile = QueryProfile::current()) {
+            executor->profile = QueryProfile::addOperator("select", details);
+            executor->planOnly = !profile->analyze;
+        }
+
     } MLDB_CATCH_ALL {
         rethrowHttpException(KEEP_HTTP_CODE, "Binding error: "
                              + getExceptionString(),
@@ -1216,6 +1520,23 @@ execute(std::function<bool (NamedRowValue & output,
 
     ExcAssert(processor);
 
+    if (executor->planOnly)
+        return true;
+
+    auto profile = executor->profile;
+    OperatorProfile::Activity activity(profile.get(), true /* measureMemory */);
+    QueryProfile::Nest nest(profile);
+    if (profile) {
+        auto inner = std::move(processor);
+        processor = [=] (NamedRowValue & output,
+                         std::vector<ExpressionValue> & calcd,
+                         int groupNum)
+            {
+                profile->rowsOut += 1;
+                return inner(output, calcd, groupNum);
+            };
+    }
+
     try {
         return executor->execute(processor, processInParallel, offset, limit, onProgress);
     } MLDB_CATCH_ALL {
@@ -1265,6 +1586,24 @@ executeExpr(std::function<bool (Path & rowName,
 
     ExcAssert(processor);
 
+    if (executor->planOnly)
+        return true;
+
+    auto profile = executor->profile;
+    OperatorProfile::Activity activity(profile.get(), true /* measureMemory */);
+    QueryProfile::Nest nest(profile);
+    if (profile) {
+        auto inner = std::move(processor);
+        processor = [=] (Path & rowName,
+                         ExpressionValue & output,
+                         std::vector<ExpressionValue> & calcd,
+                         int groupNum)
+            {
+                profile->rowsOut += 1;
+                return inner(rowName, output, calcd, groupNum);
+            };
+    }
+
     try {
         return executor->executeExpr(processor, processInParallel,
                                      offset, limit, onProgress);
@@ -1640,7 +1979,8 @@ BoundGroupByQuery(const SelectExpression & select,
       having(having.shallowCopy()),
       orderBy(orderBy),
       numBuckets(1),
-      logger(getMldbLog<BoundGroupByQuery>())
+      logger(getMldbLog<BoundGroupByQuery>()),
+      planOnly(false)
 {
     for (auto & g: groupBy.clauses) {
         calc.push_back(g);
@@ -1662,6 +2002,18 @@ BoundGroupByQuery(const SelectExpression & select,
     numBuckets = maxNumRow <= maxNumTask*MIN_ROW_PER_TASK? maxNumRow / maxNumTask : maxNumTask;
     numBuckets = std::max(numBuckets, (size_t)1U);
 
+    // Describe the plan, in case the query is being explained.  The
+    // select that feeds the groups is recorded as its input.
+    if (auto queryProfile = QueryProfile::current()) {
+        Json::Value details;
+        details["groupBy"] = groupBy.surface;
+        details["having"] = having.surface;
+        details["numBuckets"] = numBuckets;
+        profile = QueryProfile::addOperator("groupBy", details);
+        planOnly = !queryProfile->analyze;
+    }
+    QueryProfile::Nest nest(profile);
+
     // bind the subselect
     //false means no implicit sort by rowhash, we want unsorted
     subSelect.reset(new BoundSelectQuery(subSelectExpr, from, alias, when, where, subOrderBy, calc, numBuckets));
@@ -1740,6 +2092,19 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
+    if (planOnly)
+        return {true, selectInfo};
+
+    OperatorProfile::Activity activity(profile.get(), true /* measureMemory */);
+    QueryProfile::Nest nest(profile);
+
+    auto output = [&] (NamedRowValue & row)
+        {
+            if (profile)
+                profile->rowsOut += 1;
+            return processor(row);
+        };
+
     // When we get a row, we record it under the group key
     auto onRow = [&] (NamedRowValue & row,
                       const std::vector<ExpressionValue> & calc,
@@ -1766,6 +2131,10 @@ execute(RowProcessor processor,
     //merge the maps in fixed order
     GroupByMapType destMap;
     std::vector<GroupByMapType>& threads = accum;
+    auto mergeStage = profile ? QueryProfile::addOperator("merge") : nullptr;
+    std::unique_ptr<OperatorProfile::Activity> mergeActivity
+        (new OperatorProfile::Activity(mergeStage.get(),
+                                       true /* measureMemory */));
     if (threads.size() > 0)
     {
 //        STACK_PROFILE(MergingBuckets);
@@ -1793,6 +2162,20 @@ execute(RowProcessor processor,
         groupContext->initializePerThreadAggregators(pair.first->second);
     }
 
+    if (mergeStage) {
+        for (auto & srcMap: threads)
+            mergeStage->rowsIn += srcMap.size();
+        mergeStage->rowsOut = destMap.size();
+    }
+    mergeActivity.reset();
+
+    auto aggregateStage
+        = profile ? QueryProfile::addOperator("aggregate") : nullptr;
+    std::unique_ptr<OperatorProfile::Activity> aggregateActivity
+        (new OperatorProfile::Activity(aggregateStage.get()));
+    if (aggregateStage)
+        aggregateStage->rowsIn = destMap.size();
+
     //output rows
     //each entry in the final map should be an output row for us   
     for (auto it = destMap.begin(); it != destMap.end(); ++it)
@@ -1811,6 +2194,9 @@ execute(RowProcessor processor,
         if (!havingResult.isTrue())
             continue;
 
+        if (aggregateStage)
+            aggregateStage->rowsOut += 1;
+
         outputRow.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
         outputRow.rowHash = outputRow.rowName;        
 
@@ -1824,7 +2210,7 @@ execute(RowProcessor processor,
             if (limit != -1 && n >= limit)
                break;
 
-            processor(outputRow);
+            output(outputRow);
         }
         else
         {
@@ -1840,6 +2226,8 @@ execute(RowProcessor processor,
         }           
     }
 
+    aggregateActivity.reset();
+
     if (boundOrderBy.empty())
         return {true, selectInfo};
 
@@ -1852,7 +2240,13 @@ execute(RowProcessor processor,
         };
 
     // Sort our output rows
-    std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
+    {
+        auto sortStage = profile ? QueryProfile::addOperator("sort") : nullptr;
+        OperatorProfile::Activity activity(sortStage.get());
+        std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
+        if (sortStage)
+            sortStage->rowsOut = rowsSorted.size();
+    }
 
     // Now select only the required subset of sorted rows
     if (limit == -1)
@@ -1897,7 +2291,7 @@ execute(RowProcessor processor,
             auto & row = std::get<1>(rowsSorted[i]);
 
             /* Finally, pass to the terminator to continue. */
-            if (!processor(row))
+            if (!output(row))
                 return {false, selectInfo}; //early exis on processor error
 
             if (count - offset == limit)
@@ -1914,7 +2308,7 @@ execute(RowProcessor processor,
             auto & row = std::get<1>(rowsSorted[i]);
 
             /* Finally, pass to the terminator to continue. */
-            if (!processor(row))
+            if (!output(row))
                 return {false, selectInfo}; //early exis on processor error
         } 
     }  
@@ -17,6 +17,7 @@ namespace MLDB {
 
 struct GroupContext;
 struct SqlExpressionDatasetScope;
+struct OperatorProfile;
 
 
 /** This object is designed to track whether a thread is executing a
@@ -193,6 +194,12 @@ struct BoundGroupByQuery {
 
     std::shared_ptr<spdlog::logger> logger;
 
+    /// Records the execution when the query is being explained
+    std::shared_ptr<OperatorProfile> profile;
+
+    /// If true, the query is only being explained (EXPLAIN without
+    /// ANALYZE), and must not be run
+    bool planOnly;
 };
 
 } // namespace MLDB
@@ -0,0 +1,517 @@
+/** columnar_output.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Binary columnar serialization of query results.
+*/
+
+#include "mldb/server/columnar_output.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/http/http_exception.h"
+#include <unordered_map>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+template<typename T>
+void appendPod(std::string & out, T val)
+{
+    static_assert(std::is_pod<T>::value, "appendPod requires a POD type");
+    out.append(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+void appendBytes(std::string & out, const char * data, size_t len)
+{
+    ExcAssertLessEqual(len, (size_t)std::numeric_limits<uint32_t>::max());
+    appendPod<uint32_t>(out, len);
+    out.append(data, len);
+}
+
+void appendBytes(std::string & out, const Utf8String & str)
+{
+    appendBytes(out, str.rawData(), str.rawLength());
+}
+
+/** Figure out which type a column with the given values will be serialized
+    as.  Null values are ignored.
+*/
+ColumnarType getColumnType(const std::vector<CellValue> & vals)
+{
+    bool anyInt64 = false, anyUInt64 = false, anyFloat = false;
+    bool anyTimestamp = false, anyBlob = false, anyOther = false;
+
+    for (auto & v: vals) {
+        switch (v.cellType()) {
+        case CellValue::EMPTY:
+            break;
+        case CellValue::INTEGER:
+            if (v.isInt64())
+                anyInt64 = true;
+            else anyUInt64 = true;
+            break;
+        case CellValue::FLOAT:
+            anyFloat = true;  break;
+        case CellValue::TIMESTAMP:
+            anyTimestamp = true;  break;
+        case CellValue::BLOB:
+            anyBlob = true;  break;
+        default:
+            anyOther = true;  break;
+        }
+    }
+
+    int numKinds = (anyInt64 || anyUInt64 || anyFloat)
+        + anyTimestamp + anyBlob + anyOther;
+
+    if (numKinds > 1 || anyOther)
+        return COLUMNAR_STRING;
+    if (anyTimestamp)
+        return COLUMNAR_TIMESTAMP;
+    if (anyBlob)
+        return COLUMNAR_BLOB;
+    if (anyFloat)
+        return COLUMNAR_FLOAT64;
+    if (anyUInt64) {
+        // Negative numbers and numbers over 2^63 can't share a 64 bit
+        // integer representation
+        bool anyNegative = false;
+        for (auto & v: vals) {
+            if (v.isInteger() && v.isNegativeNumber())
+                anyNegative = true;
+        }
+        return anyNegative ? COLUMNAR_FLOAT64 : COLUMNAR_UINT64;
+    }
+    return COLUMNAR_INT64;
+}
+
+Utf8String stringValue(const CellValue & val)
+{
+    if (val.isPath())
+        return val.coerceToPath().toUtf8String();
+    return val.toUtf8String();
+}
+
+void appendColumn(std::string & out,
+                  const Utf8String & name,
+                  const std::vector<CellValue> & vals)
+{
+    ColumnarType type = getColumnType(vals);
+
+    appendBytes(out, name);
+    appendPod<uint8_t>(out, type);
+
+    // Validity bitmap
+    std::string validity((vals.size() + 7) / 8, '\0');
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        if (!vals[i].empty())
+            validity[i / 8] |= (1 << (i % 8));
+    }
+    out += validity;
+
+    switch (type) {
+    case COLUMNAR_INT64:
+        for (auto & v: vals)
+            appendPod<int64_t>(out, v.empty() ? 0 : v.toInt());
+        break;
+    case COLUMNAR_UINT64:
+        for (auto & v: vals)
+            appendPod<uint64_t>(out, v.empty() ? 0 : v.toUInt());
+        break;
+    case COLUMNAR_FLOAT64:
+        for (auto & v: vals)
+            appendPod<double>(out, v.empty() ? 0.0 : v.toDouble());
+        break;
+    case COLUMNAR_TIMESTAMP:
+        for (auto & v: vals)
+            appendPod<double>(out, v.empty()
+                              ? 0.0 : v.toTimestamp().secondsSinceEpoch());
+        break;
+    case COLUMNAR_BLOB: {
+        uint64_t offset = 0;
+        appendPod<uint64_t>(out, offset);
+        for (auto & v: vals) {
+            if (!v.empty())
+                offset += v.blobLength();
+            appendPod<uint64_t>(out, offset);
+        }
+        for (auto & v: vals) {
+            if (!v.empty())
+                out.append((const char *)v.blobData(), v.blobLength());
+        }
+        break;
+    }
+    case COLUMNAR_STRING: {
+        std::vector<Utf8String> dictionary;
+        std::unordered_map<std::string, uint32_t> dictionaryIndex;
+        std::vector<uint32_t> indexes(vals.size(), 0);
+
+        for (size_t i = 0;  i < vals.size();  ++i) {
+            if (vals[i].empty())
+                continue;
+            Utf8String str = stringValue(vals[i]);
+            auto it = dictionaryIndex.emplace(str.rawString(),
+                                              dictionary.size());
+            if (it.second)
+                dictionary.emplace_back(std::move(str));
+            indexes[i] = it.first->second;
+        }
+
+        appendPod<uint32_t>(out, dictionary.size());
+        for (auto & s: dictionary)
+            appendBytes(out, s);
+        out.append((const char *)indexes.data(),
+                   indexes.size() * sizeof(uint32_t));
+        break;
+    }
+    default:
+        throw HttpReturnException(500, "Unknown columnar output type");
+    }
+}
+
+/** Reads the values of a stream in the columnar format, checking that they
+    are not past its end.
+*/
+struct ColumnarReader {
+    ColumnarReader(const std::string & data)
+        : data(data), pos(0)
+    {
+    }
+
+    size_t remaining() const
+    {
+        return data.size() - pos;
+    }
+
+    const char * take(size_t len)
+    {
+        if (len > remaining())
+            throw HttpReturnException(400, "Columnar input is truncated");
+        const char * result = data.data() + pos;
+        pos += len;
+        return result;
+    }
+
+    template<typename T>
+    T readPod()
+    {
+        T result;
+        std::memcpy(&result, take(sizeof(T)), sizeof(T));
+        return result;
+    }
+
+    Utf8String readString()
+    {
+        uint32_t len = readPod<uint32_t>();
+        const char * p = take(len);
+        return Utf8String(std::string(p, len));
+    }
+
+    const std::string & data;
+    size_t pos;
+};
+
+std::vector<CellValue>
+readColumn(ColumnarReader & reader, uint8_t type, size_t numRows,
+           const char * validity)
+{
+    auto isValid = [&] (size_t i)
+        {
+            return validity[i / 8] & (1 << (i % 8));
+        };
+
+    std::vector<CellValue> result(numRows);
+
+    switch (type) {
+    case COLUMNAR_INT64:
+        for (size_t i = 0;  i < numRows;  ++i) {
+            int64_t val = reader.readPod<int64_t>();
+            if (isValid(i))
+                result[i] = val;
+        }
+        break;
+    case COLUMNAR_UINT64:
+        for (size_t i = 0;  i < numRows;  ++i) {
+            uint64_t val = reader.readPod<uint64_t>();
+            if (isValid(i))
+                result[i] = val;
+        }
+        break;
+    case COLUMNAR_FLOAT64:
+        for (size_t i = 0;  i < numRows;  ++i) {
+            double val = reader.readPod<double>();
+            if (isValid(i))
+                result[i] = val;
+        }
+        break;
+    case COLUMNAR_TIMESTAMP:
+        for (size_t i = 0;  i < numRows;  ++i) {
+            double val = reader.readPod<double>();
+            if (isValid(i))
+                result[i] = Date::fromSecondsSinceEpoch(val);
+        }
+        break;
+    case COLUMNAR_BLOB: {
+        const char * offsetData = reader.take((numRows + 1) * sizeof(uint64_t));
+        std::vector<uint64_t> offsets(numRows + 1);
+        std::memcpy(offsets.data(), offsetData,
+                    offsets.size() * sizeof(uint64_t));
+        for (size_t i = 0;  i < numRows;  ++i) {
+            if (offsets[i + 1] < offsets[i])
+                throw HttpReturnException(400, "Columnar input has "
+                                          "decreasing blob offsets");
+        }
+        if (offsets[0] != 0 || offsets[numRows] > reader.remaining())
+            throw HttpReturnException(400, "Columnar input has blob "
+                                      "offsets out of range");
+        const char * bytes = reader.take(offsets[numRows]);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            if (isValid(i))
+                result[i] = CellValue::blob(bytes + offsets[i],
+                                            offsets[i + 1] - offsets[i]);
+        }
+        break;
+    }
+    case COLUMNAR_STRING: {
+        uint32_t dictionarySize = reader.readPod<uint32_t>();
+        std::vector<CellValue> dictionary;
+        for (uint32_t i = 0;  i < dictionarySize;  ++i)
+            dictionary.emplace_back(reader.readString());
+        for (size_t i = 0;  i < numRows;  ++i) {
+            uint32_t index = reader.readPod<uint32_t>();
+            if (!isValid(i))
+                continue;
+            if (index >= dictionary.size())
+                throw HttpReturnException(400, "Columnar input has a string "
+                                          "index out of range");
+            result[i] = dictionary[index];
+        }
+        break;
+    }
+    default:
+        throw HttpReturnException(400, "Unknown columnar input type "
+                                  + std::to_string(type));
+    }
+
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMNAR OUTPUT WRITER                                                    */
+/*****************************************************************************/
+
+const std::string
+ColumnarOutputWriter::
+CONTENT_TYPE = "application/x-mldb-columnar";
+
+ColumnarOutputWriter::
+ColumnarOutputWriter(OnData onData,
+                     bool rowNames,
+                     bool rowHashes,
+                     bool sortColumns,
+                     size_t rowsPerBatch)
+    : onData(std::move(onData)),
+      rowNames(rowNames), rowHashes(rowHashes), sortColumns(sortColumns),
+      rowsPerBatch(std::max<size_t>(rowsPerBatch, 1)),
+      headerSent(false), finished(false)
+{
+    ExcAssert(this->onData);
+}
+
+void
+ColumnarOutputWriter::
+addRow(MatrixNamedRow row)
+{
+    ExcAssert(!finished);
+    rows.emplace_back(std::move(row));
+    if (rows.size() >= rowsPerBatch)
+        flush();
+}
+
+void
+ColumnarOutputWriter::
+flush()
+{
+    if (rows.empty())
+        return;
+    writeBatch();
+    rows.clear();
+}
+
+void
+ColumnarOutputWriter::
+finish()
+{
+    if (finished)
+        return;
+    flush();
+
+    std::string out;
+    if (!headerSent) {
+        out = "MLDBCOL1";
+        headerSent = true;
+    }
+    appendPod<uint32_t>(out, 0);
+    onData(std::move(out));
+    finished = true;
+}
+
+void
+ColumnarOutputWriter::
+writeBatch()
+{
+    // Find the columns in this batch, in order of first appearance, and
+    // lay out their latest values in arrays
+    std::vector<ColumnPath> columns;
+    std::vector<std::vector<CellValue> > values;
+    Lightweight_Hash<ColumnHash, int> columnIndex;
+
+    for (size_t i = 0;  i < rows.size();  ++i) {
+        for (auto & c: rows[i].columns) {
+            const ColumnPath & columnName = std::get<0>(c);
+            auto it = columnIndex.insert({columnName, columns.size()});
+            if (it.second) {
+                columns.push_back(columnName);
+                values.emplace_back(rows.size());
+            }
+            values[it.first->second][i] = std::get<1>(c);
+        }
+    }
+
+    std::vector<size_t> order(columns.size());
+    for (size_t i = 0;  i < order.size();  ++i)
+        order[i] = i;
+    if (sortColumns) {
+        std::sort(order.begin(), order.end(),
+                  [&] (size_t i1, size_t i2)
+                  {
+                      return columns[i1] < columns[i2];
+                  });
+    }
+
+    std::string out;
+    if (!headerSent) {
+        out = "MLDBCOL1";
+        headerSent = true;
+    }
+
+    appendPod<uint32_t>(out, rows.size());
+    appendPod<uint32_t>(out, columns.size() + rowNames + rowHashes);
+
+    if (rowNames) {
+        std::vector<CellValue> names;
+        names.reserve(rows.size());
+        for (auto & r: rows)
+            names.emplace_back(r.rowName.toUtf8String());
+        appendColumn(out, "_rowName", names);
+    }
+    if (rowHashes) {
+        std::vector<CellValue> hashes;
+        hashes.reserve(rows.size());
+        for (auto & r: rows)
+            hashes.emplace_back(r.rowHash.toString());
+        appendColumn(out, "_rowHash", hashes);
+    }
+
+    for (size_t i: order) {
+        appendColumn(out, columns[i].toUtf8String(), values[i]);
+        values[i].clear();
+    }
+
+    onData(std::move(out));
+}
+
+
+/*****************************************************************************/
+/* COLUMNAR INPUT                                                            */
+/*****************************************************************************/
+
+std::vector<MatrixNamedRow>
+readColumnar(const std::string & data, Date ts)
+{
+    if (data.compare(0, 8, "MLDBCOL1") != 0)
+        throw HttpReturnException(400, "Columnar input doesn't start with "
+                                  "the MLDBCOL1 magic number");
+
+    ColumnarReader reader(data);
+    reader.take(8);
+
+    std::vector<MatrixNamedRow> result;
+
+    for (;;) {
+        uint32_t numRows = reader.readPod<uint32_t>();
+        if (numRows == 0)
+            break;
+        uint32_t numColumns = reader.readPod<uint32_t>();
+
+        // Rows without any column take no space at all, so a handful of
+        // bytes could claim any number of them
+        if (numColumns == 0)
+            throw HttpReturnException(400, "Columnar input has a batch "
+                                      "with rows but no columns",
+                                      "numRows", numRows);
+
+        // Don't believe a row count that the data can't hold.  Each column
+        // takes at least its name length, type, validity bitmap and four
+        // bytes per row.
+        uint64_t minColumnBytes = 5 + (numRows + 7) / 8 + 4 * (uint64_t)numRows;
+        if (numColumns > reader.remaining() / minColumnBytes)
+            throw HttpReturnException(400, "Columnar input is truncated");
+
+        size_t first = result.size();
+        result.resize(first + numRows);
+
+        for (uint32_t c = 0;  c < numColumns;  ++c) {
+            Utf8String name = reader.readString();
+            uint8_t type = reader.readPod<uint8_t>();
+            const char * validity = reader.take((numRows + 7) / 8);
+            std::vector<CellValue> vals
+                = readColumn(reader, type, numRows, validity);
+
+            if (name == "_rowHash")
+                continue;
+
+            if (name == "_rowName") {
+                for (size_t i = 0;  i < numRows;  ++i) {
+                    if (!vals[i].empty())
+                        result[first + i].rowName
+                            = RowPath::parse(vals[i].toUtf8String());
+                }
+                continue;
+            }
+
+            ColumnPath columnName = ColumnPath::parse(name);
+            for (size_t i = 0;  i < numRows;  ++i) {
+                if (!vals[i].empty())
+                    result[first + i].columns
+                        .emplace_back(columnName, std::move(vals[i]), ts);
+            }
+        }
+    }
+
+    if (reader.remaining() != 0)
+        throw HttpReturnException(400, "Columnar input has data after the "
+                                  "end of the stream");
+
+    for (size_t i = 0;  i < result.size();  ++i) {
+        if (result[i].rowName.empty())
+            result[i].rowName = RowPath(PathElement(i));
+        result[i].rowHash = result[i].rowName;
+    }
+
+    return result;
+}
+
+} // namespace MLDB
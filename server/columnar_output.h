@@ -0,0 +1,141 @@
+/** columnar_output.h                                              -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Binary columnar serialization of query results.  This is the format
+    returned by /v1/query when format=columnar; it avoids the cost of
+    producing and parsing JSON for large result sets and keeps full
+    precision for numeric values.  It's also accepted as input by
+    /v1/functions/<id>/batch.
+
+    The stream is made of an 8 byte magic number followed by a sequence of
+    record batches, each of which holds up to rowsPerBatch rows.  All
+    integers are little-endian.
+
+    stream:
+      char[8]  magic "MLDBCOL1"
+      batch*   record batches
+      uint32   0 (a batch with zero rows terminates the stream)
+
+    batch:
+      uint32   numRows
+      uint32   numColumns
+      column*  numColumns columns
+
+    column:
+      uint32   name length, followed by the UTF-8 column name
+      uint8    type (see ColumnarType)
+      uint8[]  validity bitmap, (numRows + 7) / 8 bytes, LSB first; a set
+               bit means that the row has a value in the column
+      values, depending on type:
+        INT64, UINT64, FLOAT64, TIMESTAMP:
+               numRows 8 byte values (zero where the row is null).
+               Timestamps are in seconds since the epoch.
+        STRING:
+               uint32 dictionary size, then for each entry a uint32
+               length and the UTF-8 bytes; then numRows uint32 indexes
+               into the dictionary (zero where the row is null).
+        BLOB:  numRows + 1 uint64 offsets, followed by the bytes.
+
+    Each batch carries its own set of columns, in order of first
+    appearance within the batch; only the latest value of each cell is
+    serialized (as with the soa and table formats).  Columns that mix
+    numeric types are widened to FLOAT64; any other mix of types, as well
+    as time intervals and paths, is serialized as STRING.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_types.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COLUMNAR TYPE                                                             */
+/*****************************************************************************/
+
+enum ColumnarType : uint8_t {
+    COLUMNAR_INT64 = 1,
+    COLUMNAR_UINT64 = 2,
+    COLUMNAR_FLOAT64 = 3,
+    COLUMNAR_STRING = 4,
+    COLUMNAR_TIMESTAMP = 5,
+    COLUMNAR_BLOB = 6
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR OUTPUT WRITER                                                    */
+/*****************************************************************************/
+
+/** Accumulates rows and serializes them as record batches in the binary
+    columnar format described above.  Each time some output is ready, it
+    is passed to the onData callback, which makes it possible to stream
+    batches out as they are produced.
+
+    This is not tied to the query endpoint; anything that produces a
+    sequence of MatrixNamedRow can use it to serialize them.
+*/
+
+struct ColumnarOutputWriter {
+
+    typedef std::function<void (std::string data)> OnData;
+
+    static constexpr size_t DEFAULT_ROWS_PER_BATCH = 65536;
+
+    ColumnarOutputWriter(OnData onData,
+                         bool rowNames,
+                         bool rowHashes,
+                         bool sortColumns,
+                         size_t rowsPerBatch = DEFAULT_ROWS_PER_BATCH);
+
+    /** Add a row to the current batch.  If the batch is full, it will be
+        serialized and passed to onData.
+    */
+    void addRow(MatrixNamedRow row);
+
+    /** Serialize the current batch (if it's not empty). */
+    void flush();
+
+    /** Serialize the current batch and terminate the stream.  No rows
+        may be added after this call.
+    */
+    void finish();
+
+    /** MIME type under which the format is returned over HTTP. */
+    static const std::string CONTENT_TYPE;
+
+private:
+    void writeBatch();
+
+    OnData onData;
+    bool rowNames;
+    bool rowHashes;
+    bool sortColumns;
+    size_t rowsPerBatch;
+    bool headerSent;
+    bool finished;
+    std::vector<MatrixNamedRow> rows;
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR INPUT                                                            */
+/*****************************************************************************/
+
+/** Parse a complete stream in the binary columnar format back into rows,
+    in order.  The _rowName column, if there is one, gives the name of each
+    row; rows without a name are named after their position in the stream.
+    The _rowHash column is ignored.  All of the values get the timestamp
+    ts.  Malformed input causes a 400 HttpReturnException.
+*/
+std::vector<MatrixNamedRow>
+readColumnar(const std::string & data, Date ts);
+
+} // namespace MLDB
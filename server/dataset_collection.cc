@@ -10,6 +10,8 @@
 #include "mldb/server/dataset_collection.h"
 #include "mldb/rest/poly_collection_impl.h"
 #include "mldb/server/mldb_server.h"
+#include "mldb/server/columnar_output.h"
+#include "mldb/server/query_executor.h"
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/jml/utils/lightweight_hash.h"
@@ -18,6 +20,9 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/types/pointer_description.h"
 #include "mldb/types/tuple_description.h"
+#include "mldb/arch/exception.h"
+#include "mldb/rest/in_process_rest_connection.h"
+#include "mldb/utils/log.h"
 
 using namespace std;
 
@@ -66,6 +71,117 @@ registerDatasetType(const Package & package,
                                            docRoute, customRoute, config, registryFlags);
 }
 
+namespace {
+
+/** Convert a row to the representation used by the sparse output format. */
+std::vector<std::pair<ColumnPath, CellValue> >
+toSparseRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    std::vector<std::pair<ColumnPath, CellValue> > rowOut;
+    rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+
+    if (rowNames)
+        rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
+    if (rowHashes)
+        rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
+
+    for (auto & c: row.columns) {
+        rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
+    }
+
+    std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
+
+    return rowOut;
+}
+
+/** Convert a row to the representation used by the aos output format. */
+std::map<ColumnPath, CellValue>
+toAosRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    std::map<ColumnPath, CellValue> rowOut;
+
+    if (rowNames)
+        rowOut[ColumnPath("_rowName")] = row.rowName.toUtf8String();
+    if (rowHashes)
+        rowOut[ColumnPath("_rowHash")] = row.rowHash.toString();
+
+    for (auto & c: row.columns) {
+        const ColumnPath & col = std::get<0>(c);
+        const CellValue & val = std::get<1>(c);
+        rowOut[col] = val;
+    }
+
+    return rowOut;
+}
+
+/// Amount of output we accumulate before sending it as a chunk
+static constexpr size_t STREAM_CHUNK_BYTES = 64 * 1024;
+
+/// Amount of output we allow to be queued on the connection before we
+/// stop producing rows and wait for the client to catch up
+static constexpr size_t STREAM_MAX_PENDING_BYTES = 1024 * 1024;
+
+/** Accumulates the output of a streamed query and sends it on the
+    connection in chunks.  Nothing is sent until the first chunk is full,
+    which means that small results (and errors that happen before
+    anything was produced) go out as a normal, non-chunked response.
+*/
+struct QueryOutputStream {
+    QueryOutputStream(RestConnection & connection,
+                      std::string contentType)
+        : connection(connection), contentType(std::move(contentType)),
+          started(false)
+    {
+    }
+
+    /** Add some output.  Returns false if the client went away, in which
+        case the query should be stopped.
+    */
+    bool write(const std::string & data)
+    {
+        buffer += data;
+        if (buffer.size() < STREAM_CHUNK_BYTES)
+            return true;
+        return flush();
+    }
+
+    /** Send what we have as a chunk and wait until the connection has
+        caught up enough to accept more.
+    */
+    bool flush()
+    {
+        if (!started) {
+            connection.sendHttpResponseHeader
+                (200, contentType, RestConnection::CHUNKED_ENCODING);
+            started = true;
+        }
+        if (!buffer.empty()) {
+            connection.sendPayload(std::move(buffer));
+            buffer.clear();
+        }
+        return connection.waitForPayloadDrain(STREAM_MAX_PENDING_BYTES);
+    }
+
+    /** Finish the response. */
+    void finish()
+    {
+        if (!started) {
+            connection.sendResponse(200, std::move(buffer), contentType);
+            return;
+        }
+        if (!buffer.empty())
+            connection.sendPayload(std::move(buffer));
+        connection.finishResponse();
+    }
+
+    RestConnection & connection;
+    std::string contentType;
+    std::string buffer;
+    bool started;
+};
+
+} // file scope
+
 void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   RestConnection & connection,
                   const std::string & format,
@@ -91,22 +207,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         output.reserve(sparseOutput.size());
 
         for (auto & row: sparseOutput) {
-
-            std::vector<std::pair<ColumnPath, CellValue> > rowOut;
-            rowOut.reserve(row.columns.size() + rowNames + rowHashes);
-
-            if (rowNames)
-                rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
-            if (rowHashes)
-                rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
-
-            for (auto & c: row.columns) {
-                rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
-            }
-
-            std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
-
-            output.emplace_back(std::move(rowOut));
+            output.emplace_back(toSparseRow(row, rowNames, rowHashes));
         }
 
         connection.sendResponse(200, jsonEncodeStr(output),
@@ -139,22 +240,8 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
     else if (format == "aos") {
         // Array of structures; one structure per row
         std::vector<std::map<ColumnPath, CellValue> > output;
-        for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
-
-            std::map<ColumnPath, CellValue> row;
-
-            if (rowNames)
-                row[ColumnPath("_rowName")] = sparseOutput[i].rowName.toUtf8String();
-            if (rowHashes)
-                row[ColumnPath("_rowHash")] = sparseOutput[i].rowHash.toString();
-
-            for (auto & c: sparseOutput[i].columns) {
-                const ColumnPath & col = std::get<0>(c);
-                const CellValue & val = std::get<1>(c);
-                row[col] = val;
-            }
-
-            output.emplace_back(std::move(row));
+        for (auto & row: sparseOutput) {
+            output.emplace_back(toAosRow(row, rowNames, rowHashes));
         }
         connection.sendResponse(200, jsonEncodeStr(output),
                                 "application/json");
@@ -278,12 +365,161 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         connection.sendResponse(200, jsonEncodeStr(val),
                                 "application/json"); 
     }
+    else if (format == "columnar") {
+        // Binary record batches, sent as chunks as they are serialized
+        connection.sendHttpResponseHeader(200, ColumnarOutputWriter::CONTENT_TYPE,
+                                          RestConnection::CHUNKED_ENCODING);
+
+        auto onData = [&] (std::string data)
+            {
+                connection.sendPayload(std::move(data));
+            };
+
+        ColumnarOutputWriter writer(onData, rowNames, rowHashes, sortColumns);
+        for (auto & row: sparseOutput) {
+            writer.addRow(std::move(row));
+        }
+        writer.finish();
+        connection.finishResponse();
+    }
     else {
         connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
     }
 }
 
 
+void runHttpQueryAsync(QueryExecutor & executor,
+                       RestConnection & connection,
+                       std::function<void (RestConnection & connection)> run)
+{
+    // An in-process caller is waiting for the response anyway, and its
+    // connection can't be captured
+    if (dynamic_cast<InProcessRestConnection *>(&connection)) {
+        run(connection);
+        return;
+    }
+
+    // There is nothing to do on a disconnection; the query notices it the
+    // next time it writes to the connection, and stops.
+    std::shared_ptr<RestConnection> captured
+        = connection.capture([] () {});
+
+    auto toRun = [=] ()
+        {
+            try {
+                MLDB_TRACE_EXCEPTIONS(false);
+                run(*captured);
+            } catch (const std::exception & exc) {
+                if (!captured->responseSent())
+                    sendExceptionResponse(*captured, exc);
+            } catch (...) {
+                if (!captured->responseSent())
+                    captured->sendErrorResponse(500, "unknown exception");
+            }
+        };
+
+    if (!executor.add(toRun))
+        captured->sendErrorResponse(503, "The server is shutting down");
+}
+
+void runHttpQueryStreaming(std::function<bool (const OnQueryRow &)> runQuery,
+                           RestConnection & connection,
+                           const std::string & format,
+                           bool createHeaders,
+                           bool rowNames,
+                           bool rowHashes,
+                           bool sortColumns)
+{
+    bool isJson = format == "full" || format == "" || format == "sparse"
+        || format == "aos";
+
+    if (!isJson && format != "columnar") {
+        // These formats need to see the whole result before they can
+        // produce any output
+        auto collectQuery = [&] ()
+            {
+                std::vector<MatrixNamedRow> rows;
+                runQuery([&] (MatrixNamedRow & row)
+                         {
+                             rows.emplace_back(std::move(row));
+                             return true;
+                         });
+                return rows;
+            };
+
+        runHttpQuery(collectQuery, connection, format, createHeaders,
+                     rowNames, rowHashes, sortColumns);
+        return;
+    }
+
+    QueryOutputStream stream(connection,
+                             isJson
+                             ? "application/json"
+                             : ColumnarOutputWriter::CONTENT_TYPE);
+    bool connected = true;
+
+    std::unique_ptr<ColumnarOutputWriter> columnar;
+    if (!isJson) {
+        auto onData = [&] (std::string data)
+            {
+                connected = connected && stream.write(data);
+            };
+
+        // Smaller batches than the default, so that the first rows are
+        // sent out quickly and the memory used is bounded
+        columnar.reset(new ColumnarOutputWriter(onData, rowNames, rowHashes,
+                                                sortColumns, 4096));
+    }
+
+    size_t numRows = 0;
+
+    auto onRow = [&] (MatrixNamedRow & row) -> bool
+        {
+            if (sortColumns)
+                std::sort(row.columns.begin(), row.columns.end());
+
+            if (columnar) {
+                columnar->addRow(std::move(row));
+                return connected;
+            }
+
+            std::string data = numRows++ == 0 ? "[" : ",";
+            if (format == "sparse")
+                data += jsonEncodeStr(toSparseRow(row, rowNames, rowHashes));
+            else if (format == "aos")
+                data += jsonEncodeStr(toAosRow(row, rowNames, rowHashes));
+            else data += jsonEncodeStr(row);
+
+            return connected = stream.write(data);
+        };
+
+    try {
+        runQuery(onRow);
+    } catch (...) {
+        // Before anything was sent, the error can be returned normally.
+        // Afterwards, all we can do is to cut the response short, by
+        // closing the connection without its final chunk.
+        if (!stream.started)
+            throw;
+        std::string error = getExceptionString();
+        getServerLog()->error()
+            << "error after query output was started; aborting response: "
+            << error;
+        connection.abortResponse(error);
+        return;
+    }
+
+    if (!connected)
+        return;
+
+    if (columnar)
+        columnar->finish();
+    else stream.write(numRows == 0 ? "[]" : "]");
+
+    stream.finish();
+}
+
+
 /*****************************************************************************/
 /* DATASET COLLECTION                                                         */
 /*****************************************************************************/
@@ -555,7 +791,7 @@ getColumnValueCounts(const Dataset * dataset,
 
 void
 DatasetCollection::
-queryStructured(const Dataset * dataset,
+queryStructured(std::shared_ptr<const Dataset> dataset,
                 RestConnection & connection,
                 const std::string & format,
                 const Utf8String & select,
@@ -594,14 +830,23 @@ queryStructured(const Dataset * dataset,
     //cerr << "limit = " << limit << endl;
     //cerr << "offset = " << offset << endl;
 
-    auto runQuery = [&] ()
+    // This runs later on the query's own thread, so everything that it
+    // needs is captured by value
+    auto run = [=] (RestConnection & connection,
+                    RunningQueries::Entry & running)
         {
-            return dataset->queryStructured
-                (selectParsed, whenParsed, *whereParsed, orderByParsed,
-                 groupByParsed,havingParsed, rowNameParsed, offset, limit);
+            auto runQuery = [&] ()
+                {
+                    return dataset->queryStructured
+                        (selectParsed, whenParsed, *whereParsed, orderByParsed,
+                         groupByParsed,havingParsed, rowNameParsed, offset, limit);
+                };
+
+            runHttpQuery(runQuery, connection, format, createHeaders,rowNames, rowHashes, sortColumns);
         };
 
-    runHttpQuery(runQuery, connection, format, createHeaders,rowNames, rowHashes, sortColumns);
+    // Admitted and prioritized just like queries via /v1/query
+    dataset->server->runAdmittedHttpQuery(select, connection, run);
 }
 
 template class PolyCollection<Dataset>;
@@ -18,6 +18,8 @@ struct RestConnection;
 
 namespace MLDB {
 
+struct QueryExecutor;
+
 
 /** Run a query (by calling the given function) and format and return the
     results in HTTP based upon the given flag.
@@ -34,7 +36,49 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   bool rowNames,
                   bool rowHashes,
                   bool sortColumns);
-                      
+
+/** Call run, which sends the response to a query on the connection, on
+    one of the executor's threads.  That thread waits for the client to
+    read the output of a streamed query, so that the threads handling the
+    connections are never held up by a slow client.  Errors that escape
+    from run are sent back as an error response, as is a 503 if the
+    executor was shut down.  In-process connections can't be captured,
+    so run is called directly for them.
+*/
+void runHttpQueryAsync(QueryExecutor & executor,
+                       RestConnection & connection,
+                       std::function<void (RestConnection & connection)> run);
+
+/** Callback for a query producing its output incrementally.  Returning
+    false means that no more rows are wanted.
+*/
+typedef std::function<bool (MatrixNamedRow & row)> OnQueryRow;
+
+/** Streaming version of runHttpQuery.  The runQuery function must call
+    the callback for each output row, sequentially and in order.  For the
+    full, sparse, aos and columnar formats, the rows are serialized as
+    they arrive and sent back as a chunked response once more than a
+    few tens of kilobytes are available.  The query is paused when the
+    client isn't reading the output fast enough, and stopped if it goes
+    away.  The other formats need the whole result before anything can
+    be written, and are buffered as with runHttpQuery.
+
+    An error that happens after the response was started can't be
+    reported with an HTTP status code any more; the connection is closed
+    without finishing the chunked response instead, which the client
+    sees as an incomplete response.
+
+    The waiting for the client blocks the calling thread, so this should
+    be called through runHttpQueryAsync.
+*/
+void runHttpQueryStreaming(std::function<bool (const OnQueryRow &)> runQuery,
+                           RestConnection & connection,
+                           const std::string & format,
+                           bool createHeaders,
+                           bool rowNames,
+                           bool rowHashes,
+                           bool sortColumns);
+
 
 /*****************************************************************************/
 /* DATASET COLLECTION                                                        */
@@ -53,9 +97,12 @@ struct DatasetCollection: public PolyCollection<Dataset> {
                          ssize_t offset,
                          ssize_t limit) const;
 
-    /** Select from the database in a given format */
+    /** Select from the database in a given format.  Like /v1/query, the
+        query goes through admission control and runs on its own thread,
+        so the response may be sent after this returns.
+    */
     virtual void
-    queryStructured(const Dataset * dataset,
+    queryStructured(std::shared_ptr<const Dataset> dataset,
                     RestConnection & connection,
                     const std::string & format,
                     const Utf8String & select,
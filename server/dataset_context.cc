@@ -75,10 +75,28 @@ doGetFunction(const Utf8String & tableName,
                     }
                 };
 
+            auto execBatch
+                = [=] (std::vector<std::vector<ExpressionValue> > & args,
+                       const std::vector<const SqlRowScope *> & scopes)
+                -> std::vector<ExpressionValue>
+                {
+                    std::vector<ExpressionValue> inputs;
+                    inputs.reserve(args.size());
+                    for (auto & a: args) {
+                        if (a.empty())
+                            inputs.emplace_back();
+                        else inputs.emplace_back(std::move(a[0]));
+                    }
+                    return applier->applyBatch(inputs);
+                };
+
             bool isConst = constantArgs && applier->info.deterministic;
             auto outputInfo = applier->info.output->getConst(isConst);
 
-            return BoundFunction(exec, outputInfo);
+            BoundFunction result(exec, outputInfo);
+            if (fn->supportsBatch())
+                result.execBatch = execBatch;
+            return result;
         }
     }
 
@@ -15,6 +15,11 @@
 #include "mldb/types/meta_value_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/types/map_description.h"
+#include "mldb/base/metrics.h"
+#include "mldb/base/parallel.h"
+#include "mldb/server/columnar_output.h"
+#include <chrono>
+#include <iterator>
 
 
 
@@ -136,6 +141,30 @@ call(const ExpressionValue & input) const
 /* FUNCTION COLLECTION                                                       */
 /*****************************************************************************/
 
+namespace {
+
+/// Latency of applying functions through the REST API, for single calls
+/// and for each input of a batch
+const LatencyHistogram & applyLatency(bool batch)
+{
+    static const LatencyHistogram single
+        = MetricsRegistry::instance()
+        .histogram("mldb_function_apply_seconds",
+                   "Time taken to apply functions through the REST API",
+                   "mode=\"single\"");
+    static const LatencyHistogram batched
+        = MetricsRegistry::instance()
+        .histogram("mldb_function_apply_seconds",
+                   "Time taken to apply functions through the REST API",
+                   "mode=\"batch\"");
+    return batch ? batched : single;
+}
+
+/// Number of inputs of a batch that are applied together by a thread
+constexpr size_t BATCH_CHUNK_SIZE = 64;
+
+} // file scope
+
 FunctionCollection::
 FunctionCollection(MldbServer * server)
     : PolyCollection<Function>("function", "functions", server)
@@ -156,7 +185,11 @@ applyFunction(const Function * function,
         inputExpr.emplace_back(i.first, i.second);
     }
 
-    ExpressionValue output = function->call(std::move(inputExpr));
+    ExpressionValue output;
+    {
+        LatencyTimer timer(applyLatency(false /* batch */));
+        output = function->call(std::move(inputExpr));
+    }
 
     //cerr << "output = " << jsonEncode(output) << endl;
 
@@ -211,69 +244,198 @@ applyFunction(const Function * function,
     }
 }
 
-void
+std::vector<ExpressionValue>
 FunctionCollection::
 applyBatch(const Function * function,
-           const Json::Value & inputs,
-           const std::string & inputFormat,
-           const std::string & outputFormat,
-           RestConnection & connection) const
+           std::vector<ExpressionValue> inputs) const
 {
-    if (inputFormat != "json") {
-        throw HttpReturnException
-            (400, "batch apply only accepts 'json' input format currently; got '"
-             + inputFormat + "'");
-    }
-    if (outputFormat != "json") {
-        throw HttpReturnException
-            (400, "batch apply only accepts 'json' output format currently; got '"
-             + inputFormat + "'");
-    }
-
-    Utf8String str;
-    Utf8StringJsonPrintingContext printingContext(str);
-
     SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
     
     auto info = function->getFunctionInfo();
     auto applier = function->bind(outerContext, info.input);
-    
+
+    std::vector<ExpressionValue> outputs(inputs.size());
+    if (inputs.empty())
+        return outputs;
+
+    // Each chunk goes through the function's batch implementation, which
+    // may be much cheaper than applying it to the inputs one by one
+    auto doChunk = [&] (size_t first, size_t last)
+        {
+            std::vector<ExpressionValue> chunk
+                (std::make_move_iterator(inputs.begin() + first),
+                 std::make_move_iterator(inputs.begin() + last));
+
+            auto started = std::chrono::steady_clock::now();
+            std::vector<ExpressionValue> results = applier->applyBatch(chunk);
+            uint64_t nanos
+                = std::chrono::duration_cast<std::chrono::nanoseconds>
+                (std::chrono::steady_clock::now() - started).count();
+
+            // The latency is recorded for each input, as for single calls
+            for (size_t i = first;  i < last;  ++i)
+                applyLatency(true /* batch */).recordNanos(nanos / chunk.size());
+
+            std::move(results.begin(), results.end(), outputs.begin() + first);
+        };
+
+    parallelMapChunked(0, inputs.size(), BATCH_CHUNK_SIZE, doChunk);
+
+    return outputs;
+}
+
+void
+FunctionCollection::
+handleBatch(const Function * function,
+            const RestRequest & request,
+            RestConnection & connection) const
+{
     Date ts = Date::now();
 
-    auto doInput = [&] (const Json::Value & val)
+    bool columnarBody
+        = request.header.contentType == ColumnarOutputWriter::CONTENT_TYPE;
+
+    // Parameters are in the query string, or in the body if it's JSON.
+    // The body is only parsed once, however big the batch is.
+    Json::Value body;
+    if (!columnarBody && !request.payload.empty()) {
+        body = Json::parse(request.payload);
+        if (!request.params.empty() && !body.empty()) {
+            throw HttpReturnException(
+                400, "You cannot mix query string and body parameters");
+        }
+    }
+
+    auto getParam = [&] (const std::string & name, const std::string & def)
+        -> std::string
         {
-            StructuredJsonParsingContext context(val);
-            ExpressionValue inputExpr
-                = ExpressionValue::parseJson(context, ts);
-            ExpressionValue output
-                = function->apply(*applier, std::move(inputExpr));
-            output.extractJson(printingContext);
+            if (body.isMember(name))
+                return body[name].asString();
+            if (request.params.hasValue(name))
+                return request.params.getValue(name).rawString();
+            return def;
         };
 
-    if (inputs.isNull()) {
-        connection.sendResponse(200, inputs, "application/json");
-        return;
+    std::string inputFormat
+        = getParam("inputFormat", columnarBody ? "columnar" : "json");
+    std::string outputFormat = getParam("outputFormat", "json");
+
+    if (inputFormat != "json" && inputFormat != "columnar") {
+        throw HttpReturnException
+            (400, "batch apply accepts 'json' or 'columnar' input format; "
+             "got '" + inputFormat + "'");
     }
-    else if (inputs.isArray()) {
-        printingContext.startArray(inputs.size());
-        for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
-            printingContext.newArrayElement();
-            doInput(*it);
+    if (outputFormat != "json" && outputFormat != "columnar") {
+        throw HttpReturnException
+            (400, "batch apply accepts 'json' or 'columnar' output format; "
+             "got '" + outputFormat + "'");
+    }
+    if ((inputFormat == "columnar") != columnarBody) {
+        throw HttpReturnException
+            (400, "columnar input must be sent as the request body, "
+             "with a Content-Type of " + ColumnarOutputWriter::CONTENT_TYPE);
+    }
+
+    // The inputs, and how the outputs should be laid out: JSON arrays and
+    // columnar input give an array, JSON objects an object keyed by the
+    // same members, and anything else a single output.
+    enum { SINGLE, ARRAY, OBJECT } shape = ARRAY;
+    std::vector<ExpressionValue> inputs;
+    std::vector<RowPath> names;
+
+    if (columnarBody) {
+        std::vector<MatrixNamedRow> rows = readColumnar(request.payload, ts);
+        inputs.reserve(rows.size());
+        names.reserve(rows.size());
+        for (auto & r: rows) {
+            inputs.emplace_back(std::move(r.columns));
+            names.emplace_back(std::move(r.rowName));
+        }
+    }
+    else {
+        Json::Value input;
+        if (body.isMember("input"))
+            input.swap(body["input"]);
+        else if (request.params.hasValue("input"))
+            input = Json::parse(request.params.getValue("input").rawString());
+
+        if (input.isNull()) {
+            connection.sendResponse(200, input, "application/json");
+            return;
+        }
+
+        auto addInput = [&] (const Json::Value & val, RowPath name)
+            {
+                StructuredJsonParsingContext context(val);
+                inputs.emplace_back(ExpressionValue::parseJson(context, ts));
+                names.emplace_back(std::move(name));
+            };
+
+        if (input.isArray()) {
+            inputs.reserve(input.size());
+            for (unsigned i = 0;  i < input.size();  ++i)
+                addInput(input[i], PathElement(i));
+        }
+        else if (input.isObject()) {
+            shape = OBJECT;
+            for (auto it = input.begin(), end = input.end();
+                 it != end;  ++it) {
+                addInput(*it, PathElement(it.memberName()));
+            }
+        }
+        else {
+            shape = SINGLE;
+            addInput(input, PathElement(0));
         }
-        printingContext.endArray();
     }
-    else if (inputs.isObject()) {
+
+    std::vector<ExpressionValue> outputs
+        = applyBatch(function, std::move(inputs));
+
+    if (outputFormat == "columnar") {
+        std::string result;
+        auto onData = [&] (std::string data)
+            {
+                result += data;
+            };
+        ColumnarOutputWriter writer(onData, true /* rowNames */,
+                                    false /* rowHashes */,
+                                    false /* sortColumns */);
+        for (size_t i = 0;  i < outputs.size();  ++i) {
+            MatrixNamedRow row;
+            row.rowName = std::move(names[i]);
+            row.rowHash = row.rowName;
+            outputs[i].appendToRow(ColumnPath(), row);
+            writer.addRow(std::move(row));
+        }
+        writer.finish();
+        connection.sendResponse(200, std::move(result),
+                                ColumnarOutputWriter::CONTENT_TYPE);
+        return;
+    }
+
+    Utf8String str;
+    Utf8StringJsonPrintingContext printingContext(str);
+
+    if (shape == SINGLE) {
+        outputs.at(0).extractJson(printingContext);
+    }
+    else if (shape == OBJECT) {
         printingContext.startObject();
-        for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
-            printingContext.startMember(it.memberName());
-            doInput(*it);
+        for (size_t i = 0;  i < outputs.size();  ++i) {
+            // The member name as given, not escaped as a path
+            printingContext.startMember(names[i][0].toUtf8String());
+            outputs[i].extractJson(printingContext);
         }
         printingContext.endObject();
     }
     else {
-        doInput(inputs);
+        printingContext.startArray(outputs.size());
+        for (auto & output: outputs) {
+            printingContext.newArrayElement();
+            output.extractJson(printingContext);
+        }
+        printingContext.endArray();
     }
 
     connection.sendResponse(200, str.stealRawString(), "application/json");
@@ -322,31 +484,62 @@ initRoutes(RouteManager & manager)
                   PassConnectionId()
                   );
 
-    const char * outputFormatDefStr2 = "String describing output format: "
-        "'json' is JSON output (the output of the expression will be turned "
-        "back into a vanilla JSON object, dropping any non-JSON types like "
-        "dates;  This is the default and currently the only value accepted.";
+    // The batch route parses its own parameters, as its body may be
+    // binary and as parsing a big JSON body once per parameter is slow
+    RestRequestRouter::OnProcessRequest handleBatchRoute
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               RestRequestParsingContext & cxt)
+        {
+            auto collection
+                = static_cast<FunctionCollection *>(manager.getCollection(cxt));
+            Function * function = getFunction(cxt);
 
-    const char * inputFormatDefStr2 = "String describing input format: "
-        "'json' is JSON input (the fields will be interpreted as JSON, and "
-        "it is not possible to pass types that are not representable in JSON "
-        "like dates into the call. This is the default and currently the only "
-        "value accepted.";
-    
-    addRouteAsync(*manager.valueNode, "/batch", { "GET" },
-                  "Apply a function to each element of a given set of input values and return the output",
-                  //"Output of all values or those selected in the keepValues parameter",
-                  &FunctionCollection::applyBatch,
-                  manager.getCollection,
-                  getFunction,
-                  HybridParamJsonDefault<Json::Value>
-                      ("input", inputDefStr, {}, ""),
-                  HybridParamDefault<std::string>
-                      ("inputFormat", inputFormatDefStr2, "json"),
-                  HybridParamDefault<std::string>
-                      ("outputFormat", outputFormatDefStr2, "json"),
-                  PassConnectionId()
-                  );
+            try {
+                collection->handleBatch(function, req, connection);
+                return RestRequestRouter::MR_YES;
+            }
+            catch (const HttpReturnException & exc) {
+                return sendExceptionResponse(connection, exc);
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+        };
+
+    Json::Value batchHelp;
+    auto addBatchHelp = [&] (const char * name, const char * description)
+        {
+            Json::Value desc;
+            desc["name"] = name;
+            desc["description"] = description;
+            desc["encoding"] = "URI encoded or JSON";
+            desc["location"] = "query string or Request Body";
+            for (const auto key: {"requestParams", "jsonParams"}) {
+                Json::Value & v = batchHelp[key];
+                v[v.size()] = desc;
+            }
+        };
+
+    addBatchHelp("input", "Array or object of input values, each of which "
+                 "is an object with the input values of one call.  Must be "
+                 "defined either as a query string parameter or the json "
+                 "body.  With the 'columnar' input format, the body "
+                 "holds the inputs instead, one per row.");
+    addBatchHelp("inputFormat", "String describing input format: 'json' "
+                 "(the default) is JSON input; 'columnar' is the binary "
+                 "columnar format of /v1/query, sent as the request body "
+                 "with a Content-Type of application/x-mldb-columnar.");
+    addBatchHelp("outputFormat", "String describing output format: 'json' "
+                 "(the default) returns the output of each input as a "
+                 "vanilla JSON object, in the same order or under the same "
+                 "keys as the inputs; 'columnar' returns them as rows of "
+                 "the binary columnar format, named after the inputs.");
+
+    manager.valueNode->addRoute("/batch", { "GET", "POST" },
+                                "Apply a function to each element of a "
+                                "given set of input values and return the "
+                                "outputs",
+                                handleBatchRoute, batchHelp);
 
     addRouteSyncJsonReturn(*manager.valueNode, "/info", { "GET" },
                            "Return information about the values and metadata of the function",
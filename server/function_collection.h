@@ -15,6 +15,7 @@ struct RestConnection;
 
 namespace MLDB {
 
+struct RestRequest;
 
 /*****************************************************************************/
 /* FUNCTION COLLECTION                                                      */
@@ -36,11 +37,19 @@ struct FunctionCollection: public PolyCollection<Function> {
                        const std::string & outputFormat,
                        RestConnection & connection) const;
     
-    void applyBatch(const Function * function,
-                    const Json::Value & inputs,
-                    const std::string & inputFormat,
-                    const std::string & outputFormat,
-                    RestConnection & connection) const;
+    /** Apply the function to each of the inputs, in parallel and through
+        a single applier, and return the outputs in the same order.
+    */
+    std::vector<ExpressionValue>
+    applyBatch(const Function * function,
+               std::vector<ExpressionValue> inputs) const;
+
+    /** Handle a call to the batch route, whose inputs are either JSON or
+        in the binary columnar format.
+    */
+    void handleBatch(const Function * function,
+                     const RestRequest & request,
+                     RestConnection & connection) const;
     
     static ExpressionValue call(MldbServer * server,
                                const Function * function,
@@ -92,6 +92,7 @@ int main(int argc, char ** argv)
     bool dontExitAfterScript = false;
 
     string cacheDir;
+    uint64_t cacheMaxSizeMb = DEFAULT_URL_CACHE_SIZE / 1024 / 1024;
     string httpBaseUrl = "";
 
 #if 0
@@ -143,6 +144,8 @@ int main(int argc, char ** argv)
          "directory to serve documentation from")
         ("cache-dir", value(&cacheDir),
          "Cache directory to memory map large files and store downloads")
+        ("cache-max-size", value(&cacheMaxSizeMb)->default_value(cacheMaxSizeMb),
+         "Maximum size in megabytes of the downloads kept in the cache directory")
 
 #if 0
         ("peer-listen-port,l",
@@ -324,7 +327,7 @@ int main(int argc, char ** argv)
     if (initSuccess) {
         // Set up the SSD cache, if configured
         if (!cacheDir.empty()) {
-            server.setCacheDirectory(cacheDir);
+            server.setCacheDirectory(cacheDir, cacheMaxSizeMb * 1024 * 1024);
         }
 
         // Scan each of our plugin directories
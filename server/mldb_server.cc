@@ -31,8 +31,15 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/server/analytics.h"
+#include "mldb/server/admission_control.h"
+#include "mldb/server/running_queries.h"
+#include "mldb/server/query_executor.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/metrics.h"
+#include "mldb/base/scope.h"
 #include "mldb/types/meta_value_description.h"
 #include "mldb/arch/simd.h"
+#include "mldb/arch/sampling_profiler.h"
 #include "mldb/utils/log.h"
 
 
@@ -42,6 +49,63 @@ using namespace std;
 namespace MLDB {
 
 namespace {
+
+struct QueryMetrics {
+    QueryMetrics()
+    {
+        auto & registry = MetricsRegistry::instance();
+        queries = registry.counter("mldb_queries_total",
+                                   "Queries run through the REST API");
+        cancelled = registry.counter("mldb_queries_cancelled_total",
+                                     "Queries that were cancelled");
+        timedOut = registry.counter("mldb_queries_timed_out_total",
+                                    "Queries that reached their timeout");
+        rowsOutput = registry.counter("mldb_query_rows_output_total",
+                                      "Rows returned by queries run through "
+                                      "the REST API");
+        latency = registry.histogram("mldb_query_seconds",
+                                     "Time taken to run queries through the "
+                                     "REST API, once admitted");
+    }
+
+    Counter queries;
+    Counter cancelled;
+    Counter timedOut;
+    Counter rowsOutput;
+    LatencyHistogram latency;
+};
+
+const QueryMetrics & queryMetrics()
+{
+    static const QueryMetrics result;
+    return result;
+}
+
+/** Turn the exception or early stop caused by the cancellation of a query
+    into an error that tells the client what happened.  Does nothing if
+    the query wasn't cancelled.
+*/
+void checkQueryCancelled(const RunningQueries::Entry & running,
+                         double timeout)
+{
+    const CancellationToken & token = *running.token;
+    if (!token.isCancelled())
+        return;
+    const QueryMetrics & metrics = queryMetrics();
+    if (token.timedOut()) {
+        metrics.timedOut.inc();
+        throw HttpReturnException
+            (408, "Query timed out after "
+             + to_string(timeout) + " seconds",
+             "query", running.query,
+             "timeout", timeout);
+    }
+    metrics.cancelled.inc();
+    throw HttpReturnException(400, "Query was cancelled: "
+                              + token.reason(),
+                              "query", running.query);
+}
+
 bool supportsSystemRequirements() {
 #if MLDB_INTEL_ISA
     return has_sse42();
@@ -85,13 +149,18 @@ MldbServer(const std::string & serviceName,
            const std::string & httpBaseUrl)
     : ServicePeer(serviceName, "MLDB", "global", enableAccessLog),
       EventRecorder(serviceName, std::make_shared<NullEventService>()),
+      admission(std::make_shared<AdmissionController>()),
+      runningQueries(std::make_shared<RunningQueries>()),
+      queryExecutor(std::make_shared<QueryExecutor>()),
       httpBaseUrl(httpBaseUrl), versionNode(nullptr),
-      logger(getMldbLog<MldbServer>())
+      logger(getMldbLog<MldbServer>()),
+      shuttingDown(false)
 {
     // Don't allow URIs without a scheme
     setGlobalAcceptUrisWithoutScheme(false);
 
     addRoutes();
+    initMetrics();
 
     if (etcdUri != "")
         initDiscovery(std::make_shared<EtcdPeerDiscovery>(this, etcdUri, etcdPath));
@@ -103,6 +172,54 @@ MldbServer::
 ~MldbServer()
 {
     shutdown();
+
+    for (uint64_t id: metricCallbacks)
+        MetricsRegistry::instance().removeCallback(id);
+}
+
+void
+MldbServer::
+initMetrics()
+{
+    auto & registry = MetricsRegistry::instance();
+
+    // Make sure that the thread pool metrics are there from the start
+    ThreadPool::instance();
+
+    for (int p = 0;  p < NUM_JOB_PRIORITIES;  ++p) {
+        const char * name = jobPriorityName((JobPriority)p);
+        std::string labels = string("priority=\"") + name + "\"";
+
+        auto addStat = [&] (const char * metric, const char * help,
+                            MetricsRegistry::Type type, const char * field)
+            {
+                auto read = [=] ()
+                    {
+                        return admission->getStats()[name][field].asDouble();
+                    };
+                metricCallbacks.push_back
+                    (registry.addCallback(metric, help, type, read, labels));
+            };
+
+        addStat("mldb_admission_running_tasks",
+                "Tasks admitted and running, by priority class",
+                MetricsRegistry::GAUGE, "running");
+        addStat("mldb_admission_waiting_tasks",
+                "Tasks waiting to be admitted, by priority class",
+                MetricsRegistry::GAUGE, "waiting");
+        addStat("mldb_admission_rejected_total",
+                "Tasks rejected as too many were waiting, by priority class",
+                MetricsRegistry::COUNTER, "rejected");
+        addStat("mldb_admission_timed_out_total",
+                "Tasks rejected after waiting too long, by priority class",
+                MetricsRegistry::COUNTER, "timedOut");
+    }
+
+    metricCallbacks.push_back
+        (registry.addCallback("mldb_running_queries",
+                              "Queries running through the REST API",
+                              MetricsRegistry::GAUGE,
+                              [=] () { return runningQueries->size(); }));
 }
 
 bool
@@ -190,6 +307,111 @@ initRoutes()
                          handleShutdown,
                          Json::Value());
 
+    auto handleMetrics = [=] (RestConnection & connection,
+                              const RestRequest & request,
+                              const RestRequestParsingContext & context)
+        {
+            connection.sendHttpResponse(200, getMetrics(),
+                                        "text/plain; version=0.0.4", {});
+            return RestRequestRouter::MR_YES;
+        };
+
+    versionNode.addRoute("/metrics", "GET",
+                         "Get the metrics of the server in the Prometheus "
+                         "text format",
+                         handleMetrics, Json::Value());
+
+    addRouteSyncJsonReturn(versionNode, "/scheduler", {"GET"},
+                           "Get the state of the thread pool and of "
+                           "admission control for each priority class",
+                           "JSON description of the scheduler state",
+                           &MldbServer::getSchedulerInfo,
+                           this);
+
+    auto listQueries = [=] (RestConnection & connection,
+                            const RestRequest & request,
+                            const RestRequestParsingContext & context)
+        {
+            connection.sendResponse(200, runningQueries->list());
+            return RestRequestRouter::MR_YES;
+        };
+
+    auto cancelAllQueries = [=] (RestConnection & connection,
+                                 const RestRequest & request,
+                                 const RestRequestParsingContext & context)
+        {
+            connection.sendResponse
+                (200, runningQueries->cancelAll("cancelled through the API"));
+            return RestRequestRouter::MR_YES;
+        };
+
+    auto getQueryId = [] (const RestRequestParsingContext & context)
+        {
+            const Utf8String & id = context.resources.back();
+            try {
+                return std::stoull(id.rawString());
+            } catch (const std::exception & exc) {
+                throw HttpReturnException(400, "Invalid query id '" + id + "'");
+            }
+        };
+
+    auto getQuery = [=] (RestConnection & connection,
+                         const RestRequest & request,
+                         const RestRequestParsingContext & context)
+        {
+            connection.sendResponse
+                (200, runningQueries->get(getQueryId(context)));
+            return RestRequestRouter::MR_YES;
+        };
+
+    auto cancelQuery = [=] (RestConnection & connection,
+                            const RestRequest & request,
+                            const RestRequestParsingContext & context)
+        {
+            connection.sendResponse
+                (200, runningQueries->cancel(getQueryId(context),
+                                             "cancelled through the API"));
+            return RestRequestRouter::MR_YES;
+        };
+
+    versionNode.addRoute("/queries", "GET", "List the running queries",
+                         listQueries, Json::Value());
+    versionNode.addRoute("/queries", "DELETE", "Cancel all running queries",
+                         cancelAllQueries, Json::Value());
+    versionNode.addRoute(Rx("/queries/([0-9]+)", "/queries/<id>"), "GET",
+                         "Get the status of a running query",
+                         getQuery, Json::Value());
+    versionNode.addRoute(Rx("/queries/([0-9]+)", "/queries/<id>"), "DELETE",
+                         "Cancel a running query",
+                         cancelQuery, Json::Value());
+
+    auto handleProfile = [=] (RestConnection & connection,
+                              const RestRequest & request,
+                              const RestRequestParsingContext & context)
+        {
+            // A profile lasts for seconds, so like a query it runs on one
+            // of the query threads rather than on one handling the
+            // connections
+            RestParams params = request.params;
+            auto run = [=] (RestConnection & connection)
+                {
+                    checkNotShuttingDown();
+                    Profile profile = getProfile(params);
+                    connection.sendHttpResponse
+                        (200, profile.printFolded(), "text/plain",
+                         { { "X-MLDB-Profile-Samples", std::to_string(profile.samples) },
+                           { "X-MLDB-Profile-Dropped", std::to_string(profile.dropped) } });
+                };
+
+            MLDB::runHttpQueryAsync(*queryExecutor, connection, run);
+            return RestRequestRouter::MR_ASYNC;
+        };
+
+    versionNode.addRoute("/debug/profile", "GET",
+                         "Profile the CPU time or the allocations of the "
+                         "server and return the folded stacks",
+                         handleProfile, Json::Value());
+
 
    // MLDB-1380 - make sure that the CPU support the minimal instruction sets
     if (supportsSystemRequirements()) {
@@ -215,7 +437,11 @@ initRoutes()
                                      false),
             HybridParamDefault<bool>("sortColumns",
                                      "Do we sort the column names",
-                                     false));
+                                     false),
+            HybridParamDefault<double>("timeout",
+                                       "Number of seconds after which the "
+                                       "query is cancelled; 0 for no limit",
+                                       0.0));
 
         this->versionNode = &versionNode;
         return true;
@@ -248,19 +474,158 @@ runHttpQuery(const Utf8String& query,
              bool createHeaders,
              bool rowNames,
              bool rowHashes,
-             bool sortColumns) const
+             bool sortColumns,
+             double timeout) const
 {
-    auto stm = SelectStatement::parse(query.rawString());
+    auto run = [=] (RestConnection & connection,
+                    RunningQueries::Entry & running)
+        {
+            this->runHttpQueryItl(query, connection, running, format,
+                                  createHeaders, rowNames, rowHashes,
+                                  sortColumns, timeout);
+        };
+
+    runAdmittedHttpQuery(query, connection, run, timeout);
+}
+
+void
+MldbServer::
+runAdmittedHttpQuery(const Utf8String & description,
+                     RestConnection & connection,
+                     std::function<void (RestConnection & connection,
+                                         RunningQueries::Entry & running)> run,
+                     double timeout) const
+{
+    // Queries are batch work, and may need to wait their turn.  That
+    // happens on the query's thread, so that the waiting queries don't
+    // take the threads that function calls need.
+    auto admitted = [=] (RestConnection & connection)
+        {
+            checkNotShuttingDown();
+
+            // Register the query before it waits, so that it can be
+            // listed and cancelled while it's queued and its timeout
+            // covers the wait.  The token is carried to all of the
+            // threads working on the query, which check it as they go.
+            auto running = runningQueries->add(description, timeout);
+            // shutdown() cancels the queries that were registered before it
+            if (shuttingDown)
+                running->token->cancel("the server is shutting down");
+            CancellationScope cancellation(running->token.get());
+
+            AdmissionController::Ticket ticket;
+            try {
+                ticket = admission->admit(PRIORITY_BATCH, description,
+                                          running->token.get());
+            } catch (...) {
+                checkQueryCancelled(*running, timeout);
+                throw;
+            }
+            running->admitted = true;
+
+            JobPriorityScope priority(PRIORITY_BATCH, true /* admitted */);
+            run(connection, *running);
+        };
+
+    MLDB::runHttpQueryAsync(*queryExecutor, connection, admitted);
+}
+
+void
+MldbServer::
+checkNotShuttingDown() const
+{
+    if (shuttingDown)
+        throw HttpReturnException(503, "The server is shutting down");
+}
+
+void
+MldbServer::
+runHttpQueryItl(const Utf8String& query,
+                RestConnection & connection,
+                RunningQueries::Entry & running,
+                const std::string & format,
+                bool createHeaders,
+                bool rowNames,
+                bool rowHashes,
+                bool sortColumns,
+                double timeout) const
+{
+    ExplainMode explain;
+    auto stm = SelectStatement::parse(query, explain);
     SqlExpressionMldbScope mldbContext(this);
 
-    auto runQuery = [&] ()
+    const QueryMetrics & metrics = queryMetrics();
+    metrics.queries.inc();
+    LatencyTimer timer(metrics.latency);
+
+    const CancellationToken & token = *running.token;
+
+    // Turn the exceptions or early stop caused by a cancellation into an
+    // error that tells the client what happened.  Once rows have been
+    // streamed, runHttpQueryStreaming can't send that error any more, and
+    // aborts the connection instead so that the client doesn't mistake
+    // the rows it got for the whole result.
+    auto checkCancelled = [&] ()
+        {
+            checkQueryCancelled(running, timeout);
+        };
+
+    // EXPLAIN and EXPLAIN ANALYZE return the plan instead of the rows.
+    // EXPLAIN ANALYZE runs the query, which may be stopped like any other.
+    if (explain != EXPLAIN_NONE) {
+        Json::Value plan;
+        try {
+            plan = explainStatement(stm, mldbContext,
+                                    explain == EXPLAIN_ANALYZE);
+        } catch (...) {
+            checkCancelled();
+            throw;
+        }
+        checkCancelled();
+        connection.sendResponse(200, plan);
+        return;
+    }
+
+    Scope_Exit(metrics.rowsOutput.inc(running.rowsOutput));
+
+    auto onProgress = [&] (const ProgressState & state)
+        {
+            return running.onProgress(state);
+        };
+
+    // Rows are passed through to the output as they are produced, so
+    // that large results don't need to be held in memory
+    auto runQuery = [&] (const OnQueryRow & onQueryRow)
         {
-            return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
+            std::function<bool (Path &, ExpressionValue &)> onRow
+                = [&] (Path & rowName, ExpressionValue & val)
+                {
+                    if (token.isCancelled())
+                        return false;
+                    MatrixNamedRow row;
+                    row.rowName = std::move(rowName);
+                    row.rowHash = row.rowName;
+                    val.mergeToRowDestructive(row.columns);
+                    ++running.rowsOutput;
+                    return onQueryRow(row);
+                };
+
+            bool result;
+            try {
+                result = queryFromStatement(onRow, stm, mldbContext,
+                                            nullptr /*params*/,
+                                            onProgress);
+            } catch (...) {
+                checkCancelled();
+                throw;
+            }
+            checkCancelled();
+            return result;
         };
 
-    MLDB::runHttpQuery(runQuery,
-                       connection, format, createHeaders,
-                       rowNames, rowHashes, sortColumns);
+    MLDB::runHttpQueryStreaming(runQuery,
+                                connection, format, createHeaders,
+                                rowNames, rowHashes, sortColumns);
 }
 
 std::vector<MatrixNamedRow>
@@ -289,6 +654,107 @@ getTypeInfo(const std::string & typeName)
     return result;
 }
 
+Json::Value
+MldbServer::
+getSchedulerInfo() const
+{
+    Json::Value result;
+
+    const ThreadPool & pool = ThreadPool::instance();
+    Json::Value & threadPool = result["threadPool"];
+    threadPool["numThreads"] = pool.numThreads();
+    for (int p = 0;  p < NUM_JOB_PRIORITIES;  ++p) {
+        auto stats = pool.priorityStats((JobPriority)p);
+        Json::Value & entry = threadPool[jobPriorityName((JobPriority)p)];
+        entry["maxThreads"] = stats.maxThreads;
+        entry["running"] = stats.running;
+        entry["queued"] = stats.queued;
+        entry["submitted"] = stats.submitted;
+        entry["started"] = stats.started;
+        entry["totalWaitSeconds"] = stats.totalWaitSeconds;
+        entry["longestWaitSeconds"] = stats.maxWaitSeconds;
+    }
+
+    result["admission"] = admission->getStats();
+    return result;
+}
+
+std::string
+MldbServer::
+getMetrics() const
+{
+    return MetricsRegistry::instance().printPrometheus();
+}
+
+Profile
+MldbServer::
+getProfile(const RestParams & params) const
+{
+    double seconds = 30.0;
+    std::string mode = "cpu";
+    int frequency = 100;
+    size_t sampleBytes = 512 * 1024;
+
+    for (auto & p: params) {
+        const std::string & key = p.first.rawString();
+        const std::string & value = p.second.rawString();
+        try {
+            if (key == "seconds")
+                seconds = std::stod(value);
+            else if (key == "mode")
+                mode = value;
+            else if (key == "frequency")
+                frequency = std::stoi(value);
+            else if (key == "sampleBytes")
+                sampleBytes = std::stoull(value);
+            else throw HttpReturnException
+                     (400, "Unknown parameter '" + key + "' for profile; "
+                      "known parameters are seconds, mode, frequency and "
+                      "sampleBytes");
+        } catch (const std::logic_error & exc) {
+            throw HttpReturnException(400, "Invalid value '" + value
+                                      + "' for profile parameter '"
+                                      + key + "'");
+        }
+    }
+
+    if (!(seconds > 0.0 && seconds <= 300.0))
+        throw HttpReturnException(400, "Profile length must be between 0 "
+                                  "and 300 seconds");
+    if (frequency <= 0 || frequency > 10000)
+        throw HttpReturnException(400, "Profile frequency must be between 1 "
+                                  "and 10000 samples per second");
+    if (sampleBytes == 0)
+        throw HttpReturnException(400, "sampleBytes must be positive");
+    if (mode != "cpu" && mode != "allocations" && mode != "live")
+        throw HttpReturnException(400, "Unknown profile mode '" + mode
+                                  + "'; known modes are cpu, allocations "
+                                  "and live");
+    if (mode != "cpu" && !allocation_hook_installed)
+        throw HttpReturnException(400, "Allocation profiling is not "
+                                  "available in this build of MLDB");
+
+    // Checked here so that the usual case gets a proper error; the
+    // profiler itself is what makes sure two don't run at once
+    if (profileRunning())
+        throw HttpReturnException(409, "A profile is already running");
+
+    // Stop early when the server shuts down, which waits for the profile
+    auto keepGoing = [this] () { return !shuttingDown; };
+
+    try {
+        if (mode == "cpu")
+            return profileCpu(seconds, frequency, keepGoing);
+        return profileAllocations(seconds, sampleBytes, mode == "live",
+                                  keepGoing);
+    } catch (const std::exception & exc) {
+        // Lost the race with another profile
+        if (profileRunning())
+            throw HttpReturnException(409, exc.what());
+        throw;
+    }
+}
+
 void
 MldbServer::
 initCollections(std::string credentialsPath,
@@ -373,6 +839,13 @@ void
 MldbServer::
 shutdown()
 {
+    // The queries use the server, so they need to be finished before it
+    // goes away.  Those that are waiting give up when they get their turn,
+    // and those that are running are cancelled.
+    shuttingDown = true;
+    runningQueries->cancelAll("the server is shutting down");
+    queryExecutor->shutdown();
+
     httpEndpoint->closePeer();
 
     ServicePeer::shutdown();
@@ -509,9 +982,11 @@ getPackageDocumentationPath(const Package & package) const
 
 void
 MldbServer::
-setCacheDirectory(const std::string & dir)
+setCacheDirectory(const std::string & dir, uint64_t maxUrlCacheBytes)
 {
     cacheDirectory_ = dir;
+    setUrlCacheDirectory(dir.empty() ? dir : dir + "/urls",
+                         maxUrlCacheBytes);
 }
 
 std::string
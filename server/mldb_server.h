@@ -14,6 +14,9 @@
 #include "mldb/types/string.h"
 #include "mldb/soa/service/event_service.h"
 #include "mldb/utils/log_fwd.h"
+#include "mldb/vfs/url_cache.h"
+#include "mldb/server/running_queries.h"
+#include <atomic>
 
 
 namespace MLDB {
@@ -29,6 +32,9 @@ struct ProcedureCollection;
 struct FunctionCollection;
 struct CredentialRuleCollection;
 struct TypeClassCollection;
+struct AdmissionController;
+struct QueryExecutor;
+struct Profile;
 
 struct Plugin;
 struct Dataset;
@@ -77,9 +83,13 @@ struct MldbServer: public ServicePeer, public EventRecorder {
     void scanPlugins(const std::string & dir);
 
     /** Set up the SSD cache directory, where files that need memory
-        mapping can be cached.
+        mapping can be cached.  Remote objects that are read (model
+        files, imported data, etc) are also kept in its "urls"
+        subdirectory, up to maxUrlCacheBytes bytes, so that loading them
+        again doesn't require a download.
     */
-    void setCacheDirectory(const std::string & dir);
+    void setCacheDirectory(const std::string & dir,
+                           uint64_t maxUrlCacheBytes = DEFAULT_URL_CACHE_SIZE);
 
     /** Initialize the server in standalone mode, with the given
         configuration path.  No remote
@@ -107,11 +117,23 @@ struct MldbServer: public ServicePeer, public EventRecorder {
     std::shared_ptr<CredentialRuleCollection> credentials;
     std::shared_ptr<TypeClassCollection> types;
 
+    /// Limits the number of queries and procedure runs that run at once
+    std::shared_ptr<AdmissionController> admission;
+
+    /// Queries run through the REST API, so that they can be cancelled
+    std::shared_ptr<RunningQueries> runningQueries;
+
+    /// Threads on which the queries made through the REST API run
+    std::shared_ptr<QueryExecutor> queryExecutor;
+
     /** Parse and perform an SQL query. */
     std::vector<MatrixNamedRow> query(const Utf8String& query) const;
 
     /** Parse and perform an SQL query, returning the results
-        on the given HTTP connection.
+        on the given HTTP connection.  The query is cancelled if it's
+        still running after timeout seconds, unless timeout is zero.
+        The query runs on one of the query executor's threads, rather
+        than on the thread handling the connection.
     */
     void runHttpQuery(const Utf8String& query,
                       RestConnection & connection,
@@ -119,12 +141,59 @@ struct MldbServer: public ServicePeer, public EventRecorder {
                       bool createHeaders,
                       bool rowNames,
                       bool rowHashes,
-                      bool sortColumns) const;
+                      bool sortColumns,
+                      double timeout) const;
+
+    /** Call run, which sends the response to a query on the connection,
+        on one of the query executor's threads once admission control
+        lets it run as batch work.  While it waits to be admitted, the
+        query only holds its executor thread, never one handling the
+        connections.  The query is registered in runningQueries, under
+        the given description, before it waits, so that it can be listed
+        and cancelled from then on, and it's cancelled if it's still
+        running after timeout seconds, unless timeout is zero.  Once the
+        server is shutting down, queries are refused with a 503.
+    */
+    void runAdmittedHttpQuery(const Utf8String & description,
+                              RestConnection & connection,
+                              std::function<void (RestConnection & connection,
+                                                  RunningQueries::Entry & running)> run,
+                              double timeout = 0.0) const;
+
+    /** Implementation of runHttpQuery, which runs on the query's
+        executor thread once it's admitted.
+    */
+    void runHttpQueryItl(const Utf8String& query,
+                         RestConnection & connection,
+                         RunningQueries::Entry & running,
+                         const std::string & format,
+                         bool createHeaders,
+                         bool rowNames,
+                         bool rowHashes,
+                         bool sortColumns,
+                         double timeout) const;
 
     /** Get a type info structure for the given type. */
     Json::Value
     getTypeInfo(const std::string & typeName);
 
+    /** Return the state of the thread pool and of admission control for
+        each priority class.
+    */
+    Json::Value
+    getSchedulerInfo() const;
+
+    /** Return the metrics of the process, in the Prometheus text
+        format.
+    */
+    std::string getMetrics() const;
+
+    /** Run a profile of the process as described by the parameters of a
+        /v1/debug/profile request, and return it once it's done, or
+        once the server starts shutting down.
+    */
+    Profile getProfile(const RestParams & params) const;
+
     /** Get the documentation path for the given package.  This will look
         at the working directory of the package that loaded it.
     */
@@ -165,15 +234,25 @@ struct MldbServer: public ServicePeer, public EventRecorder {
         const Json::Value payload = Json::Value()) const;
 
 private:
+    /** Throw a 503 if the server is shutting down. */
+    void checkNotShuttingDown() const;
+
     void preInit();
     bool initRoutes();
+    void initMetrics();
     void initCollections(std::string credentialsPath,
                          std::string staticFilesPath,
                          std::string staticDocPath,
                          bool hideInternalEntities);
     RestRequestRouter * versionNode;
     std::string cacheDirectory_;
+
+    /// Metrics read from this server, to be removed when it's destroyed
+    std::vector<uint64_t> metricCallbacks;
     std::shared_ptr<spdlog::logger> logger;
+
+    /// Set by shutdown(), so that no more queries are started
+    std::atomic<bool> shuttingDown;
 };
 
 } // namespace MLDB
@@ -12,7 +12,11 @@
 #include "mldb/rest/service_peer.h"
 #include "mldb/utils/json_utils.h"
 #include "mldb/rest/rest_request_binding.h"
+#include "mldb/rest/in_process_rest_connection.h"
 #include "mldb/server/procedure_collection.h"
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/query_executor.h"
+#include <thread>
 
 
 using namespace std;
@@ -20,6 +24,132 @@ using namespace std;
 
 namespace MLDB {
 
+namespace {
+
+/** Is the given run state one that the run will never leave? */
+bool isFinalRunState(const Utf8String & state)
+{
+    return state == "finished" || state == "cancelled" || state == "error";
+}
+
+/** Format a run event in the text/event-stream format of server-sent
+    events.  The JSON is printed on a single line, as a newline would
+    terminate the data field.
+*/
+std::string
+formatRunEvent(const std::string & event, const ProcedureRunStatus & status)
+{
+    return "event: " + event + "\ndata: " + jsonEncodeStr(status) + "\n\n";
+}
+
+std::string
+formatRunEvent(const std::string & event, const Utf8String & key,
+               const Utf8String & state, const Json::Value & progress)
+{
+    ProcedureRunStatus status;
+    status.id = key;
+    status.state = state;
+    status.progress = progress;
+    return formatRunEvent(event, status);
+}
+
+/** State of a client streaming the events of a run.  The watch's callback
+    holds a reference to it, and it holds the run's task.  Both the
+    connection and the watch are released as soon as the run is done or
+    the client goes away, which frees the stream and lets the task go.
+*/
+struct RunEventStream {
+    RunEventStream(Utf8String key, double minInterval,
+                   std::shared_ptr<QueryExecutor> executor)
+        : key(std::move(key)), minInterval(minInterval),
+          executor(std::move(executor))
+    {
+    }
+
+    /** Send the event on the connection, if it's still there.  Events that
+        only update the progress are dropped if they come less than
+        minInterval seconds after the previous one.  Called with the task's
+        mutex held, so that events are sent in order.
+    */
+    void onEvent(const Utf8String & state, const Json::Value & progress)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (!connection)
+            return;
+
+        bool stateChanged = state != lastState;
+        Date now = Date::now();
+        if (!stateChanged && now.secondsSince(lastEvent) < minInterval)
+            return;
+
+        if (!connection->isConnected()) {
+            connection.reset();
+            releaseWatch();
+            return;
+        }
+
+        connection->sendPayload(formatRunEvent(stateChanged
+                                               ? "state" : "progress",
+                                               key, state, progress));
+        lastState = state;
+        lastEvent = now;
+
+        if (isFinalRunState(state)) {
+            connection->finishResponse();
+            connection.reset();
+            releaseWatch();
+        }
+    }
+
+    void onDisconnect()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        connection.reset();
+        releaseWatch();
+    }
+
+    /** Detach the watch from the task, so that later events don't reach
+        the stream any more.  This is mostly called from within the watch's
+        own callback, while the task is iterating over its watches, where
+        the watch can't be detached.  So it's done as a job on the server's
+        executor, which never runs it inline; the job waits for the event
+        in progress to be delivered, and holds the task so that it's not
+        destroyed underneath the watch.  If the server is shutting down,
+        the watch is left attached and goes away with the task.  Called
+        with the mutex held.
+    */
+    void releaseWatch()
+    {
+        if (!watch)
+            return;
+
+        auto toRelease = std::move(watch);
+        auto heldTask = std::move(task);
+        auto doRelease = [toRelease, heldTask] ()
+            {
+                toRelease->detach();
+            };
+
+        executor->add(doRelease);
+    }
+
+    Utf8String key;
+    double minInterval;
+    std::shared_ptr<QueryExecutor> executor;
+
+    // The watch is only ever moved through the pointer, as moving a watch
+    // needs the lock that is held while its callback runs
+    std::shared_ptr<WatchT<Utf8String, Json::Value> > watch;
+    std::shared_ptr<BackgroundTaskBase> task;
+
+    std::mutex mutex;
+    std::shared_ptr<RestConnection> connection;
+    Utf8String lastState;
+    Date lastEvent;
+};
+
+} // file scope
+
 
 /*****************************************************************************/
 /* PROCEDURE TRAINING COLLECTION                                              */
@@ -45,6 +175,9 @@ initRoutes(RouteManager & manager)
 
     ExcAssert(manager.getKey);
 
+    // A synchronous run waits for batch admission and then for the whole
+    // run; neither should hold a thread that handles HTTP requests
+    manager.deferSyncResponses = true;
     manager.addPutRoute();
     manager.addPostRoute();
     manager.addDeleteRoute();
@@ -105,6 +238,98 @@ initRoutes(RouteManager & manager)
         };
 
 
+    RestRequestRouter::OnProcessRequest getRunEvents
+        = [=] (RestConnection & connection,
+               const RestRequest & req,
+               const RestRequestParsingContext & cxt)
+        {
+            try {
+                auto collection = manager.getCollection(cxt);
+                Utf8String key = manager.getKey(cxt);
+
+                double minInterval = 0.0;
+                if (req.params.hasValue("minInterval")) {
+                    MLDB_TRACE_EXCEPTIONS(false);
+                    minInterval = jsonDecodeStr<double>
+                        (req.params.getValue("minInterval").rawString());
+                }
+
+                RestParams headers = { { "Cache-Control", "no-cache" } };
+
+                auto runEntry = collection->getEntry(key);
+                if (!runEntry.second) {
+                    // Nothing more will happen to the run, so its status is
+                    // the only event
+                    connection.sendHttpResponse
+                        (200, formatRunEvent("state", collection->getStatus(key)),
+                         "text/event-stream", headers);
+                    return RestRequestRouter::MR_YES;
+                }
+
+                // Watch before we do anything else, so that we don't miss
+                // any event.  They are queued until we bind.
+                auto watch = runEntry.second->watchProgress();
+
+                // In-process connections can't be captured, so we wait for
+                // the run to finish and send all of its events at once.
+                if (dynamic_cast<InProcessRestConnection *>(&connection)) {
+                    std::string events;
+                    Utf8String lastState;
+                    while (!isFinalRunState(lastState)) {
+                        Utf8String state;
+                        Json::Value progress;
+                        std::tie(state, progress) = watch.wait();
+                        events += formatRunEvent(state != lastState
+                                                 ? "state" : "progress",
+                                                 key, state, progress);
+                        lastState = state;
+                    }
+                    connection.sendHttpResponse(200, std::move(events),
+                                                "text/event-stream", headers);
+                    return RestRequestRouter::MR_YES;
+                }
+
+                auto stream = std::make_shared<RunEventStream>
+                    (key, minInterval,
+                     static_cast<ProcedureRunCollection *>(collection)
+                     ->procedure->server->queryExecutor);
+                stream->watch = std::make_shared<WatchT<Utf8String, Json::Value> >
+                    (std::move(watch));
+                stream->task = runEntry.second;
+                std::weak_ptr<RunEventStream> weakStream = stream;
+                auto onDisconnect = [=] ()
+                    {
+                        auto stream = weakStream.lock();
+                        if (stream)
+                            stream->onDisconnect();
+                    };
+
+                auto captured = connection.capture(onDisconnect);
+                captured->sendHttpResponseHeader
+                    (200, "text/event-stream",
+                     RestConnection::CHUNKED_ENCODING, headers);
+                stream->connection = std::move(captured);
+
+                auto onEvent = [=] (const Utf8String & state,
+                                    const Json::Value & progress)
+                    {
+                        stream->onEvent(state, progress);
+                    };
+
+                // The stream holds the watch and the watch holds the
+                // stream; the cycle is broken when the stream releases the
+                // watch, at the end of the run or when the client goes
+                // away.  Binding may deliver the final state and release
+                // it straight away, so we bind through our own reference.
+                auto boundWatch = stream->watch;
+                boundWatch->bind(onEvent);
+
+                return RestRequestRouter::MR_ASYNC;
+            } catch (const std::exception & exc) {
+                return sendExceptionResponse(connection, exc);
+            }
+        };
+
     Json::Value help;
     help["result"] = manager.nounSingular + " status after creation";
 
@@ -140,6 +365,22 @@ initRoutes(RouteManager & manager)
                            help);
 
 
+    Json::Value eventsHelp;
+    Json::Value & p = eventsHelp["requestParams"][0];
+    p["name"] = "minInterval";
+    p["description"] = "Minimum number of seconds between two events that "
+        "only update the progress of the run.  State changes are always "
+        "sent.  Defaults to 0, which sends every update.";
+    p["encoding"] = "URI encoded";
+    p["location"] = "query string";
+    eventsHelp["result"] = "Stream of server-sent events with the state and "
+        "progress of the run, which ends once the run is done";
+
+    manager.valueNode->addRoute("/events", { "GET" },
+                                "Stream the state and progress of the run",
+                                getRunEvents,
+                                eventsHelp);
+
     addRouteSyncJsonReturn(*manager.valueNode, "/details", { "GET" },
                            "Get the details about the run's output",
                            "Run-specific JSON output",
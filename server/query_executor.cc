@@ -0,0 +1,135 @@
+/** query_executor.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "query_executor.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/jml/utils/environment.h"
+#include <algorithm>
+#include <iostream>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+EnvOption<int, true /* trace */>
+MLDB_QUERY_THREADS("MLDB_QUERY_THREADS", 0);
+
+} // file scope
+
+
+/*****************************************************************************/
+/* QUERY EXECUTOR                                                            */
+/*****************************************************************************/
+
+QueryExecutor::
+QueryExecutor(int maxThreads)
+    : maxThreads(maxThreads), idleThreads(0), shuttingDown(false)
+{
+    if (this->maxThreads <= 0)
+        this->maxThreads = MLDB_QUERY_THREADS;
+    // Enough for the batch tasks that admission control lets run at once,
+    // plus those waiting for their turn or for a slow client
+    if (this->maxThreads <= 0)
+        this->maxThreads = std::max(4 * numCpus(), 64);
+}
+
+QueryExecutor::
+~QueryExecutor()
+{
+    shutdown();
+}
+
+bool
+QueryExecutor::
+add(std::function<void ()> job)
+{
+    ExcAssert(job);
+
+    std::unique_lock<std::mutex> guard(mutex);
+    if (shuttingDown)
+        return false;
+
+    queue.emplace_back(std::move(job));
+
+    if (idleThreads < queue.size() && threads.size() < maxThreads)
+        threads.emplace_back([this] () { this->runThread(); });
+    else changed.notify_one();
+
+    return true;
+}
+
+void
+QueryExecutor::
+shutdown()
+{
+    std::vector<std::thread> toJoin;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        shuttingDown = true;
+        toJoin.swap(threads);
+        changed.notify_all();
+    }
+
+    // The threads exit once the queue is empty
+    for (auto & t: toJoin)
+        t.join();
+
+    ExcAssert(queue.empty());
+}
+
+size_t
+QueryExecutor::
+numThreads() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return threads.size();
+}
+
+size_t
+QueryExecutor::
+numQueued() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return queue.size();
+}
+
+void
+QueryExecutor::
+runThread()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    for (;;) {
+        ++idleThreads;
+        changed.wait(guard, [&] () { return !queue.empty() || shuttingDown; });
+        --idleThreads;
+
+        if (queue.empty())
+            return;  // shutting down, and nothing left to do
+
+        auto job = std::move(queue.front());
+        queue.pop_front();
+
+        guard.unlock();
+        try {
+            job();
+        } catch (const std::exception & exc) {
+            cerr << "ERROR: query job threw exception: " << exc.what() << endl;
+        } catch (...) {
+            cerr << "ERROR: query job threw unknown exception" << endl;
+        }
+        // Destroy the job, and what it holds, before we wait again
+        job = nullptr;
+        guard.lock();
+    }
+}
+
+} // namespace MLDB
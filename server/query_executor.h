@@ -0,0 +1,80 @@
+/** query_executor.h                                               -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Threads on which the server runs the queries made through the REST API.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY EXECUTOR                                                            */
+/*****************************************************************************/
+
+/** A bounded set of threads, owned by the server, which run the queries
+    made through the REST API so that they don't hold up the threads
+    handling the connections.  A query may block its thread for a long
+    time, waiting to be admitted or for a slow client to read its output,
+    which is why these aren't the ThreadPool's threads.
+
+    Threads are started as they are needed, up to the limit, and then kept
+    for the following queries.  Queries over the limit wait in a queue
+    until a thread is free.
+*/
+
+struct QueryExecutor {
+
+    /** Create an executor with at most the given number of threads.  If
+        it is zero or less, the MLDB_QUERY_THREADS environment variable is
+        used, or a default based on the number of CPUs.
+    */
+    QueryExecutor(int maxThreads = 0);
+
+    /** Shuts down the executor, waiting for its jobs to finish. */
+    ~QueryExecutor();
+
+    /** Queue the job to run on one of the threads.  Returns false, without
+        running the job, if the executor was shut down.  Exceptions that
+        escape from the job are logged and ignored.
+    */
+    bool add(std::function<void ()> job);
+
+    /** Stop taking new jobs, and wait for the running and queued ones to
+        finish before joining the threads.  It's up to the caller to make
+        sure that they finish promptly, by cancelling them.  May be called
+        more than once.
+    */
+    void shutdown();
+
+    /** Return the number of threads started. */
+    size_t numThreads() const;
+
+    /** Return the number of jobs waiting for a thread. */
+    size_t numQueued() const;
+
+private:
+    void runThread();
+
+    int maxThreads;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::function<void ()> > queue;
+    std::vector<std::thread> threads;
+    int idleThreads;
+    bool shuttingDown;
+};
+
+} // namespace MLDB
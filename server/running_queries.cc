@@ -0,0 +1,191 @@
+/** running_queries.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "running_queries.h"
+#include "mldb/http/http_exception.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ENTRY                                                                     */
+/*****************************************************************************/
+
+RunningQueries::Entry::
+Entry(uint64_t id, const Utf8String & query)
+    : id(id), query(query), started(Date::now()),
+      token(std::make_shared<CancellationToken>()), admitted(false),
+      rowsOutput(0), progress(0), progressTotal(-1)
+{
+}
+
+bool
+RunningQueries::Entry::
+onProgress(const ProgressState & state)
+{
+    progress = state.count;
+    if (state.total)
+        progressTotal = *state.total;
+    return !token->isCancelled();
+}
+
+Json::Value
+RunningQueries::Entry::
+getStatus() const
+{
+    Json::Value result;
+    result["id"] = to_string(id);
+    result["query"] = query;
+    result["started"] = started.printIso8601();
+    result["elapsedSeconds"] = Date::now().secondsSince(started);
+    result["rowsOutput"] = (uint64_t)rowsOutput;
+
+    Json::Value & prog = result["progress"];
+    prog["count"] = (uint64_t)progress;
+    int64_t total = progressTotal;
+    if (total >= 0) {
+        prog["total"] = total;
+        if (total > 0)
+            prog["percent"] = 100.0 * progress / total;
+    }
+
+    if (token->isCancelled()) {
+        result["state"] = token->timedOut() ? "timedOut" : "cancelled";
+        result["reason"] = token->reason();
+    }
+    else result["state"] = admitted ? "running" : "waiting";
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* REGISTRATION                                                              */
+/*****************************************************************************/
+
+RunningQueries::Registration::
+Registration(RunningQueries * owner, std::shared_ptr<Entry> entry)
+    : owner(owner), entry(std::move(entry))
+{
+}
+
+RunningQueries::Registration::
+Registration(Registration && other)
+    : owner(other.owner), entry(std::move(other.entry))
+{
+    other.owner = nullptr;
+}
+
+RunningQueries::Registration::
+~Registration()
+{
+    if (owner && entry)
+        owner->remove(entry->id);
+}
+
+
+/*****************************************************************************/
+/* RUNNING QUERIES                                                           */
+/*****************************************************************************/
+
+RunningQueries::
+RunningQueries()
+    : nextId(1)
+{
+}
+
+RunningQueries::Registration
+RunningQueries::
+add(const Utf8String & query, double timeoutSeconds)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto entry = std::make_shared<Entry>(nextId++, query);
+    if (timeoutSeconds > 0)
+        entry->token->setTimeout(timeoutSeconds);
+    queries[entry->id] = entry;
+    return Registration(this, std::move(entry));
+}
+
+void
+RunningQueries::
+remove(uint64_t id)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    queries.erase(id);
+}
+
+std::shared_ptr<RunningQueries::Entry>
+RunningQueries::
+find(uint64_t id) const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto it = queries.find(id);
+    if (it == queries.end())
+        throw HttpReturnException(404, "Query " + to_string(id)
+                                  + " is not running",
+                                  "queryId", id);
+    return it->second;
+}
+
+size_t
+RunningQueries::
+size() const
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    return queries.size();
+}
+
+Json::Value
+RunningQueries::
+list() const
+{
+    std::vector<std::shared_ptr<Entry> > entries;
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        for (auto & q: queries)
+            entries.push_back(q.second);
+    }
+
+    Json::Value result(Json::arrayValue);
+    for (auto & e: entries)
+        result.append(e->getStatus());
+    return result;
+}
+
+Json::Value
+RunningQueries::
+get(uint64_t id) const
+{
+    return find(id)->getStatus();
+}
+
+Json::Value
+RunningQueries::
+cancel(uint64_t id, const std::string & reason)
+{
+    auto entry = find(id);
+    entry->token->cancel(reason);
+    return entry->getStatus();
+}
+
+Json::Value
+RunningQueries::
+cancelAll(const std::string & reason)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    for (auto & q: queries)
+        q.second->token->cancel(reason);
+
+    Json::Value result;
+    result["cancelled"] = (uint64_t)queries.size();
+    return result;
+}
+
+} // namespace MLDB
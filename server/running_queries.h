@@ -0,0 +1,112 @@
+/** running_queries.h                                              -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Registry of the queries that are running on the server, so that they
+    can be listed and cancelled.
+*/
+
+#pragma once
+
+#include "mldb/base/cancellation.h"
+#include "mldb/types/string.h"
+#include "mldb/types/date.h"
+#include "mldb/utils/progress.h"
+#include "mldb/ext/jsoncpp/value.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* RUNNING QUERIES                                                           */
+/*****************************************************************************/
+
+/** Keeps track of the queries that are running on the server, each with
+    the CancellationToken that allows it to be stopped.  Queries are
+    identified by a sequential number.
+*/
+
+struct RunningQueries {
+
+    /// A query that is running, or waiting to be admitted
+    struct Entry {
+        Entry(uint64_t id, const Utf8String & query);
+
+        uint64_t id;
+        Utf8String query;
+        Date started;
+        std::shared_ptr<CancellationToken> token;
+
+        /// Has the query been admitted, or is it still waiting its turn?
+        std::atomic<bool> admitted;
+
+        /// Number of rows that were sent to the client
+        std::atomic<uint64_t> rowsOutput;
+
+        /// Latest progress reported by the query
+        std::atomic<uint64_t> progress;
+        std::atomic<int64_t> progressTotal;  ///< -1 if unknown
+
+        /** Record the given progress, and return false if the query
+            should stop.  Suitable for use as a ProgressFunc.
+        */
+        bool onProgress(const ProgressState & state);
+
+        Json::Value getStatus() const;
+    };
+
+    /** Holds the registration of a query.  The query is removed from the
+        registry when it is destroyed.
+    */
+    struct Registration {
+        Registration(RunningQueries * owner, std::shared_ptr<Entry> entry);
+        Registration(Registration && other);
+        ~Registration();
+
+        Entry & operator * () const { return *entry; }
+        Entry * operator -> () const { return entry.get(); }
+
+    private:
+        RunningQueries * owner;
+        std::shared_ptr<Entry> entry;
+    };
+
+    RunningQueries();
+
+    /** Register a new query, which will time out after the given number
+        of seconds if it is positive.
+    */
+    Registration add(const Utf8String & query, double timeoutSeconds);
+
+    /** Return the number of running queries. */
+    size_t size() const;
+
+    /** Return the status of all running queries. */
+    Json::Value list() const;
+
+    /** Return the status of the given query.  Throws a 404 if it's not
+        running.
+    */
+    Json::Value get(uint64_t id) const;
+
+    /** Ask the given query to stop.  Throws a 404 if it's not running. */
+    Json::Value cancel(uint64_t id, const std::string & reason);
+
+    /** Ask all running queries to stop, and return how many there were. */
+    Json::Value cancelAll(const std::string & reason);
+
+private:
+    void remove(uint64_t id);
+    std::shared_ptr<Entry> find(uint64_t id) const;
+
+    mutable std::mutex mutex;
+    std::map<uint64_t, std::shared_ptr<Entry> > queries;
+    uint64_t nextId;
+};
+
+} // namespace MLDB
@@ -26,6 +26,10 @@ LIBMLDB_SOURCES:= \
 	forwarded_dataset.cc \
 	column_scope.cc \
 	bucket.cc \
+	admission_control.cc \
+	running_queries.cc \
+	columnar_output.cc \
+	query_executor.cc \
 
 LIBMLDB_LINK:= \
 	service_peer mldb_builtin_plugins sql_expression runner credentials git2 hoedown mldb_builtin command_expression vfs_handlers mldb_core
@@ -35,4 +39,4 @@ $(eval $(call library,mldb,$(LIBMLDB_SOURCES),$(LIBMLDB_LINK)))
 $(eval $(call library_forward_dependency,mldb,mldb_builtin))
 $(eval $(call library_forward_dependency,mldb,mldb_builtin_plugins))
 
-$(eval $(call program,mldb_runner,mldb boost_program_options config))
+$(eval $(call program,mldb_runner,mldb boost_program_options config allocation_hook))
@@ -7,9 +7,12 @@
 
 #include "execution_pipeline.h"
 #include "execution_pipeline_impl.h"
+#include "query_profile.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/arch/demangle.h"
+#include "mldb/base/exc_assert.h"
 #include <algorithm>
 
 
@@ -393,6 +396,116 @@ takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
     return true;
 }
 
+
+/*****************************************************************************/
+/* BOUND PIPELINE ELEMENT                                                    */
+/*****************************************************************************/
+
+namespace {
+
+/** Name of a pipeline element for EXPLAIN, for example "JoinElement"
+    for a JoinElement::Bound.
+*/
+std::string elementName(const BoundPipelineElement & element)
+{
+    std::string result = MLDB::type_name(element);
+    if (result.compare(0, 6, "MLDB::") == 0)
+        result.erase(0, 6);
+    size_t pos = result.rfind("::Bound");
+    if (pos != std::string::npos && pos + 7 == result.size())
+        result.erase(pos);
+    return result;
+}
+
+/** Executor that measures the element it wraps, for EXPLAIN ANALYZE. */
+struct ProfiledExecutor: public ElementExecutor {
+    ProfiledExecutor(std::shared_ptr<ElementExecutor> inner,
+                     std::shared_ptr<OperatorProfile> profile)
+        : inner(std::move(inner)), profile(std::move(profile))
+    {
+    }
+
+    std::shared_ptr<ElementExecutor> inner;
+    std::shared_ptr<OperatorProfile> profile;
+
+    virtual std::shared_ptr<PipelineResults> take()
+    {
+        OperatorProfile::Activity activity(profile.get());
+        auto result = inner->take();
+        if (result)
+            profile->rowsOut += 1;
+        return result;
+    }
+
+    virtual bool takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
+    {
+        OperatorProfile::Activity activity(profile.get());
+        auto onResult2 = [&] (std::shared_ptr<PipelineResults> & result)
+            {
+                profile->rowsOut += 1;
+                return onResult(result);
+            };
+        return inner->takeAll(onResult2);
+    }
+
+    virtual void restart()
+    {
+        inner->restart();
+    }
+};
+
+} // file scope
+
+std::vector<std::shared_ptr<BoundPipelineElement> >
+BoundPipelineElement::
+boundInputs() const
+{
+    auto source = boundSource();
+    if (!source)
+        return {};
+    return { source };
+}
+
+Json::Value
+BoundPipelineElement::
+explainDetails() const
+{
+    return Json::Value();
+}
+
+Json::Value
+BoundPipelineElement::
+explain() const
+{
+    Json::Value result;
+    result["operator"] = elementName(*this);
+    Json::Value details = explainDetails();
+    if (!details.isNull())
+        result["details"] = details;
+    for (auto & input: boundInputs())
+        result["inputs"].append(input->explain());
+    return result;
+}
+
+std::shared_ptr<ElementExecutor>
+BoundPipelineElement::
+startInput(const std::shared_ptr<BoundPipelineElement> & input,
+           const BoundParameters & getParam)
+{
+    ExcAssert(input);
+
+    auto profile = QueryProfile::addOperator(elementName(*input),
+                                             input->explainDetails());
+    if (!profile)
+        return input->start(getParam);
+
+    // Inputs started by this element will be recorded as its children
+    QueryProfile::Nest nest(profile);
+    return std::make_shared<ProfiledExecutor>(input->start(getParam),
+                                              profile);
+}
+
+
 /*****************************************************************************/
 /* PIPELINE ELEMENT                                                          */
 /*****************************************************************************/
@@ -264,6 +264,30 @@ struct BoundPipelineElement {
     {
         return outputScope()->numOutputFields();
     }
+
+    /** Return the elements whose output this element consumes.  The
+        default is the bound source.  Used by EXPLAIN.
+    */
+    virtual std::vector<std::shared_ptr<BoundPipelineElement> >
+    boundInputs() const;
+
+    /** Return an element-specific description of what this element
+        does, or null if there is nothing to add.  Used by EXPLAIN.
+    */
+    virtual Json::Value explainDetails() const;
+
+    /** Describe the pipeline that ends with this element as a tree of
+        operators, without running it.
+    */
+    Json::Value explain() const;
+
+    /** Start the given element.  Elements must start their inputs through
+        this function so that when a query is explained with EXPLAIN
+        ANALYZE (see QueryProfile), each element is measured separately.
+    */
+    static std::shared_ptr<ElementExecutor>
+    startInput(const std::shared_ptr<BoundPipelineElement> & input,
+               const BoundParameters & getParam);
 };
 
 
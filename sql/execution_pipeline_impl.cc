@@ -8,6 +8,7 @@
 */
 
 #include "execution_pipeline_impl.h"
+#include "query_profile.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/set_description.h"
@@ -17,6 +18,7 @@
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/base/scope.h"
+#include "mldb/base/cancellation.h"
 #include "mldb/utils/log.h"
 
 using namespace std;
@@ -278,6 +280,13 @@ take()
     if (currentDone == current.size() && !generateMore(*result))
         return nullptr;
 
+    // Rows are produced one at a time here, so this is where a cancelled
+    // query stops pulling them through the pipeline
+    if (currentDone % 1000 == 0) {
+        if (CancellationToken * token = currentCancellationToken())
+            token->throwIfCancelled();
+    }
+
     //cerr << "got row " << current[currentDone].rowName << " "
     //     << jsonEncodeStr(current[currentDone].columns) << endl;
 
@@ -347,7 +356,7 @@ GenerateRowsElement::Bound::
 start(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<GenerateRowsExecutor>();
-    result->source = source_->start(getParam);
+    result->source = startInput(source_, getParam);
 
     result->generator
         = parent->from.runQuery(*outputScope_,
@@ -359,6 +368,11 @@ start(const BoundParameters & getParam) const
                                 nullptr /*onProgress*/);
     result->params = getParam;
     ExcAssert(result->params);
+
+    // The row generation strategy is only known once the query is run
+    if (auto op = QueryProfile::currentOperator())
+        op->details["rowGenerator"] = result->generator.explain;
+
     return result;
 }
 
@@ -376,6 +390,18 @@ outputScope() const
     return outputScope_;
 }
 
+Json::Value
+GenerateRowsElement::Bound::
+explainDetails() const
+{
+    Json::Value result;
+    result["as"] = parent->as;
+    result["where"] = parent->where->surface;
+    if (!parent->orderBy.clauses.empty())
+        result["orderBy"] = parent->orderBy.surface;
+    return result;
+}
+
 /*****************************************************************************/
 /* SUB SELECT LEXICAL SCOPE                                                  */
 /*****************************************************************************/
@@ -455,7 +481,7 @@ SubSelectExecutor::
 SubSelectExecutor(std::shared_ptr<BoundPipelineElement> boundSelect,
                   const BoundParameters & getParam)
 {
-    pipeline = boundSelect->start(getParam);
+    pipeline = BoundPipelineElement::startInput(boundSelect, getParam);
 }
 
 std::shared_ptr<PipelineResults>
@@ -538,6 +564,14 @@ boundSource() const
     return source_;
 }
 
+std::vector<std::shared_ptr<BoundPipelineElement> >
+SubSelectElement::Bound::
+boundInputs() const
+{
+    // The sub select runs its own pipeline; the source is only a scope
+    return { boundSelect };
+}
+
 std::shared_ptr<PipelineExpressionScope>
 SubSelectElement::Bound::
 outputScope() const
@@ -1639,18 +1673,18 @@ start(const BoundParameters & getParam) const
         if (joinQualification_ == JOIN_FULL) {
             return std::make_shared<FullCrossJoinExecutor>
             (this,
-             root_->start(getParam),
-             left_->start(getParam),
-             right_->start(getParam),
+             startInput(root_, getParam),
+             startInput(left_, getParam),
+             startInput(right_, getParam),
              leftAdded,
              rightAdded);
         }
         else {
             return std::make_shared<CrossJoinExecutor>
             (this,
-             root_->start(getParam),
-             left_->start(getParam),
-             right_->start(getParam),
+             startInput(root_, getParam),
+             startInput(left_, getParam),
+             startInput(right_, getParam),
              leftAdded,
              rightAdded);
         }        
@@ -1659,9 +1693,9 @@ start(const BoundParameters & getParam) const
     case AnnotatedJoinCondition::EQUIJOIN:
         return std::make_shared<EquiJoinExecutor>
             (this,
-             root_->start(getParam),
-             left_->start(getParam),
-             right_->start(getParam),
+             startInput(root_, getParam),
+             startInput(left_, getParam),
+             startInput(right_, getParam),
              leftAdded,
              rightAdded);
 
@@ -1678,6 +1712,23 @@ boundSource() const
     return left_->boundSource();
 }
 
+std::vector<std::shared_ptr<BoundPipelineElement> >
+JoinElement::Bound::
+boundInputs() const
+{
+    return { left_, right_ };
+}
+
+Json::Value
+JoinElement::Bound::
+explainDetails() const
+{
+    Json::Value result;
+    result["style"] = jsonEncode(condition_.style);
+    result["qualification"] = jsonEncode(joinQualification_);
+    return result;
+}
+
 std::shared_ptr<PipelineExpressionScope>
 JoinElement::Bound::
 outputScope() const
@@ -1994,7 +2045,7 @@ start(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent_ = this;
-    result->source_ = source_->start(getParam);
+    result->source_ = startInput(source_, getParam);
     return result;
 }
 
@@ -2092,7 +2143,7 @@ start(const BoundParameters & getParam) const
 {
     auto result = std::make_shared<Executor>();
     result->parent = this;
-    result->source = source_->start(getParam);
+    result->source = startInput(source_, getParam);
     return result;
 }
 
@@ -2216,7 +2267,7 @@ OrderByElement::Bound::
 start(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>(this,
-                                      source_->start(getParam));
+                                      startInput(source_, getParam));
 }
 
 std::shared_ptr<BoundPipelineElement>
@@ -2490,7 +2541,7 @@ PartitionElement::Bound::
 start(const BoundParameters & getParam) const
 {
     return std::make_shared<Executor>
-        (this, source_->start(getParam),
+        (this, startInput(source_, getParam),
          source_->numOutputFields() - numValues_,
          source_->numOutputFields());
 }
@@ -2575,7 +2626,7 @@ std::shared_ptr<ElementExecutor>
 ParamsElement::Bound::
 start(const BoundParameters & getParam) const
 {
-    return std::make_shared<Executor>(source_->start(getParam),
+    return std::make_shared<Executor>(startInput(source_, getParam),
                                       getParam);
 }
 
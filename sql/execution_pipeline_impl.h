@@ -123,6 +123,7 @@ struct GenerateRowsElement: public PipelineElement {
 
         virtual std::shared_ptr<PipelineExpressionScope>
         outputScope() const;
+        virtual Json::Value explainDetails() const;
     };
 
     std::shared_ptr<BoundPipelineElement> bind() const;
@@ -222,6 +223,9 @@ struct SubSelectElement: public PipelineElement {
         virtual std::shared_ptr<PipelineExpressionScope>
         outputScope() const;
 
+        virtual std::vector<std::shared_ptr<BoundPipelineElement> >
+        boundInputs() const;
+
         std::shared_ptr<BoundPipelineElement> boundSelect;
     };
 
@@ -461,6 +465,11 @@ struct JoinElement: public PipelineElement {
             output context is the same as its input context.
         */
         virtual std::shared_ptr<PipelineExpressionScope> outputScope() const;
+
+        virtual std::vector<std::shared_ptr<BoundPipelineElement> >
+        boundInputs() const;
+
+        virtual Json::Value explainDetails() const;
     };
 
     std::shared_ptr<BoundPipelineElement>
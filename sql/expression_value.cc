@@ -1897,6 +1897,15 @@ ExpressionValue(StructValue vals,
     initStructured(std::move(vals), needsSorting, hasDuplicates);
 }
 
+ExpressionValue
+ExpressionValue::
+fromSortedRow(std::shared_ptr<const StructValue> row) noexcept
+{
+    ExpressionValue result;
+    result.initStructured(std::move(row));
+    return result;
+}
+
 ExpressionValue &
 ExpressionValue::
 operator = (const ExpressionValue & other)
@@ -799,6 +799,13 @@ struct ExpressionValue {
                     Sorting sorting = MAY_BE_SORTED,
                     Duplicates duplicates = MAY_HAVE_DUPLICATES) noexcept;
 
+    /** Construct a row that shares the given columns, which must already
+        be sorted by name with no duplicates.  This lets the caller decide
+        where the storage of the row comes from, for example to recycle it.
+    */
+    static ExpressionValue
+    fromSortedRow(std::shared_ptr<const StructValue> row) noexcept;
+
     // Construct from JSON.  Will convert to an atom or a row.
     ExpressionValue(const Json::Value & json, Date ts);
     
@@ -9,6 +9,9 @@
 #include "mldb/types/value_description.h"
 #include "mldb/types/meta_value_description.h"
 #include "mldb/http/http_exception.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 
 namespace MLDB {
@@ -35,6 +38,55 @@ struct FieldInfo {
     PathElement fieldName;
 };
 
+/** Recycles the rows that are output for a structure.  A row is handed
+    out again once nothing but the pool refers to it, keeping its storage,
+    so that converting values of the same type over and over, as a
+    function does for each call, doesn't allocate the row once it has
+    reached a steady state.  The values in a row that was let go are only
+    destroyed once it's reused.
+*/
+struct RowPool {
+    /// Number of rows kept for reuse; rows beyond are allocated as usual
+    static constexpr size_t MAX_ROWS = 32;
+
+    RowPool(size_t width)
+        : width(width), next(0)
+    {
+        rows.reserve(MAX_ROWS);
+    }
+
+    /** Return an empty row with room for width columns, which nobody
+        else refers to.
+    */
+    std::shared_ptr<StructValue> get()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        for (size_t i = 0;  i < rows.size();  ++i) {
+            size_t n = (next + i) % rows.size();
+            if (rows[n].use_count() != 1)
+                continue;
+            // Nobody can take a new reference to a row that only the pool
+            // holds.  This pairs with the release of the last one, so that
+            // it's done with the row before we touch it.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = n + 1;
+            rows[n]->clear();
+            return rows[n];
+        }
+
+        auto result = std::make_shared<StructValue>();
+        result->reserve(width);
+        if (rows.size() < MAX_ROWS)
+            rows.push_back(result);
+        return result;
+    }
+
+    size_t width;
+    std::mutex mutex;
+    std::vector<std::shared_ptr<StructValue> > rows;
+    size_t next;
+};
+
 } // file scope
 
 std::tuple<std::shared_ptr<ExpressionValueInfo>,
@@ -71,6 +123,19 @@ toValueInfo(std::shared_ptr<const ValueDescription> desc)
         // Since it's a structure, we don't need an actual instance of the
         // object to know what its fields are
         desc->forEachField(nullptr /* no object */, onField);
+
+        // Output columns are sorted by name, so we put them in that order
+        // once here rather than having each output row sorted
+        std::vector<int> sortedFields(fields.size());
+        for (size_t i = 0;  i < fields.size();  ++i)
+            sortedFields[i] = i;
+        std::sort(sortedFields.begin(), sortedFields.end(),
+                  [&] (int i1, int i2)
+                  {
+                      return fields[i1].fieldName < fields[i2].fieldName;
+                  });
+
+        auto pool = std::make_shared<RowPool>(fields.size());
         
         auto info = std::make_shared<RowValueInfo>(std::move(knownColumns),
                                                    SCHEMA_CLOSED);
@@ -93,9 +158,9 @@ toValueInfo(std::shared_ptr<const ValueDescription> desc)
 
                     const FieldInfo & f = fields[it->second];
 
-                    // Run the conversion recursively
-                    f.fromInput(f.desc.getFieldPtr(obj),
-                                input.getColumn(f.fieldName));
+                    // Run the conversion recursively.  We already have
+                    // the value, so there's no need to look it up again.
+                    f.fromInput(f.desc.getFieldPtr(obj), val);
 
                     return true;
                 };
@@ -104,18 +169,20 @@ toValueInfo(std::shared_ptr<const ValueDescription> desc)
             };
 
         // Function used to convert back from the binary value to the
-        // ExpressionValue representation.
+        // ExpressionValue representation.  The fields are visited in the
+        // order of their names, so the row is built already sorted, and
+        // into a row recycled from the pool.
         auto toOutput = [=] (const void * obj) -> ExpressionValue
             {
-                StructValue result;
-                result.reserve(fields.size());
-                
-                for (auto & f: fields) {
-                    result.emplace_back(f.fieldName,
-                                        f.toOutput(f.desc.getFieldPtr(obj)));
+                std::shared_ptr<StructValue> result = pool->get();
+
+                for (int i: sortedFields) {
+                    const FieldInfo & f = fields[i];
+                    result->emplace_back(f.fieldName,
+                                         f.toOutput(f.desc.getFieldPtr(obj)));
                 }
 
-                return std::move(result);
+                return ExpressionValue::fromSortedRow(std::move(result));
             };
 
         return std::make_tuple(info, fromInput, toOutput);
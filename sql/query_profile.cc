@@ -0,0 +1,224 @@
+/** query_profile.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "query_profile.h"
+#include "mldb/arch/timers.h"
+#include <mutex>
+#include <malloc.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Beyond this many operators (for example when a function runs a query
+/// for each row), further operators are measured but not recorded.
+constexpr size_t MAX_OPERATORS = 1000;
+
+__thread QueryProfile * currentProfile = nullptr;
+
+/// Id of the last operator noteThread() was called on by this thread
+__thread uint64_t lastNotedOperator = 0;
+
+std::atomic<uint64_t> nextOperatorId(1);
+
+int64_t heapBytesInUse()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+    return (size_t)(unsigned)info.uordblks + (size_t)(unsigned)info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* OPERATOR PROFILE                                                          */
+/*****************************************************************************/
+
+OperatorProfile::
+OperatorProfile(Utf8String op, Json::Value details)
+    : op(std::move(op)), details(std::move(details)),
+      rowsIn(0), rowsOut(0), calls(0),
+      wallTime(0.0), cpuTime(0.0), bytesAllocated(0),
+      memoryMeasured(false),
+      id(nextOperatorId.fetch_add(1))
+{
+}
+
+void
+OperatorProfile::
+noteThread()
+{
+    // This is called for each row, so avoid taking the lock when the
+    // thread has already been recorded
+    if (lastNotedOperator == id)
+        return;
+    lastNotedOperator = id;
+    std::unique_lock<Spinlock> guard(threadsLock);
+    threads.insert(std::this_thread::get_id());
+}
+
+size_t
+OperatorProfile::
+numThreads() const
+{
+    std::unique_lock<Spinlock> guard(threadsLock);
+    return threads.size();
+}
+
+OperatorProfile::Activity::
+Activity(OperatorProfile * op, bool measureMemory)
+    : op(op), measureMemory(measureMemory),
+      startWall(0.0), startCpu(0.0), startBytes(0)
+{
+    if (!op)
+        return;
+    op->calls += 1;
+    op->noteThread();
+    if (measureMemory)
+        startBytes = heapBytesInUse();
+    startWall = wall_time();
+    startCpu = cpu_time();
+}
+
+OperatorProfile::Activity::
+~Activity()
+{
+    if (!op)
+        return;
+    // Activities are only opened on the thread that drives the operator,
+    // so there is no need to synchronize the updates
+    op->wallTime += wall_time() - startWall;
+    op->cpuTime += cpu_time() - startCpu;
+    if (measureMemory) {
+        op->bytesAllocated += heapBytesInUse() - startBytes;
+        op->memoryMeasured = true;
+    }
+}
+
+Json::Value
+OperatorProfile::
+toJson() const
+{
+    Json::Value result;
+    result["operator"] = op;
+    if (!details.isNull())
+        result["details"] = details;
+
+    uint64_t childRows = 0;
+    for (auto & c: children) {
+        result["inputs"].append(c->toJson());
+        childRows += c->rowsOut;
+    }
+
+    if (calls > 0) {
+        result["rowsIn"] = rowsIn > 0 ? rowsIn.load() : childRows;
+        result["rowsOut"] = rowsOut.load();
+        result["wallTime"] = wallTime;
+        result["cpuTime"] = cpuTime;
+        result["threads"] = numThreads();
+        if (memoryMeasured)
+            result["bytesAllocated"] = bytesAllocated;
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* QUERY PROFILE                                                             */
+/*****************************************************************************/
+
+QueryProfile::
+QueryProfile(bool analyze)
+    : analyze(analyze),
+      root(std::make_shared<OperatorProfile>("query")),
+      open({ root.get() }),
+      numOperators(1)
+{
+}
+
+QueryProfile *
+QueryProfile::
+current()
+{
+    return currentProfile;
+}
+
+OperatorProfile *
+QueryProfile::
+currentOperator()
+{
+    if (!currentProfile)
+        return nullptr;
+    return currentProfile->open.back();
+}
+
+std::shared_ptr<OperatorProfile>
+QueryProfile::
+addOperator(Utf8String op, Json::Value details)
+{
+    if (!currentProfile)
+        return nullptr;
+
+    auto result = std::make_shared<OperatorProfile>(std::move(op),
+                                                     std::move(details));
+    if (currentProfile->numOperators < MAX_OPERATORS) {
+        currentProfile->open.back()->children.push_back(result);
+        ++currentProfile->numOperators;
+    }
+    return result;
+}
+
+QueryProfile::Scope::
+Scope(QueryProfile & profile)
+    : previous(currentProfile)
+{
+    currentProfile = &profile;
+}
+
+QueryProfile::Scope::
+~Scope()
+{
+    currentProfile = previous;
+}
+
+QueryProfile::Nest::
+Nest(const std::shared_ptr<OperatorProfile> & op)
+    : profile(op ? currentProfile : nullptr)
+{
+    if (profile)
+        profile->open.push_back(op.get());
+}
+
+QueryProfile::Nest::
+~Nest()
+{
+    if (profile)
+        profile->open.pop_back();
+}
+
+Json::Value
+QueryProfile::
+toJson() const
+{
+    Json::Value result;
+    result["analyze"] = analyze;
+    result["plan"] = root->toJson();
+    return result;
+}
+
+} // namespace MLDB
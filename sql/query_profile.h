@@ -0,0 +1,160 @@
+/** query_profile.h                                                -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Collection of the plan and execution statistics of a query, for
+    EXPLAIN and EXPLAIN ANALYZE.
+*/
+
+#pragma once
+
+#include "mldb/types/string.h"
+#include "mldb/ext/jsoncpp/value.h"
+#include "mldb/arch/spinlock.h"
+#include <atomic>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* OPERATOR PROFILE                                                          */
+/*****************************************************************************/
+
+/** Statistics for one operator (a stage of query execution, such as a
+    pipeline element or the scan phase of a dataset query).  Operators
+    form a tree; the inputs of an operator are its children.
+
+    The times recorded are inclusive of any time spent in the children
+    while the operator was active.
+*/
+
+struct OperatorProfile {
+    OperatorProfile(Utf8String op, Json::Value details = Json::Value());
+
+    /// Name of the operator
+    Utf8String op;
+
+    /// Operator-specific description, for example the strategy used
+    Json::Value details;
+
+    /// Number of rows passed in to the operator.  If none are recorded,
+    /// the number of rows output by the children is reported instead.
+    std::atomic<uint64_t> rowsIn;
+
+    /// Number of rows produced by the operator
+    std::atomic<uint64_t> rowsOut;
+
+    /// Number of times the operator was entered
+    std::atomic<uint64_t> calls;
+
+    double wallTime;        ///< Elapsed time, in seconds
+    double cpuTime;         ///< CPU time over all threads, in seconds
+    int64_t bytesAllocated; ///< Growth of the heap while active
+    bool memoryMeasured;    ///< Was bytesAllocated measured?
+
+    std::vector<std::shared_ptr<OperatorProfile> > children;
+
+    /** Record that the calling thread did some work for this operator. */
+    void noteThread();
+
+    /** Number of distinct threads that did work for this operator. */
+    size_t numThreads() const;
+
+    /** Measures the time (and optionally the heap growth) from when it
+        is created to when it is destroyed, and adds it to the operator.
+        Null operators are allowed, in which case nothing is measured.
+        Measuring the heap is expensive, so it should only be done for
+        coarse stages rather than per row.
+    */
+    struct Activity {
+        Activity(OperatorProfile * op, bool measureMemory = false);
+        ~Activity();
+
+        OperatorProfile * op;
+        bool measureMemory;
+        double startWall, startCpu;
+        int64_t startBytes;
+    };
+
+    Json::Value toJson() const;
+
+private:
+    uint64_t id;   ///< Unique, so threads can cache the last one noted
+    mutable Spinlock threadsLock;
+    std::set<std::thread::id> threads;
+};
+
+
+/*****************************************************************************/
+/* QUERY PROFILE                                                             */
+/*****************************************************************************/
+
+/** Profile of a whole query, which is the root of a tree of operators.
+
+    While a query is being explained, its profile is made current for the
+    thread that runs it (see Scope), and the query execution code then
+    records the operators it uses under the innermost open operator.  Code
+    that isn't being explained pays only for a thread-local lookup.
+*/
+
+struct QueryProfile {
+    QueryProfile(bool analyze);
+
+    /// If true, the query is run and measured (EXPLAIN ANALYZE).  If
+    /// false, it is only planned (EXPLAIN), and execution should stop
+    /// once the plan has been recorded.
+    bool analyze;
+
+    /// Operator for the query as a whole
+    std::shared_ptr<OperatorProfile> root;
+
+    /** Return the profile for the query running on this thread, or null
+        if it isn't being explained.
+    */
+    static QueryProfile * current();
+
+    /** Return the innermost open operator of the current profile, or null
+        if there is no current profile.
+    */
+    static OperatorProfile * currentOperator();
+
+    /** Add an operator under the innermost open operator of the current
+        profile and return it.  Returns null if there is no current
+        profile, so that callers can test the result.
+    */
+    static std::shared_ptr<OperatorProfile>
+    addOperator(Utf8String op, Json::Value details = Json::Value());
+
+    /** Make the given profile current for this thread for the lifetime of
+        the object.
+    */
+    struct Scope {
+        Scope(QueryProfile & profile);
+        ~Scope();
+        QueryProfile * previous;
+    };
+
+    /** Make the given operator the innermost open one for the lifetime of
+        the object, so that operators added meanwhile become its children.
+        Does nothing for a null operator.
+    */
+    struct Nest {
+        Nest(const std::shared_ptr<OperatorProfile> & op);
+        ~Nest();
+        QueryProfile * profile;
+    };
+
+    Json::Value toJson() const;
+
+private:
+    std::vector<OperatorProfile *> open;
+    size_t numOperators;
+};
+
+} // namespace MLDB
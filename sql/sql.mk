@@ -31,6 +31,7 @@ SQL_EXPRESSION_SOURCES := \
 	regex_helper.cc \
 	execution_pipeline.cc \
 	execution_pipeline_impl.cc \
+	query_profile.cc \
 	sql_utils.cc \
 	sql_expression_operations.cc \
 	eval_sql.cc \
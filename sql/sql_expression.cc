@@ -131,6 +131,31 @@ constantValue() const
     return this->exec(noRow, storage, GET_LATEST);
 }
 
+bool
+BoundSqlExpression::
+supportsBatch() const
+{
+    return execBatch && !info->isConst();
+}
+
+std::vector<ExpressionValue>
+BoundSqlExpression::
+applyBatch(const std::vector<const SqlRowScope *> & rows,
+           const VariableFilter & filter) const
+{
+    if (supportsBatch()) {
+        std::vector<ExpressionValue> result = execBatch(rows, filter);
+        ExcAssertEqual(result.size(), rows.size());
+        return result;
+    }
+
+    std::vector<ExpressionValue> result;
+    result.reserve(rows.size());
+    for (auto & row: rows)
+        result.emplace_back((*this)(*row, filter));
+    return result;
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(BoundSqlExpression);
 
 BoundSqlExpressionDescription::
@@ -3161,7 +3186,36 @@ bind(SqlBindingScope & context) const
             return storage = ExpressionValue(std::move(result));
         };
 
-    return BoundSqlExpression(exec, this, outputInfo);
+    BoundSqlExpression result(exec, this, outputInfo);
+
+    bool anyBatch = false;
+    for (auto & c: boundClauses)
+        anyBatch = anyBatch || c.supportsBatch();
+
+    if (anyBatch) {
+        result.execBatch
+            = [=] (const std::vector<const SqlRowScope *> & rows,
+                   const VariableFilter & filter)
+            {
+                std::vector<std::vector<ExpressionValue> > clauseValues;
+                clauseValues.reserve(boundClauses.size());
+                for (auto & c: boundClauses)
+                    clauseValues.emplace_back(c.applyBatch(rows, filter));
+
+                std::vector<ExpressionValue> output;
+                output.reserve(rows.size());
+                for (size_t i = 0;  i < rows.size();  ++i) {
+                    StructValue row;
+                    row.reserve(boundClauses.size());
+                    for (auto & vals: clauseValues)
+                        vals[i].mergeToRowDestructive(row);
+                    output.emplace_back(std::move(row));
+                }
+                return output;
+            };
+    }
+
+    return result;
 }
 
 Utf8String
@@ -3946,6 +4000,28 @@ parse(const char * body)
     return parse(string(body));
 }
 
+SelectStatement
+SelectStatement::
+parse(const Utf8String& body, ExplainMode & explain)
+{
+    const std::string & str = body.rawString();
+    ParseContext context(str, str.c_str(), str.length());
+
+    explain = EXPLAIN_NONE;
+    if (matchKeyword(context, "EXPLAIN ANALYZE "))
+        explain = EXPLAIN_ANALYZE;
+    else if (matchKeyword(context, "EXPLAIN "))
+        explain = EXPLAIN_PLAN;
+
+    const bool acceptUtf8 = true;
+
+    SelectStatement stm = parse(context, acceptUtf8);
+
+    context.expect_eof();
+
+    return stm;
+}
+
 SelectStatement
 SelectStatement::parse(ParseContext& context, bool acceptUtf8)
 {
@@ -124,6 +124,15 @@ struct BoundSqlExpression {
                                                    ExpressionValue & storage,
                                                    const VariableFilter & filter)> ExecFunction;
 
+    /** Function type to execute the expression over several rows at once,
+        returning one value per row.  This is optional; it's provided by
+        expressions (such as calls to user functions) that can do less work
+        per row when many rows are processed together.
+    */
+    typedef std::function<std::vector<ExpressionValue>
+                          (const std::vector<const SqlRowScope *> & rows,
+                           const VariableFilter & filter)> ExecBatchFunction;
+
     BoundSqlExpression()
     {
     }
@@ -135,6 +144,7 @@ struct BoundSqlExpression {
     operator bool () const { return !!exec; };
 
     ExecFunction exec;
+    ExecBatchFunction execBatch;
     std::shared_ptr<const SqlExpression> expr;
 
     /// What kind of value does this return?
@@ -145,6 +155,19 @@ struct BoundSqlExpression {
     */
     ExpressionValue constantValue() const;
 
+    /** Does the expression benefit from being executed over many rows at
+        once with execBatch()?
+    */
+    bool supportsBatch() const;
+
+    /** Execute the expression over the given rows.  This uses the batch
+        implementation if there is one, and otherwise calls exec for each
+        row.
+    */
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<const SqlRowScope *> & rows,
+               const VariableFilter & filter /*= GET_ALL*/) const;
+
     const ExpressionValue &
     operator () (const SqlRowScope & context,
                  ExpressionValue & storage,
@@ -318,6 +341,15 @@ struct BoundFunction {
     std::shared_ptr<ExpressionValueInfo> resultInfo;
     VariableFilter filter; // allows function to filter variable as they need
 
+    /** Optional version of exec operating over many rows at once.  args
+        contains the evaluated arguments of each row.
+    */
+    typedef std::function<std::vector<ExpressionValue>
+                          (std::vector<std::vector<ExpressionValue> > & args,
+                           const std::vector<const SqlRowScope *> & rows)>
+        ExecBatch;
+    ExecBatch execBatch;
+
     /// If defined, overrides the default bindFunction call.
     BindFunction bindFunction;
 
@@ -1700,6 +1732,15 @@ PREDECLARE_VALUE_DESCRIPTION(WhenExpression);
     allows parsing of everything after FROM ... SELECT
 */
 
+/** Whether a statement was prefixed with EXPLAIN, asking for it to be
+    explained rather than simply run.
+*/
+enum ExplainMode {
+    EXPLAIN_NONE,      ///< Run the statement
+    EXPLAIN_PLAN,      ///< EXPLAIN: describe the plan without running it
+    EXPLAIN_ANALYZE    ///< EXPLAIN ANALYZE: run it and measure each operator
+};
+
 struct SelectStatement
 {
     SelectStatement();
@@ -1724,6 +1765,11 @@ struct SelectStatement
     static SelectStatement parse(const Utf8String& body);
     static SelectStatement parse(ParseContext& context, bool allowUtf8);
 
+    /** Parse a statement which may be prefixed by EXPLAIN or EXPLAIN
+        ANALYZE, and return which one in explain.
+    */
+    static SelectStatement parse(const Utf8String& body, ExplainMode & explain);
+
     UnboundEntities getUnbound() const;
 
     Utf8String print() const;
@@ -2329,9 +2329,10 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 fn.resultInfo};
     }
     else {
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter) -> const ExpressionValue &
+        BoundSqlExpression result
+            {[=] (const SqlRowScope & row,
+                  ExpressionValue & storage,
+                  const VariableFilter & filter) -> const ExpressionValue &
                 {
                     std::vector<ExpressionValue> evaluatedArgs;
                     evaluatedArgs.reserve(boundArgs.size());
@@ -2342,6 +2343,30 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 },
                 this,
                 fn.resultInfo};
+
+        if (fn.execBatch) {
+            auto execBatch = fn.execBatch;
+            auto filter = fn.filter;
+            result.execBatch
+                = [=] (const std::vector<const SqlRowScope *> & rows,
+                       const VariableFilter &)
+                {
+                    // Arguments are evaluated in batch too, so that calls
+                    // nested in the arguments are batched as well
+                    std::vector<std::vector<ExpressionValue> >
+                        evaluatedArgs(rows.size());
+                    for (auto & a: evaluatedArgs)
+                        a.reserve(boundArgs.size());
+                    for (auto & a: boundArgs) {
+                        auto vals = a.applyBatch(rows, filter);
+                        for (size_t i = 0;  i < rows.size();  ++i)
+                            evaluatedArgs[i].emplace_back(std::move(vals[i]));
+                    }
+                    return execBatch(evaluatedArgs, rows);
+                };
+        }
+
+        return result;
     }
 }
 
@@ -3755,6 +3780,25 @@ bind(SqlBindingScope & scope) const
             };
 
         BoundSqlExpression result(exec, this, info);
+
+        if (exprBound.supportsBatch()) {
+            result.execBatch
+                = [=] (const std::vector<const SqlRowScope *> & rows,
+                       const VariableFilter & filter)
+                {
+                    auto vals = exprBound.applyBatch(rows, filter);
+                    for (auto & val: vals) {
+                        if (val.isAtom())
+                            throw HttpReturnException
+                                (400, "Expression with AS * must return a row",
+                                 "valueReturned", val,
+                                 "ast", print(),
+                                 "surface", surface);
+                    }
+                    return vals;
+                };
+        }
+
         return result;
     }
     else {
@@ -3798,7 +3842,28 @@ bind(SqlBindingScope & scope) const
         auto info = std::make_shared<RowValueInfo>
             (knownColumns, SCHEMA_CLOSED, exprBound.info->isConst());
 
-        return BoundSqlExpression(exec, this, info);
+        BoundSqlExpression result(exec, this, info);
+
+        if (exprBound.supportsBatch()) {
+            result.execBatch
+                = [=] (const std::vector<const SqlRowScope *> & rows,
+                       const VariableFilter & filter)
+                {
+                    auto vals = exprBound.applyBatch(rows, filter);
+                    for (auto & val: vals) {
+                        // Wrap with the structure of the alias, from the
+                        // inside out
+                        for (size_t i = alias.size();  i > 0;  --i) {
+                            StructValue row;
+                            row.emplace_back(alias[i - 1], std::move(val));
+                            val = ExpressionValue(std::move(row));
+                        }
+                    }
+                    return vals;
+                };
+        }
+
+        return result;
     }
 }
 
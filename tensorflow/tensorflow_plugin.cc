@@ -1461,6 +1461,31 @@ struct TensorflowGraphBase: public Function {
             .apply(context);
     }
 
+    /** The graphs don't declare a batch dimension, so the rows of a batch
+        can't be stacked into a single tensor.  Instead, they are run
+        concurrently, which spreads them over all of the device sessions.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override
+    {
+        std::vector<ExpressionValue> result(inputs.size());
+        auto & tfApplier = static_cast<const Applier &>(applier);
+
+        parallelMap(0, inputs.size(),
+                    [&] (size_t i)
+                    {
+                        result[i] = tfApplier.apply(inputs[i]);
+                    });
+
+        return result;
+    }
+
+    virtual bool supportsBatch() const override
+    {
+        return true;
+    }
+
     virtual FunctionInfo
     getFunctionInfo() const override
     {
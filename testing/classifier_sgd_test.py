@@ -0,0 +1,93 @@
+#
+# classifier_sgd_test.py
+# 2017-04-19
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that the sgd classifier trains on wide, sparse features.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 2000
+NUM_WORDS = 5000
+
+
+class ClassifierSgdTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1234)
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            # The label is decided by the first few words; the others are
+            # noise
+            words = random.sample(range(NUM_WORDS), 20)
+            score = sum(1 if w % 10 == 0 else 0 for w in words)
+            cols = [['w%d' % w, 1, 0] for w in words]
+            cols.append(['label', score > 1, 0])
+            cols.append(['target', float(score), 0])
+            ds.record_row('row%d' % i, cols)
+        ds.commit()
+
+    def train(self, name, algorithm, mode, label, config=None):
+        params = {
+            'trainingData' : """
+                SELECT {* EXCLUDING (label, target)} AS features,
+                       %s AS label
+                FROM ds
+            """ % label,
+            'algorithm' : algorithm,
+            'mode' : mode,
+            'modelFileUrl' : 'file://tmp/%s.cls' % name,
+            'functionName' : name,
+            'runOnCreation' : True
+        }
+        if config is not None:
+            params['configuration'] = config
+        mldb.post('/v1/procedures', {
+            'type' : 'classifier.train',
+            'params' : params
+        })
+
+    def auc(self, name):
+        res = mldb.post('/v1/procedures', {
+            'type' : 'classifier.test',
+            'params' : {
+                'testingData' : """
+                    SELECT %s({{* EXCLUDING (label, target)} AS features})
+                               [score] AS score,
+                           label
+                    FROM ds
+                """ % name,
+                'runOnCreation' : True
+            }
+        }).json()
+        return res['status']['firstRun']['status']['auc']
+
+    def test_boolean(self):
+        self.train('cls_sgd', 'sgd', 'boolean', 'label')
+        self.assertGreater(self.auc('cls_sgd'), 0.9)
+
+    def test_plain_sgd_with_l1(self):
+        self.train('cls_plain_sgd', 'my_sgd', 'boolean', 'label', {
+            'my_sgd' : {
+                'type' : 'sgd',
+                'update_alg' : 'sgd',
+                'l1' : 1e-4,
+                'num_epochs' : 10
+            }
+        })
+        self.assertGreater(self.auc('cls_plain_sgd'), 0.9)
+
+    def test_regression(self):
+        self.train('reg_sgd', 'sgd_linear', 'regression', 'target')
+        res = mldb.query("""
+            SELECT avg(abs(reg_sgd({{* EXCLUDING (label, target)}
+                                    AS features})[score] - target))
+            FROM ds
+        """)
+        self.assertLess(res[1][1], 0.5)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,91 @@
+#
+# embedding_hnsw_index_test.py
+# 2017-04-05
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that the hnsw index of the embedding dataset finds (nearly) the
+# same neighbors as the exact vantage point tree, including across
+# several commits.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 2000
+NUM_DIMS = 32
+
+
+class EmbeddingHnswIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(5678)
+        rows = [[random.gauss(0, 1) for d in range(NUM_DIMS)]
+                for r in range(NUM_ROWS)]
+
+        for index in ['vptree', 'hnsw']:
+            for metric in ['euclidean', 'cosine']:
+                ds = mldb.create_dataset({
+                    'id' : '%s_%s' % (index, metric),
+                    'type' : 'embedding',
+                    'params' : { 'metric' : metric, 'index' : index }
+                })
+                # Two commits, so that the second one adds to the index
+                for r, row in enumerate(rows):
+                    ds.record_row('row%d' % r,
+                                  [['x%02d' % d, v, 0]
+                                   for d, v in enumerate(row)])
+                    if r == NUM_ROWS // 2:
+                        ds.commit()
+                ds.commit()
+
+                mldb.put('/v1/functions/nn_%s_%s' % (index, metric), {
+                    'type' : 'embedding.neighbors',
+                    'params' : {
+                        'dataset' : '%s_%s' % (index, metric),
+                        'defaultNumNeighbors' : 10
+                    }
+                })
+
+    def neighbors(self, index, metric, row):
+        res = mldb.query("SELECT nn_%s_%s({coords: '%s'})[distances] AS *"
+                         % (index, metric, row))
+        return set(res[0][1:])
+
+    def check_recall(self, metric):
+        found = 0
+        total = 0
+        for r in range(0, NUM_ROWS, 50):
+            row = 'row%d' % r
+            exact = self.neighbors('vptree', metric, row)
+            approx = self.neighbors('hnsw', metric, row)
+            self.assertIn(row, approx)
+            found += len(exact & approx)
+            total += len(exact)
+        self.assertGreater(found / float(total), 0.9)
+
+    def test_euclidean_recall(self):
+        self.check_recall('euclidean')
+
+    def test_cosine_recall(self):
+        self.check_recall('cosine')
+
+    def test_query_coords(self):
+        coords = ', '.join('x%02d: 0.1' % d for d in range(NUM_DIMS))
+        res = mldb.query(
+            "SELECT nn_hnsw_euclidean({coords: {%s}, numNeighbors: 5})"
+            "[distances] AS *" % coords)
+        dists = res[1][1:]
+        self.assertEqual(len(dists), 5)
+        self.assertEqual(dists, sorted(dists))
+
+    def test_bad_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.create_dataset({
+                'id' : 'bad_hnsw',
+                'type' : 'embedding',
+                'params' : { 'index' : 'hnsw', 'hnswNeighbors' : 1 }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
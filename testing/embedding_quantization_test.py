@@ -0,0 +1,113 @@
+#
+# embedding_quantization_test.py
+# 2017-04-12
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that the int8 and product quantized embedding datasets find
+# (nearly) the same neighbors as the full precision one.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 2000
+NUM_DIMS = 32
+
+
+class EmbeddingQuantizationTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(4321)
+        rows = [[random.gauss(0, 1) for d in range(NUM_DIMS)]
+                for r in range(NUM_ROWS)]
+
+        configs = {
+            'exact' : {},
+            'int8' : { 'quantization' : 'int8' },
+            'pq' : { 'quantization' : 'pq', 'pqSubvectors' : 8 },
+            'int8_dropped' : { 'quantization' : 'int8',
+                               'keepFullVectors' : False },
+            'pq_hnsw' : { 'quantization' : 'pq', 'index' : 'hnsw' }
+        }
+
+        for name, params in configs.items():
+            ds = mldb.create_dataset({
+                'id' : name,
+                'type' : 'embedding',
+                'params' : params
+            })
+            # Two commits, so that rows are encoded with the quantizer
+            # learnt on the first one
+            for r, row in enumerate(rows):
+                ds.record_row('row%d' % r,
+                              [['x%02d' % d, v, 0]
+                               for d, v in enumerate(row)])
+                if r == NUM_ROWS // 2:
+                    ds.commit()
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + name, {
+                'type' : 'embedding.neighbors',
+                'params' : {
+                    'dataset' : name,
+                    'defaultNumNeighbors' : 10
+                }
+            })
+
+    def neighbors(self, name, row):
+        res = mldb.query("SELECT nn_%s({coords: '%s'})[distances] AS *"
+                         % (name, row))
+        return set(res[0][1:])
+
+    def recall(self, name):
+        found = 0
+        total = 0
+        for r in range(0, NUM_ROWS, 50):
+            row = 'row%d' % r
+            exact = self.neighbors('exact', row)
+            approx = self.neighbors(name, row)
+            found += len(exact & approx)
+            total += len(exact)
+        return found / float(total)
+
+    def test_int8_recall(self):
+        self.assertGreater(self.recall('int8'), 0.95)
+        self.assertGreater(self.recall('int8_dropped'), 0.8)
+
+    def test_pq_recall(self):
+        # Re-ranking with the full vectors makes up for the coarse codes
+        self.assertGreater(self.recall('pq'), 0.8)
+        self.assertGreater(self.recall('pq_hnsw'), 0.7)
+
+    def test_reranked_distances_are_exact(self):
+        exact = mldb.query("SELECT nn_exact({coords: 'row7'})[distances] "
+                           "AS *")
+        reranked = mldb.query("SELECT nn_int8({coords: 'row7'})[distances] "
+                              "AS *")
+        self.assertEqual(exact[0][1:], reranked[0][1:])
+
+    def test_values_without_full_vectors(self):
+        exact = mldb.query("SELECT * FROM exact WHERE rowName() = 'row3'")
+        approx = mldb.query(
+            "SELECT * FROM int8_dropped WHERE rowName() = 'row3'")
+        self.assertEqual(exact[0], approx[0])
+        self.assertEqual(len(exact[1]), len(approx[1]))
+        for e, a in zip(exact[1][1:], approx[1][1:]):
+            self.assertAlmostEqual(e, a, delta=0.05)
+
+        # Column based access decodes the rows too
+        res = mldb.query("SELECT count(*) FROM int8_dropped "
+                         "WHERE x00 IS NOT NULL")
+        self.assertEqual(res[1][1], NUM_ROWS)
+
+    def test_bad_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.create_dataset({
+                'id' : 'bad_pq',
+                'type' : 'embedding',
+                'params' : { 'quantization' : 'pq', 'rerankFactor' : 0 }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,115 @@
+#
+# explain_analyze_test.py
+# 2017-04-19
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of EXPLAIN and EXPLAIN ANALYZE on the query endpoint.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+def find_operators(op, name):
+    result = [op] if op['operator'] == name else []
+    for i in op.get('inputs', []):
+        result += find_operators(i, name)
+    return result
+
+
+class ExplainAnalyzeTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for name in ['ds', 'ds2']:
+            ds = mldb.create_dataset({'id' : name, 'type' : 'sparse.mutable'})
+            for i in range(100):
+                ds.record_row('row%d' % i,
+                              [['x', i, 0], ['y', i % 7, 0]])
+            ds.commit()
+
+    def explain(self, query):
+        return mldb.get('/v1/query', q=query).json()
+
+    def test_explain_does_not_run(self):
+        res = self.explain('EXPLAIN SELECT x FROM ds WHERE x > 10 ORDER BY y')
+        self.assertEqual(res['analyze'], False)
+        self.assertEqual(res['statement'].strip(),
+                         'SELECT x FROM ds WHERE x > 10 ORDER BY y')
+
+        plan = res['plan']
+        self.assertEqual(plan['operator'], 'query')
+        self.assertNotIn('rowsOut', plan)
+
+        [select] = find_operators(plan, 'select')
+        self.assertEqual(select['details']['strategy'], 'ordered')
+        self.assertIn('rowGenerator', select['details'])
+        self.assertNotIn('wallTime', select)
+
+    def test_explain_analyze_select(self):
+        res = self.explain(
+            'explain analyze SELECT x FROM ds WHERE x > 10 ORDER BY y')
+        self.assertEqual(res['analyze'], True)
+
+        plan = res['plan']
+        self.assertEqual(plan['rowsOut'], 89)
+
+        [select] = find_operators(plan, 'select')
+        self.assertEqual(select['rowsOut'], 89)
+        self.assertGreaterEqual(select['wallTime'], 0)
+        self.assertGreaterEqual(select['cpuTime'], 0)
+        self.assertGreaterEqual(select['threads'], 1)
+        self.assertIn('bytesAllocated', select)
+
+        stages = [i['operator'] for i in select['inputs']]
+        self.assertEqual(stages, ['generateRows', 'scan', 'sort'])
+        [generate] = find_operators(select, 'generateRows')
+        self.assertEqual(generate['rowsOut'], 89)
+
+    def test_explain_analyze_limit(self):
+        res = self.explain('EXPLAIN ANALYZE SELECT * FROM ds LIMIT 5')
+        self.assertEqual(res['plan']['rowsOut'], 5)
+        [select] = find_operators(res['plan'], 'select')
+        self.assertEqual(select['details']['strategy'], 'unordered')
+
+    def test_explain_analyze_group_by(self):
+        res = self.explain(
+            'EXPLAIN ANALYZE SELECT count(*) FROM ds GROUP BY y')
+        plan = res['plan']
+        self.assertEqual(plan['rowsOut'], 7)
+
+        [group] = find_operators(plan, 'groupBy')
+        self.assertEqual(group['rowsOut'], 7)
+        [select] = find_operators(group, 'select')
+        self.assertEqual(select['rowsOut'], 100)
+        [merge] = find_operators(group, 'merge')
+        self.assertEqual(merge['rowsOut'], 7)
+
+    def test_explain_join(self):
+        query = 'SELECT * FROM ds JOIN ds2 ON ds.x = ds2.x'
+        res = self.explain('EXPLAIN ' + query)
+        [join] = find_operators(res['plan'], 'JoinElement')
+        self.assertEqual(len(join['inputs']), 2)
+        self.assertIn('style', join['details'])
+        self.assertNotIn('rowsOut', join)
+
+        res = self.explain('EXPLAIN ANALYZE ' + query)
+        self.assertEqual(res['plan']['rowsOut'], 100)
+        [join] = find_operators(res['plan'], 'JoinElement')
+        self.assertEqual(join['rowsOut'], 100)
+        generators = find_operators(join, 'GenerateRowsElement')
+        self.assertEqual(len(generators), 2)
+        for g in generators:
+            self.assertEqual(g['rowsOut'], 100)
+            self.assertIn('rowGenerator', g['details'])
+
+    def test_explain_without_from(self):
+        res = self.explain('EXPLAIN ANALYZE SELECT 1 + 1 AS x')
+        [op] = find_operators(res['plan'], 'selectWithoutFrom')
+        self.assertEqual(op['rowsOut'], 1)
+
+    def test_normal_query_unaffected(self):
+        res = mldb.query('SELECT count(*) FROM ds')
+        self.assertEqual(res[1][1], 100)
+
+if __name__ == '__main__':
+    mldb.run_tests()
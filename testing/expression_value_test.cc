@@ -9,6 +9,7 @@
 #include "mldb/types/value_description.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/types/tuple_description.h"
+#include "mldb/types/structure_description.h"
 #include "mldb/jml/stats/distribution.h"
 #include "mldb/http/http_exception.h"
 
@@ -23,6 +24,34 @@ using namespace std;
 
 using namespace MLDB;
 
+namespace MLDB {
+
+// expression_value_description.cc
+std::tuple<std::shared_ptr<ExpressionValueInfo>,
+           std::function<void (void * obj, const ExpressionValue & inputVal)>,
+           std::function<ExpressionValue (const void * obj)> >
+toValueInfo(std::shared_ptr<const ValueDescription> desc);
+
+} // namespace MLDB
+
+struct OutputStruct {
+    double z = 1.0;
+    double a = 2.0;
+    double m = 3.0;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(OutputStruct);
+DEFINE_STRUCTURE_DESCRIPTION(OutputStruct);
+
+OutputStructDescription::
+OutputStructDescription()
+{
+    // Not in the order of their names
+    addField("z", &OutputStruct::z, "");
+    addField("a", &OutputStruct::a, "");
+    addField("m", &OutputStruct::m, "");
+}
+
 BOOST_AUTO_TEST_CASE( test_size )
 {
     BOOST_CHECK_EQUAL(sizeof(ExpressionValue), 32);
@@ -548,3 +577,54 @@ BOOST_AUTO_TEST_CASE( test_embedding_length )
     BOOST_CHECK_EQUAL(myValue.rowLength(), 2);
     BOOST_CHECK_EQUAL(myValue.getAtomCount(), 4);
 }
+
+BOOST_AUTO_TEST_CASE( test_structure_output )
+{
+    auto toOutput
+        = std::get<2>(toValueInfo(getDefaultDescriptionSharedT<OutputStruct>()));
+
+    // Address of the column in the row, which is its storage
+    auto column = [] (const ExpressionValue & val, const char * name)
+        {
+            ExpressionValue storage;
+            const ExpressionValue * result
+                = val.tryGetColumn(PathElement(name), storage);
+            BOOST_REQUIRE(result && result != &storage);
+            return result;
+        };
+
+    OutputStruct obj;
+    const ExpressionValue * firstColumn;
+    {
+        ExpressionValue val = toOutput(&obj);
+        BOOST_REQUIRE(val.isRow());
+        BOOST_CHECK_EQUAL(val.rowLength(), 3);
+
+        // Columns are sorted by name
+        std::vector<PathElement> names;
+        val.forEachColumn([&] (const PathElement & name,
+                               const ExpressionValue & v)
+                          {
+                              names.push_back(name);
+                              return true;
+                          });
+        BOOST_CHECK_EQUAL(names.size(), 3);
+        BOOST_CHECK_EQUAL(names.at(0), PathElement("a"));
+        BOOST_CHECK_EQUAL(names.at(1), PathElement("m"));
+        BOOST_CHECK_EQUAL(names.at(2), PathElement("z"));
+
+        firstColumn = column(val, "a");
+        BOOST_CHECK_EQUAL(firstColumn->getAtom().toDouble(), 2.0);
+    }
+
+    // Once the first output is gone, its row is reused for the next
+    obj.a = 4.0;
+    ExpressionValue val2 = toOutput(&obj);
+    BOOST_CHECK_EQUAL(column(val2, "a"), firstColumn);
+    BOOST_CHECK_EQUAL(column(val2, "a")->getAtom().toDouble(), 4.0);
+
+    // While it's still held, the next output gets another row
+    ExpressionValue val3 = toOutput(&obj);
+    BOOST_CHECK_NE(column(val3, "a"), firstColumn);
+    BOOST_CHECK_EQUAL(column(val2, "z")->getAtom().toDouble(), 1.0);
+}
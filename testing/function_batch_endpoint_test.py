@@ -0,0 +1,120 @@
+#
+# function_batch_endpoint_test.py
+# 2017-03-28
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that /v1/functions/<id>/batch applies the function to each of its
+# inputs, in order, for JSON and binary columnar inputs and outputs.
+#
+import json
+import struct
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+COLUMNAR = 'application/x-mldb-columnar'
+
+# More than one chunk, and not a multiple of the chunk size
+NUM_INPUTS = 1000
+
+
+class FunctionBatchEndpointTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put('/v1/functions/double', {
+            'type' : 'sql.expression',
+            'params' : {
+                'expression' : 'x * 2 AS x'
+            }
+        })
+
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'tabular'})
+        for i in range(NUM_INPUTS):
+            ds.record_row('row%d' % i, [['x', i, 0]])
+        ds.commit()
+
+    def batch(self, **kwargs):
+        return requests.post(url + '/v1/functions/double/batch', **kwargs)
+
+    def test_json_array(self):
+        inputs = [{'x' : i} for i in range(NUM_INPUTS)]
+        r = self.batch(data=json.dumps({'input' : inputs}))
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), [{'x' : i * 2} for i in range(NUM_INPUTS)])
+
+    def test_json_object(self):
+        r = self.batch(data=json.dumps({'input' : {'a' : {'x' : 1},
+                                                   'b' : {'x' : 2}}}))
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), {'a' : {'x' : 2}, 'b' : {'x' : 4}})
+
+    def test_json_object_keys(self):
+        # Keys come back as they were given, not escaped as row names
+        keys = ['a.b', '"quoted"', '', 'x y', 'a"b.c']
+        inputs = {k : {'x' : i} for i, k in enumerate(keys)}
+        r = self.batch(data=json.dumps({'input' : inputs}))
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(),
+                         {k : {'x' : i * 2} for i, k in enumerate(keys)})
+
+    def test_query_string(self):
+        r = requests.get(url + '/v1/functions/double/batch',
+                         params={'input' : json.dumps([{'x' : 3}])})
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), [{'x' : 6}])
+
+    def test_empty(self):
+        r = self.batch(data=json.dumps({'input' : []}))
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), [])
+
+    def test_columnar_input(self):
+        # Use the columnar output of a query as input; it's made of several
+        # record batches
+        r = requests.get(url + '/v1/query', params={
+            'q' : 'SELECT x FROM ds ORDER BY x',
+            'format' : 'columnar'
+        })
+        self.assertEqual(r.status_code, 200, r.text)
+
+        r = self.batch(data=r.content, headers={'Content-Type' : COLUMNAR})
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), [{'x' : i * 2} for i in range(NUM_INPUTS)])
+
+    def test_columnar_output(self):
+        inputs = [{'x' : i} for i in range(NUM_INPUTS)]
+        r = self.batch(data=json.dumps({'input' : inputs,
+                                        'outputFormat' : 'columnar'}))
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.headers['content-type'], COLUMNAR)
+
+        # Apply the function again to the columnar output
+        r = self.batch(data=r.content, headers={'Content-Type' : COLUMNAR})
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), [{'x' : i * 4} for i in range(NUM_INPUTS)])
+
+    def test_errors(self):
+        r = self.batch(data=b'MLDBCOL1\x05\x00',
+                       headers={'Content-Type' : COLUMNAR})
+        self.assertEqual(r.status_code, 400, r.text)
+
+        # A few bytes claiming millions of rows, with or without columns
+        for num_columns in [0, 1]:
+            r = self.batch(data=b'MLDBCOL1' + struct.pack('<II', 10000000,
+                                                          num_columns)
+                           + b'\x00' * 64,
+                           headers={'Content-Type' : COLUMNAR})
+            self.assertEqual(r.status_code, 400, r.text)
+
+        r = self.batch(data=json.dumps({'input' : [],
+                                        'inputFormat' : 'columnar'}))
+        self.assertEqual(r.status_code, 400, r.text)
+
+        r = self.batch(data=json.dumps({'input' : [],
+                                        'outputFormat' : 'csv'}))
+        self.assertEqual(r.status_code, 400, r.text)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,171 @@
+#
+# function_batch_test.py
+# 2017-03-20
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that functions applied to whole batches of rows in a query return
+# the same thing as when they are applied one row at a time.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+# More than one batch, and not a multiple of the batch size
+NUM_ROWS = 700
+
+
+class FunctionBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(4321)
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'tabular'})
+        for i in range(NUM_ROWS):
+            x = random.random()
+            y = random.random()
+            cols = [['x', x, 0], ['y', y, 0], ['label', x + y > 1, 0]]
+            # Some rows with missing values
+            if i % 7 != 0:
+                cols.append(['z', random.random(), 0])
+            ds.record_row('row%d' % i, cols)
+        ds.commit()
+
+        mldb.post('/v1/procedures', {
+            'type' : 'classifier.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y, z} AS features, label FROM ds
+                """,
+                'algorithm' : 'glz',
+                'modelFileUrl' : 'file://tmp/function_batch_test.cls',
+                'functionName' : 'cls',
+                'runOnCreation' : True
+            }
+        })
+
+        mldb.put('/v1/functions/expl', {
+            'type' : 'classifier.explain',
+            'params' : {
+                'modelFileUrl' : 'file://tmp/function_batch_test.cls'
+            }
+        })
+
+        mldb.post('/v1/procedures', {
+            'type' : 'kmeans.train',
+            'params' : {
+                'trainingData' : 'SELECT x, y FROM ds',
+                'numClusters' : 5,
+                'modelFileUrl' : 'file://tmp/function_batch_test.kms',
+                'functionName' : 'kms',
+                'runOnCreation' : True
+            }
+        })
+
+        mldb.post('/v1/procedures', {
+            'type' : 'svd.train',
+            'params' : {
+                'trainingData' : 'SELECT x, y, z FROM ds',
+                'modelFileUrl' : 'file://tmp/function_batch_test.svd',
+                'numSingularValues' : 2,
+                'functionName' : 'svd',
+                'runOnCreation' : True
+            }
+        })
+
+    def by_row(self, query):
+        res = mldb.query(query)
+        header = res[0]
+        return header, {r[0]: r[1:] for r in res[1:]}
+
+    def assert_same(self, select):
+        # The first query goes through the batched path, the second one is
+        # ordered and applies the functions row by row
+        header, batched = self.by_row('SELECT %s FROM ds' % select)
+        header2, ordered = self.by_row(
+            'SELECT %s FROM ds ORDER BY rowName()' % select)
+        self.assertEqual(header, header2)
+        self.assertEqual(len(batched), NUM_ROWS)
+        self.assertEqual(sorted(batched.keys()), sorted(ordered.keys()))
+        for k, v in batched.items():
+            for v1, v2 in zip(v, ordered[k]):
+                if isinstance(v1, float):
+                    self.assertAlmostEqual(v1, v2, places=5)
+                else:
+                    self.assertEqual(v1, v2)
+
+    def test_classifier(self):
+        self.assert_same('cls({{x, y, z} AS features})[score] AS score')
+
+    def test_classifier_whole_output(self):
+        self.assert_same('cls({{x, y, z} AS features}) AS *')
+
+    def test_classifier_with_other_columns(self):
+        self.assert_same("""
+            x, cls({{x, y, z} AS features})[score] AS score, label
+        """)
+
+    def test_kmeans(self):
+        self.assert_same('kms({{x, y} AS embedding})[cluster] AS cluster')
+
+    def test_svd(self):
+        self.assert_same('svd({{x, y, z} AS row})[embedding] AS *')
+
+    def test_nested(self):
+        self.assert_same("""
+            cls({{x, y, z} AS features})[score]
+                + kms({{x, y} AS embedding})[cluster] AS v
+        """)
+
+    def test_matches_application(self):
+        _, batched = self.by_row("""
+            SELECT cls({{x, y, z} AS features})[score] AS score,
+                   kms({{x, y} AS embedding})[cluster] AS cluster
+            FROM ds
+        """)
+        _, values = self.by_row('SELECT x, y, z FROM ds')
+
+        for i in range(0, NUM_ROWS, 37):
+            name = 'row%d' % i
+            x, y, z = values[name]
+            features = {'x' : x, 'y' : y}
+            if z is not None:
+                features['z'] = z
+            score = mldb.get('/v1/functions/cls/application',
+                             input={'features' : features}).json()
+            self.assertAlmostEqual(batched[name][0],
+                                   score['output']['score'], places=5)
+            cluster = mldb.get('/v1/functions/kms/application',
+                               input={'embedding' : {'x' : x, 'y' : y}}
+                               ).json()
+            self.assertEqual(batched[name][1], cluster['output']['cluster'])
+
+    def test_explain(self):
+        # Explanations have no batched implementation, and must not use
+        # the one of the classifier that they derive from
+        self.assert_same("""
+            expl({{x, y, z} AS features, label})[explanation][x] AS ex,
+            expl({{x, y, z} AS features, label})[explanation][y] AS ey
+        """)
+
+        # And they must match the explanation of each row on its own
+        _, batched = self.by_row("""
+            SELECT expl({{x, y, z} AS features, label})[explanation][x] AS ex
+            FROM ds
+        """)
+        _, values = self.by_row('SELECT x, y, z, label FROM ds')
+
+        for i in range(0, NUM_ROWS, 37):
+            name = 'row%d' % i
+            x, y, z, label = values[name]
+            features = {'x' : x, 'y' : y}
+            if z is not None:
+                features['z'] = z
+            res = mldb.get('/v1/functions/expl/application',
+                           input={'features' : features,
+                                  'label' : label}).json()
+            self.assertAlmostEqual(batched[name][0],
+                                   res['output']['explanation']['x'],
+                                   places=5)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,77 @@
+#
+# function_bound_input_test.py
+# 2017-03-30
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that functions called with the input columns they were bound with
+# (which are matched by position) give the same result as when the input
+# columns change from one call to the next.
+#
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class FunctionBoundInputTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'pts', 'type' : 'embedding'})
+        for i in range(10):
+            ds.record_row('p%d' % i, [['x', i, 0], ['y', i % 3, 0]])
+        ds.commit()
+
+        mldb.put('/v1/functions/nn', {
+            'type' : 'embedding.neighbors',
+            'params' : {
+                'dataset' : 'pts'
+            }
+        })
+
+        # Rows that don't all have the same columns
+        ds = mldb.create_dataset({'id' : 'args', 'type' : 'sparse.mutable'})
+        ds.record_row('a', [['numNeighbors', 2, 0], ['maxDistance', 10, 0]])
+        ds.record_row('b', [['numNeighbors', 3, 0]])
+        ds.record_row('c', [['maxDistance', 1.5, 0]])
+        ds.commit()
+
+    def query(self, q):
+        res = mldb.get('/v1/query', q=q, format='aos').json()
+        for row in res:
+            row.pop('_rowName', None)
+        return res
+
+    def call(self, args):
+        return self.query('SELECT nn({%s}) AS *' % args)[0]
+
+    def test_field_order(self):
+        self.assertEqual(
+            self.call('coords: {x: 4, y: 1}, numNeighbors: 3'),
+            self.call('numNeighbors: 3, coords: {x: 4, y: 1}'))
+
+    def test_many_rows(self):
+        res = self.query("""
+            SELECT nn({coords: {x, y}, numNeighbors: 2}) AS *
+            FROM pts ORDER BY rowName()
+        """)
+        self.assertEqual(len(res), 10)
+        for i, row in enumerate(res):
+            self.assertEqual(
+                row,
+                self.call('coords: {x: %d, y: %d}, numNeighbors: 2'
+                          % (i, i % 3)))
+
+    def test_varying_columns(self):
+        res = self.query("""
+            SELECT nn({coords: {x: 0, y: 0}, *}) AS *
+            FROM args ORDER BY rowName()
+        """)
+        expected = [
+            'coords: {x: 0, y: 0}, numNeighbors: 2, maxDistance: 10',
+            'coords: {x: 0, y: 0}, numNeighbors: 3',
+            'coords: {x: 0, y: 0}, maxDistance: 1.5'
+        ]
+        self.assertEqual(len(res), len(expected))
+        for row, args in zip(res, expected):
+            self.assertEqual(row, self.call(args))
+
+if __name__ == '__main__':
+    mldb.run_tests()
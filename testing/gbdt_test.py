@@ -0,0 +1,101 @@
+#
+# gbdt_test.py
+# 2017-03-10
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 2000
+
+
+class GbdtTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1234)
+        ds = mldb.create_dataset({'id' : 'train', 'type' : 'tabular'})
+        for i in range(NUM_ROWS):
+            x = random.random()
+            y = random.random()
+            color = random.choice(['red', 'green', 'blue'])
+            label = (x > 0.5) != (color == 'red')
+            ds.record_row('row%d' % i,
+                          [['x', x, 0], ['y', y, 0], ['color', color, 0],
+                           ['label', label, 0],
+                           ['target', 3 * x + (color == 'blue'), 0]])
+        ds.commit()
+
+    def test_boolean(self):
+        res = mldb.post('/v1/procedures', {
+            'type' : 'gbdt.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y, color} AS features, label FROM train
+                """,
+                'modelFileUrl' : 'file://tmp/gbdt_test_boolean.cls',
+                'functionName' : 'gbdt_boolean',
+                'numTrees' : 30,
+                'maxLeaves' : 8,
+                'runOnCreation' : True
+            }
+        }).json()
+        status = res['status']['firstRun']['status']
+        self.assertEqual(status['numRows'], NUM_ROWS)
+        self.assertEqual(status['numTrees'], 30)
+
+        res = mldb.post('/v1/procedures', {
+            'type' : 'classifier.test',
+            'params' : {
+                'testingData' : """
+                    SELECT gbdt_boolean({{x, y, color} AS features})[score]
+                               AS score,
+                           label
+                    FROM train
+                """,
+                'runOnCreation' : True
+            }
+        }).json()
+        self.assertGreater(res['status']['firstRun']['status']['auc'], 0.95)
+
+    def test_regression(self):
+        mldb.post('/v1/procedures', {
+            'type' : 'gbdt.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y, color} AS features, target AS label
+                    FROM train
+                """,
+                'mode' : 'regression',
+                'modelFileUrl' : 'file://tmp/gbdt_test_regression.cls',
+                'functionName' : 'gbdt_regression',
+                'numTrees' : 100,
+                'runOnCreation' : True
+            }
+        })
+
+        res = mldb.query("""
+            SELECT avg(abs(gbdt_regression({{x, y, color} AS features})[score]
+                           - target))
+            FROM train
+        """)
+        self.assertLess(res[1][1], 0.2)
+
+    def test_categorical_mode_rejected(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'boolean'):
+            mldb.post('/v1/procedures', {
+                'type' : 'gbdt.train',
+                'params' : {
+                    'trainingData' : """
+                        SELECT {x, y} AS features, color AS label FROM train
+                    """,
+                    'mode' : 'categorical',
+                    'modelFileUrl' : 'file://tmp/gbdt_test_categorical.cls',
+                    'runOnCreation' : True
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
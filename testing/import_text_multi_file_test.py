@@ -0,0 +1,110 @@
+#
+# import_text_multi_file_test.py
+# 2017-03-09
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+import os
+import shutil
+import tempfile
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_FILES = 5
+LINES_PER_FILE = 100
+
+
+class ImportTextMultiFileTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.dir = tempfile.mkdtemp(dir='build/x86_64/tmp')
+        for f in range(NUM_FILES):
+            with open(os.path.join(cls.dir, 'part-%d.csv' % f), 'w') as out:
+                out.write('a,b\n')
+                for i in range(LINES_PER_FILE):
+                    out.write('%d,%d\n' % (f, i))
+
+        os.mkdir(os.path.join(cls.dir, 'other'))
+        with open(os.path.join(cls.dir, 'other', 'bad.csv'), 'w') as out:
+            out.write('a,c\n1,2\n')
+
+    @classmethod
+    def tearDownClass(cls):
+        shutil.rmtree(cls.dir)
+
+    def url(self, name):
+        return 'file://' + os.path.join(self.dir, name)
+
+    def run_import(self, **params):
+        params['outputDataset'] = 'imported'
+        params['runOnCreation'] = True
+        return mldb.post('/v1/procedures', {
+            'type' : 'import.text',
+            'params' : params
+        }).json()['status']['firstRun']['status']
+
+    def test_glob(self):
+        status = self.run_import(dataFileUrl=self.url('part-*.csv'))
+        self.assertEqual(status['rowCount'], NUM_FILES * LINES_PER_FILE)
+
+        res = mldb.query("""
+            SELECT a, count(*) AS cnt, min(b) AS lo, max(b) AS hi
+            FROM imported GROUP BY a ORDER BY a
+        """)
+        self.assertEqual(res[1:], [[str([f]), f, LINES_PER_FILE, 0,
+                                    LINES_PER_FILE - 1]
+                                   for f in range(NUM_FILES)])
+
+    def test_default_row_names_are_unique(self):
+        self.run_import(dataFileUrl=self.url('part-*.csv'))
+        res = mldb.query("SELECT count(*) FROM imported")
+        self.assertEqual(res[1][1], NUM_FILES * LINES_PER_FILE)
+
+        res = mldb.query("SELECT a, b FROM imported WHERE rowName() = '"
+                         + self.url('part-1.csv') + ":2'")
+        self.assertEqual(res[1][1:], [1, 0])
+
+    def test_explicit_row_names(self):
+        # A row name that is given explicitly isn't qualified, even if it's
+        # the same as the default for a single file
+        self.run_import(dataFileUrls=[self.url('part-0.csv'),
+                                      self.url('part-3.csv')],
+                        named='lineNumber()',
+                        where="dataFileUrl() = '%s'" % self.url('part-3.csv'))
+        res = mldb.query("SELECT count(*) FROM imported")
+        self.assertEqual(res[1][1], LINES_PER_FILE)
+        res = mldb.query("SELECT a, b FROM imported WHERE rowName() = '2'")
+        self.assertEqual(res[1][1:], [3, 0])
+
+    def test_list(self):
+        status = self.run_import(dataFileUrls=[self.url('part-0.csv'),
+                                               self.url('part-3.csv')],
+                                 select="a, dataFileUrl() AS url")
+        self.assertEqual(status['rowCount'], 2 * LINES_PER_FILE)
+        res = mldb.query("SELECT count(distinct url) FROM imported")
+        self.assertEqual(res[1][1], 2)
+
+    def test_per_file_offset_and_limit(self):
+        status = self.run_import(dataFileUrl=self.url('part-*.csv'),
+                                 offset=10, limit=5)
+        self.assertEqual(status['rowCount'], NUM_FILES * 5)
+        res = mldb.query("SELECT min(b), max(b) FROM imported")
+        self.assertEqual(res[1][1:], [10, 14])
+
+    def test_header_mismatch(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "doesn't match that of the first file"):
+            self.run_import(dataFileUrls=[self.url('part-0.csv'),
+                                          self.url('other/bad.csv')])
+
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     "doesn't match that of the first file"):
+            self.run_import(dataFileUrl=self.url(''))
+
+    def test_no_match(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'No files match'):
+            self.run_import(dataFileUrl=self.url('nothing-*.csv'))
+
+if __name__ == '__main__':
+    mldb.run_tests()
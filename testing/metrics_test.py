@@ -0,0 +1,83 @@
+#
+# metrics_test.py
+# 2017-04-27
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the Prometheus metrics returned by /v1/metrics.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+def parse_metrics(text):
+    result = {}
+    for line in text.splitlines():
+        if not line or line.startswith('#'):
+            continue
+        name, value = line.rsplit(' ', 1)
+        result[name] = float(value)
+    return result
+
+
+class MetricsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(100):
+            ds.record_row('row%d' % i, [['x', i, 0]])
+        ds.commit()
+
+    def metrics(self):
+        res = mldb.get('/v1/metrics')
+        headers = {k.lower(): v for k, v in res.headers.items()}
+        self.assertTrue(headers['content-type'].startswith('text/plain'))
+        return res.text
+
+    def test_format(self):
+        text = self.metrics()
+        self.assertIn('# TYPE mldb_query_seconds histogram', text)
+        self.assertIn('# TYPE mldb_queries_total counter', text)
+        self.assertIn('# TYPE mldb_thread_pool_threads gauge', text)
+        metrics = parse_metrics(text)
+        self.assertGreaterEqual(metrics['mldb_thread_pool_threads'], 1)
+        self.assertIn('mldb_thread_pool_queued_jobs{priority="batch"}',
+                      metrics)
+        self.assertIn('mldb_admission_running_tasks{priority="batch"}',
+                      metrics)
+
+    def test_query_metrics(self):
+        before = parse_metrics(self.metrics())
+        mldb.query('SELECT x FROM ds')
+        after = parse_metrics(self.metrics())
+
+        self.assertEqual(after['mldb_queries_total'],
+                         before['mldb_queries_total'] + 1)
+        self.assertEqual(after['mldb_query_seconds_count'],
+                         before['mldb_query_seconds_count'] + 1)
+        self.assertEqual(after['mldb_query_rows_output_total'],
+                         before['mldb_query_rows_output_total'] + 100)
+        self.assertGreaterEqual(after['mldb_query_rows_scanned_total'],
+                                before['mldb_query_rows_scanned_total'] + 100)
+
+        # Histogram buckets are cumulative
+        self.assertEqual(after['mldb_query_seconds_bucket{le="+Inf"}'],
+                         after['mldb_query_seconds_count'])
+
+    def test_procedure_metrics(self):
+        mldb.post('/v1/procedures', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT x * 2 AS y FROM ds',
+                'outputDataset' : 'ds_out',
+                'runOnCreation' : True
+            }
+        })
+        metrics = parse_metrics(self.metrics())
+        self.assertGreaterEqual(
+            metrics['mldb_procedure_runs_total{type="transform"}'], 1)
+        self.assertGreaterEqual(
+            metrics['mldb_procedure_run_seconds_count{type="transform"}'], 1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
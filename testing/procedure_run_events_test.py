@@ -0,0 +1,121 @@
+#
+# procedure_run_events_test.py
+# 2017-04-03
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that /v1/procedures/<id>/runs/<run>/events streams the state and
+# progress of a run as server-sent events, and ends when the run is done.
+#
+import json
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+
+def parse_events(lines):
+    """Parse the lines of a text/event-stream into (event, data) pairs."""
+    events = []
+    event = None
+    for line in lines:
+        if not line:
+            continue
+        if line.startswith('event: '):
+            event = line[len('event: '):]
+        elif line.startswith('data: '):
+            events.append((event, json.loads(line[len('data: '):])))
+    return events
+
+
+class ProcedureRunEventsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'sample', 'type' : 'sparse.mutable'})
+        for i in range(10000):
+            ds.record_row(str(i), [['x', i, 0]])
+        ds.commit()
+
+        mldb.put('/v1/procedures/bucketize', {
+            'type' : 'bucketize',
+            'params' : {
+                'inputData' : 'SELECT * FROM sample ORDER BY x',
+                'outputDataset' : {
+                    'id' : 'output',
+                    'type' : 'sparse.mutable'
+                },
+                'percentileBuckets': {'b1': [0, 50], 'b2': [50, 100]}
+            }
+        })
+
+    def run_async(self):
+        res = mldb.post_async('/v1/procedures/bucketize/runs')
+        return res.headers['Location']
+
+    def check_events(self, events, run_id):
+        self.assertGreater(len(events), 0)
+        for event, data in events:
+            self.assertIn(event, ['state', 'progress'])
+            self.assertEqual(data['id'], run_id)
+
+        # The stream ends with the final state, and only once
+        self.assertEqual(events[-1][0], 'state')
+        self.assertEqual(events[-1][1]['state'], 'finished')
+        states = [data['state'] for event, data in events]
+        self.assertEqual(states.count('finished'), 1)
+
+    def test_stream(self):
+        location = self.run_async()
+        run_id = location.split('/')[-1]
+        r = requests.get(url + location + '/events', stream=True)
+        self.assertEqual(r.status_code, 200)
+        self.assertEqual(r.headers['content-type'], 'text/event-stream')
+
+        lines = [line.decode('utf-8') if isinstance(line, bytes) else line
+                 for line in r.iter_lines()]
+        events = parse_events(lines)
+        self.check_events(events, run_id)
+
+        # The stream ends when the run is done
+        self.assertEqual(mldb.get(location).json()['state'], 'finished')
+
+    def test_disconnect(self):
+        # Clients that go away before the end of the run release their
+        # watch; the run carries on and can still be followed
+        location = self.run_async()
+        for i in range(5):
+            r = requests.get(url + location + '/events', stream=True)
+            self.assertEqual(r.status_code, 200)
+            next(r.iter_lines())
+            r.close()
+
+        r = requests.get(url + location + '/events')
+        self.check_events(parse_events(r.text.split('\n')),
+                          location.split('/')[-1])
+        self.assertEqual(mldb.get(location).json()['state'], 'finished')
+
+    def test_in_process(self):
+        location = self.run_async()
+        res = mldb.get(location + '/events')
+        events = parse_events(res.text.split('\n'))
+        self.check_events(events, location.split('/')[-1])
+
+    def test_finished_run(self):
+        res = mldb.post('/v1/procedures/bucketize/runs')
+        run_id = res.json()['id']
+        r = requests.get(url + '/v1/procedures/bucketize/runs/%s/events'
+                         % run_id)
+        self.assertEqual(r.status_code, 200)
+        events = parse_events(r.text.split('\n'))
+        self.assertEqual(len(events), 1)
+        self.check_events(events, run_id)
+        # the event is the run's status, not just its state
+        status = mldb.get('/v1/procedures/bucketize/runs/%s' % run_id).json()
+        self.assertEqual(events[0][1]['runFinished'], status['runFinished'])
+
+    def test_unknown_run(self):
+        r = requests.get(url + '/v1/procedures/bucketize/runs/nope/events')
+        self.assertEqual(r.status_code, 404)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,89 @@
+#
+# profiler_test.py
+# 2017-04-28
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the sampling profiler at /v1/debug/profile.
+#
+
+import threading
+import time
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+
+class ProfilerTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(1000):
+            ds.record_row('row%d' % i, [['x', i, 0]])
+        ds.commit()
+
+    def check_folded(self, res):
+        headers = {k.lower(): v for k, v in res.headers.items()}
+        self.assertTrue(headers['content-type'].startswith('text/plain'))
+        samples = int(headers['x-mldb-profile-samples'])
+        self.assertGreaterEqual(samples, 0)
+        self.assertEqual(int(headers['x-mldb-profile-dropped']), 0)
+
+        # Each line is a stack followed by its weight
+        for line in res.text.splitlines():
+            stack, weight = line.rsplit(' ', 1)
+            self.assertGreater(len(stack), 0)
+            self.assertGreater(int(weight), 0)
+        return samples
+
+    def test_cpu(self):
+        self.check_folded(mldb.get('/v1/debug/profile', seconds=0.5))
+        self.check_folded(mldb.get('/v1/debug/profile', seconds=0.5,
+                                   mode='cpu', frequency=1000))
+
+    def test_busy_frame(self):
+        # A billion rows, which keeps the query busy joining while the
+        # profile runs; its frames must show up in the stacks
+        query = 'SELECT count(*) FROM ds AS a JOIN ds AS b JOIN ds AS c'
+
+        def run():
+            requests.get(url + '/v1/query',
+                         params={'q' : query, 'timeout' : 30})
+
+        t = threading.Thread(target=run)
+        t.start()
+        try:
+            time.sleep(0.5)
+            res = mldb.get('/v1/debug/profile', seconds=1, frequency=1000)
+        finally:
+            mldb.delete('/v1/queries')
+            t.join()
+
+        self.assertGreater(self.check_folded(res), 0)
+        busy = [line for line in res.text.splitlines()
+                if 'JoinElement' in line]
+        self.assertGreater(len(busy), 0, res.text[:4000])
+
+    def test_allocations(self):
+        self.check_folded(mldb.get('/v1/debug/profile', seconds=0.5,
+                                   mode='allocations', sampleBytes=1024))
+        self.check_folded(mldb.get('/v1/debug/profile', seconds=0.5,
+                                   mode='live'))
+
+    def test_bad_parameters(self):
+        def check(**params):
+            with self.assertRaises(mldb_wrapper.ResponseException) as re:
+                mldb.get('/v1/debug/profile', **params)
+            self.assertEqual(re.exception.response.status_code, 400)
+
+        check(seconds=0.1, mode='wall')
+        check(seconds=0)
+        check(seconds=1000)
+        check(seconds='soon')
+        check(seconds=0.1, frequency=0)
+        check(seconds=0.1, sampleBytes=0)
+        check(seconds=0.1, depth=10)
+
+if __name__ == '__main__':
+    mldb.run_tests()
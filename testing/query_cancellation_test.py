@@ -0,0 +1,117 @@
+#
+# query_cancellation_test.py
+# 2017-04-26
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of query timeouts and of the /v1/queries endpoint.
+#
+
+import time
+import threading
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+
+class QueryCancellationTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(1000):
+            ds.record_row('row%d' % i, [['x', i, 0]])
+        ds.commit()
+
+    def test_timeout(self):
+        # A billion rows; this would take much longer than the timeout
+        query = 'SELECT count(*) FROM ds AS a JOIN ds AS b JOIN ds AS c'
+        before = time.time()
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get('/v1/query', q=query, timeout=0.5)
+        self.assertEqual(re.exception.response.status_code, 408)
+        self.assertLess(time.time() - before, 30)
+
+        # Once stopped, the query is no longer listed
+        self.assertEqual(mldb.get('/v1/queries').json(), [])
+
+    def test_timeout_while_streaming(self):
+        # Rows are streamed back well before the timeout.  The timeout
+        # must then cut the response short rather than end it cleanly, so
+        # that the client can't mistake it for the whole result.
+        query = 'SELECT a.x AS a, b.x AS b, c.x AS c ' \
+                'FROM ds AS a JOIN ds AS b JOIN ds AS c'
+        r = requests.get(url + '/v1/query', params={
+            'q' : query,
+            'format' : 'aos',
+            'timeout' : 2
+        }, stream=True)
+        if r.status_code != 200:
+            # Timed out before anything was sent
+            self.assertEqual(r.status_code, 408, r.text)
+            return
+        with self.assertRaises(requests.exceptions.ChunkedEncodingError):
+            r.content
+        self.assertEqual(mldb.get('/v1/queries').json(), [])
+
+    def test_explain_analyze_timeout(self):
+        # EXPLAIN ANALYZE runs the query, so it's stopped by its timeout
+        query = 'EXPLAIN ANALYZE ' \
+                'SELECT count(*) FROM ds AS a JOIN ds AS b JOIN ds AS c'
+        before = time.time()
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get('/v1/query', q=query, timeout=0.5)
+        self.assertEqual(re.exception.response.status_code, 408)
+        self.assertLess(time.time() - before, 30)
+        self.assertEqual(mldb.get('/v1/queries').json(), [])
+
+    def test_explain_analyze_cancel(self):
+        # Listed while it runs, and cancellable, like any other query
+        query = 'EXPLAIN ANALYZE ' \
+                'SELECT count(*) FROM ds AS a JOIN ds AS b JOIN ds AS c'
+        result = {}
+
+        def run():
+            result['response'] = requests.get(url + '/v1/query',
+                                              params={'q' : query})
+
+        t = threading.Thread(target=run)
+        t.start()
+
+        queries = []
+        for _ in range(100):
+            queries = mldb.get('/v1/queries').json()
+            if queries:
+                break
+            time.sleep(0.1)
+        self.assertEqual(len(queries), 1)
+        self.assertEqual(queries[0]['query'], query)
+        self.assertEqual(queries[0]['state'], 'running')
+
+        mldb.delete('/v1/queries/' + queries[0]['id'])
+        t.join(30)
+        self.assertFalse(t.is_alive())
+        self.assertEqual(result['response'].status_code, 400)
+        self.assertEqual(mldb.get('/v1/queries').json(), [])
+
+    def test_timeout_not_reached(self):
+        res = mldb.get('/v1/query', q='SELECT count(*) FROM ds',
+                       format='atom', timeout=60).json()
+        self.assertEqual(res, 1000)
+
+    def test_list_and_cancel(self):
+        self.assertEqual(mldb.get('/v1/queries').json(), [])
+        res = mldb.delete('/v1/queries').json()
+        self.assertEqual(res['cancelled'], 0)
+
+    def test_unknown_query(self):
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.get('/v1/queries/123456')
+        self.assertEqual(re.exception.response.status_code, 404)
+
+        with self.assertRaises(mldb_wrapper.ResponseException) as re:
+            mldb.delete('/v1/queries/123456')
+        self.assertEqual(re.exception.response.status_code, 404)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,111 @@
+#
+# query_columnar_format_test.py
+# 2017-03-02
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+import struct
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+
+def decode_columnar(data):
+    """Decode the columnar format into a list of batches, each of them a
+    list of (name, type, values) with None for null values."""
+    assert data[:8] == b'MLDBCOL1'
+    pos = 8
+
+    def read(fmt):
+        res = struct.unpack_from('<' + fmt, data, pos)
+        return res, pos + struct.calcsize('<' + fmt)
+
+    batches = []
+    while True:
+        (num_rows,), pos = read('I')
+        if num_rows == 0:
+            break
+        (num_cols,), pos = read('I')
+        cols = []
+        for _ in range(num_cols):
+            (name_len,), pos = read('I')
+            name = data[pos:pos + name_len].decode('utf-8')
+            pos += name_len
+            (tp,), pos = read('B')
+            bitmap = bytearray(data[pos:pos + (num_rows + 7) // 8])
+            pos += (num_rows + 7) // 8
+            valid = [(bitmap[i // 8] >> (i % 8)) & 1 for i in range(num_rows)]
+            if tp in (1, 2, 3, 5):
+                fmt = {1: 'q', 2: 'Q', 3: 'd', 5: 'd'}[tp] * num_rows
+                vals, pos = read(fmt)
+            elif tp == 4:
+                (dict_size,), pos = read('I')
+                dictionary = []
+                for _ in range(dict_size):
+                    (l,), pos = read('I')
+                    dictionary.append(data[pos:pos + l].decode('utf-8'))
+                    pos += l
+                indexes, pos = read('I' * num_rows)
+                vals = [dictionary[i] for i in indexes]
+            elif tp == 6:
+                offsets, pos = read('Q' * (num_rows + 1))
+                vals = [data[pos + offsets[i]:pos + offsets[i + 1]]
+                        for i in range(num_rows)]
+                pos += offsets[-1]
+            else:
+                raise Exception('unknown type {}'.format(tp))
+            cols.append((name, tp, [v if ok else None
+                                    for v, ok in zip(vals, valid)]))
+        batches.append(cols)
+    assert pos == len(data)
+    return batches
+
+
+class QueryColumnarFormatTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        ds.record_row('ex1', [['x', 0, 0], ['y', 3, 0]])
+        ds.record_row('ex2', [['x', 1, 0], ['y', 2.5, 0], ['z', 'yes', 0]])
+        ds.record_row('ex3', [['x', 2, 0], ['y', 1, 0]])
+        ds.record_row('ex4', [['x', 3, 0], ['y', 0, 0], ['z', 'no', 0]])
+        ds.commit()
+
+    def query(self, q, **kwargs):
+        params = {'q' : q, 'format' : 'columnar'}
+        params.update(kwargs)
+        r = requests.get(url + '/v1/query', params=params)
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.headers['content-type'],
+                         'application/x-mldb-columnar')
+        return decode_columnar(r.content)
+
+    def test_types(self):
+        batches = self.query(
+            'SELECT * FROM ds ORDER BY rowName()', sortColumns='true')
+        self.assertEqual(len(batches), 1)
+        self.assertEqual(batches[0], [
+            ('_rowName', 4, ['ex1', 'ex2', 'ex3', 'ex4']),
+            ('x', 1, [0, 1, 2, 3]),
+            ('y', 3, [3.0, 2.5, 1.0, 0.0]),
+            ('z', 4, [None, 'yes', None, 'no'])
+        ])
+
+    def test_float_precision(self):
+        batches = self.query('SELECT 0.1 + 0.2 AS x', rowNames='false')
+        self.assertEqual(batches, [[('x', 3, [0.1 + 0.2])]])
+
+    def test_timestamp_and_blob(self):
+        batches = self.query(
+            "SELECT TIMESTAMP '2015-01-01T00:00:01Z' AS ts, "
+            "CAST ('abc' AS BLOB) AS b", rowNames='false')
+        self.assertEqual(batches, [[('ts', 5, [1420070401.0]),
+                                    ('b', 6, [b'abc'])]])
+
+    def test_empty_result(self):
+        batches = self.query('SELECT * FROM ds WHERE x = 12')
+        self.assertEqual(batches, [])
+
+if __name__ == '__main__':
+    mldb.run_tests()
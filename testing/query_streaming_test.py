@@ -0,0 +1,125 @@
+#
+# query_streaming_test.py
+# 2017-03-06
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+import json
+import socket
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+NUM_ROWS = 20000
+
+
+class QueryStreamingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            ds.record_row('row%05d' % i,
+                          [['x', i, 0], ['y', 'value %d' % i, 0]])
+        ds.commit()
+
+    def get(self, q, format):
+        r = requests.get(url + '/v1/query',
+                         params={'q' : q, 'format' : format}, stream=True)
+        self.assertEqual(r.status_code, 200, r.text)
+        return r
+
+    def test_large_result_is_chunked(self):
+        r = self.get('SELECT * FROM ds ORDER BY rowName()', 'aos')
+        self.assertEqual(r.headers.get('transfer-encoding'), 'chunked')
+        rows = json.loads(r.content)
+        self.assertEqual(len(rows), NUM_ROWS)
+        for i, row in enumerate(rows):
+            self.assertEqual(row, {'_rowName' : 'row%05d' % i,
+                                   'x' : i, 'y' : 'value %d' % i})
+
+    def test_small_result_is_not_chunked(self):
+        r = self.get('SELECT * FROM ds WHERE x < 3 ORDER BY x', 'aos')
+        self.assertNotIn('transfer-encoding', r.headers)
+        self.assertEqual(len(json.loads(r.content)), 3)
+
+    def test_full_format(self):
+        rows = json.loads(self.get(
+            'SELECT x FROM ds ORDER BY x DESC LIMIT 15000', 'full').content)
+        self.assertEqual(len(rows), 15000)
+        self.assertEqual(rows[0]['rowName'], 'row19999')
+        self.assertEqual(rows[-1]['rowName'], 'row05000')
+
+    def test_sparse_format(self):
+        rows = json.loads(self.get(
+            'SELECT x, y FROM ds ORDER BY x DESC LIMIT 15000',
+            'sparse').content)
+        self.assertEqual(len(rows), 15000)
+        self.assertEqual(rows[0], [['_rowName', 'row19999'], ['x', 19999],
+                                   ['y', 'value 19999']])
+
+    def test_empty_result(self):
+        r = self.get('SELECT * FROM ds WHERE x = -1', 'full')
+        self.assertEqual(json.loads(r.content), [])
+
+    def test_grouped_result(self):
+        rows = json.loads(self.get(
+            'SELECT count(*) AS c FROM ds GROUP BY x % 4 ORDER BY x % 4',
+            'aos').content)
+        self.assertEqual([r['c'] for r in rows], [NUM_ROWS / 4] * 4)
+
+    def test_early_disconnect(self):
+        # Reading only a part of the response and closing the connection
+        # must leave the server able to serve other queries
+        r = self.get('SELECT * FROM ds', 'full')
+        next(r.iter_content(1024))
+        r.close()
+        rows = json.loads(self.get('SELECT count(*) AS c FROM ds',
+                                   'aos').content)
+        self.assertEqual(rows[0]['c'], NUM_ROWS)
+
+    def test_slow_clients(self):
+        # More clients that don't read their response than there are
+        # threads handling connections must not stop the server from
+        # answering other requests
+        port = int(url.split(':')[-1])
+        q = ('SELECT *, y AS y1, y AS y2, y AS y3, y AS y4, y AS y5 '
+             'FROM ds')
+        request = ('GET /v1/query?format=full&q=%s HTTP/1.1\r\n'
+                   'Host: localhost\r\n\r\n'
+                   % requests.utils.quote(q)).encode()
+        sockets = []
+        try:
+            for i in range(32):
+                s = socket.create_connection(('localhost', port))
+                s.sendall(request)
+                sockets.append(s)
+
+            r = requests.get(url + '/v1/query',
+                             params={'q' : 'SELECT 1 AS x',
+                                     'format' : 'aos'},
+                             timeout=30)
+            self.assertEqual(r.status_code, 200, r.text)
+            self.assertEqual(r.json(), [{'_rowName' : 'result', 'x' : 1}])
+        finally:
+            for s in sockets:
+                s.close()
+
+    def test_error_while_streaming(self):
+        # Once rows have been sent, an error can only be reported by
+        # closing the connection before the end of the chunked response.
+        # Unordered queries output their rows in a deterministic order,
+        # in blocks of 16k; only the last row fails, so that the first
+        # block has been streamed by the time the error happens.
+        rows = json.loads(self.get('SELECT x FROM ds', 'aos').content)
+        self.assertEqual(len(rows), NUM_ROWS)
+        last = rows[-1]['_rowName']
+
+        r = self.get("SELECT CASE WHEN rowName() = '%s' THEN parse_json(y) "
+                     "ELSE x END AS v FROM ds" % last, 'aos')
+        self.assertEqual(r.headers.get('transfer-encoding'), 'chunked')
+        with self.assertRaises(requests.exceptions.ChunkedEncodingError):
+            r.content
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,103 @@
+#
+# scheduler_test.py
+# 2017-04-24
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the priority classes and admission control reported by
+# /v1/scheduler.
+#
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+
+class SchedulerTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(100):
+            ds.record_row('row%d' % i, [['x', i, 0]])
+        ds.commit()
+
+    def scheduler(self):
+        return mldb.get('/v1/scheduler').json()
+
+    def test_structure(self):
+        res = self.scheduler()
+        self.assertGreaterEqual(res['threadPool']['numThreads'], 1)
+        for cls in ['interactive', 'batch', 'background']:
+            self.assertIn(cls, res['threadPool'])
+            self.assertIn(cls, res['admission'])
+            self.assertGreaterEqual(res['threadPool'][cls]['maxThreads'], 1)
+            self.assertGreaterEqual(res['threadPool'][cls]['queued'], 0)
+
+        # interactive work is never held back
+        self.assertEqual(res['admission']['interactive']['maxRunning'], -1)
+        self.assertGreaterEqual(res['admission']['batch']['maxRunning'], 2)
+
+    def test_query_is_batch(self):
+        before = self.scheduler()['admission']['batch']['admitted']
+        mldb.query('SELECT count(*) FROM ds')
+        after = self.scheduler()['admission']['batch']
+        self.assertEqual(after['admitted'], before + 1)
+        self.assertEqual(after['running'], 0)
+
+    def test_http_query_is_batch(self):
+        # Over HTTP, the query is admitted on its own thread
+        before = self.scheduler()['admission']['batch']['admitted']
+        r = requests.get(url + '/v1/query',
+                         params={'q' : 'SELECT count(*) FROM ds'})
+        self.assertEqual(r.status_code, 200)
+        after = self.scheduler()['admission']['batch']
+        self.assertEqual(after['admitted'], before + 1)
+
+    def test_procedure_run_is_batch(self):
+        before = self.scheduler()['admission']['batch']['admitted']
+        mldb.post('/v1/procedures', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT x * 2 AS y FROM ds',
+                'outputDataset' : 'ds_out',
+                'runOnCreation' : True
+            }
+        })
+        after = self.scheduler()['admission']['batch']
+        # The queries run by the procedure are part of its run
+        self.assertEqual(after['admitted'], before + 1)
+        self.assertEqual(after['running'], 0)
+
+    def test_http_procedure_run(self):
+        # Over HTTP, a synchronous run is answered from the thread that
+        # ran it, once it's done
+        mldb.put('/v1/procedures/http_proc', {
+            'type' : 'transform',
+            'params' : {
+                'inputData' : 'SELECT x * 3 AS y FROM ds',
+                'outputDataset' : 'ds_http_out'
+            }
+        })
+        before = self.scheduler()['admission']['batch']['admitted']
+        r = requests.post(url + '/v1/procedures/http_proc/runs', json={})
+        self.assertEqual(r.status_code, 201)
+        self.assertEqual(r.json()['state'], 'finished')
+        self.assertIn('/v1/procedures/http_proc/runs/', r.headers['Location'])
+        self.assertEqual(self.scheduler()['admission']['batch']['admitted'],
+                         before + 1)
+        res = mldb.query('SELECT count(*) FROM ds_http_out')
+        self.assertEqual(res[1][1], 100)
+
+        r = requests.put(url + '/v1/procedures/http_proc/runs/r1', json={})
+        self.assertEqual(r.status_code, 201)
+        self.assertEqual(r.json()['id'], 'r1')
+
+        # A run that fails is reported with its error
+        r = requests.post(url + '/v1/procedures/http_proc/runs', json={
+            'params' : { 'inputData' : 'SELECT x FROM no_such_dataset' }
+        })
+        self.assertGreaterEqual(r.status_code, 400)
+        self.assertIn('no_such_dataset', r.text)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,85 @@
+#
+# svd_randomized_solver_test.py
+# 2017-03-27
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that the randomized SVD solver gives the same embedding as the
+# Lanczos solver.
+#
+import math
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_DIMS = 3
+
+
+class SvdRandomizedSolverTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1234)
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        # A few latent factors with decreasing weights, so that the leading
+        # singular values are well separated
+        for i in range(500):
+            factors = [random.gauss(0, 1) * 0.5 ** f for f in range(6)]
+            cols = []
+            for c in range(40):
+                v = sum(f * math.cos(c * (k + 1)) for k, f in
+                        enumerate(factors))
+                cols.append(['x%d' % c, v + random.gauss(0, 0.05), 0])
+            cols.append(['cat', random.choice(['a', 'b', 'c']), 0])
+            ds.record_row('row%d' % i, cols)
+        ds.commit()
+
+    def train(self, name, **params):
+        config = {
+            'trainingData' : 'SELECT * FROM ds',
+            'numSingularValues' : 10,
+            'columnOutputDataset' : name,
+            'runOnCreation' : True
+        }
+        config.update(params)
+        mldb.post('/v1/procedures', {'type' : 'svd.train',
+                                     'params' : config})
+        res = mldb.query('SELECT * FROM %s ORDER BY rowName()' % name)
+        return res[0][1:], [r[1:] for r in res[1:]]
+
+    def column(self, rows, i):
+        v = [r[i] for r in rows]
+        norm = math.sqrt(sum(x * x for x in v))
+        return [x / norm for x in v]
+
+    def test_same_as_lanczos(self):
+        header, lanczos = self.train('lanczos')
+        header2, randomized = self.train('randomized', solver='randomized',
+                                         powerIterations=4)
+        self.assertEqual(header, header2)
+        self.assertEqual(len(lanczos), len(randomized))
+
+        # Singular vectors are only defined up to their sign
+        for i in range(NUM_DIMS):
+            v1 = self.column(lanczos, i)
+            v2 = self.column(randomized, i)
+            cos = sum(x * y for x, y in zip(v1, v2))
+            self.assertGreater(abs(cos), 0.999)
+
+    def test_no_power_iterations(self):
+        header, lanczos = self.train('lanczos2')
+        header2, randomized = self.train('randomized2', solver='randomized',
+                                         powerIterations=0, oversampling=20)
+        self.assertEqual(len(header2), len(header))
+        v1 = self.column(lanczos, 0)
+        v2 = self.column(randomized, 0)
+        cos = sum(x * y for x, y in zip(v1, v2))
+        self.assertGreater(abs(cos), 0.99)
+
+    def test_negative_parameters(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.train('bad', solver='randomized', oversampling=-1)
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.train('bad', solver='randomized', powerIterations=-1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
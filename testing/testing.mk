@@ -478,3 +478,21 @@ $(eval $(call mldb_unit_test,MLDB-2119_segfault_transform_no_input.py))
 $(eval $(call mldb_unit_test,MLDB-2126-export-structured.py))
 $(eval $(call mldb_unit_test,square_bracket_accessor_test.py))
 $(eval $(call mldb_unit_test,MLDB-2143-classifier-utf8.py))
+$(eval $(call mldb_unit_test,query_columnar_format_test.py))
+$(eval $(call mldb_unit_test,query_streaming_test.py))
+$(eval $(call mldb_unit_test,import_text_multi_file_test.py))
+$(eval $(call mldb_unit_test,gbdt_test.py))
+$(eval $(call mldb_unit_test,function_batch_test.py))
+$(eval $(call mldb_unit_test,svd_randomized_solver_test.py))
+$(eval $(call mldb_unit_test,tsne_fft_repulsion_test.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_index_test.py))
+$(eval $(call mldb_unit_test,embedding_quantization_test.py))
+$(eval $(call mldb_unit_test,classifier_sgd_test.py))
+$(eval $(call mldb_unit_test,explain_analyze_test.py))
+$(eval $(call mldb_unit_test,scheduler_test.py))
+$(eval $(call mldb_unit_test,query_cancellation_test.py))
+$(eval $(call mldb_unit_test,metrics_test.py))
+$(eval $(call mldb_unit_test,profiler_test.py))
+$(eval $(call mldb_unit_test,function_batch_endpoint_test.py))
+$(eval $(call mldb_unit_test,function_bound_input_test.py))
+$(eval $(call mldb_unit_test,procedure_run_events_test.py))
@@ -0,0 +1,66 @@
+#
+# tsne_fft_repulsion_test.py
+# 2017-04-03
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Check that t-SNE trained with the FFT repulsion separates clusters.
+#
+import math
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+
+class TsneFftRepulsionTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(4321)
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        # Two well separated clusters in 10 dimensions
+        for i in range(400):
+            center = 0 if i % 2 == 0 else 10
+            ds.record_row('row%d' % i,
+                          [['x%d' % c, center + random.gauss(0, 1), 0]
+                           for c in range(10)])
+        ds.commit()
+
+    def train(self, name, **params):
+        config = {
+            'trainingData' : 'SELECT * FROM ds',
+            'rowOutputDataset' : {'id' : name, 'type' : 'embedding'},
+        }
+        config.update(params)
+        mldb.post('/v1/procedures', {
+            'type' : 'tsne.train',
+            'params' : config
+        })
+
+    def test_fft_separates_clusters(self):
+        self.train('fft_out', repulsion='fft')
+
+        res = mldb.query('SELECT * FROM fft_out ORDER BY rowName()')
+        self.assertEqual(len(res[0]), 3)
+        coords = {row[0] : row[1:] for row in res[1:]}
+        self.assertEqual(len(coords), 400)
+
+        def centroid(parity):
+            pts = [coords['row%d' % i] for i in range(parity, 400, 2)]
+            return [sum(p[d] for p in pts) / len(pts) for d in range(2)]
+
+        def spread(parity, c):
+            pts = [coords['row%d' % i] for i in range(parity, 400, 2)]
+            return max(math.hypot(p[0] - c[0], p[1] - c[1]) for p in pts)
+
+        c0 = centroid(0)
+        c1 = centroid(1)
+        between = math.hypot(c0[0] - c1[0], c0[1] - c1[1])
+        self.assertGreater(between, spread(0, c0))
+        self.assertGreater(between, spread(1, c1))
+
+    def test_fft_needs_two_dimensions(self):
+        with self.assertMldbRaises(status_code=400):
+            self.train('fft_out_3d', repulsion='fft', numOutputDimensions=3)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -35,15 +35,13 @@
 #include "ext/lzma/lzma.h"
 #include "lz4_filter.h"
 #include "fs_utils.h"
+#include "url_cache.h"
 
 
 using namespace std;
 
 namespace MLDB {
 
-const UriHandlerFactory &
-getUriHandler(const std::string & scheme);
-
 std::pair<std::string, std::string>
 getScheme(const std::string & uri)
 {
@@ -768,9 +766,8 @@ open(const std::string & uri,
     const auto & handlerFactory = getUriHandler(scheme);
     auto onException = [&]() { this->deferredFailure = true; };
     auto options = createOptions(mode, compression, -1);
-    UriHandler handler = handlerFactory(scheme, resource, mode,
-                                        options,
-                                        onException);
+    UriHandler handler = openCachedUriHandler(scheme, resource, mode, options,
+                                              handlerFactory, onException);
     
     openFromHandler(handler, resource, options);
 }
@@ -796,7 +793,9 @@ open(const std::string & uri,
 
     const auto & handlerFactory = getUriHandler(scheme);
     auto onException = [&]() { this->deferredFailure = true; };
-    UriHandler handler = handlerFactory(scheme, resource, ios::in, options, onException);
+    UriHandler handler = openCachedUriHandler(scheme, resource, ios::in,
+                                              options, handlerFactory,
+                                              onException);
     openFromHandler(handler, resource, options);
 }
 
@@ -215,6 +215,11 @@ public:
         - httpAbortOnSlowConnection: For http files, will timeout if the
           connexion is too slow. Refer to http_rest_proxy.cc for the
           specification of slow. (the parameter name is abortOnSlowConnection)
+        - "num-requests": for http and s3 files, the maximum number of
+          concurrent range requests used to download large objects.  For
+          http, a value of 1 disables range requests.
+        - "request-size": for http and s3 files, the size in bytes of
+          each range request.
     */
     filter_istream(const std::string & uri,
                    const std::map<std::string, std::string> & options);
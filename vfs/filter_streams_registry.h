@@ -43,6 +43,11 @@ UriHandlerFactory;
 void registerUriHandler(const std::string & scheme,
                         const UriHandlerFactory & handler);
 
+/** Return the handler factory registered for the given scheme, or throw
+    if there is none.
+*/
+const UriHandlerFactory & getUriHandler(const std::string & scheme);
+
 std::string & getMemStreamString(const std::string & name);
 void setMemStreamString(const std::string & name,
                         const std::string & contents);
@@ -14,8 +14,11 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/exc_assert.h"
 #include <chrono>
+#include <condition_variable>
 #include <future>
+#include <mutex>
 
 
 using namespace std;
@@ -317,12 +320,331 @@ struct HttpStreamingDownloadSource {
     }
 };
 
+
+/*****************************************************************************/
+/* HTTP RANGE DOWNLOAD SOURCE                                                */
+/*****************************************************************************/
+
+/** Download source that reads an object using several concurrent byte
+    range requests, and passes the data on in order.  This allows a large
+    object to be read faster than what a single TCP connection allows.
+
+    At most numRequests ranges of requestSize bytes are in flight or
+    waiting to be read at any given time, which bounds the memory used to
+    numRequests * requestSize bytes.  The etag of each range is checked
+    against that of the object when it was opened, so that a file being
+    overwritten during the download is detected.
+*/
+struct HttpRangeDownloadSource {
+
+    HttpRangeDownloadSource(const std::string & urlStr,
+                            const std::string & cookie,
+                            const FsObjectInfo & info,
+                            size_t numRequests,
+                            size_t requestSize)
+    {
+        impl.reset(new Impl(urlStr, cookie, info, numRequests, requestSize));
+        impl->start();
+    }
+
+    typedef char char_type;
+    struct category
+        : //input_seekable,
+        boost::iostreams::input,
+        boost::iostreams::device_tag,
+        boost::iostreams::closable_tag
+    { };
+
+    struct Impl {
+        Impl(const std::string & urlStr,
+             const std::string & cookie,
+             const FsObjectInfo & info,
+             size_t numRequests,
+             size_t requestSize)
+            : proxy(urlStr), urlStr(urlStr), info(info),
+              numRequests(numRequests), requestSize(requestSize),
+              numChunks((info.size + requestSize - 1) / requestSize),
+              slots(numRequests),
+              nextChunk(0), readChunk(0), shutdown(false),
+              currentDone(0)
+        {
+            ExcAssertGreater(numRequests, 0);
+            ExcAssertGreater(requestSize, 0);
+            if (!cookie.empty())
+                proxy.setCookie(cookie);
+        }
+
+        ~Impl()
+        {
+            stop();
+        }
+
+        /// A downloaded range that is waiting to be read
+        struct Slot {
+            Slot()
+                : ready(false)
+            {
+            }
+
+            bool ready;
+            std::string data;
+        };
+
+        HttpRestProxy proxy;
+        std::string urlStr;
+        FsObjectInfo info;
+        size_t numRequests;
+        size_t requestSize;
+        size_t numChunks;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+
+        /* Chunk n is stored in slots[n % numRequests]; a chunk can only be
+           requested once the one that used its slot before has been read. */
+        std::vector<Slot> slots;
+        size_t nextChunk;       ///< Next chunk to be requested
+        size_t readChunk;       ///< Next chunk to be passed to the reader
+        bool shutdown;
+        exception_ptr lastExc;
+
+        /* reader thread */
+        std::string current;
+        size_t currentDone;
+
+        vector<std::thread> threads;
+
+        void start()
+        {
+            for (size_t i = 0;  i < std::min(numRequests, numChunks);  ++i)
+                threads.emplace_back(&Impl::runThread, this);
+        }
+
+        void stop()
+        {
+            {
+                std::unique_lock<std::mutex> guard(mutex);
+                shutdown = true;
+            }
+            cond.notify_all();
+
+            for (thread & th: threads) {
+                th.join();
+            }
+
+            threads.clear();
+        }
+
+        std::streamsize read(char_type* s, std::streamsize n)
+        {
+            if (currentDone == current.size()) {
+                std::unique_lock<std::mutex> guard(mutex);
+                if (readChunk == numChunks)
+                    return -1;
+
+                Slot & slot = slots[readChunk % numRequests];
+                cond.wait(guard, [&] () { return slot.ready || lastExc; });
+                if (lastExc)
+                    rethrow_exception(lastExc);
+
+                current = std::move(slot.data);
+                currentDone = 0;
+                slot.data = std::string();
+                slot.ready = false;
+                ++readChunk;
+
+                guard.unlock();
+                cond.notify_all();
+            }
+
+            size_t toDo = min<size_t>(current.size() - currentDone, n);
+            const char_type * start = current.c_str() + currentDone;
+            std::copy(start, start + toDo, s);
+
+            currentDone += toDo;
+
+            return toDo;
+        }
+
+        std::string getRange(size_t chunk)
+        {
+            uint64_t start = chunk * requestSize;
+            uint64_t end = std::min<uint64_t>(start + requestSize, info.size);
+            std::string range = "bytes=" + to_string(start)
+                + "-" + to_string(end - 1);
+
+            HttpRestProxy::Response resp;
+            for (unsigned attempt = 0;  attempt < 5;  ++attempt) {
+                if (attempt != 0) {
+                    std::this_thread::sleep_for
+                        (std::chrono::milliseconds(100 * attempt + random() % 100));
+                }
+
+                resp = proxy.get("", {}, { { "range", range } },
+                                 -1 /* timeout */, false /* exceptions */,
+                                 nullptr, nullptr,
+                                 true /* follow redirect */);
+
+                if (resp.errorCode() != 0
+                    || (resp.code() >= 500 && resp.code() < 600)) {
+                    cerr << "error retrieving range " << range << " of "
+                         << urlStr << " (retry): " << resp.code() << " "
+                         << resp.errorMessage() << endl;
+                    continue;
+                }
+                break;
+            }
+
+            if (resp.code() != 206) {
+                throw MLDB::Exception("HTTP code %d reading range %s of %s\n\n%s",
+                                      (int)resp.code(),
+                                      range.c_str(),
+                                      urlStr.c_str(),
+                                      resp.errorMessage().c_str());
+            }
+
+            std::string etag = resp.header().tryGetHeader("etag");
+            if (etag != info.etag) {
+                throw MLDB::Exception("range etag '%s' differs from original"
+                                      " etag '%s' of '%s'",
+                                      etag.c_str(), info.etag.c_str(),
+                                      urlStr.c_str());
+            }
+
+            if (resp.body().size() != end - start) {
+                throw MLDB::Exception("range %s of %s returned %zd bytes",
+                                      range.c_str(), urlStr.c_str(),
+                                      resp.body().size());
+            }
+
+            return resp.body();
+        }
+
+        void runThread()
+        {
+            for (;;) {
+                size_t chunk;
+                {
+                    std::unique_lock<std::mutex> guard(mutex);
+                    cond.wait(guard, [&] ()
+                              {
+                                  return shutdown || lastExc
+                                      || nextChunk == numChunks
+                                      || nextChunk < readChunk + numRequests;
+                              });
+                    if (shutdown || lastExc || nextChunk == numChunks)
+                        return;
+                    chunk = nextChunk++;
+                }
+
+                try {
+                    std::string data = getRange(chunk);
+
+                    std::unique_lock<std::mutex> guard(mutex);
+                    Slot & slot = slots[chunk % numRequests];
+                    slot.data = std::move(data);
+                    slot.ready = true;
+                } catch (const std::exception & exc) {
+                    std::unique_lock<std::mutex> guard(mutex);
+                    if (!lastExc)
+                        lastExc = std::current_exception();
+                }
+                cond.notify_all();
+            }
+        }
+    };
+
+    std::shared_ptr<Impl> impl;
+
+    std::streamsize read(char_type* s, std::streamsize n)
+    {
+        return impl->read(s, n);
+    }
+
+    bool is_open() const
+    {
+        return !!impl;
+    }
+
+    void close()
+    {
+        impl.reset();
+    }
+};
+
+/// Default number of concurrent range requests for a large download
+static constexpr size_t DEFAULT_NUM_RANGE_REQUESTS = 8;
+
+/// Default size of each range request
+static constexpr size_t DEFAULT_RANGE_REQUEST_SIZE = 8 * 1024 * 1024;
+
+/** Find out if the given object can be downloaded using concurrent range
+    requests, and if so return its header.  This requires the server to
+    advertise range support and a known size large enough to make it
+    worthwhile.  Some URLs (for example pre-signed S3 URLs) can't be
+    accessed with a HEAD request, so an error means we fall back to a
+    single streaming request.
+*/
+static std::pair<bool, HttpHeader>
+tryGetRangeHeader(const std::string & uri,
+                  const std::string & cookie,
+                  size_t requestSize)
+{
+    HttpRestProxy proxy(uri);
+    if (!cookie.empty())
+        proxy.setCookie(cookie);
+
+    auto resp = proxy.perform("HEAD", "", HttpRestProxy::Content(),
+                              {}, {}, 10.0 /* timeout */,
+                              false /* exceptions */, nullptr, nullptr,
+                              true /* follow redirects */);
+
+    const HttpHeader & header = resp.header();
+    bool useRanges = resp.errorCode() == 0
+        && resp.code() == 200
+        && header.tryGetHeader("accept-ranges") == "bytes"
+        && header.tryGetHeader("content-encoding").empty()
+        && header.contentLength >= 2 * (int64_t)requestSize;
+
+    return { useRanges, header };
+}
+
 std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo>
 makeHttpStreamingDownload(const std::string & uri,
                           const std::map<std::string, std::string> & options)
 {
+    size_t numRequests = DEFAULT_NUM_RANGE_REQUESTS;
+    size_t requestSize = DEFAULT_RANGE_REQUEST_SIZE;
+    std::string cookie;
+
+    std::map<std::string, std::string> streamOptions;
+    for (auto & o: options) {
+        if (o.first == "num-requests")
+            numRequests = std::stoul(o.second);
+        else if (o.first == "request-size")
+            requestSize = std::stoul(o.second);
+        else {
+            if (o.first == "http-set-cookie")
+                cookie = o.second;
+            streamOptions.insert(o);
+        }
+    }
+
     std::unique_ptr<std::streambuf> result;
-    HttpStreamingDownloadSource source(uri, options);
+
+    if (numRequests > 1 && requestSize > 0) {
+        auto rangeHeader = tryGetRangeHeader(uri, cookie, requestSize);
+        if (rangeHeader.first) {
+            FsObjectInfo info = convertHeaderToInfo(rangeHeader.second);
+            HttpRangeDownloadSource source(uri, cookie, info,
+                                           numRequests, requestSize);
+            result.reset(new boost::iostreams::stream_buffer<HttpRangeDownloadSource>
+                         (source, 131072));
+            return { std::move(result), std::move(info) };
+        }
+    }
+
+    HttpStreamingDownloadSource source(uri, streamOptions);
     const HttpHeader & header = source.getHeader();
     result.reset(new boost::iostreams::stream_buffer<HttpStreamingDownloadSource>
                  (source, 131072));
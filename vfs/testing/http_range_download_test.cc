@@ -0,0 +1,135 @@
+/* http_range_download_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test for downloads of http objects using concurrent range requests.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <string>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/io/asio_thread_pool.h"
+#include "mldb/io/event_loop.h"
+#include "mldb/http/testing/test_http_services.h"
+#include "mldb/utils/testing/watchdog.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+string makeBody(size_t size)
+{
+    string result;
+    result.reserve(size);
+    for (size_t i = 0;  result.size() < size;  ++i) {
+        result += "line " + to_string(i) + "\n";
+    }
+    result.resize(size);
+    return result;
+}
+
+string readAll(const string & uri,
+               const map<string, string> & options)
+{
+    filter_istream stream(uri, options);
+    return string(istreambuf_iterator<char>(stream),
+                  istreambuf_iterator<char>());
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_range_download )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+
+    string body = makeBody(1000003);
+    TestHttpRangeService service(eventLoop, body);
+    string baseUrl = service.start();
+
+    // Object is read in ranges of 10000 bytes, 8 at a time
+    string data = readAll(baseUrl + "/object.txt",
+                          { { "num-requests", "8" },
+                            { "request-size", "10000" },
+                            { "compression", "none" } });
+    BOOST_CHECK_EQUAL(data.size(), body.size());
+    BOOST_CHECK(data == body);
+    BOOST_CHECK_EQUAL(service.numRangeReqs, 101);
+
+    // Reading a line at a time gives the same result
+    filter_istream stream(baseUrl + "/object.txt",
+                          { { "num-requests", "3" },
+                            { "request-size", "4096" } });
+    BOOST_CHECK_EQUAL(stream.info().size, body.size());
+    string line;
+    getline(stream, line);
+    BOOST_CHECK_EQUAL(line, "line 0");
+    size_t numLines = 1;
+    while (getline(stream, line))
+        ++numLines;
+    BOOST_CHECK_EQUAL(numLines, 91920);
+}
+
+BOOST_AUTO_TEST_CASE( test_range_download_early_close )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+
+    string body = makeBody(1000000);
+    TestHttpRangeService service(eventLoop, body);
+    string baseUrl = service.start();
+
+    // Closing the stream before the end must stop the requests in flight
+    {
+        filter_istream stream(baseUrl + "/object.txt",
+                              { { "num-requests", "4" },
+                                { "request-size", "1000" } });
+        char buf[10];
+        stream.read(buf, 10);
+        BOOST_CHECK_EQUAL(string(buf, 10), body.substr(0, 10));
+    }
+
+    // Only a window of the 1000 ranges can have been requested
+    BOOST_CHECK_LT(service.numRangeReqs, 100);
+}
+
+BOOST_AUTO_TEST_CASE( test_download_fallbacks )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+
+    string body = makeBody(100000);
+    TestHttpRangeService service(eventLoop, body, false /* supportRanges */);
+    string baseUrl = service.start();
+
+    // The server doesn't support ranges: a single request is used
+    string data = readAll(baseUrl + "/object.txt",
+                          { { "request-size", "1000" } });
+    BOOST_CHECK(data == body);
+    BOOST_CHECK_EQUAL(service.numRangeReqs, 0);
+
+    TestHttpRangeService rangeService(eventLoop, body);
+    string rangeUrl = rangeService.start();
+
+    // Range requests disabled
+    data = readAll(rangeUrl + "/object.txt",
+                   { { "num-requests", "1" }, { "request-size", "1000" } });
+    BOOST_CHECK(data == body);
+    BOOST_CHECK_EQUAL(rangeService.numRangeReqs, 0);
+
+    // Object too small to be worth it
+    data = readAll(rangeUrl + "/object.txt", {});
+    BOOST_CHECK(data == body);
+    BOOST_CHECK_EQUAL(rangeService.numRangeReqs, 0);
+}
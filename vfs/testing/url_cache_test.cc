@@ -0,0 +1,144 @@
+/* url_cache_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test for the local disk cache of remote objects.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <string>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include "mldb/io/asio_thread_pool.h"
+#include "mldb/io/event_loop.h"
+#include "mldb/http/testing/test_http_services.h"
+#include "mldb/utils/testing/watchdog.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/vfs/url_cache.h"
+
+
+using namespace std;
+using namespace MLDB;
+namespace fs = boost::filesystem;
+
+
+namespace {
+
+string readAll(const string & uri,
+               const map<string, string> & options = {})
+{
+    filter_istream stream(uri, options);
+    return string(istreambuf_iterator<char>(stream),
+                  istreambuf_iterator<char>());
+}
+
+struct CacheDirectory {
+    CacheDirectory(uint64_t maxSize)
+        : dir(fs::temp_directory_path() / fs::unique_path())
+    {
+        setUrlCacheDirectory(dir.string(), maxSize);
+    }
+
+    ~CacheDirectory()
+    {
+        setUrlCacheDirectory("");
+        fs::remove_all(dir);
+    }
+
+    fs::path dir;
+};
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_url_cache )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+
+    string body(100000, 'x');
+    TestHttpRangeService service(eventLoop, body);
+    string url = service.start() + "/object.txt";
+
+    CacheDirectory cache(1000000);
+
+    // First read fills the cache
+    BOOST_CHECK(readAll(url) == body);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().misses, 1);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().numEntries, 1);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().totalBytes, body.size());
+
+    // Second read is served locally, after checking the metadata
+    size_t numReqs = service.numReqs;
+    BOOST_CHECK(readAll(url) == body);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().hits, 1);
+    BOOST_CHECK_EQUAL(service.numReqs, numReqs + 1);
+
+    // The cache can be bypassed
+    numReqs = service.numReqs;
+    BOOST_CHECK(readAll(url, { { "cache", "false" } }) == body);
+    BOOST_CHECK_GT(service.numReqs, numReqs + 1);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().hits, 1);
+
+    // A partial read doesn't create an entry
+    string url2 = url + "?other";
+    {
+        filter_istream stream(url2);
+        char buf[10];
+        stream.read(buf, 10);
+    }
+    BOOST_CHECK_EQUAL(getUrlCacheStats().numEntries, 1);
+
+    // The object changing means we fetch it again
+    service.body_ = string(100000, 'y');
+    service.etag_ = "\"changed\"";
+    BOOST_CHECK(readAll(url) == service.body_);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().misses, 3);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().numEntries, 2);
+
+    // Entries are picked up again when the cache is reopened
+    setUrlCacheDirectory(cache.dir.string(), 1000000);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().numEntries, 2);
+    BOOST_CHECK(readAll(url) == service.body_);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().hits, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_url_cache_eviction )
+{
+    ML::Watchdog watchdog(30);
+    EventLoop eventLoop;
+    AsioThreadPool threadPool(eventLoop);
+
+    string body(100000, 'x');
+    TestHttpRangeService service(eventLoop, body);
+    string baseUrl = service.start();
+
+    // Room for 2 objects
+    CacheDirectory cache(250000);
+
+    readAll(baseUrl + "/1");
+    readAll(baseUrl + "/2");
+    readAll(baseUrl + "/1");  // 2 is now the least recently used
+    readAll(baseUrl + "/3");
+
+    UrlCacheStats stats = getUrlCacheStats();
+    BOOST_CHECK_EQUAL(stats.numEntries, 2);
+    BOOST_CHECK_EQUAL(stats.totalBytes, 200000);
+    BOOST_CHECK_EQUAL(stats.hits, 1);
+
+    readAll(baseUrl + "/1");
+    BOOST_CHECK_EQUAL(getUrlCacheStats().hits, 2);
+    readAll(baseUrl + "/2");
+    BOOST_CHECK_EQUAL(getUrlCacheStats().hits, 2);
+
+    // Objects larger than half of the cache are not cached
+    service.body_ = string(200000, 'z');
+    service.etag_ = "\"big\"";
+    BOOST_CHECK(readAll(baseUrl + "/4") == service.body_);
+    BOOST_CHECK(readAll(baseUrl + "/4") == service.body_);
+    BOOST_CHECK_EQUAL(getUrlCacheStats().hits, 2);
+}
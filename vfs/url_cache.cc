@@ -0,0 +1,382 @@
+/** url_cache.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Local disk cache for remote objects.
+*/
+
+#include "mldb/vfs/url_cache.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/ext/xxhash/xxhash.h"
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/stream_buffer.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <cstdio>
+#include <unistd.h>
+
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Schemes whose objects are worth caching locally
+const std::set<std::string> CACHEABLE_SCHEMES
+    = { "http", "https", "s3", "sftp", "hdfs" };
+
+/// Suffix of files that are being filled
+const std::string TMP_SUFFIX = ".tmp";
+
+struct UrlCache {
+    UrlCache()
+        : maxSize(0), totalSize(0), useCounter(0), tmpCounter(0)
+    {
+    }
+
+    struct Entry {
+        uint64_t size;
+        uint64_t lastUsed;   ///< Value of useCounter when last used
+    };
+
+    std::mutex mutex;
+    std::string dir;
+    uint64_t maxSize;
+    uint64_t totalSize;
+    uint64_t useCounter;
+    std::atomic<uint64_t> tmpCounter;
+    UrlCacheStats stats;
+    std::unordered_map<std::string, Entry> entries;
+
+    std::string getPath(const std::string & key) const
+    {
+        return dir + "/" + key;
+    }
+
+    /** Remove the least recently used entries until the cache fits within
+        its maximum size.  Must be called with the mutex held.
+    */
+    void evictLocked()
+    {
+        while (totalSize > maxSize && !entries.empty()) {
+            auto it = std::min_element
+                (entries.begin(), entries.end(),
+                 [] (const std::pair<const std::string, Entry> & e1,
+                     const std::pair<const std::string, Entry> & e2)
+                 {
+                     return e1.second.lastUsed < e2.second.lastUsed;
+                 });
+            ::unlink(getPath(it->first).c_str());
+            totalSize -= it->second.size;
+            entries.erase(it);
+        }
+    }
+
+    /** Add a completely written temporary file as the entry for the
+        given key.
+    */
+    void commit(const std::string & key, const std::string & tmpPath,
+                uint64_t size)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        if (dir.empty() || tmpPath.compare(0, dir.size(), dir) != 0) {
+            // Cache was disabled or moved in the meantime
+            ::unlink(tmpPath.c_str());
+            return;
+        }
+
+        if (::rename(tmpPath.c_str(), getPath(key).c_str()) != 0) {
+            ::unlink(tmpPath.c_str());
+            return;
+        }
+
+        auto it = entries.find(key);
+        if (it != entries.end())
+            totalSize -= it->second.size;
+        entries[key] = { size, ++useCounter };
+        totalSize += size;
+        evictLocked();
+    }
+};
+
+UrlCache urlCache;
+
+std::string getCacheKey(const std::string & uri, const FsObjectInfo & info)
+{
+    std::string toHash = uri + "\n" + info.etag + "\n"
+        + info.lastModified.printIso8601() + "\n" + to_string(info.size);
+
+    // 128 bits of hash make collisions of no concern
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx",
+             (unsigned long long)XXH64(toHash.data(), toHash.size(), 0),
+             (unsigned long long)XXH64(toHash.data(), toHash.size(), 1));
+    return buf;
+}
+
+
+/*****************************************************************************/
+/* CACHE FILLING SOURCE                                                      */
+/*****************************************************************************/
+
+/** Source that reads from a remote handler, writing everything it reads
+    into a temporary file.  Once the whole object has been read, the file
+    is added to the cache; if the stream is closed before that, the
+    temporary file is removed.
+*/
+struct CacheFillingSource {
+
+    CacheFillingSource(UriHandler remote,
+                       std::string key,
+                       std::string tmpPath,
+                       uint64_t expectedSize)
+        : itl(new Itl(std::move(remote), std::move(key),
+                      std::move(tmpPath), expectedSize))
+    {
+    }
+
+    typedef char char_type;
+    struct category
+        : boost::iostreams::input,
+          boost::iostreams::device_tag,
+          boost::iostreams::closable_tag
+    { };
+
+    struct Itl {
+        Itl(UriHandler remote, std::string key, std::string tmpPath,
+            uint64_t expectedSize)
+            : remote(std::move(remote)), key(std::move(key)),
+              tmpPath(std::move(tmpPath)), expectedSize(expectedSize),
+              written(0)
+        {
+            out = fopen(this->tmpPath.c_str(), "wb");
+        }
+
+        ~Itl()
+        {
+            abandon();
+        }
+
+        void abandon()
+        {
+            if (out) {
+                fclose(out);
+                out = nullptr;
+                ::unlink(tmpPath.c_str());
+            }
+        }
+
+        void finish()
+        {
+            if (!out)
+                return;
+            bool ok = fclose(out) == 0 && written == expectedSize;
+            out = nullptr;
+            if (ok)
+                urlCache.commit(key, tmpPath, written);
+            else ::unlink(tmpPath.c_str());
+        }
+
+        std::streamsize read(char_type * s, std::streamsize n)
+        {
+            std::streamsize got = remote.buf->sgetn(s, n);
+            if (got <= 0) {
+                finish();
+                return -1;
+            }
+
+            if (out) {
+                if (fwrite(s, 1, got, out) == (size_t)got)
+                    written += got;
+                else abandon();  // eg disk full; keep on reading
+            }
+            return got;
+        }
+
+        UriHandler remote;
+        std::string key;
+        std::string tmpPath;
+        uint64_t expectedSize;
+        uint64_t written;
+        FILE * out;
+    };
+
+    std::shared_ptr<Itl> itl;
+
+    std::streamsize read(char_type * s, std::streamsize n)
+    {
+        return itl->read(s, n);
+    }
+
+    bool is_open() const
+    {
+        return !!itl;
+    }
+
+    void close()
+    {
+        itl.reset();
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* URL CACHE                                                                 */
+/*****************************************************************************/
+
+void setUrlCacheDirectory(const std::string & dir, uint64_t maxSizeBytes)
+{
+    std::unique_lock<std::mutex> guard(urlCache.mutex);
+
+    urlCache.dir.clear();
+    urlCache.entries.clear();
+    urlCache.totalSize = 0;
+    urlCache.stats = UrlCacheStats();
+
+    if (dir.empty())
+        return;
+
+    boost::system::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec)
+        throw MLDB::Exception("couldn't create URL cache directory '%s': %s",
+                              dir.c_str(), ec.message().c_str());
+
+    // Pick up the entries from a previous run, oldest first
+    std::vector<std::tuple<std::time_t, std::string, uint64_t> > found;
+    for (fs::directory_iterator it(dir), end;  it != end;  ++it) {
+        if (!fs::is_regular_file(it->status()))
+            continue;
+        std::string name = it->path().filename().string();
+        if (name.size() > TMP_SUFFIX.size()
+            && name.compare(name.size() - TMP_SUFFIX.size(),
+                            TMP_SUFFIX.size(), TMP_SUFFIX) == 0) {
+            // Left over from an interrupted download
+            fs::remove(it->path(), ec);
+            continue;
+        }
+        found.emplace_back(fs::last_write_time(it->path()), name,
+                           fs::file_size(it->path()));
+    }
+    std::sort(found.begin(), found.end());
+
+    urlCache.dir = dir;
+    urlCache.maxSize = maxSizeBytes;
+    for (auto & f: found) {
+        urlCache.entries[std::get<1>(f)]
+            = { std::get<2>(f), ++urlCache.useCounter };
+        urlCache.totalSize += std::get<2>(f);
+    }
+    urlCache.evictLocked();
+}
+
+std::string getUrlCacheDirectory()
+{
+    std::unique_lock<std::mutex> guard(urlCache.mutex);
+    return urlCache.dir;
+}
+
+UrlCacheStats getUrlCacheStats()
+{
+    std::unique_lock<std::mutex> guard(urlCache.mutex);
+    UrlCacheStats result = urlCache.stats;
+    result.numEntries = urlCache.entries.size();
+    result.totalBytes = urlCache.totalSize;
+    return result;
+}
+
+UriHandler
+openCachedUriHandler(const std::string & scheme,
+                     const std::string & resource,
+                     std::ios_base::openmode mode,
+                     const std::map<std::string, std::string> & options,
+                     const UriHandlerFactory & factory,
+                     const OnUriHandlerException & onException)
+{
+    auto openRemote = [&] ()
+        {
+            return factory(scheme, resource, mode, options, onException);
+        };
+
+    std::string dir;
+    uint64_t maxSize;
+    {
+        std::unique_lock<std::mutex> guard(urlCache.mutex);
+        dir = urlCache.dir;
+        maxSize = urlCache.maxSize;
+    }
+
+    auto it = options.find("cache");
+    if (dir.empty() || !CACHEABLE_SCHEMES.count(scheme)
+        || (it != options.end() && it->second == "false"))
+        return openRemote();
+
+    std::string uri = scheme + "://" + resource;
+    FsObjectInfo info = tryGetUriObjectInfo(uri);
+
+    // Without a way to know if the object changed, or with objects that
+    // would take too much of the cache, we go straight to the source
+    if (!info || info.size < 0 || (uint64_t)info.size > maxSize / 2
+        || (info.etag.empty() && info.lastModified == Date()))
+        return openRemote();
+
+    std::string key = getCacheKey(uri, info);
+    std::string path = dir + "/" + key;
+
+    bool hit = false;
+    {
+        std::unique_lock<std::mutex> guard(urlCache.mutex);
+        auto entry = urlCache.entries.find(key);
+        if (entry != urlCache.entries.end()) {
+            entry->second.lastUsed = ++urlCache.useCounter;
+            hit = true;
+            ++urlCache.stats.hits;
+        }
+        else ++urlCache.stats.misses;
+    }
+
+    if (hit) {
+        try {
+            // Keep the modification time in LRU order across restarts
+            boost::system::error_code ec;
+            fs::last_write_time(path, std::time(nullptr), ec);
+
+            UriHandler handler
+                = getUriHandler("file")("file", path, ios::in, options,
+                                        onException);
+            if (handler.info && handler.info->size == info.size) {
+                // Present the object as what it's a copy of
+                handler.info = std::make_shared<FsObjectInfo>(info);
+                return handler;
+            }
+        } catch (const std::exception & exc) {
+            // The entry was evicted meanwhile
+        }
+        return openRemote();
+    }
+
+    UriHandler remote = openRemote();
+    std::string tmpPath = path + "." + to_string(getpid()) + "."
+        + to_string(urlCache.tmpCounter.fetch_add(1)) + TMP_SUFFIX;
+
+    CacheFillingSource source(std::move(remote), key, tmpPath, info.size);
+    std::shared_ptr<std::streambuf> buf
+        (new boost::iostreams::stream_buffer<CacheFillingSource>
+         (source, 131072));
+    return UriHandler(buf.get(), buf, info);
+}
+
+} // namespace MLDB
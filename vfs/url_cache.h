@@ -0,0 +1,80 @@
+/** url_cache.h                                                    -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Local disk cache for remote objects that are read through
+    filter_istream.
+
+    When enabled, objects opened for reading from a remote scheme (http,
+    https, s3, sftp, hdfs) are stored in the cache directory as they are
+    read, and later opens of the same object are served from the local
+    copy.  Entries are keyed by the URL along with the etag, modification
+    time and size of the object, so that a changed object is fetched
+    again; this costs a metadata request (eg HEAD) per open, but not the
+    download.  The total size of the cache is bounded, and the least
+    recently used entries are removed first.
+
+    The cache can be bypassed for a given stream by passing the option
+    "cache" with a value of "false" to filter_istream.
+*/
+
+#pragma once
+
+#include "mldb/vfs/filter_streams_registry.h"
+#include <string>
+#include <cstdint>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* URL CACHE                                                                 */
+/*****************************************************************************/
+
+/// Default maximum size of the cache, in bytes
+constexpr uint64_t DEFAULT_URL_CACHE_SIZE = 10ULL * 1024 * 1024 * 1024;
+
+/** Enable caching of remote objects in the given directory, which will be
+    created if it doesn't exist.  Existing entries in the directory are
+    reused.  maxSizeBytes bounds the total size of the cached objects.
+    Passing an empty directory disables the cache.
+*/
+void setUrlCacheDirectory(const std::string & dir,
+                          uint64_t maxSizeBytes = DEFAULT_URL_CACHE_SIZE);
+
+/** Return the current cache directory, or an empty string if caching is
+    disabled.
+*/
+std::string getUrlCacheDirectory();
+
+/** Statistics about the use of the cache since it was enabled. */
+struct UrlCacheStats {
+    UrlCacheStats()
+        : hits(0), misses(0), numEntries(0), totalBytes(0)
+    {
+    }
+
+    uint64_t hits;        ///< Number of opens served from the cache
+    uint64_t misses;      ///< Number of opens that went to the remote
+    uint64_t numEntries;  ///< Number of objects in the cache
+    uint64_t totalBytes;  ///< Total size of the objects in the cache
+};
+
+UrlCacheStats getUrlCacheStats();
+
+/** Open the given resource for reading.  If caching is enabled and the
+    object can be cached, the handler will read the local copy, or fill
+    the cache as it reads the remote object.  Otherwise this simply calls
+    the factory.
+*/
+UriHandler
+openCachedUriHandler(const std::string & scheme,
+                     const std::string & resource,
+                     std::ios_base::openmode mode,
+                     const std::map<std::string, std::string> & options,
+                     const UriHandlerFactory & factory,
+                     const OnUriHandlerException & onException);
+
+} // namespace MLDB
@@ -4,6 +4,7 @@ LIBVFS_SOURCES := \
 	fs_utils.cc \
         filter_streams.cc \
 	http_streambuf.cc \
+	url_cache.cc \
 	compressor.cc \
 	zstandard.cc
 
@@ -137,7 +137,9 @@ struct S3Downloader {
     S3Downloader(const S3Api * api,
                  const string & bucket,
                  const string & resource, // starts with "/", unescaped (buggy)
-                 ssize_t startOffset = 0, ssize_t endOffset = -1)
+                 ssize_t startOffset = 0, ssize_t endOffset = -1,
+                 unsigned numRequests = 0, // 0 = depending on size
+                 size_t requestSize = 0) // 0 = ramp up
         : api(api),
           bucket(bucket), resource(resource),
           offset(startOffset),
@@ -166,6 +168,11 @@ struct S3Downloader {
         size_t sysMemory = getTotalSystemMemory();
         maxChunkSize = std::min(maxChunkSize, sysMemory / 100);
 
+        /* A fixed request size disables the ramp up. */
+        if (requestSize > 0) {
+            baseChunkSize = maxChunkSize = requestSize;
+        }
+
         /* The maximum number of concurrent requests is set depending on
            the total size of the stream. */
         maxRqs = 1;
@@ -175,6 +182,8 @@ struct S3Downloader {
             maxRqs = 15;
         if (fileInfo.size > 256 * 1024 * 1024)
             maxRqs = 30;
+        if (numRequests > 0)
+            maxRqs = numRequests;
         chunks.resize(maxRqs);
 
         /* Kick start the requests */
@@ -466,14 +475,17 @@ private:
 /****************************************************************************/
 
 struct StreamingDownloadSource {
-    StreamingDownloadSource(const std::string & urlStr)
+    StreamingDownloadSource(const std::string & urlStr,
+                            unsigned numRequests = 0,
+                            size_t requestSize = 0)
     {
         owner = getS3ApiForUri(urlStr);
 
         string bucket, resource;
         std::tie(bucket, resource) = S3Api::parseUri(urlStr);
         downloader.reset(new S3Downloader(owner.get(),
-                                          bucket, "/" + resource));
+                                          bucket, "/" + resource,
+                                          0, -1, numRequests, requestSize));
     }
 
     const FsObjectInfo & info()
@@ -513,10 +525,12 @@ private:
 
 
 std::pair<std::unique_ptr<std::streambuf>, FsObjectInfo>
-makeStreamingDownload(const std::string & uri)
+makeStreamingDownload(const std::string & uri,
+                      unsigned numRequests = 0,
+                      size_t requestSize = 0)
 {
     std::unique_ptr<std::streambuf> result;
-    StreamingDownloadSource source(uri);
+    StreamingDownloadSource source(uri, numRequests, requestSize);
     result.reset(new boost::iostreams::stream_buffer<StreamingDownloadSource>
                  (source,131072));
     return make_pair(std::move(result), source.info());
@@ -814,7 +828,17 @@ struct RegisterS3Handler {
         if (mode == ios::in) {
             std::unique_ptr<std::streambuf> source;
             FsObjectInfo info;
-            auto dl = makeStreamingDownload("s3://" + resource);
+            unsigned numRequests = 0;
+            size_t requestSize = 0;
+            auto it = options.find("num-requests");
+            if (it != options.end())
+                numRequests = std::stoul(it->second);
+            it = options.find("request-size");
+            if (it != options.end())
+                requestSize = std::stoul(it->second);
+
+            auto dl = makeStreamingDownload("s3://" + resource,
+                                            numRequests, requestSize);
             source = std::move(dl.first);
             info = std::move(dl.second);
             std::shared_ptr<std::streambuf> buf(source.release());